@@ -11,21 +11,162 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 #include "fitsio.h"
 #include "dprt_jni_general.h"
 #include "dprt.h"
+#include "dprt_fits.h"
+#include "dprt_kernel.h"
+#include "dprt_master.h"
+#include "dprt_cache.h"
+#include "dprt_config.h"
+#include "dprt_quick.h"
+#include "dprt_extract.h"
+#include "dprt_wavelength.h"
+#include "dprt_abort.h"
+#include "dprt_job.h"
+#include "dprt_writer.h"
+#include "dprt_metrics.h"
+#include "dprt_context.h"
+#include "dprt_log.h"
+#include "dprt_cosmic.h"
+#include "dprt_overscan.h"
+#include "dprt_accumulator.h"
 
 /* ------------------------------------------------------- */
 /* hash definitions */
 /* ------------------------------------------------------- */
 /**
- * This program only accepts FITS files with the bits per pixel of this value.
+ * The suffix of an unreduced frame's filename. The reduced frame's filename has this replaced by
+ * DPRT_REDUCED_FILENAME_SUFFIX.
+ * @see #DPRT_REDUCED_FILENAME_SUFFIX
  */
-#define FITS_GET_DATA_BITPIX		(16)
+#define DPRT_RAW_FILENAME_SUFFIX	("_0.fits")
 /**
- * This program only accepts FITS files with this number of axes.
+ * The suffix of a reduced frame's filename.
  */
-#define FITS_GET_DATA_NAXIS		(2)
+#define DPRT_REDUCED_FILENAME_SUFFIX	("_1.fits")
+/**
+ * The OBSTYPE of an arc lamp frame, which DpRt_Calibrate_Reduce fits a wavelength solution to.
+ */
+#define DPRT_ARC_OBSTYPE		("ARC")
+/**
+ * The OBSTYPE of a bias frame, which DpRt_Calibrate_Reduce adds to the running master bias if
+ * dprt.bias.accumulate is set.
+ */
+#define DPRT_BIAS_OBSTYPE		("BIAS")
+/**
+ * The number of stages in the DpRt_Expose_Reduce_Batch pipeline (read, extract and write), and hence the
+ * number of frames in flight at once.
+ */
+#define DPRT_BATCH_STAGE_COUNT		(3)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding one expose frame as it passes through the stages of a full reduction.
+ * <dl>
+ * <dt>Input_Filename</dt> <dd>The FITS filename to be processed, or NULL if the frame is in memory.</dd>
+ * <dt>Input_Pixels</dt> <dd>The pixels of a frame in memory, or NULL if the frame is read from Input_Filename.
+ *     The caller fills in Header for a frame in memory.</dd>
+ * <dt>Input_Pixel_Format</dt> <dd>The format of Input_Pixels, a DPRT_KERNEL_PIXEL_FORMAT value.</dd>
+ * <dt>Output_Filename</dt> <dd>The FITS filename the reduced frame is written to.</dd>
+ * <dt>Header</dt> <dd>The dimensions and binning of the frame. Once the frame has been read, the dimensions are
+ *     those of the calibrated (and perhaps trimmed) frame.</dd>
+ * <dt>Frame</dt> <dd>The calibrated frame, Naxis1*Naxis2 floats, in one of the context's scratch buffers.</dd>
+ * <dt>X_Offset</dt> <dd>The column of the raw frame the first column of Frame came from, non zero if the frame
+ *     was trimmed.</dd>
+ * <dt>Y_Offset</dt> <dd>The row of the raw frame the first row of Frame came from.</dd>
+ * <dt>Saturation_Mask</dt> <dd>A bit-packed mask of saturated pixels, or NULL if none were saturated.</dd>
+ * <dt>Cosmic_Mask</dt> <dd>A bit-packed mask of cosmic ray pixels, or NULL if cosmic ray rejection is not
+ *     configured.</dd>
+ * <dt>Cosmic_Count</dt> <dd>The number of cosmic ray pixels in Cosmic_Mask.</dd>
+ * <dt>Seeing</dt> <dd>The full width half maximum of the spectrum's spatial profile in pixels, measured from the
+ *     trace by a full reduction or by a quick reduction, or 0.</dd>
+ * <dt>Found</dt> <dd>Whether a spectral trace was found.</dd>
+ * <dt>Spectrum</dt> <dd>The optimally extracted spectrum, if a trace was found.</dd>
+ * <dt>Counts</dt> <dd>The counts of the brightest pixel in the extraction aperture.</dd>
+ * <dt>X_Pix</dt> <dd>The flux weighted centre (FITS pixels of the raw frame) of the spectrum along the
+ *     dispersion axis.</dd>
+ * <dt>Y_Pix</dt> <dd>The trace centre (FITS pixels of the raw frame) at X_Pix.</dd>
+ * <dt>Saturated</dt> <dd>Whether a pixel in the extraction aperture was saturated.</dd>
+ * <dt>Scratch_Slot</dt> <dd>Which of the context's scratch buffers holds Frame and Saturation_Mask.</dd>
+ * <dt>Successful</dt> <dd>Whether every stage run on the frame so far has succeeded.</dd>
+ * <dt>Error</dt> <dd>The error state the frame's stages are run with, holding the error of the stage that
+ *     failed.</dd>
+ * </dl>
+ * @see dprt_context.html#DpRt_Context_Scratch_Get
+ */
+struct Expose_Frame_Struct
+{
+	char *Input_Filename;
+	unsigned short *Input_Pixels;
+	int Input_Pixel_Format;
+	char *Output_Filename;
+	struct DpRt_Fits_Header_Struct Header;
+	float *Frame;
+	int X_Offset;
+	int Y_Offset;
+	unsigned char *Saturation_Mask;
+	unsigned char *Cosmic_Mask;
+	long Cosmic_Count;
+	double Seeing;
+	int Found;
+	struct DpRt_Extract_Spectrum_Struct Spectrum;
+	double Counts;
+	double X_Pix;
+	double Y_Pix;
+	int Saturated;
+	int Scratch_Slot;
+	int Successful;
+	struct DpRt_Error_Struct Error;
+};
+
+/**
+ * Structure shared by the stage threads of a batch and the thread running the batch, used to start each step
+ * of the pipeline on the stage threads and wait for it to finish.
+ * <dl>
+ * <dt>Mutex</dt> <dd>Mutex protecting the other fields, and the Frame of each threaded stage.</dd>
+ * <dt>Condition</dt> <dd>Signalled when a step is started, a stage thread finishes its step, or the threads
+ *     are told to exit.</dd>
+ * <dt>Step</dt> <dd>The number of steps started so far.</dd>
+ * <dt>Done_Count</dt> <dd>The number of stage threads that have finished the current step.</dd>
+ * <dt>Exit</dt> <dd>Set when the batch is finished, to tell the stage threads to exit.</dd>
+ * </dl>
+ * @see #Expose_Stage_Thread
+ */
+struct Expose_Pipeline_Struct
+{
+	pthread_mutex_t Mutex;
+	pthread_cond_t Condition;
+	int Step;
+	int Done_Count;
+	int Exit;
+};
+
+/**
+ * Structure describing one reduction stage to run on a frame, passed to Expose_Stage_Run.
+ * <dl>
+ * <dt>Stage</dt> <dd>The stage routine to call.</dd>
+ * <dt>Frame</dt> <dd>The frame to run the stage on, or NULL if the stage has no frame this step.</dd>
+ * <dt>Context</dt> <dd>The reduction context.</dd>
+ * <dt>Pipeline</dt> <dd>The pipeline the stage's thread (if it has one) takes its steps from.</dd>
+ * <dt>Thread</dt> <dd>The thread running the stage for the whole batch.</dd>
+ * <dt>Thread_Started</dt> <dd>Whether Thread was created. If not, the stage is run inline.</dd>
+ * </dl>
+ * @see #Expose_Stage_Run
+ * @see #Expose_Stage_Thread
+ */
+struct Expose_Stage_Struct
+{
+	int (*Stage)(struct Expose_Frame_Struct *frame,struct DpRt_Context_Struct *context);
+	struct Expose_Frame_Struct *Frame;
+	struct DpRt_Context_Struct *Context;
+	struct Expose_Pipeline_Struct *Pipeline;
+	pthread_t Thread;
+	int Thread_Started;
+};
 
 /* ------------------------------------------------------- */
 /* internal variables */
@@ -38,47 +179,244 @@ static char rcsid[] = "$Id: dprt.c,v 0.13 2025-02-10 11:50:06 cjm Exp $";
 /* ------------------------------------------------------- */
 /* internal function declarations */
 /* ------------------------------------------------------- */
+static int Context_Begin(struct DpRt_Context_Struct *context,char *function_name,
+			 struct DpRt_Error_Struct **previous_error);
+static void Context_End(struct DpRt_Error_Struct *previous_error);
+static int Calibrate_Reduce(struct DpRt_Context_Struct *context,char *input_filename,char **output_filename,
+			    double *mean_counts,double *peak_counts);
+static int Expose_Reduce(struct DpRt_Context_Struct *context,char *input_filename,char **output_filename,
+			 double *seeing,double *counts,double *x_pix,double *y_pix,double *photometricity,
+			 double *sky_brightness,int *saturated);
+static int Expose_Reduce_Batch(struct DpRt_Context_Struct *context,char **input_filename_list,int frame_count,
+			       struct DpRt_Expose_Result_Struct *result_list);
+static int Expose_Reduce_Buffer(struct DpRt_Context_Struct *context,unsigned short *pixels,int pixel_format,
+				int naxis1,int naxis2,int x_bin,int y_bin,struct DpRt_Expose_Result_Struct *result);
+static int Make_Master_Bias(struct DpRt_Context_Struct *context,char *directory_name);
+static int Make_Master_Flat(struct DpRt_Context_Struct *context,char *directory_name);
+static int Expose_Reduce_Full(struct DpRt_Context_Struct *context,char *input_filename,char *output_filename,
+			      double *seeing,double *counts,double *x_pix,double *y_pix,int *saturated);
+static int Expose_Reduce_Filename_Get(char *input_filename,char **output_filename);
+static void Expose_Frame_Initialise(struct Expose_Frame_Struct *frame,char *input_filename,int scratch_slot);
+static int Expose_Frame_Read(struct Expose_Frame_Struct *frame,struct DpRt_Context_Struct *context);
+static int Expose_Frame_Overscan_Fit(struct Expose_Frame_Struct *frame,struct DpRt_Config_Struct *config,
+				     struct DpRt_Fits_Reader_Struct *reader,float *bias,
+				     struct DpRt_Overscan_Struct *overscan);
+static int Expose_Frame_Extract(struct Expose_Frame_Struct *frame,struct DpRt_Context_Struct *context);
+static int Expose_Frame_Write(struct Expose_Frame_Struct *frame,struct DpRt_Context_Struct *context);
+static int Expose_Frame_Queue(struct Expose_Frame_Struct *frame,struct DpRt_Context_Struct *context);
+static int Expose_Frame_Quick(struct Expose_Frame_Struct *frame,struct DpRt_Context_Struct *context);
+static void Expose_Frame_Free(struct Expose_Frame_Struct *frame);
+static void *Expose_Stage_Run(void *user_arg);
+static void *Expose_Stage_Thread(void *user_arg);
 
 /* ------------------------------------------------------- */
 /* external functions */
 /* ------------------------------------------------------- */
+
+/**
+ * This finction should be called when the library/DpRt is first initialised/loaded. It calls
+ * DpRt_Initialise_Context in the default context, and copies any error to DpRt_JNI_Error_Number and
+ * DpRt_JNI_Error_String.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Initialise_Context
+ * @see #DpRt_Context_Error_Publish
+ * @see dprt_context.html#DpRt_Context_Default_Get
+ */
+int DpRt_Initialise(void)
+{
+	return DpRt_Context_Error_Publish(DpRt_Initialise_Context(DpRt_Context_Default_Get()));
+}
+
 /**
  * This finction should be called when the library/DpRt is first initialised/loaded.
  * It allows the C layer to perform initial initialisation.
  * The function pointers to use a C routine to load the property from the config file are initialised.
  * Note these function pointers will be over-written by the functions in DpRtLibrary.c if this
  * initialise routine was called from the Java (JNI) layer.
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_Number
+ * The "dprt.*" configuration properties are read into a snapshot, which is copied into the default context and
+ * the specified context. Each context uses its copy until it is next refreshed.
+ * The master calibration frame cache is initialised, so master frames are loaded once and stay resident
+ * until DpRt_Shutdown.
+ * @param context The reduction context. Its error state is set.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Context_Begin
+ * @see #Context_End
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Context_Config_Refresh
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_General_Initialise
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
+ * @see dprt_config.html#DpRt_Config_Load
+ * @see dprt_log.html#DpRt_Log_Initialise
+ * @see dprt_cache.html#DpRt_Cache_Initialise
  */
-int DpRt_Initialise(void)
+int DpRt_Initialise_Context(struct DpRt_Context_Struct *context)
 {
-	DpRt_JNI_Error_Number = 0;
-	DpRt_JNI_Error_String[0] = '\0';
-	if(!DpRt_JNI_Initialise())
+	struct DpRt_Error_Struct *previous_error = NULL;
+	int retval;
+
+	if(!Context_Begin(context,"DpRt_Initialise_Context",&previous_error))
 		return FALSE;
-	/* call reduction library initialisation routine here. */
-	return TRUE;
+	retval = DpRt_JNI_Initialise();
+	if(!retval)
+	{
+		DpRt_Error_Number = DpRt_JNI_Get_Error_Number();
+		DpRt_JNI_Get_Error_String(DpRt_Error_String);
+	}
+	if(retval)
+		retval = DpRt_Config_Load();
+	if(retval)
+		retval = DpRt_Log_Initialise();
+	if(retval)
+		retval = DpRt_Cache_Initialise();
+	if(retval)
+	{
+		DpRt_Context_Config_Refresh(DpRt_Context_Default_Get());
+		DpRt_Context_Config_Refresh(context);
+	}
+	Context_End(previous_error);
+	return retval;
 }
 
 /**
- * This finction should be called when the library/DpRt is about to be shutdown.
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
+ * This routine re-reads the "dprt.*" configuration properties, by calling DpRt_Reload_Config_Context in the
+ * default context. Any error is copied to DpRt_JNI_Error_Number and DpRt_JNI_Error_String.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Reload_Config_Context
+ * @see #DpRt_Context_Error_Publish
+ * @see dprt_context.html#DpRt_Context_Default_Get
+ */
+int DpRt_Reload_Config(void)
+{
+	return DpRt_Context_Error_Publish(DpRt_Reload_Config_Context(DpRt_Context_Default_Get()));
+}
+
+/**
+ * This routine re-reads the "dprt.*" configuration properties into the configuration snapshot, and copies it
+ * into the default context and the specified context. It should be called when the properties have been
+ * changed. Other contexts keep their snapshot until they are refreshed. If the master directory property is
+ * set, the calibration cache looks for masters there from now on. The log level and filename are re-applied.
+ * @param context The reduction context. Its error state is set.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Context_Begin
+ * @see #Context_End
+ * @see dprt_config.html#DpRt_Config_Load
+ * @see dprt_log.html#DpRt_Log_Initialise
+ * @see dprt_context.html#DpRt_Context_Config_Refresh
+ * @see dprt_cache.html#DpRt_Cache_Master_Directory_Set
+ */
+int DpRt_Reload_Config_Context(struct DpRt_Context_Struct *context)
+{
+	struct DpRt_Error_Struct *previous_error = NULL;
+	int retval;
+
+	if(!Context_Begin(context,"DpRt_Reload_Config_Context",&previous_error))
+		return FALSE;
+	retval = DpRt_Config_Load();
+	if(retval)
+		retval = DpRt_Log_Initialise();
+	if(retval)
+	{
+		DpRt_Context_Config_Refresh(DpRt_Context_Default_Get());
+		DpRt_Context_Config_Refresh(context);
+		if(strlen(context->Config.Master_Directory) > 0)
+			retval = DpRt_Cache_Master_Directory_Set(context->Config.Master_Directory);
+	}
+	Context_End(previous_error);
+	return retval;
+}
+
+/**
+ * This finction should be called when the library/DpRt is about to be shutdown. It calls
+ * DpRt_Shutdown_Context in the default context, and copies any error to DpRt_JNI_Error_Number and
+ * DpRt_JNI_Error_String.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Shutdown_Context
+ * @see #DpRt_Context_Error_Publish
+ * @see dprt_context.html#DpRt_Context_Default_Get
  */
 int DpRt_Shutdown(void)
 {
-	DpRt_JNI_Error_Number = 0;
-	DpRt_JNI_Error_String[0] = '\0';
-	/* call reduction library shutdown routine here. */
-	return TRUE;
+	return DpRt_Context_Error_Publish(DpRt_Shutdown_Context(DpRt_Context_Default_Get()));
+}
+
+/**
+ * This finction should be called when the library/DpRt is about to be shutdown.
+ * The asynchronous job queue is shut down first, letting the running job finish and cancelling queued ones.
+ * The background writer is then shut down, after writing every queued frame.
+ * The master calibration frame cache, the running master biases and the wavelength solutions are then freed, as
+ * are the scratch buffers
+ * of the default context and the specified context. Other contexts should be destroyed by their creators.
+ * The stage timings and counters are logged once the job queue and writer have finished. Finally the log drain
+ * thread is stopped, after delivering every message logged so far.
+ * @param context The reduction context. Its error state is set.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Context_Begin
+ * @see #Context_End
+ * @see dprt_job.html#DpRt_Job_Shutdown
+ * @see dprt_writer.html#DpRt_Writer_Shutdown
+ * @see dprt_metrics.html#DpRt_Metrics_Log
+ * @see dprt_cache.html#DpRt_Cache_Shutdown
+ * @see dprt_accumulator.html#DpRt_Accumulator_Shutdown
+ * @see dprt_wavelength.html#DpRt_Wavelength_Shutdown
+ * @see dprt_context.html#DpRt_Context_Scratch_Free
+ * @see dprt_log.html#DpRt_Log_Shutdown
+ */
+int DpRt_Shutdown_Context(struct DpRt_Context_Struct *context)
+{
+	struct DpRt_Error_Struct *previous_error = NULL;
+	int retval;
+
+	if(!Context_Begin(context,"DpRt_Shutdown_Context",&previous_error))
+		return FALSE;
+	retval = DpRt_Job_Shutdown();
+	if(retval)
+		retval = DpRt_Writer_Shutdown();
+	DpRt_Metrics_Log();
+	if(retval)
+		retval = DpRt_Cache_Shutdown();
+	if(retval)
+		retval = DpRt_Accumulator_Shutdown();
+	if(retval)
+		retval = DpRt_Wavelength_Shutdown();
+	DpRt_Context_Scratch_Free(DpRt_Context_Default_Get());
+	DpRt_Context_Scratch_Free(context);
+	DpRt_Log_Shutdown();
+	Context_End(previous_error);
+	return retval;
+}
+
+/**
+ * Call DpRt_Calibrate_Reduce_Context in the default context. Any error is copied to DpRt_JNI_Error_Number and
+ * DpRt_JNI_Error_String, where the JNI layer reads it.
+ * @param input_filename The FITS filename to be processed.
+ * @param output_filename The resultant filename should be put in this variable. This variable is the
+ *       address of a pointer to a sequence of characters, hence it should be referenced using
+ *       <code>(*output_filename)</code> in this routine.
+ * @param meanCounts The address of a double to store the mean counts calculated by this routine.
+ * @param peakCounts The address of a double to store the peak counts calculated by this routine.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Calibrate_Reduce_Context
+ * @see #DpRt_Context_Error_Publish
+ * @see dprt_context.html#DpRt_Context_Default_Get
+ */
+int DpRt_Calibrate_Reduce(char *input_filename,char **output_filename,double *mean_counts,double *peak_counts)
+{
+	return DpRt_Context_Error_Publish(DpRt_Calibrate_Reduce_Context(DpRt_Context_Default_Get(),input_filename,
+								   output_filename,mean_counts,peak_counts));
 }
 
 /**
  * This routine does the real time data reduction pipeline on a calibration file. It is usually invoked from the
- * Java DpRtCalibrateReduce call in DpRtLibrary.java. If the DpRt_JNI_Get_Abort
- * routine returns TRUE during the execution of the pipeline the pipeline should abort it's
- * current operation and return FALSE.
+ * Java DpRtCalibrateReduce call in DpRtLibrary.java. The image is read a block of rows at a time, and the
+ * mean and peak counts are accumulated from each block as it is read, so the whole frame is never held in
+ * memory. If the frame is an arc (OBSTYPE is DPRT_ARC_OBSTYPE), a wavelength solution is fitted to it and kept
+ * for wavelength calibrating subsequent expose frames of the same binning. If the frame is a bias (OBSTYPE is
+ * DPRT_BIAS_OBSTYPE) and dprt.bias.accumulate is set, each block is also staged as it is read, and the bias added
+ * to the running master bias of its binning once it has all been read, for DpRt_Make_Master_Bias to write; a bias
+ * that fails or is aborted part way through is not added. If DpRt_Abort_Request is called (from
+ * the JNI DpRt_Abort routine) during the execution of the pipeline, the pipeline stops at its next abort
+ * checkpoint and returns FALSE, with the error number DPRT_ABORT_ERROR_NUMBER.
+ * @param context The reduction context. Its configuration snapshot is used, and its error state is set.
  * @param input_filename The FITS filename to be processed.
  * @param output_filename The resultant filename should be put in this variable. This variable is the
  *       address of a pointer to a sequence of characters, hence it should be referenced using
@@ -88,63 +426,576 @@ int DpRt_Shutdown(void)
  * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
  *       succeeded and FALSE if they fail.
  * @see ngat_dprt_ftspec_DpRtLibrary.html
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
+ * @see dprt_context.html#DpRt_Context_Config_Refresh
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see #Calibrate_Reduce_Fake
+ * @see dprt_fits.html#DpRt_Fits_Reader_Open
+ * @see dprt_fits.html#DpRt_Fits_Reader_Read_Block
+ * @see dprt_fits.html#DpRt_Fits_Reader_Close
+ * @see dprt_kernel.html#DpRt_Kernel_Stats_Initialise
+ * @see dprt_kernel.html#DpRt_Kernel_Stats_Accumulate
+ * @see dprt_kernel.html#DpRt_Kernel_Stats_Mean
+ * @see dprt_fits.html#DpRt_Fits_Header_Read
+ * @see dprt_wavelength.html#DpRt_Wavelength_Arc_Reduce
+ * @see dprt_accumulator.html#DpRt_Accumulator_Frame_Start
+ * @see dprt_accumulator.html#DpRt_Accumulator_Block_Add
+ * @see dprt_accumulator.html#DpRt_Accumulator_Frame_End
+ * @see dprt_accumulator.html#DpRt_Accumulator_Frame_Abort
+ * @see dprt_abort.html#DpRt_Abort_Request
+ * @see dprt_abort.html#DpRt_Abort_Checkpoint
+ * @see #DPRT_ARC_OBSTYPE
+ * @see #DPRT_BIAS_OBSTYPE
+ * @see #Calibrate_Reduce
+ * @see #Context_Begin
+ * @see #Context_End
+ */
+int DpRt_Calibrate_Reduce_Context(struct DpRt_Context_Struct *context,char *input_filename,char **output_filename,
+				  double *mean_counts,double *peak_counts)
+{
+	struct DpRt_Error_Struct *previous_error = NULL;
+	int retval;
+
+	if(!Context_Begin(context,"DpRt_Calibrate_Reduce_Context",&previous_error))
+		return FALSE;
+	retval = Calibrate_Reduce(context,input_filename,output_filename,mean_counts,peak_counts);
+	DpRt_Metrics_Count_Add(retval ? DPRT_METRICS_COUNTER_FRAMES : DPRT_METRICS_COUNTER_FRAMES_FAILED,1);
+	Context_End(previous_error);
+	return retval;
+}
+
+/**
+ * Call DpRt_Expose_Reduce_Context in the default context. Any error is copied to DpRt_JNI_Error_Number and
+ * DpRt_JNI_Error_String, where the JNI layer reads it.
+ * @param input_filename The FITS filename to be processed.
+ * @param output_filename The resultant filename should be put in this variable. This variable is the
+ *       address of a pointer to a sequence of characters, hence it should be referenced using
+ *       <code>(*output_filename)</code> in this routine.
+ * @param seeing The address of a double to store the seeing calculated by this routine: the full width half
+ *        maximum of the spectrum's spatial profile in pixels, measured from the trace by a full reduction or by a
+ *        quick reduction, or 0.
+ * @param counts The address of a double to store the counts of th brightest pixel calculated by this
+ *       routine.
+ * @param x_pix The x pixel position of the brightest object in the field. Note this is an average pixel
+ *       number that may not be a whole number of pixels.
+ * @param y_pix The y pixel position of the brightest object in the field. Note this is an average pixel
+ *       number that may not be a whole number of pixels.
+ * @param photometricity In units of magnitudes of extinction. This is only filled in for standard field
+ * 	reductions.
+ * @param sky_brightness In units of magnitudes per arcsec&#178;. This is always set to 0.0: a full reduction
+ *        measures (and logs) the sky level in counts per pixel, but no photometric zero point or plate scale is
+ *        configured to convert it to a sky brightness.
+ * @param saturated This is a boolean, returning TRUE if the object is saturated.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Expose_Reduce_Context
+ * @see #DpRt_Context_Error_Publish
+ * @see dprt_context.html#DpRt_Context_Default_Get
+ */
+int DpRt_Expose_Reduce(char *input_filename,char **output_filename,double *seeing,double *counts,double *x_pix,
+		       double *y_pix,double *photometricity,double *sky_brightness,int *saturated)
+{
+	return DpRt_Context_Error_Publish(DpRt_Expose_Reduce_Context(DpRt_Context_Default_Get(),input_filename,
+								output_filename,seeing,counts,x_pix,y_pix,
+								photometricity,sky_brightness,saturated));
+}
+
+/**
+ * This routine does the real time data reduction pipeline on an expose file. It is usually invoked from the
+ * Java DpRtExposeReduce call in DpRtLibrary.java. When doing a full reduction, the frame is bias subtracted and
+ * flat fielded using the master frames of the same binning held in the calibration cache, the spectral trace is
+ * found and the spectrum optimally extracted, and the reduced frame and spectrum are written to a new file.
+ * If an arc of the same binning has been fitted, the wavelength of each spectrum pixel is written too. If the
+ * writer async property is set, the routine returns once the output filename is decided and the frame is queued
+ * for the background writer; DpRt_Writer_Flush reports whether it was written.
+ * The counts and position returned are then measured along the trace. Otherwise a quick reduction measures the
+ * spectrum's counts, position and saturation from a decimated subset of the frame, within the configured time
+ * budget, and the frame is not modified.
+ * If DpRt_Abort_Request is called (from the JNI DpRt_Abort routine) during the execution of the pipeline, the
+ * pipeline stops at its next abort checkpoint and returns FALSE, with the error number DPRT_ABORT_ERROR_NUMBER.
+ * @param context The reduction context. Its configuration snapshot is used, and its error state is set.
+ * @param input_filename The FITS filename to be processed.
+ * @param output_filename The resultant filename should be put in this variable. This variable is the
+ *       address of a pointer to a sequence of characters, hence it should be referenced using
+ *       <code>(*output_filename)</code> in this routine.
+ * @param seeing The address of a double to store the seeing calculated by this routine: the full width half
+ *        maximum of the spectrum's spatial profile in pixels, measured from the trace by a full reduction or by a
+ *        quick reduction, or 0.
+ * @param counts The address of a double to store the counts of th brightest pixel calculated by this
+ *       routine.
+ * @param x_pix The x pixel position of the brightest object in the field. Note this is an average pixel
+ *       number that may not be a whole number of pixels.
+ * @param y_pix The y pixel position of the brightest object in the field. Note this is an average pixel
+ *       number that may not be a whole number of pixels.
+ * @param photometricity In units of magnitudes of extinction. This is only filled in for standard field
+ * 	reductions.
+ * @param sky_brightness In units of magnitudes per arcsec&#178;. This is always set to 0.0: a full reduction
+ *        measures (and logs) the sky level in counts per pixel, but no photometric zero point or plate scale is
+ *        configured to convert it to a sky brightness.
+ * @param saturated This is a boolean, returning TRUE if the object is saturated.
+ * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
+ *       succeeded and FALSE if they fail.
+ * @see ngat_dprt_ftspec_DpRtLibrary.html
+ * @see dprt_context.html#DpRt_Context_Config_Refresh
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see #Expose_Reduce_Fake
+ * @see #Expose_Reduce_Filename_Get
+ * @see #Expose_Reduce_Full
+ * @see dprt_quick.html#DpRt_Quick_Reduce
+ * @see #Expose_Reduce
+ * @see #Context_Begin
+ * @see #Context_End
+ */
+int DpRt_Expose_Reduce_Context(struct DpRt_Context_Struct *context,char *input_filename,char **output_filename,
+			       double *seeing,double *counts,double *x_pix,double *y_pix,double *photometricity,
+			       double *sky_brightness,int *saturated)
+{
+	struct DpRt_Error_Struct *previous_error = NULL;
+	int retval;
+
+	if(!Context_Begin(context,"DpRt_Expose_Reduce_Context",&previous_error))
+		return FALSE;
+	retval = Expose_Reduce(context,input_filename,output_filename,seeing,counts,x_pix,y_pix,photometricity,
+			       sky_brightness,saturated);
+	DpRt_Metrics_Count_Add(retval ? DPRT_METRICS_COUNTER_FRAMES : DPRT_METRICS_COUNTER_FRAMES_FAILED,1);
+	Context_End(previous_error);
+	return retval;
+}
+
+/**
+ * Call DpRt_Expose_Reduce_Batch_Context in the default context. Any error is copied to DpRt_JNI_Error_Number and
+ * DpRt_JNI_Error_String, where the JNI layer reads it.
+ * @param input_filename_list A list of FITS filenames to be processed.
+ * @param frame_count The number of filenames in the list.
+ * @param result_list A list of frame_count result structures, filled in for each frame. The caller should
+ *        free the Output_Filename of each successful result.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Expose_Reduce_Batch_Context
+ * @see #DpRt_Context_Error_Publish
+ * @see dprt_context.html#DpRt_Context_Default_Get
+ */
+int DpRt_Expose_Reduce_Batch(char **input_filename_list,int frame_count,
+			     struct DpRt_Expose_Result_Struct *result_list)
+{
+	return DpRt_Context_Error_Publish(DpRt_Expose_Reduce_Batch_Context(DpRt_Context_Default_Get(),
+								      input_filename_list,frame_count,result_list));
+}
+
+/**
+ * This routine reduces a batch of expose frames, filling in a result structure for each. It is usually invoked
+ * from the Java DpRtExposeReduceBatch call in DpRtLibrary.java, for instance to re-reduce a night's frames after
+ * a calibration change. Each frame is reduced as by DpRt_Expose_Reduce, but when doing a full reduction the read,
+ * extract and write stages are pipelined: frame N+1 is read and calibrated in one thread while frame N is
+ * extracted in this thread and frame N-1 is written in another, so the disk is kept busy while the spectrum is
+ * extracted. The read and write threads are created once per batch, and are started on each step and waited for
+ * through a shared pipeline structure. The DPRT_BATCH_STAGE_COUNT frames in flight are held in the context's
+ * scratch buffers. cfitsio calls in the read and write stages hold the cfitsio lock, and each stage runs with
+ * its frame's own error state bound. If the writer async property is set, the write stage only
+ * queues each frame for the background writer, so the batch returns before the last frames reach the disk.
+ * A frame that fails is reported in its result structure, and the remaining frames are still reduced.
+ * If DpRt_Abort_Request is called (from the JNI DpRt_Abort routine) during the batch, the frame stages stop at their
+ * next abort checkpoint, and every frame not yet written fails with the error number DPRT_ABORT_ERROR_NUMBER.
+ * @param context The reduction context. Its configuration snapshot is used, and its error state is set.
+ * @param input_filename_list A list of FITS filenames to be processed.
+ * @param frame_count The number of filenames in the list.
+ * @param result_list A list of frame_count result structures, filled in for each frame. The caller should
+ *        free the Output_Filename of each successful result.
+ * @return The routine returns TRUE if the batch was processed (even if some frames failed), and FALSE if the
+ *         parameters were invalid.
+ * @see #DPRT_BATCH_STAGE_COUNT
+ * @see #Expose_Frame_Initialise
+ * @see #Expose_Reduce_Filename_Get
+ * @see #Expose_Frame_Read
+ * @see #Expose_Frame_Extract
+ * @see #Expose_Frame_Write
+ * @see #Expose_Frame_Queue
+ * @see #Expose_Frame_Quick
+ * @see #Expose_Frame_Free
+ * @see #Expose_Stage_Run
+ * @see #Expose_Stage_Thread
+ * @see dprt_context.html#DpRt_Context_Config_Refresh
+ * @see dprt_abort.html#DpRt_Abort_Request
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see #Expose_Reduce_Batch
+ * @see #Context_Begin
+ * @see #Context_End
+ */
+int DpRt_Expose_Reduce_Batch_Context(struct DpRt_Context_Struct *context,char **input_filename_list,
+				     int frame_count,struct DpRt_Expose_Result_Struct *result_list)
+{
+	struct DpRt_Error_Struct *previous_error = NULL;
+	int retval;
+
+	if(!Context_Begin(context,"DpRt_Expose_Reduce_Batch_Context",&previous_error))
+		return FALSE;
+	retval = Expose_Reduce_Batch(context,input_filename_list,frame_count,result_list);
+	Context_End(previous_error);
+	return retval;
+}
+
+/**
+ * Call DpRt_Expose_Reduce_Buffer_Context in the default context. Any error is copied to DpRt_JNI_Error_Number
+ * and DpRt_JNI_Error_String, where the JNI layer reads it.
+ * @param pixels The frame's pixels, naxis2 rows of naxis1 pixels.
+ * @param pixel_format The format of the pixels, a DPRT_KERNEL_PIXEL_FORMAT value.
+ * @param naxis1 The number of columns in the frame.
+ * @param naxis2 The number of rows in the frame.
+ * @param x_bin The binning of the frame along NAXIS1 (CCDXBIN).
+ * @param y_bin The binning of the frame along NAXIS2 (CCDYBIN).
+ * @param result The address of a result structure to fill in.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Expose_Reduce_Buffer_Context
+ * @see #DpRt_Context_Error_Publish
+ * @see dprt_context.html#DpRt_Context_Default_Get
+ */
+int DpRt_Expose_Reduce_Buffer(unsigned short *pixels,int pixel_format,int naxis1,int naxis2,int x_bin,int y_bin,
+			      struct DpRt_Expose_Result_Struct *result)
+{
+	return DpRt_Context_Error_Publish(DpRt_Expose_Reduce_Buffer_Context(DpRt_Context_Default_Get(),pixels,
+								       pixel_format,naxis1,naxis2,x_bin,y_bin,
+								       result));
+}
+
+/**
+ * Reduce an expose frame that is still in memory, e.g. a camera readout passed in from Java before it has been
+ * written to disk, so quick look results are available without waiting for the filesystem. The pixels are used
+ * in place, they are not copied, and must not be modified until the routine returns. The header keywords the
+ * reduction needs are passed in rather than read from the FITS header.
+ * When doing a full reduction, the frame is calibrated using the master frames of the same binning held in the
+ * calibration cache, and the spectrum optimally extracted, exactly as DpRt_Expose_Reduce does, but no reduced
+ * frame is written. Otherwise a quick reduction measures the spectrum from a decimated subset of the pixels.
+ * If DpRt_Abort_Request is called during the reduction, it stops at its next abort checkpoint and returns FALSE,
+ * with the error number DPRT_ABORT_ERROR_NUMBER.
+ * @param context The reduction context. Its configuration snapshot is used, and its error state is set.
+ * @param pixels The frame's pixels, naxis2 rows of naxis1 pixels.
+ * @param pixel_format The format of the pixels, a DPRT_KERNEL_PIXEL_FORMAT value:
+ *        DPRT_KERNEL_PIXEL_FORMAT_NATIVE for unsigned shorts in the host's byte order, or
+ *        DPRT_KERNEL_PIXEL_FORMAT_FITS for the raw FITS encoding.
+ * @param naxis1 The number of columns in the frame.
+ * @param naxis2 The number of rows in the frame.
+ * @param x_bin The binning of the frame along NAXIS1 (CCDXBIN), used to find the master frames.
+ * @param y_bin The binning of the frame along NAXIS2 (CCDYBIN).
+ * @param result The address of a result structure to fill in. Successful, Error_Number and Error_String are
+ *        always filled in. Output_Filename is set to NULL, as nothing is written.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Expose_Reduce_Buffer
+ * @see #Context_Begin
+ * @see #Context_End
+ * @see dprt_kernel.h#DPRT_KERNEL_PIXEL_FORMAT
+ */
+int DpRt_Expose_Reduce_Buffer_Context(struct DpRt_Context_Struct *context,unsigned short *pixels,int pixel_format,
+				      int naxis1,int naxis2,int x_bin,int y_bin,
+				      struct DpRt_Expose_Result_Struct *result)
+{
+	struct DpRt_Error_Struct *previous_error = NULL;
+	int retval;
+
+	if(!Context_Begin(context,"DpRt_Expose_Reduce_Buffer_Context",&previous_error))
+		return FALSE;
+	retval = Expose_Reduce_Buffer(context,pixels,pixel_format,naxis1,naxis2,x_bin,y_bin,result);
+	DpRt_Metrics_Count_Add(retval ? DPRT_METRICS_COUNTER_FRAMES : DPRT_METRICS_COUNTER_FRAMES_FAILED,1);
+	if(result != NULL)
+	{
+		result->Successful = retval;
+		result->Error_Number = DpRt_Error_Number;
+		strcpy(result->Error_String,DpRt_Error_String);
+	}
+	Context_End(previous_error);
+	return retval;
+}
+
+/**
+ * Call DpRt_Make_Master_Bias_Context in the default context. Any error is copied to DpRt_JNI_Error_Number and
+ * DpRt_JNI_Error_String, where the JNI layer reads it.
+ * @param directory_name A directory containing the  FITS filenames to be processed.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Make_Master_Bias_Context
+ * @see #DpRt_Context_Error_Publish
+ * @see dprt_context.html#DpRt_Context_Default_Get
+ */
+int DpRt_Make_Master_Bias(char *directory_name)
+{
+	return DpRt_Context_Error_Publish(DpRt_Make_Master_Bias_Context(DpRt_Context_Default_Get(),directory_name));
+}
+
+/**
+ * This routine creates a master bias frame for each binning factor, created from biases in the specified
+ * directory. The biases are median combined a tile of rows at a time by a pool of worker threads. If
+ * dprt.bias.accumulate is set, the running master biases built as the biases were reduced are written instead, and
+ * the directory's biases are only combined for the binnings whose running master did not have enough biases.
+ * @param context The reduction context. Its configuration snapshot is used, and its error state is set.
+ * @param directory_name A directory containing the  FITS filenames to be processed.
+ * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
+ *       succeeded and FALSE if they fail.
+ * @see dprt_context.html#DpRt_Context_Config_Refresh
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see dprt_master.html#DpRt_Master_Bias_Make
+ * @see dprt_accumulator.html#DpRt_Accumulator_Master_Write
+ * @see dprt_cache.html#DpRt_Cache_Master_Directory_Set
+ * @see dprt_abort.html#DpRt_Abort_Request
+ * @see #Make_Master_Bias
+ * @see #Context_Begin
+ * @see #Context_End
+ */
+int DpRt_Make_Master_Bias_Context(struct DpRt_Context_Struct *context,char *directory_name)
+{
+	struct DpRt_Error_Struct *previous_error = NULL;
+	int retval;
+
+	if(!Context_Begin(context,"DpRt_Make_Master_Bias_Context",&previous_error))
+		return FALSE;
+	retval = Make_Master_Bias(context,directory_name);
+	Context_End(previous_error);
+	return retval;
+}
+
+/**
+ * Call DpRt_Make_Master_Flat_Context in the default context. Any error is copied to DpRt_JNI_Error_Number and
+ * DpRt_JNI_Error_String, where the JNI layer reads it.
+ * @param directory_name A directory containing the  FITS filenames to be processed.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Make_Master_Flat_Context
+ * @see #DpRt_Context_Error_Publish
+ * @see dprt_context.html#DpRt_Context_Default_Get
+ */
+int DpRt_Make_Master_Flat(char *directory_name)
+{
+	return DpRt_Context_Error_Publish(DpRt_Make_Master_Flat_Context(DpRt_Context_Default_Get(),directory_name));
+}
+
+/**
+ * This routine creates a master flat frame for each binning factor, created from flats in the specified
+ * directory. The flats are bias subtracted, scaled, sigma clip combined a tile of rows at a time by a pool of
+ * worker threads, and normalised along the dispersion axis.
+ * @param context The reduction context. Its configuration snapshot is used, and its error state is set.
+ * @param directory_name A directory containing the  FITS filenames to be processed.
+ * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
+ *       succeeded and FALSE if they fail.
+ * @see dprt_context.html#DpRt_Context_Config_Refresh
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ * @see dprt_master.html#DpRt_Master_Flat_Make
+ * @see dprt_cache.html#DpRt_Cache_Master_Directory_Set
+ * @see dprt_abort.html#DpRt_Abort_Request
+ * @see #Make_Master_Flat
+ * @see #Context_Begin
+ * @see #Context_End
+ */
+int DpRt_Make_Master_Flat_Context(struct DpRt_Context_Struct *context,char *directory_name)
+{
+	struct DpRt_Error_Struct *previous_error = NULL;
+	int retval;
+
+	if(!Context_Begin(context,"DpRt_Make_Master_Flat_Context",&previous_error))
+		return FALSE;
+	retval = Make_Master_Flat(context,directory_name);
+	Context_End(previous_error);
+	return retval;
+}
+
+/**
+ * Copy the default context's error state to DpRt_JNI_Error_Number and DpRt_JNI_Error_String, where the JNI
+ * layer (through DpRt_JNI_Get_Error_Number and DpRt_JNI_Get_Error_String) reads it. The JNI layer also calls this
+ * to publish the errors its own routines set in the default context's error state.
+ * @param retval The value returned by the routine called in the default context.
+ * @return retval.
+ * @see dprt_context.html#DpRt_Context_Default_Get
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_Number
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_String
- * @see #Calibrate_Reduce_Fake
  */
-int DpRt_Calibrate_Reduce(char *input_filename,char **output_filename,double *mean_counts,double *peak_counts)
+int DpRt_Context_Error_Publish(int retval)
+{
+	struct DpRt_Context_Struct *context = NULL;
+
+	context = DpRt_Context_Default_Get();
+	DpRt_JNI_Error_Number = context->Error.Number;
+	strcpy(DpRt_JNI_Error_String,context->Error.String);
+	return retval;
+}
+
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Start a call in a context. The context's error state is bound to the calling thread, and cleared. The call
+ * is given a new log tag, so the messages it logs can be told apart from those of concurrent calls. The call
+ * records the abort generation it starts in (or the context's Abort_Generation, if that is set), so an abort
+ * requested from now on stops it, while an abort requested for an earlier call is not cancelled.
+ * @param context The reduction context.
+ * @param function_name The name of the calling routine, used in the error if context is NULL.
+ * @param previous_error The address of a pointer, set to the error state previously bound to the thread, which
+ *        should be passed to Context_End.
+ * @return The routine returns TRUE on success, and FALSE if context is NULL.
+ * @see #Context_End
+ * @see dprt_context.html#DpRt_Error_Bind
+ * @see dprt_log.html#DpRt_Log_Tag_Create
+ * @see dprt_abort.html#DpRt_Abort_Generation_Get
+ */
+static int Context_Begin(struct DpRt_Context_Struct *context,char *function_name,
+			 struct DpRt_Error_Struct **previous_error)
+{
+	if(context == NULL)
+	{
+		DpRt_Error_Number = 114;
+		sprintf(DpRt_Error_String,"%s:context was NULL.",function_name);
+		return FALSE;
+	}
+	(*previous_error) = DpRt_Error_Bind(&(context->Error));
+	DpRt_Error_Number = 0;
+	DpRt_Error_String[0] = '\0';
+	context->Error.Log_Tag = DpRt_Log_Tag_Create();
+	if(context->Abort_Generation != 0)
+		context->Error.Abort_Generation = context->Abort_Generation;
+	else
+		context->Error.Abort_Generation = DpRt_Abort_Generation_Get();
+	return TRUE;
+}
+
+/**
+ * End a call in a context, restoring the error state bound to the calling thread before Context_Begin. The
+ * context's error state is marked as no longer running a reduction, so it is never aborted if it is used
+ * unbound (as the default context's is).
+ * @param previous_error The error state returned by Context_Begin.
+ * @see #Context_Begin
+ * @see dprt_context.html#DpRt_Error_Bind
+ */
+static void Context_End(struct DpRt_Error_Struct *previous_error)
 {
+	DpRt_Error_Current_Get()->Abort_Generation = 0;
+	DpRt_Error_Bind(previous_error);
+}
+
+/**
+ * The body of DpRt_Calibrate_Reduce_Context, called with the context's error state bound to the calling thread.
+ * @param context The reduction context.
+ * @see #DpRt_Calibrate_Reduce_Context
+ */
+static int Calibrate_Reduce(struct DpRt_Context_Struct *context,char *input_filename,char **output_filename,
+			    double *mean_counts,double *peak_counts)
+{
+	struct DpRt_Config_Struct *config = NULL;
+	struct DpRt_Fits_Reader_Struct reader;
+	struct DpRt_Kernel_Stats_Struct stats;
+	struct DpRt_Fits_Header_Struct header;
+	struct DpRt_Wavelength_Solution_Struct solution;
+	struct DpRt_Abort_Checkpoint_Struct checkpoint;
+	struct DpRt_Accumulator_Frame_Struct accumulator_frame;
+	unsigned short *block = NULL;
 	float l1mean,l1counts;
-	int full_reduction;
+	int start_row,row_count,fitted,accumulate,retval;
 
-	DpRt_JNI_Error_Number = 0;
-	DpRt_JNI_Error_String[0] = '\0';
 	/* check parameters */
 	if(input_filename == NULL)
 	{
-		DpRt_JNI_Error_Number = 100;
-		strcpy(DpRt_JNI_Error_String,"DpRt_Calibrate_Reduce:input filename was NULL.");
+		DpRt_Error_Number = 100;
+		strcpy(DpRt_Error_String,"DpRt_Calibrate_Reduce:input filename was NULL.");
 		return FALSE;
 	}
 	if(output_filename == NULL)
 	{
-		DpRt_JNI_Error_Number = 101;
-		strcpy(DpRt_JNI_Error_String,"DpRt_Calibrate_Reduce:output filename was NULL.");
+		DpRt_Error_Number = 101;
+		strcpy(DpRt_Error_String,"DpRt_Calibrate_Reduce:output filename was NULL.");
 		return FALSE;
 	}
 	if(mean_counts == NULL)
 	{
-		DpRt_JNI_Error_Number = 102;
-		strcpy(DpRt_JNI_Error_String,"DpRt_Calibrate_Reduce:mean counts was NULL.");
+		DpRt_Error_Number = 102;
+		strcpy(DpRt_Error_String,"DpRt_Calibrate_Reduce:mean counts was NULL.");
 		return FALSE;
 	}
 	if(peak_counts == NULL)
 	{
-		DpRt_JNI_Error_Number = 103;
-		strcpy(DpRt_JNI_Error_String,"DpRt_Calibrate_Reduce:peak counts was NULL.");
+		DpRt_Error_Number = 103;
+		strcpy(DpRt_Error_String,"DpRt_Calibrate_Reduce:peak counts was NULL.");
 		return FALSE;
 	}
 	/* do full reduction? */
-	if(!DpRt_JNI_Get_Property_Boolean("dprt.full_reduction",&full_reduction))
-		return FALSE;
-	fprintf(stdout,"DpRt_Calibrate_Reduce:Full Reduction Flag:%d\n",full_reduction);
-	/*
-	if(full_reduction)
-		run_mode = FULL_REDUCTION;
-	else
-		run_mode = QUICK_REDUCTION;
-	*/
+	config = &(context->Config);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Calibrate_Reduce:Full Reduction Flag:%d",config->Full_Reduction);
 	/* initialise return values */
 	l1mean = 0.0f;
 	l1counts= 0.0f;
-	/* call reduction library routine here. */
-	/* copy input filename to output - no reduction done */
+	/* other contexts may be using cfitsio, so the cfitsio lock is held by each call that may use it */
+	DpRt_Fits_Lock();
+	retval = DpRt_Fits_Header_Read(input_filename,&header);
+	DpRt_Fits_Unlock();
+	if(!retval)
+		return FALSE;
+	/* read the image a block of rows at a time, accumulating statistics from each block as it is read */
+	DpRt_Fits_Lock();
+	retval = DpRt_Fits_Reader_Open(input_filename,&reader);
+	DpRt_Fits_Unlock();
+	if(!retval)
+		return FALSE;
+	/* stage biases as they are read, to add to the running master bias of their binning once read */
+	accumulate = config->Bias_Accumulate && (strcmp(header.Obstype,DPRT_BIAS_OBSTYPE) == 0);
+	if(accumulate)
+	{
+		if(!DpRt_Accumulator_Frame_Start(&header,config->Read_Noise/config->Gain,&accumulator_frame))
+		{
+			DpRt_Fits_Lock();
+			DpRt_Fits_Reader_Close(&reader);
+			DpRt_Fits_Unlock();
+			return FALSE;
+		}
+	}
+	DpRt_Kernel_Stats_Initialise(&stats);
+	DpRt_Abort_Checkpoint_Initialise(&checkpoint);
+	do
+	{
+		/* a memory mapped frame does not use cfitsio, so only a cfitsio read takes the lock */
+		if(reader.Data == NULL)
+			DpRt_Fits_Lock();
+		retval = DpRt_Fits_Reader_Read_Block(&reader,&block,&start_row,&row_count);
+		if(reader.Data == NULL)
+			DpRt_Fits_Unlock();
+		if(retval)
+		{
+			DpRt_Kernel_Stats_Accumulate(&stats,block,((long)row_count)*reader.Naxis1,reader.Pixel_Format);
+			if(accumulate)
+			{
+				DpRt_Accumulator_Block_Add(&accumulator_frame,block,start_row,row_count,
+							   reader.Pixel_Format);
+			}
+			retval = DpRt_Abort_Checkpoint(&checkpoint,((long)row_count)*reader.Naxis1,
+						       "DpRt_Calibrate_Reduce");
+		}
+	} while(retval && (row_count > 0));
+	DpRt_Fits_Lock();
+	if(retval)
+		retval = DpRt_Fits_Reader_Close(&reader);
+	else
+		DpRt_Fits_Reader_Close(&reader);
+	DpRt_Fits_Unlock();
+	if(accumulate)
+	{
+		/* a bias that failed or was aborted part way through leaves the running master untouched */
+		if(retval)
+			retval = DpRt_Accumulator_Frame_End(&accumulator_frame);
+		else
+			DpRt_Accumulator_Frame_Abort(&accumulator_frame);
+	}
+	if(!retval)
+		return FALSE;
+	l1mean = (float)DpRt_Kernel_Stats_Mean(&stats);
+	l1counts = (float)(stats.Peak);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Calibrate_Reduce:%ld pixels:Mean Counts:%.2f:Peak Counts:%.2f",stats.Count,
+		l1mean,l1counts);
+	/* fit a wavelength solution to arc frames */
+	if(strcmp(header.Obstype,DPRT_ARC_OBSTYPE) == 0)
+	{
+		if(!DpRt_Wavelength_Arc_Reduce(input_filename,config,&solution,&fitted))
+			return FALSE;
+	}
+	/* copy input filename to output - calibration frames are not modified */
 	(*output_filename) = (char*)malloc((strlen(input_filename)+1)*sizeof(char));
 	if((*output_filename) == NULL)
 	{
-		DpRt_JNI_Error_Number = 104;
-		strcpy(DpRt_JNI_Error_String,"DpRt_Calibrate_Reduce:output filename was NULL.");
+		DpRt_Error_Number = 104;
+		strcpy(DpRt_Error_String,"DpRt_Calibrate_Reduce:output filename was NULL.");
 		return FALSE;
 	}
 	strcpy((*output_filename),input_filename);
@@ -155,76 +1006,86 @@ int DpRt_Calibrate_Reduce(char *input_filename,char **output_filename,double *me
 }
 
 /**
- * This routine does the real time data reduction pipeline on an expose file. It is usually invoked from the
- * Java DpRtExposeReduce call in DpRtLibrary.java. If the <a href="#DpRt_Get_Abort">DpRt_Get_Abort</a>
- * routine returns TRUE during the execution of the pipeline the pipeline should abort it's
- * current operation and return FALSE.
- * @param input_filename The FITS filename to be processed.
- * @param output_filename The resultant filename should be put in this variable. This variable is the
- *       address of a pointer to a sequence of characters, hence it should be referenced using
- *       <code>(*output_filename)</code> in this routine.
- * @param seeing The address of a double to store the seeing calculated by this routine.
- * @param counts The address of a double to store the counts of th brightest pixel calculated by this
- *       routine.
- * @param x_pix The x pixel position of the brightest object in the field. Note this is an average pixel
- *       number that may not be a whole number of pixels.
- * @param y_pix The y pixel position of the brightest object in the field. Note this is an average pixel
- *       number that may not be a whole number of pixels.
- * @param photometricity In units of magnitudes of extinction. This is only filled in for standard field
- * 	reductions.
- * @param sky_brightness In units of magnitudes per arcsec&#178;. This is an estimate of sky brightness.
- * @param saturated This is a boolean, returning TRUE if the object is saturated.
- * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
- *       succeeded and FALSE if they fail.
- * @see ngat_dprt_ftspec_DpRtLibrary.html
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_Number
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_String
- * @see #Expose_Reduce_Fake
+ * The body of DpRt_Expose_Reduce_Context, called with the context's error state bound to the calling thread.
+ * @param context The reduction context.
+ * @see #DpRt_Expose_Reduce_Context
  */
-int DpRt_Expose_Reduce(char *input_filename,char **output_filename,double *seeing,double *counts,double *x_pix,
-		       double *y_pix,double *photometricity,double *sky_brightness,int *saturated)
+static int Expose_Reduce(struct DpRt_Context_Struct *context,char *input_filename,char **output_filename,
+			 double *seeing,double *counts,double *x_pix,double *y_pix,double *photometricity,
+			 double *sky_brightness,int *saturated)
 {
+	struct DpRt_Config_Struct *config = NULL;
+	struct DpRt_Quick_Result_Struct quick_result;
 	float l1seeing,l1xpix,l1ypix,l1counts,l1photom,l1skybright;
-	int l1sat,full_reduction;
+	double full_seeing,full_counts,full_x_pix,full_y_pix;
+	int l1sat,reduced;
 
-	DpRt_JNI_Error_Number = 0;
-	DpRt_JNI_Error_String[0] = '\0';
 	/* check parameters */
 	if(input_filename == NULL)
 	{
-		DpRt_JNI_Error_Number = 105;
-		strcpy(DpRt_JNI_Error_String,"DpRt_Expose_Reduce:input filename was NULL.");
+		DpRt_Error_Number = 105;
+		strcpy(DpRt_Error_String,"DpRt_Expose_Reduce:input filename was NULL.");
 		return FALSE;
 	}
 	if(output_filename == NULL)
 	{
-		DpRt_JNI_Error_Number = 106;
-		strcpy(DpRt_JNI_Error_String,"DpRt_Expose_Reduce:output filename was NULL.");
+		DpRt_Error_Number = 106;
+		strcpy(DpRt_Error_String,"DpRt_Expose_Reduce:output filename was NULL.");
 		return FALSE;
 	}
 	/* get whether to do full reduction */
-	if(!DpRt_JNI_Get_Property_Boolean("dprt.full_reduction",&full_reduction))
-		return FALSE;
-	fprintf(stdout,"DpRt_Calibrate_Reduce:Full Reduction Flag:%d\n",full_reduction);
+	config = &(context->Config);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Expose_Reduce:Full Reduction Flag:%d",config->Full_Reduction);
 	/* initialise return values */
 	l1seeing = 0.0f;
 	l1counts = 0.0f;
 	l1xpix = 0.0f;
 	l1ypix = 0.0f;
 	l1photom = 0.0f;
+	/* the sky level cannot be converted to magnitudes per arcsec^2 without a zero point and plate scale */
 	l1skybright = 0.0f;
 	l1sat = 0;
-	/* call reduction library routine here. */
+	reduced = FALSE;
+	if(config->Full_Reduction)
+	{
+		if(!Expose_Reduce_Filename_Get(input_filename,output_filename))
+			return FALSE;
+		if(!Expose_Reduce_Full(context,input_filename,(*output_filename),&full_seeing,&full_counts,&full_x_pix,
+				       &full_y_pix,&l1sat))
+		{
+			free(*output_filename);
+			(*output_filename) = NULL;
+			return FALSE;
+		}
+		reduced = TRUE;
+		l1seeing = (float)full_seeing;
+		l1counts = (float)full_counts;
+		l1xpix = (float)full_x_pix;
+		l1ypix = (float)full_y_pix;
+	}
+	else
+	{
+		/* the quick reduction takes the cfitsio lock itself, inside its time budget */
+		if(!DpRt_Quick_Reduce(input_filename,config,&quick_result))
+			return FALSE;
+		l1seeing = (float)(quick_result.Fwhm);
+		l1counts = (float)(quick_result.Counts);
+		l1xpix = (float)(quick_result.X_Pix);
+		l1ypix = (float)(quick_result.Y_Pix);
+		l1sat = quick_result.Saturated;
+	}
 	/* copy input filename to output - no reduction done */
-	(*output_filename) = (char*)malloc((strlen(input_filename)+1)*sizeof(char));
-	if((*output_filename) == NULL)
+	if(!reduced)
 	{
-		DpRt_JNI_Error_Number = 107;
-		strcpy(DpRt_JNI_Error_String,"DpRt_Expose_Reduce:output filename was NULL.");
-		return FALSE;
+		(*output_filename) = (char*)malloc((strlen(input_filename)+1)*sizeof(char));
+		if((*output_filename) == NULL)
+		{
+			DpRt_Error_Number = 107;
+			strcpy(DpRt_Error_String,"DpRt_Expose_Reduce:output filename was NULL.");
+			return FALSE;
+		}
+		strcpy((*output_filename),input_filename);
 	}
-	strcpy((*output_filename),input_filename);
 	/* copy return values to function return values */
 	(*seeing) = (double)l1seeing;
 	(*counts) = (double)l1counts;
@@ -237,72 +1098,1059 @@ int DpRt_Expose_Reduce(char *input_filename,char **output_filename,double *seein
 }
 
 /**
- * This routine creates a master bias frame for each binning factor, created from biases in the specified
- * directory
- * @param directory_name A directory containing the  FITS filenames to be processed.
- * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
- *       succeeded and FALSE if they fail.
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_Number
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_String
+ * The body of DpRt_Expose_Reduce_Batch_Context, called with the context's error state bound to the calling thread.
+ * @param context The reduction context.
+ * @see #DpRt_Expose_Reduce_Batch_Context
+ * @see dprt_metrics.html#DpRt_Metrics_Count_Add
  */
-int DpRt_Make_Master_Bias(char *directory_name)
+static int Expose_Reduce_Batch(struct DpRt_Context_Struct *context,char **input_filename_list,int frame_count,
+			       struct DpRt_Expose_Result_Struct *result_list)
 {
-	int make_master_bias;
+	struct DpRt_Config_Struct *config = NULL;
+	struct Expose_Frame_Struct frame_list[DPRT_BATCH_STAGE_COUNT];
+	struct Expose_Pipeline_Struct pipeline;
+	struct Expose_Stage_Struct read_stage,extract_stage,write_stage;
+	struct Expose_Stage_Struct *thread_stage_list[2];
+	struct DpRt_Expose_Result_Struct *result = NULL;
+	struct Expose_Frame_Struct *frame = NULL;
+	int step,index,thread_count,i,successful_count;
 
-	DpRt_JNI_Error_Number = 0;
-	DpRt_JNI_Error_String[0] = '\0';
-	/* whether to do the make master bias or not */
-	if(!DpRt_JNI_Get_Property_Boolean("dprt.make_master_bias",&make_master_bias))
+	/* check parameters */
+	if(input_filename_list == NULL)
+	{
+		DpRt_Error_Number = 110;
+		strcpy(DpRt_Error_String,"DpRt_Expose_Reduce_Batch:input filename list was NULL.");
 		return FALSE;
-	fprintf(stdout,"DpRt_Make_Master_Bias:Make Master Bias Flag:%d\n",make_master_bias);
-	if(make_master_bias)
+	}
+	if(result_list == NULL)
 	{
-		fprintf(stdout,"DpRt_Make_Master_Bias:Calling Make Master Bias routine.\n");
-		/* call make master bias routine here */
+		DpRt_Error_Number = 111;
+		strcpy(DpRt_Error_String,"DpRt_Expose_Reduce_Batch:result list was NULL.");
+		return FALSE;
 	}
+	if(frame_count < 0)
+	{
+		DpRt_Error_Number = 112;
+		sprintf(DpRt_Error_String,"DpRt_Expose_Reduce_Batch:Illegal frame count %d.",frame_count);
+		return FALSE;
+	}
+	config = &(context->Config);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Expose_Reduce_Batch:Reducing %d frames:Full Reduction Flag:%d",frame_count,
+		config->Full_Reduction);
+	pthread_mutex_init(&(pipeline.Mutex),NULL);
+	pthread_cond_init(&(pipeline.Condition),NULL);
+	pipeline.Step = 0;
+	pipeline.Done_Count = 0;
+	pipeline.Exit = FALSE;
+	read_stage.Stage = Expose_Frame_Read;
+	read_stage.Context = context;
+	extract_stage.Context = context;
+	if(config->Writer_Async)
+		write_stage.Stage = Expose_Frame_Queue;
+	else
+		write_stage.Stage = Expose_Frame_Write;
+	write_stage.Context = context;
+	if(config->Full_Reduction)
+		extract_stage.Stage = Expose_Frame_Extract;
 	else
+		extract_stage.Stage = Expose_Frame_Quick;
+	thread_stage_list[0] = &read_stage;
+	thread_stage_list[1] = &write_stage;
+	/* start the read and write threads for the whole batch, running a stage inline if its thread cannot be
+	** created */
+	for(i = 0; i < 2; i++)
 	{
-		fprintf(stdout,"DpRt_Make_Master_Bias:Make Master Bias Flag was FALSE:Not making master bias.\n");
+		thread_stage_list[i]->Frame = NULL;
+		thread_stage_list[i]->Pipeline = &pipeline;
+		thread_stage_list[i]->Thread_Started = FALSE;
+		if(config->Full_Reduction && (frame_count > 0))
+		{
+			thread_stage_list[i]->Thread_Started = (pthread_create(&(thread_stage_list[i]->Thread),NULL,
+									Expose_Stage_Thread,
+									thread_stage_list[i]) == 0);
+		}
 	}
+	thread_count = 0;
+	for(i = 0; i < 2; i++)
+	{
+		if(thread_stage_list[i]->Thread_Started)
+			thread_count++;
+	}
+	successful_count = 0;
+	/* at step N, frame N is read, frame N-1 extracted and frame N-2 written */
+	for(step = 0; step < frame_count+DPRT_BATCH_STAGE_COUNT-1; step++)
+	{
+		pthread_mutex_lock(&(pipeline.Mutex));
+		read_stage.Frame = NULL;
+		write_stage.Frame = NULL;
+		if(step < frame_count)
+		{
+			frame = &(frame_list[step%DPRT_BATCH_STAGE_COUNT]);
+			Expose_Frame_Initialise(frame,input_filename_list[step],step%DPRT_BATCH_STAGE_COUNT);
+			if(input_filename_list[step] == NULL)
+			{
+				frame->Successful = FALSE;
+				frame->Error.Number = 105;
+				strcpy(frame->Error.String,"DpRt_Expose_Reduce_Batch:input filename was NULL.");
+			}
+			else if(config->Full_Reduction)
+			{
+				if(!Expose_Reduce_Filename_Get(frame->Input_Filename,&(frame->Output_Filename)))
+				{
+					frame->Successful = FALSE;
+					frame->Error.Number = DpRt_Error_Number;
+					strcpy(frame->Error.String,DpRt_Error_String);
+				}
+				read_stage.Frame = frame;
+			}
+		}
+		index = step-(DPRT_BATCH_STAGE_COUNT-1);
+		if(config->Full_Reduction && (index >= 0))
+			write_stage.Frame = &(frame_list[index%DPRT_BATCH_STAGE_COUNT]);
+		/* start the step on the stage threads */
+		pipeline.Step++;
+		pipeline.Done_Count = 0;
+		pthread_cond_broadcast(&(pipeline.Condition));
+		pthread_mutex_unlock(&(pipeline.Mutex));
+		for(i = 0; i < 2; i++)
+		{
+			if((!thread_stage_list[i]->Thread_Started)&&(thread_stage_list[i]->Frame != NULL))
+				Expose_Stage_Run(thread_stage_list[i]);
+		}
+		index = step-1;
+		if((index >= 0)&&(index < frame_count))
+		{
+			extract_stage.Frame = &(frame_list[index%DPRT_BATCH_STAGE_COUNT]);
+			Expose_Stage_Run(&extract_stage);
+		}
+		/* wait for the stage threads to finish the step */
+		pthread_mutex_lock(&(pipeline.Mutex));
+		while(pipeline.Done_Count < thread_count)
+			pthread_cond_wait(&(pipeline.Condition),&(pipeline.Mutex));
+		pthread_mutex_unlock(&(pipeline.Mutex));
+		/* the oldest frame in flight has now been through every stage */
+		index = step-(DPRT_BATCH_STAGE_COUNT-1);
+		if(!config->Full_Reduction)
+			index = step-1;
+		if((index >= 0)&&(index < frame_count))
+		{
+			frame = &(frame_list[index%DPRT_BATCH_STAGE_COUNT]);
+			result = &(result_list[index]);
+			result->Successful = frame->Successful;
+			result->Error_Number = frame->Error.Number;
+			strcpy(result->Error_String,frame->Error.String);
+			result->Output_Filename = NULL;
+			if(frame->Successful)
+			{
+				result->Output_Filename = frame->Output_Filename;
+				frame->Output_Filename = NULL;
+				successful_count++;
+			}
+			result->Seeing = frame->Seeing;
+			result->Counts = frame->Counts;
+			result->X_Pix = frame->X_Pix;
+			result->Y_Pix = frame->Y_Pix;
+			result->Photometricity = 0.0;
+			result->Sky_Brightness = 0.0;
+			result->Saturated = frame->Saturated;
+			Expose_Frame_Free(frame);
+		}
+	}
+	pthread_mutex_lock(&(pipeline.Mutex));
+	pipeline.Exit = TRUE;
+	pthread_cond_broadcast(&(pipeline.Condition));
+	pthread_mutex_unlock(&(pipeline.Mutex));
+	for(i = 0; i < 2; i++)
+	{
+		if(thread_stage_list[i]->Thread_Started)
+			pthread_join(thread_stage_list[i]->Thread,NULL);
+	}
+	pthread_cond_destroy(&(pipeline.Condition));
+	pthread_mutex_destroy(&(pipeline.Mutex));
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Expose_Reduce_Batch:Reduced %d of %d frames.",successful_count,
+		frame_count);
+	DpRt_Metrics_Count_Add(DPRT_METRICS_COUNTER_FRAMES,successful_count);
+	DpRt_Metrics_Count_Add(DPRT_METRICS_COUNTER_FRAMES_FAILED,frame_count-successful_count);
 	return TRUE;
 }
 
 /**
- * This routine creates a master flat frame for each binning factor, created from flats in the specified
- * directory.
- * @param directory_name A directory containing the  FITS filenames to be processed.
- * @return The routine should return whether it succeeded or not. TRUE should be returned if the routine
- *       succeeded and FALSE if they fail.
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_Number
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Error_String
+ * The body of DpRt_Expose_Reduce_Buffer_Context, called with the context's error state bound to the calling
+ * thread.
+ * @param context The reduction context.
+ * @see #DpRt_Expose_Reduce_Buffer_Context
+ * @see #Expose_Frame_Initialise
+ * @see #Expose_Frame_Read
+ * @see #Expose_Frame_Extract
+ * @see #Expose_Frame_Free
+ * @see dprt_quick.html#DpRt_Quick_Reduce_Buffer
  */
-int DpRt_Make_Master_Flat(char *directory_name)
+static int Expose_Reduce_Buffer(struct DpRt_Context_Struct *context,unsigned short *pixels,int pixel_format,
+				int naxis1,int naxis2,int x_bin,int y_bin,struct DpRt_Expose_Result_Struct *result)
 {
-	int make_master_flat;
+	struct DpRt_Config_Struct *config = NULL;
+	struct DpRt_Quick_Result_Struct quick_result;
+	struct Expose_Frame_Struct frame;
+	int retval;
+
+	if((pixels == NULL)||(result == NULL))
+	{
+		DpRt_Error_Number = 115;
+		strcpy(DpRt_Error_String,"DpRt_Expose_Reduce_Buffer:Parameter was NULL.");
+		return FALSE;
+	}
+	result->Output_Filename = NULL;
+	result->Seeing = 0.0;
+	result->Counts = 0.0;
+	result->X_Pix = 0.0;
+	result->Y_Pix = 0.0;
+	result->Photometricity = 0.0;
+	result->Sky_Brightness = 0.0;
+	result->Saturated = FALSE;
+	if((naxis1 < 1)||(naxis2 < 1)||(x_bin < 1)||(y_bin < 1))
+	{
+		DpRt_Error_Number = 116;
+		sprintf(DpRt_Error_String,"DpRt_Expose_Reduce_Buffer:Illegal frame(%d,%d) binning(%d,%d).",naxis1,
+			naxis2,x_bin,y_bin);
+		return FALSE;
+	}
+	config = &(context->Config);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Expose_Reduce_Buffer:Full Reduction Flag:%d:Frame (%d,%d):Binning %dx%d.",
+		config->Full_Reduction,naxis1,naxis2,x_bin,y_bin);
+	if(config->Full_Reduction)
+	{
+		Expose_Frame_Initialise(&frame,NULL,0);
+		frame.Input_Pixels = pixels;
+		frame.Input_Pixel_Format = pixel_format;
+		strcpy(frame.Header.Obstype,"");
+		frame.Header.Naxis1 = naxis1;
+		frame.Header.Naxis2 = naxis2;
+		frame.Header.X_Bin = x_bin;
+		frame.Header.Y_Bin = y_bin;
+		frame.Header.Exposure_Length = 0.0;
+		frame.Header.Bias_Section_Found = FALSE;
+		frame.Header.Trim_Section_Found = FALSE;
+		retval = Expose_Frame_Read(&frame,context);
+		if(retval)
+			retval = Expose_Frame_Extract(&frame,context);
+		result->Seeing = frame.Seeing;
+		result->Counts = frame.Counts;
+		result->X_Pix = frame.X_Pix;
+		result->Y_Pix = frame.Y_Pix;
+		result->Saturated = frame.Saturated;
+		Expose_Frame_Free(&frame);
+		return retval;
+	}
+	/* the pixels are sampled in place, no cfitsio routines are called */
+	if(!DpRt_Quick_Reduce_Buffer(pixels,naxis1,naxis2,pixel_format,config,&quick_result))
+		return FALSE;
+	result->Seeing = quick_result.Fwhm;
+	result->Counts = quick_result.Counts;
+	result->X_Pix = quick_result.X_Pix;
+	result->Y_Pix = quick_result.Y_Pix;
+	result->Saturated = quick_result.Saturated;
+	return TRUE;
+}
+
+/**
+ * The body of DpRt_Make_Master_Bias_Context, called with the context's error state bound to the calling thread.
+ * @param context The reduction context.
+ * @see #DpRt_Make_Master_Bias_Context
+ */
+static int Make_Master_Bias(struct DpRt_Context_Struct *context,char *directory_name)
+{
+	struct DpRt_Config_Struct *config = NULL;
+	struct DpRt_Master_Binning_Struct *written_list = NULL;
+	int written_count,retval;
+
+	/* whether to do the make master bias or not */
+	config = &(context->Config);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Make_Master_Bias:Make Master Bias Flag:%d",config->Make_Master_Bias);
+	if(config->Make_Master_Bias)
+	{
+		written_count = 0;
+		if(config->Bias_Accumulate)
+		{
+			retval = DpRt_Accumulator_Master_Write(directory_name,&written_list,&written_count);
+			if(!retval)
+			{
+				if(written_list != NULL)
+					free(written_list);
+				return FALSE;
+			}
+			DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Make_Master_Bias:Wrote %d running master biases.",
+				written_count);
+		}
+		/* combine the biases in the directory for the binnings without a running master bias */
+		DpRt_Log_Format(DPRT_LOG_LEVEL_DEBUG,"DpRt_Make_Master_Bias:Calling Make Master Bias routine.");
+		retval = DpRt_Master_Bias_Make(directory_name,written_list,written_count);
+		if(written_list != NULL)
+			free(written_list);
+		if(!retval)
+			return FALSE;
+		/* later reductions use the new masters, the cache reloads them as they are newer */
+		if(!DpRt_Cache_Master_Directory_Set(directory_name))
+			return FALSE;
+	}
+	else
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Make_Master_Bias:Make Master Bias Flag was FALSE:"
+			"Not making master bias.");
+	}
+	return TRUE;
+}
+
+/**
+ * The body of DpRt_Make_Master_Flat_Context, called with the context's error state bound to the calling thread.
+ * @param context The reduction context.
+ * @see #DpRt_Make_Master_Flat_Context
+ */
+static int Make_Master_Flat(struct DpRt_Context_Struct *context,char *directory_name)
+{
+	struct DpRt_Config_Struct *config = NULL;
 
-	DpRt_JNI_Error_Number = 0;
-	DpRt_JNI_Error_String[0] = '\0';
 	/* should we call make master flat or not */
-	if(!DpRt_JNI_Get_Property_Boolean("dprt.make_master_flat",&make_master_flat))
+	config = &(context->Config);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Make_Master_Flat:Make Master Flat Flag:%d",config->Make_Master_Flat);
+	if(config->Make_Master_Flat)
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_DEBUG,"DpRt_Make_Master_Flat:Calling Make Master Flat routine.");
+		if(!DpRt_Master_Flat_Make(directory_name))
+			return FALSE;
+		if(!DpRt_Cache_Master_Directory_Set(directory_name))
+			return FALSE;
+	}
+	else
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Make_Master_Flat:Make Master Flat Flag was FALSE:"
+			"Not making master flat.");
+	}
+	return TRUE;
+}
+
+/**
+ * Fully reduce an expose frame, by running the read, extract and write stages on it in turn. The frame is read a
+ * block of rows at a time, and each block is calibrated in a single pass by DpRt_Kernel_Calibrate_Block. The
+ * spectral trace is then found and the spectrum optimally extracted, ignoring saturated pixels. The reduced frame
+ * is written to output_filename, with the spectrum, its variance and (if an arc of the same binning has been
+ * fitted) its wavelengths in extensions. If the writer async property is set, the frame is instead queued for the
+ * background writer, and the routine returns without waiting for it to be written.
+ * @param context The reduction context. Its first scratch buffer holds the frame.
+ * @param input_filename The FITS filename to be processed.
+ * @param output_filename The FITS filename to write the reduced frame to.
+ * @param seeing The address of a double, set to the full width half maximum of the trace's spatial profile in
+ *        pixels, or 0.0 if no spectrum was found.
+ * @param counts The address of a double, set to the counts of the brightest pixel in the extraction aperture,
+ *        or 0.0 if no spectrum was found.
+ * @param x_pix The address of a double, set to the flux weighted centre (FITS pixels) of the extracted spectrum
+ *        along the dispersion axis, or 0.0 if no spectrum was found.
+ * @param y_pix The address of a double, set to the trace centre (FITS pixels) at x_pix, or 0.0.
+ * @param saturated The address of an integer, set to TRUE if a pixel in the extraction aperture was saturated.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Expose_Frame_Struct
+ * @see #Expose_Frame_Read
+ * @see #Expose_Frame_Extract
+ * @see #Expose_Frame_Write
+ * @see #Expose_Frame_Queue
+ * @see #Expose_Frame_Free
+ */
+static int Expose_Reduce_Full(struct DpRt_Context_Struct *context,char *input_filename,char *output_filename,
+			      double *seeing,double *counts,double *x_pix,double *y_pix,int *saturated)
+{
+	struct Expose_Frame_Struct frame;
+	int retval;
+
+	Expose_Frame_Initialise(&frame,input_filename,0);
+	frame.Output_Filename = output_filename;
+	retval = Expose_Frame_Read(&frame,context);
+	if(retval)
+		retval = Expose_Frame_Extract(&frame,context);
+	if(retval && context->Config.Writer_Async)
+		retval = Expose_Frame_Queue(&frame,context);
+	else if(retval)
+		retval = Expose_Frame_Write(&frame,context);
+	(*seeing) = frame.Seeing;
+	(*counts) = frame.Counts;
+	(*x_pix) = frame.X_Pix;
+	(*y_pix) = frame.Y_Pix;
+	(*saturated) = frame.Saturated;
+	/* the output filename belongs to the caller */
+	frame.Output_Filename = NULL;
+	Expose_Frame_Free(&frame);
+	return retval;
+}
+
+/**
+ * Initialise an expose frame structure, so it can be passed to the reduction stages and Expose_Frame_Free.
+ * @param frame The address of the frame structure.
+ * @param input_filename The FITS filename to be processed, or NULL for a frame in memory, whose Input_Pixels,
+ *        Input_Pixel_Format and Header the caller then fills in.
+ * @param scratch_slot Which of the context's scratch buffers the frame is read into.
+ * The frame's error state takes the log tag and abort generation of the calling thread, so a batch frame
+ * reduced on a worker thread logs under the tag of the call that submitted it, and is aborted with it.
+ * @see #Expose_Frame_Struct
+ * @see dprt_context.html#DpRt_Error_Current_Get
+ */
+static void Expose_Frame_Initialise(struct Expose_Frame_Struct *frame,char *input_filename,int scratch_slot)
+{
+	frame->Input_Filename = input_filename;
+	frame->Input_Pixels = NULL;
+	frame->Input_Pixel_Format = DPRT_KERNEL_PIXEL_FORMAT_NATIVE;
+	frame->Output_Filename = NULL;
+	frame->Frame = NULL;
+	frame->X_Offset = 0;
+	frame->Y_Offset = 0;
+	frame->Saturation_Mask = NULL;
+	frame->Cosmic_Mask = NULL;
+	frame->Cosmic_Count = 0;
+	frame->Seeing = 0.0;
+	frame->Found = FALSE;
+	frame->Spectrum.Flux = NULL;
+	frame->Spectrum.Variance = NULL;
+	frame->Counts = 0.0;
+	frame->X_Pix = 0.0;
+	frame->Y_Pix = 0.0;
+	frame->Saturated = FALSE;
+	frame->Scratch_Slot = scratch_slot;
+	frame->Successful = TRUE;
+	frame->Error.Number = 0;
+	frame->Error.String[0] = '\0';
+	frame->Error.Log_Tag = DpRt_Error_Current_Get()->Log_Tag;
+	frame->Error.Abort_Generation = DpRt_Error_Current_Get()->Abort_Generation;
+}
+
+/**
+ * Read stage of a full reduction. The frame is read a block of rows at a time, and each block is calibrated in
+ * a single pass by DpRt_Kernel_Calibrate_Block: saturated pixels are recorded in a bit-packed mask, the block is
+ * bias subtracted and flat fielded using the master frames of the same binning from the calibration cache (if
+ * they exist), and the frame statistics are accumulated. The cfitsio lock is held by each call that may use
+ * cfitsio, so this stage can run alongside the write stage of another frame. The abort flag is polled as each
+ * block is calibrated. A frame in memory (Input_Pixels set) is calibrated in place of reading a file, using the
+ * Header filled in by the caller.
+ * If the configuration asks for overscan correction, a bias model is fitted to the frame's overscan region
+ * (BIASSEC) before the blocks are read, and subtracted from each row as it is calibrated. Only the frame's
+ * TRIMSEC region is calibrated: each row is calibrated through a view of the block starting at the region's
+ * first column, so the trimmed frame is written straight into the scratch buffer and never copied. The master
+ * frames keep the raw frame's dimensions, and are viewed in the same way.
+ * @param frame The address of the frame structure. Header (unless the frame is in memory), Frame, X_Offset,
+ *        Y_Offset and Saturation_Mask are filled in, the mask being set to NULL if no pixel was saturated.
+ *        Header's dimensions are set to those of the trimmed frame.
+ * @param context The reduction context. The frame is read into the scratch buffer given by the frame's
+ *        Scratch_Slot.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Expose_Frame_Struct
+ * @see dprt_fits.html#DpRt_Fits_Lock
+ * @see dprt_fits.html#DpRt_Fits_Unlock
+ * @see dprt_fits.html#DpRt_Fits_Header_Read
+ * @see dprt_fits.html#DpRt_Fits_Reader_Open
+ * @see dprt_fits.html#DpRt_Fits_Reader_Open_Buffer
+ * @see dprt_fits.html#DpRt_Fits_Reader_Read_Block
+ * @see dprt_fits.html#DpRt_Fits_Reader_Close
+ * @see #Expose_Frame_Overscan_Fit
+ * @see dprt_overscan.html#DpRt_Overscan_Row_Get
+ * @see dprt_cache.html#DpRt_Cache_Master_Get
+ * @see dprt_cache.html#DpRt_Cache_Master_Release
+ * @see dprt_kernel.html#DpRt_Kernel_Calibrate_Stats_Initialise
+ * @see dprt_kernel.html#DpRt_Kernel_Calibrate_Block
+ * @see dprt_kernel.html#DpRt_Kernel_Calibrate_Stats_Mean
+ * @see dprt_kernel.html#DpRt_Kernel_Calibrate_Stats_Sigma
+ * @see dprt_abort.html#DpRt_Abort_Checkpoint
+ * @see dprt_context.html#DpRt_Context_Scratch_Get
+ * @see dprt_metrics.html#DpRt_Metrics_Timer_Stop
+ */
+static int Expose_Frame_Read(struct Expose_Frame_Struct *frame,struct DpRt_Context_Struct *context)
+{
+	struct DpRt_Config_Struct *config = NULL;
+	struct DpRt_Fits_Reader_Struct reader;
+	struct DpRt_Kernel_Calibrate_Stats_Struct stats;
+	struct DpRt_Abort_Checkpoint_Struct checkpoint;
+	struct DpRt_Overscan_Struct overscan;
+	struct DpRt_Fits_Section_Struct trim;
+	struct timespec start_time;
+	unsigned short *block = NULL;
+	float *bias = NULL;
+	float *flat = NULL;
+	float *overscan_row = NULL;
+	double overscan_level;
+	long first_pixel,output_pixel,pixel_count;
+	int start_row,row_count,trim_naxis1,trim_naxis2,trimmed,row,y,retval;
+
+	if(!DpRt_Abort_Check("Expose_Frame_Read"))
+		return FALSE;
+	config = &(context->Config);
+	DpRt_Fits_Lock();
+	if(frame->Input_Pixels == NULL)
+		retval = DpRt_Fits_Header_Read(frame->Input_Filename,&(frame->Header));
+	else
+		retval = TRUE;
+	if(retval)
+	{
+		retval = DpRt_Cache_Master_Get(DPRT_CACHE_TYPE_BIAS,frame->Header.X_Bin,frame->Header.Y_Bin,
+					       frame->Header.Naxis1,frame->Header.Naxis2,&bias);
+	}
+	if(retval)
+	{
+		retval = DpRt_Cache_Master_Get(DPRT_CACHE_TYPE_FLAT,frame->Header.X_Bin,frame->Header.Y_Bin,
+					       frame->Header.Naxis1,frame->Header.Naxis2,&flat);
+		if(!retval)
+			DpRt_Cache_Master_Release(bias);
+	}
+	DpRt_Fits_Unlock();
+	if(!retval)
+		return FALSE;
+	if(bias == NULL)
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"Expose_Frame_Read:No master bias for binning %dx%d.",frame->Header.X_Bin,
+			frame->Header.Y_Bin);
+	}
+	if(flat == NULL)
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"Expose_Frame_Read:No master flat for binning %dx%d.",frame->Header.X_Bin,
+			frame->Header.Y_Bin);
+	}
+	trim.X_Start = 0;
+	trim.X_End = frame->Header.Naxis1-1;
+	trim.Y_Start = 0;
+	trim.Y_End = frame->Header.Naxis2-1;
+	if(config->Overscan_Correct && frame->Header.Trim_Section_Found)
+		trim = frame->Header.Trim_Section;
+	trim_naxis1 = trim.X_End-trim.X_Start+1;
+	trim_naxis2 = trim.Y_End-trim.Y_Start+1;
+	trimmed = ((trim_naxis1 != frame->Header.Naxis1)||(trim_naxis2 != frame->Header.Naxis2));
+	pixel_count = ((long)trim_naxis1)*trim_naxis2;
+	if(!DpRt_Context_Scratch_Get(context,frame->Scratch_Slot,pixel_count,&(frame->Frame),
+				     &(frame->Saturation_Mask)))
+	{
+		DpRt_Cache_Master_Release(bias);
+		DpRt_Cache_Master_Release(flat);
 		return FALSE;
-	fprintf(stdout,"DpRt_Make_Master_Flat:Make Master Flat Flag:%d\n",make_master_flat);
-	if(make_master_flat)
+	}
+	overscan.Level = NULL;
+	DpRt_Kernel_Calibrate_Stats_Initialise(&stats);
+	DpRt_Abort_Checkpoint_Initialise(&checkpoint);
+	if(frame->Input_Pixels == NULL)
+	{
+		DpRt_Fits_Lock();
+		retval = DpRt_Fits_Reader_Open(frame->Input_Filename,&reader);
+		DpRt_Fits_Unlock();
+	}
+	else
+	{
+		retval = DpRt_Fits_Reader_Open_Buffer(frame->Input_Pixels,frame->Header.Naxis1,frame->Header.Naxis2,
+						      frame->Input_Pixel_Format,&reader);
+	}
+	if(retval && config->Overscan_Correct)
+		retval = Expose_Frame_Overscan_Fit(frame,config,&reader,bias,&overscan);
+	if(retval && (overscan.Level != NULL))
+	{
+		overscan_row = (float *)malloc(trim_naxis1*sizeof(float));
+		if(overscan_row == NULL)
+		{
+			DpRt_Error_Number = 120;
+			sprintf(DpRt_Error_String,"Expose_Frame_Read:Failed to allocate overscan row(%d).",trim_naxis1);
+			retval = FALSE;
+		}
+	}
+	while(retval)
 	{
-		fprintf(stdout,"DpRt_Make_Master_Flat:Calling Make Master Flat routine.\n");
-		/* call make master flat routine here */
+		/* a memory mapped or in memory frame does not use cfitsio, so only a cfitsio read takes the lock */
+		if(reader.Data == NULL)
+			DpRt_Fits_Lock();
+		retval = DpRt_Fits_Reader_Read_Block(&reader,&block,&start_row,&row_count);
+		if(reader.Data == NULL)
+			DpRt_Fits_Unlock();
+		if((!retval)||(row_count == 0))
+			break;
+		retval = DpRt_Abort_Checkpoint(&checkpoint,((long)row_count)*reader.Naxis1,"Expose_Frame_Read");
+		if(!retval)
+			break;
+		DpRt_Metrics_Timer_Start(&start_time);
+		if((!trimmed)&&(overscan_row == NULL))
+		{
+			first_pixel = ((long)start_row)*reader.Naxis1;
+			DpRt_Kernel_Calibrate_Block(block,reader.Pixel_Format,(bias != NULL) ? bias+first_pixel : NULL,
+						    (flat != NULL) ? flat+first_pixel : NULL,NULL,
+						    ((long)row_count)*reader.Naxis1,(float)(config->Saturation_Level),
+						    frame->Saturation_Mask,first_pixel,frame->Frame+first_pixel,&stats);
+		}
+		else
+		{
+			/* calibrate the trimmed part of each row, through views of the block and master frames */
+			for(row = 0; row < row_count; row++)
+			{
+				y = start_row+row;
+				if((y < trim.Y_Start)||(y > trim.Y_End))
+					continue;
+				first_pixel = (((long)y)*reader.Naxis1)+trim.X_Start;
+				output_pixel = ((long)(y-trim.Y_Start))*trim_naxis1;
+				if(overscan_row != NULL)
+					DpRt_Overscan_Row_Get(&overscan,y,trim.X_Start,trim_naxis1,overscan_row);
+				DpRt_Kernel_Calibrate_Block(block+(((long)row)*reader.Naxis1)+trim.X_Start,
+							    reader.Pixel_Format,(bias != NULL) ? bias+first_pixel : NULL,
+							    (flat != NULL) ? flat+first_pixel : NULL,overscan_row,
+							    trim_naxis1,(float)(config->Saturation_Level),
+							    frame->Saturation_Mask,output_pixel,frame->Frame+output_pixel,
+							    &stats);
+			}
+		}
+		DpRt_Metrics_Timer_Stop(DPRT_METRICS_STAGE_CALIBRATE,&start_time);
 	}
+	DpRt_Fits_Lock();
+	if(retval)
+		retval = DpRt_Fits_Reader_Close(&reader);
 	else
+		DpRt_Fits_Reader_Close(&reader);
+	DpRt_Fits_Unlock();
+	DpRt_Cache_Master_Release(bias);
+	DpRt_Cache_Master_Release(flat);
+	overscan_level = DpRt_Overscan_Level_Mean(&overscan);
+	DpRt_Overscan_Free(&overscan);
+	if(overscan_row != NULL)
+		free(overscan_row);
+	if(!retval)
+		return FALSE;
+	if(config->Overscan_Correct)
 	{
-		fprintf(stdout,"DpRt_Make_Master_Flat:Make Master Flat Flag was FALSE:Not making master flat.\n");
+		DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"Expose_Frame_Read:Overscan bias level %.2f:Kept [%d:%d,%d:%d] of "
+			"(%d,%d).",overscan_level,trim.X_Start+1,trim.X_End+1,trim.Y_Start+1,trim.Y_End+1,
+			frame->Header.Naxis1,frame->Header.Naxis2);
 	}
+	frame->Header.Naxis1 = trim_naxis1;
+	frame->Header.Naxis2 = trim_naxis2;
+	frame->X_Offset = trim.X_Start;
+	frame->Y_Offset = trim.Y_Start;
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"Expose_Frame_Read:Calibrated %ld pixels:Mean %.2f:Sigma %.2f:Minimum %.2f:"
+		"Maximum %.2f:%ld saturated.",stats.Count,DpRt_Kernel_Calibrate_Stats_Mean(&stats),
+		DpRt_Kernel_Calibrate_Stats_Sigma(&stats),stats.Minimum,stats.Maximum,stats.Saturated_Count);
+	/* an empty mask need not be tested for every aperture pixel */
+	if(stats.Saturated_Count == 0)
+		frame->Saturation_Mask = NULL;
 	return TRUE;
 }
 
-/* ------------------------------------------------------- */
-/* internal functions */
-/* ------------------------------------------------------- */
+/**
+ * Fit the overscan bias model of a frame being read. The frame's overscan region (BIASSEC) is read through the
+ * reader and fitted. If there is a master bias, the model fitted to the same region of the master bias is
+ * subtracted, as the master bias already holds the bias level of the bias frames it was made from. Subtracting
+ * both the model and the master bias then removes the structure of the master bias and the frame's own bias
+ * level, rather than the bias level twice. A frame without a BIASSEC keyword is not an error, the model is just
+ * not fitted.
+ * @param frame The address of the frame structure, with Header filled in.
+ * @param config The configuration snapshot, giving Overscan_Smooth.
+ * @param reader The address of the frame's open reader.
+ * @param bias The master bias of the frame's binning, with the raw frame's dimensions, or NULL.
+ * @param overscan The address of the model to fill in. Level is left NULL if no model was fitted.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Expose_Frame_Read
+ * @see dprt_fits.html#DpRt_Fits_Reader_Read_Section
+ * @see dprt_overscan.html#DpRt_Overscan_Fit
+ * @see dprt_overscan.html#DpRt_Overscan_Level_Subtract
+ */
+static int Expose_Frame_Overscan_Fit(struct Expose_Frame_Struct *frame,struct DpRt_Config_Struct *config,
+				     struct DpRt_Fits_Reader_Struct *reader,float *bias,
+				     struct DpRt_Overscan_Struct *overscan)
+{
+	struct DpRt_Fits_Section_Struct *section = NULL;
+	struct DpRt_Overscan_Struct reference;
+	float *data = NULL;
+	int width,height,retval;
+
+	overscan->Level = NULL;
+	if(!frame->Header.Bias_Section_Found)
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"Expose_Frame_Overscan_Fit:No BIASSEC:Overscan not subtracted.");
+		return TRUE;
+	}
+	section = &(frame->Header.Bias_Section);
+	width = section->X_End-section->X_Start+1;
+	height = section->Y_End-section->Y_Start+1;
+	data = (float *)malloc(((size_t)width)*height*sizeof(float));
+	if(data == NULL)
+	{
+		DpRt_Error_Number = 121;
+		sprintf(DpRt_Error_String,"Expose_Frame_Overscan_Fit:Failed to allocate overscan region(%d,%d).",width,
+			height);
+		return FALSE;
+	}
+	DpRt_Fits_Lock();
+	retval = DpRt_Fits_Reader_Read_Section(reader,section,data);
+	DpRt_Fits_Unlock();
+	if(retval)
+		retval = DpRt_Overscan_Fit(data,width,section,config->Overscan_Smooth,overscan);
+	free(data);
+	if(retval && (bias != NULL))
+	{
+		reference.Level = NULL;
+		retval = DpRt_Overscan_Fit(bias+(((size_t)section->Y_Start)*frame->Header.Naxis1)+section->X_Start,
+					   frame->Header.Naxis1,section,config->Overscan_Smooth,&reference);
+		DpRt_Overscan_Level_Subtract(overscan,&reference);
+		DpRt_Overscan_Free(&reference);
+	}
+	if(!retval)
+		DpRt_Overscan_Free(overscan);
+	return retval;
+}
+
+/**
+ * Extract stage of a full reduction. If the configuration asks for it, cosmic rays are first rejected from the
+ * calibrated frame by DpRt_Cosmic_Reject, which records them in a mask and leaves the frame unchanged. The
+ * spectral trace is then found and the spectrum optimally extracted, ignoring saturated and cosmic ray pixels.
+ * The counts and position of the spectrum are then measured. No cfitsio routines are called.
+ * @param frame The address of the frame structure, filled in by Expose_Frame_Read. Cosmic_Mask, Cosmic_Count,
+ *        Found, Spectrum, Seeing, Counts, X_Pix, Y_Pix and Saturated are filled in.
+ * @param context The reduction context.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Expose_Frame_Struct
+ * @see #Expose_Frame_Read
+ * @see dprt_context.html#DpRt_Context_Cosmic_Mask_Get
+ * @see dprt_cosmic.html#DpRt_Cosmic_Reject
+ * @see dprt_extract.html#DpRt_Extract_Trace_Find
+ * @see dprt_extract.html#DpRt_Extract_Optimal
+ * @see dprt_extract.html#DpRt_Extract_Trace_Centre_Get
+ * @see dprt_metrics.html#DpRt_Metrics_Timer_Stop
+ */
+static int Expose_Frame_Extract(struct Expose_Frame_Struct *frame,struct DpRt_Context_Struct *context)
+{
+	struct DpRt_Config_Struct *config = NULL;
+	struct DpRt_Extract_Trace_Struct trace;
+	struct DpRt_Cosmic_Parameter_Struct cosmic_parameters;
+	struct timespec start_time;
+	double weight,weighted_sum;
+	long pixel;
+	int retval;
+
+	config = &(context->Config);
+	if(config->Cosmic_Reject)
+	{
+		DpRt_Metrics_Timer_Start(&start_time);
+		if(!DpRt_Context_Cosmic_Mask_Get(context,frame->Scratch_Slot,
+						 ((long)frame->Header.Naxis1)*((long)frame->Header.Naxis2),
+						 &(frame->Cosmic_Mask)))
+			return FALSE;
+		cosmic_parameters.Gain = config->Gain;
+		cosmic_parameters.Read_Noise = config->Read_Noise;
+		cosmic_parameters.Sigma_Clip = config->Cosmic_Sigma_Clip;
+		cosmic_parameters.Sigma_Fraction = config->Cosmic_Sigma_Fraction;
+		cosmic_parameters.Object_Limit = config->Cosmic_Object_Limit;
+		cosmic_parameters.Iteration_Count = config->Cosmic_Iterations;
+		if(!DpRt_Cosmic_Reject(frame->Frame,frame->Saturation_Mask,frame->Header.Naxis1,frame->Header.Naxis2,
+				       &cosmic_parameters,frame->Cosmic_Mask,&(frame->Cosmic_Count)))
+			return FALSE;
+		DpRt_Metrics_Timer_Stop(DPRT_METRICS_STAGE_COSMIC,&start_time);
+		DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"Expose_Frame_Extract:Rejected %ld cosmic ray pixels.",
+			frame->Cosmic_Count);
+	}
+	DpRt_Metrics_Timer_Start(&start_time);
+	retval = DpRt_Extract_Trace_Find(frame->Frame,frame->Header.Naxis1,frame->Header.Naxis2,config->Trace_Order,
+					 &trace,&(frame->Found));
+	if(retval && frame->Found)
+	{
+		retval = DpRt_Extract_Optimal(frame->Frame,frame->Saturation_Mask,frame->Cosmic_Mask,
+					      frame->Header.Naxis1,frame->Header.Naxis2,&trace,config->Gain,
+					      config->Read_Noise,&(frame->Spectrum));
+	}
+	if(retval && frame->Found)
+	{
+		weight = 0.0;
+		weighted_sum = 0.0;
+		for(pixel = 0; pixel < frame->Spectrum.Length; pixel++)
+		{
+			if(frame->Spectrum.Flux[pixel] > 0.0f)
+			{
+				weight += frame->Spectrum.Flux[pixel];
+				weighted_sum += frame->Spectrum.Flux[pixel]*pixel;
+			}
+		}
+		if(weight > 0.0)
+			frame->X_Pix = weighted_sum/weight;
+		else
+			frame->X_Pix = (frame->Spectrum.Length-1)/2.0;
+		/* positions are reported in the raw frame, whether or not it was trimmed */
+		frame->Y_Pix = DpRt_Extract_Trace_Centre_Get(&trace,frame->X_Pix)+1.0+frame->Y_Offset;
+		frame->X_Pix += 1.0+frame->X_Offset;
+		frame->Seeing = trace.Fwhm;
+		frame->Counts = frame->Spectrum.Peak_Counts;
+		frame->Saturated = frame->Spectrum.Saturated;
+		DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"Expose_Frame_Extract:Spectrum extracted:Position (%.2f,%.2f):Counts %.1f:"
+			"Seeing %.2f:Sky %.1f:Saturated %d:%ld pixels rejected.",frame->X_Pix,frame->Y_Pix,frame->Counts,
+			frame->Seeing,frame->Spectrum.Sky_Level,frame->Saturated,frame->Spectrum.Rejected_Count);
+	}
+	if(retval)
+		DpRt_Metrics_Timer_Stop(DPRT_METRICS_STAGE_EXTRACT,&start_time);
+	return retval;
+}
+
+/**
+ * Write stage of a full reduction. The reduced frame is written to the frame's Output_Filename, with the
+ * spectrum and its variance in extensions. If a wavelength solution has been fitted to an arc of the same
+ * binning, the wavelength of each spectrum pixel is copied from its lookup table into a further extension.
+ * The reduced frame is tile compressed if the writer compression property is set.
+ * The write routines take the cfitsio lock around each of their cfitsio calls (each block of rows, in the case of
+ * the reduced frame), so this stage runs alongside the read stage of another frame rather than holding it up for
+ * the whole write. The abort generation is polled before and during the write of the reduced frame.
+ * @param frame The address of the frame structure, filled in by Expose_Frame_Read and Expose_Frame_Extract.
+ * @param context The reduction context.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Expose_Frame_Struct
+ * @see #Expose_Frame_Extract
+ * @see dprt_fits.html#DpRt_Fits_Write_Reduced_Image
+ * @see dprt_fits.html#DpRt_Fits_Write_Spectrum
+ * @see dprt_wavelength.html#DpRt_Wavelength_Lut_Get
+ * @see dprt_abort.html#DpRt_Abort_Check
+ * @see dprt_metrics.html#DpRt_Metrics_Timer_Stop
+ */
+static int Expose_Frame_Write(struct Expose_Frame_Struct *frame,struct DpRt_Context_Struct *context)
+{
+	struct DpRt_Extract_Spectrum_Struct *spectrum = NULL;
+	struct timespec start_time;
+	int calibrated,retval;
+
+	if(!DpRt_Abort_Check("Expose_Frame_Write"))
+		return FALSE;
+	DpRt_Metrics_Timer_Start(&start_time);
+	retval = DpRt_Fits_Write_Reduced_Image(frame->Input_Filename,frame->Output_Filename,frame->Header.Naxis1,
+					       frame->Header.Naxis2,frame->Frame,context->Config.Writer_Compression);
+	if(retval && frame->Found)
+	{
+		spectrum = &(frame->Spectrum);
+		retval = DpRt_Fits_Write_Spectrum(frame->Output_Filename,"SPECTRUM",spectrum->Flux,spectrum->Length);
+		if(retval)
+		{
+			retval = DpRt_Fits_Write_Spectrum(frame->Output_Filename,"VARIANCE",spectrum->Variance,
+							  spectrum->Length);
+		}
+		/* the variance is no longer needed, reuse it for the wavelength of each spectrum pixel */
+		if(retval)
+		{
+			retval = DpRt_Wavelength_Lut_Get(frame->Header.X_Bin,frame->Header.Y_Bin,spectrum->Length,
+							 spectrum->Variance,&calibrated);
+		}
+		if(retval && calibrated)
+		{
+			retval = DpRt_Fits_Write_Spectrum(frame->Output_Filename,"WAVELENGTH",spectrum->Variance,
+							  spectrum->Length);
+		}
+		if(retval && (!calibrated))
+		{
+			DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"Expose_Frame_Write:No wavelength solution for binning %dx%d.",
+				frame->Header.X_Bin,frame->Header.Y_Bin);
+		}
+	}
+	if(!retval)
+		return FALSE;
+	DpRt_Metrics_Timer_Stop(DPRT_METRICS_STAGE_WRITE,&start_time);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"Expose_Frame_Write:Reduced %s to %s.",frame->Input_Filename,
+		frame->Output_Filename);
+	return TRUE;
+}
+
+/**
+ * Write stage of a full reduction, used in place of Expose_Frame_Write when the writer async property is set.
+ * The wavelength of each spectrum pixel is looked up as in Expose_Frame_Write, then the reduced frame and its
+ * spectrum are copied into the background writer's queue. The frame is written later, by a writer thread;
+ * write failures are reported by DpRt_Writer_Flush and DpRt_Writer_Status_Get.
+ * @param frame The address of the frame structure, filled in by Expose_Frame_Read and Expose_Frame_Extract.
+ * @param context The reduction context.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Expose_Frame_Struct
+ * @see #Expose_Frame_Write
+ * @see dprt_writer.html#DpRt_Writer_Submit
+ * @see dprt_wavelength.html#DpRt_Wavelength_Lut_Get
+ * @see dprt_abort.html#DpRt_Abort_Check
+ */
+static int Expose_Frame_Queue(struct Expose_Frame_Struct *frame,struct DpRt_Context_Struct *context)
+{
+	struct DpRt_Extract_Spectrum_Struct *spectrum = NULL;
+	float *wavelength = NULL;
+	int calibrated,retval;
+
+	if(!DpRt_Abort_Check("Expose_Frame_Queue"))
+		return FALSE;
+	if(!frame->Found)
+	{
+		return DpRt_Writer_Submit(&(context->Config),frame->Input_Filename,frame->Output_Filename,
+					  frame->Header.Naxis1,frame->Header.Naxis2,frame->Frame,NULL,NULL,NULL,0);
+	}
+	spectrum = &(frame->Spectrum);
+	wavelength = (float *)malloc(spectrum->Length*sizeof(float));
+	if(wavelength == NULL)
+	{
+		DpRt_Error_Number = 119;
+		sprintf(DpRt_Error_String,"Expose_Frame_Queue:Failed to allocate wavelengths(%d).",spectrum->Length);
+		return FALSE;
+	}
+	retval = DpRt_Wavelength_Lut_Get(frame->Header.X_Bin,frame->Header.Y_Bin,spectrum->Length,wavelength,
+					 &calibrated);
+	if(retval && (!calibrated))
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"Expose_Frame_Queue:No wavelength solution for binning %dx%d.",
+			frame->Header.X_Bin,frame->Header.Y_Bin);
+	}
+	if(retval)
+	{
+		retval = DpRt_Writer_Submit(&(context->Config),frame->Input_Filename,frame->Output_Filename,
+					    frame->Header.Naxis1,frame->Header.Naxis2,frame->Frame,spectrum->Flux,
+					    spectrum->Variance,calibrated ? wavelength : NULL,spectrum->Length);
+	}
+	free(wavelength);
+	return retval;
+}
+
+/**
+ * Quick reduction stage, used in place of the read, extract and write stages by DpRt_Expose_Reduce_Batch when
+ * the full reduction flag is not set. The spectrum's counts, position and saturation are measured from a
+ * decimated subset of the frame, and the frame is not modified. The frame's Output_Filename is set to a copy of
+ * its Input_Filename. The quick reduction takes the cfitsio lock around each of its cfitsio calls, inside its
+ * time budget.
+ * @param frame The address of the frame structure.
+ * @param context The reduction context.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Expose_Frame_Struct
+ * @see dprt_quick.html#DpRt_Quick_Reduce
+ */
+static int Expose_Frame_Quick(struct Expose_Frame_Struct *frame,struct DpRt_Context_Struct *context)
+{
+	struct DpRt_Quick_Result_Struct quick_result;
+
+	if(!DpRt_Quick_Reduce(frame->Input_Filename,&(context->Config),&quick_result))
+		return FALSE;
+	frame->Seeing = quick_result.Fwhm;
+	frame->Counts = quick_result.Counts;
+	frame->X_Pix = quick_result.X_Pix;
+	frame->Y_Pix = quick_result.Y_Pix;
+	frame->Saturated = quick_result.Saturated;
+	frame->Output_Filename = (char*)malloc((strlen(frame->Input_Filename)+1)*sizeof(char));
+	if(frame->Output_Filename == NULL)
+	{
+		DpRt_Error_Number = 113;
+		strcpy(DpRt_Error_String,"Expose_Frame_Quick:output filename was NULL.");
+		return FALSE;
+	}
+	strcpy(frame->Output_Filename,frame->Input_Filename);
+	return TRUE;
+}
+
+/**
+ * Free the buffers held by an expose frame structure. The frame and its saturation mask are in the context's
+ * scratch buffers, and are kept for the next frame.
+ * @param frame The address of the frame structure.
+ * @see #Expose_Frame_Struct
+ * @see dprt_extract.html#DpRt_Extract_Spectrum_Free
+ */
+static void Expose_Frame_Free(struct Expose_Frame_Struct *frame)
+{
+	if(frame->Output_Filename != NULL)
+		free(frame->Output_Filename);
+	frame->Output_Filename = NULL;
+	frame->Frame = NULL;
+	frame->Saturation_Mask = NULL;
+	frame->Cosmic_Mask = NULL;
+	DpRt_Extract_Spectrum_Free(&(frame->Spectrum));
+}
+
+/**
+ * Run one reduction stage on a frame, from a stage thread or inline. The stage is only
+ * run if all the frame's previous stages succeeded. The frame's error state is bound to the calling thread while
+ * the stage runs, so if the stage fails its error is left in the frame structure, and the frame is marked as
+ * unsuccessful.
+ * @param user_arg The address of an Expose_Stage_Struct.
+ * @return NULL.
+ * @see #Expose_Stage_Struct
+ * @see dprt_context.html#DpRt_Error_Bind
+ */
+static void *Expose_Stage_Run(void *user_arg)
+{
+	struct Expose_Stage_Struct *stage = NULL;
+	struct Expose_Frame_Struct *frame = NULL;
+	struct DpRt_Error_Struct *previous_error = NULL;
+
+	stage = (struct Expose_Stage_Struct *)user_arg;
+	frame = stage->Frame;
+	if(!frame->Successful)
+		return NULL;
+	previous_error = DpRt_Error_Bind(&(frame->Error));
+	if(!(*(stage->Stage))(frame,stage->Context))
+		frame->Successful = FALSE;
+	DpRt_Error_Bind(previous_error);
+	return NULL;
+}
+
+/**
+ * The start routine of a batch stage thread. The thread waits for each step of the pipeline to be started, runs
+ * its stage on the step's frame (if it has one), and reports that it has finished the step, until it is told
+ * to exit. The stage's Frame is set for each step while the pipeline's mutex is held, before the step is started.
+ * @param user_arg The address of an Expose_Stage_Struct, whose Pipeline is set.
+ * @return NULL.
+ * @see #Expose_Pipeline_Struct
+ * @see #Expose_Stage_Struct
+ * @see #Expose_Stage_Run
+ * @see #Expose_Reduce_Batch
+ */
+static void *Expose_Stage_Thread(void *user_arg)
+{
+	struct Expose_Stage_Struct *stage = NULL;
+	struct Expose_Pipeline_Struct *pipeline = NULL;
+	int step;
+
+	stage = (struct Expose_Stage_Struct *)user_arg;
+	pipeline = stage->Pipeline;
+	/* the thread is created before the first step is started */
+	step = 0;
+	pthread_mutex_lock(&(pipeline->Mutex));
+	while(TRUE)
+	{
+		while((pipeline->Step == step)&&(!pipeline->Exit))
+			pthread_cond_wait(&(pipeline->Condition),&(pipeline->Mutex));
+		if(pipeline->Exit)
+			break;
+		step = pipeline->Step;
+		pthread_mutex_unlock(&(pipeline->Mutex));
+		if(stage->Frame != NULL)
+			Expose_Stage_Run(stage);
+		pthread_mutex_lock(&(pipeline->Mutex));
+		pipeline->Done_Count++;
+		pthread_cond_broadcast(&(pipeline->Condition));
+	}
+	pthread_mutex_unlock(&(pipeline->Mutex));
+	return NULL;
+}
+
+/**
+ * Get the filename a reduced frame is written to. An input filename ending in DPRT_RAW_FILENAME_SUFFIX has this
+ * replaced by DPRT_REDUCED_FILENAME_SUFFIX, otherwise the ".fits" extension is replaced by
+ * DPRT_REDUCED_FILENAME_SUFFIX.
+ * @param input_filename The FITS filename to be processed.
+ * @param output_filename The address of a character pointer, set to an allocated string containing the
+ *        reduced filename. This should be freed by the caller.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DPRT_RAW_FILENAME_SUFFIX
+ * @see #DPRT_REDUCED_FILENAME_SUFFIX
+ */
+static int Expose_Reduce_Filename_Get(char *input_filename,char **output_filename)
+{
+	size_t length;
+
+	length = strlen(input_filename);
+	(*output_filename) = (char*)malloc((length+strlen(DPRT_REDUCED_FILENAME_SUFFIX)+1)*sizeof(char));
+	if((*output_filename) == NULL)
+	{
+		DpRt_Error_Number = 109;
+		strcpy(DpRt_Error_String,"Expose_Reduce_Filename_Get:output filename was NULL.");
+		return FALSE;
+	}
+	strcpy((*output_filename),input_filename);
+	if((length >= strlen(DPRT_RAW_FILENAME_SUFFIX))&&
+	   (strcmp(input_filename+length-strlen(DPRT_RAW_FILENAME_SUFFIX),DPRT_RAW_FILENAME_SUFFIX) == 0))
+	{
+		length -= strlen(DPRT_RAW_FILENAME_SUFFIX);
+	}
+	else if((length >= strlen(".fits"))&&(strcmp(input_filename+length-strlen(".fits"),".fits") == 0))
+	{
+		length -= strlen(".fits");
+	}
+	strcpy((*output_filename)+length,DPRT_REDUCED_FILENAME_SUFFIX);
+	return TRUE;
+}
 
 /*
 ** $Log: not supported by cvs2svn $
@@ -0,0 +1,143 @@
+/* dprt_abort.c
+** Cooperative abort checkpoints for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_abort.c holds the abort generation used to abort the reductions in progress. Each abort requested
+ * through the JNI DpRt_Abort call increments the generation. A reduction records the generation it started
+ * in, in the error state bound to its threads, and is aborted once the generation has moved on. Starting a
+ * new reduction therefore never cancels an abort requested for another one. The generation is a single word
+ * that is polled without taking a lock, so the reduction loops can afford to poll it often. Each long running
+ * loop polls it through a checkpoint every "dprt.abort.check_pixels" pixels processed. A loop that sees an
+ * abort frees its buffers and returns FALSE with the error number DPRT_ABORT_ERROR_NUMBER, so the abort
+ * latency is bounded by the time taken to process that many pixels, rather than by the length of the
+ * reduction.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_config.h"
+#include "dprt_abort.h"
+#include "dprt_context.h"
+#include "dprt_metrics.h"
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The abort generation, incremented by each abort request. It starts at 1, as an error state with a generation
+ * of 0 is not running a reduction. An aligned word is read in a single access, and it is volatile so each
+ * poll re-reads it, hence the reduction threads can poll it without a lock.
+ * @see #Abort_Mutex
+ */
+static volatile unsigned long Abort_Generation = 1;
+/**
+ * Mutex serialising increments of Abort_Generation, so two abort requests are not lost to each other.
+ */
+static pthread_mutex_t Abort_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Request an abort of every reduction in progress. Each stops at its next checkpoint. Reductions started
+ * afterwards are not affected.
+ * @see #Abort_Generation
+ * @see #Abort_Mutex
+ */
+void DpRt_Abort_Request(void)
+{
+	pthread_mutex_lock(&Abort_Mutex);
+	Abort_Generation++;
+	pthread_mutex_unlock(&Abort_Mutex);
+}
+
+/**
+ * Get the current abort generation. A reduction records this when it starts, in its error state's
+ * Abort_Generation, and is aborted once the generation differs from it.
+ * @return The current abort generation, which is never 0.
+ * @see #Abort_Generation
+ */
+unsigned long DpRt_Abort_Generation_Get(void)
+{
+	return Abort_Generation;
+}
+
+/**
+ * Initialise a checkpoint, taking its granularity from the configuration snapshot.
+ * @param checkpoint The address of the checkpoint to initialise.
+ * @see dprt_config.html#DpRt_Config_Get
+ */
+void DpRt_Abort_Checkpoint_Initialise(struct DpRt_Abort_Checkpoint_Struct *checkpoint)
+{
+	struct DpRt_Config_Struct config;
+
+	if(checkpoint == NULL)
+		return;
+	DpRt_Config_Get(&config);
+	checkpoint->Granularity = config.Abort_Check_Pixels;
+	if(checkpoint->Granularity < 1)
+		checkpoint->Granularity = DPRT_CONFIG_ABORT_CHECK_PIXELS_DEFAULT;
+	checkpoint->Pixel_Count = 0;
+}
+
+/**
+ * Record that a loop has processed some more pixels, and poll the abort generation if at least the checkpoint's
+ * granularity of pixels have been processed since it was last polled.
+ * @param checkpoint The address of an initialised checkpoint.
+ * @param pixel_count The number of pixels processed since the last call.
+ * @param function_name The name of the calling function, used in the error string. If this is NULL the error
+ *        number and string are not set, for worker threads that report errors through their own structures.
+ * @return The routine returns TRUE if the loop should continue, and FALSE if an abort has been requested.
+ * @see #DpRt_Abort_Check
+ */
+int DpRt_Abort_Checkpoint(struct DpRt_Abort_Checkpoint_Struct *checkpoint,long pixel_count,char *function_name)
+{
+	checkpoint->Pixel_Count += pixel_count;
+	if(checkpoint->Pixel_Count < checkpoint->Granularity)
+		return TRUE;
+	checkpoint->Pixel_Count = 0;
+	return DpRt_Abort_Check(function_name);
+}
+
+/**
+ * Poll the abort generation. If an abort has been requested since the reduction bound to the calling thread
+ * started (the generation no longer matches the error state's Abort_Generation), the error number is set to
+ * DPRT_ABORT_ERROR_NUMBER. A thread whose error state has an Abort_Generation of 0 is not running a reduction,
+ * and is never aborted.
+ * @param function_name The name of the calling function, used in the error string. If this is NULL the error
+ *        number and string are not set, and the abort is not counted.
+ * @return The routine returns TRUE if the caller should continue, and FALSE if an abort has been requested.
+ * @see #Abort_Generation
+ * @see dprt_context.html#DpRt_Error_Current_Get
+ * @see dprt_abort.h#DPRT_ABORT_ERROR_NUMBER
+ * @see dprt_metrics.html#DpRt_Metrics_Count_Add
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Abort_Check(char *function_name)
+{
+	struct DpRt_Error_Struct *error = NULL;
+
+	error = DpRt_Error_Current_Get();
+	if((error->Abort_Generation == 0)||(error->Abort_Generation == Abort_Generation))
+		return TRUE;
+	if(function_name != NULL)
+	{
+		DpRt_Error_Number = DPRT_ABORT_ERROR_NUMBER;
+		sprintf(DpRt_Error_String,"%s:Aborted.",function_name);
+		DpRt_Metrics_Count_Add(DPRT_METRICS_COUNTER_ABORTS,1);
+	}
+	return FALSE;
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
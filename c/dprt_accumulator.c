@@ -0,0 +1,628 @@
+/* dprt_accumulator.c
+** Running master bias accumulator for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_accumulator.c builds a master bias for each binning as the biases are reduced, so DpRt_Make_Master_Bias
+ * only has to write it, rather than re-read every bias in the directory. Each binning has a resident running mean
+ * of each pixel, updated (with Welford's method) with each bias DpRt_Calibrate_Reduce reads. The bias's pixels
+ * are staged as they are read, and only added to the running mean once the whole bias has been read, so a bias
+ * whose reduction fails or is aborted leaves the master untouched.
+ * A streaming median would need the history of each pixel, so outliers are removed with a running sigma
+ * clip instead: a pixel further than DPRT_ACCUMULATOR_CLIP_SIGMA standard deviations from its running mean is
+ * left out, the standard deviation being the larger of the read noise and the pooled scatter of the pixels
+ * about their running means. No value is clipped until a pixel's running mean has two values, as one value
+ * cannot tell the outlier from the bias. Each pixel counts its rejected values; once it has rejected as many as
+ * it has accepted, its running mean is assumed to be the outlier (e.g. a cosmic ray in the first bias), and it
+ * restarts from the latest value. This also lets the master follow a bias level that drifts during the night.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_fits.h"
+#include "dprt_kernel.h"
+#include "dprt_master.h"
+#include "dprt_accumulator.h"
+#include "dprt_context.h"
+#include "dprt_log.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The value of the OBSTYPE keyword written to the master biases.
+ */
+#define ACCUMULATOR_BIAS_OBSTYPE	("BIAS")
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding the running master bias of one binning.
+ * <dl>
+ * <dt>X_Bin</dt> <dd>The X binning of the biases.</dd>
+ * <dt>Y_Bin</dt> <dd>The Y binning of the biases.</dd>
+ * <dt>Naxis1</dt> <dd>The number of columns in the biases.</dd>
+ * <dt>Naxis2</dt> <dd>The number of rows in the biases.</dd>
+ * <dt>Frame_Count</dt> <dd>The number of biases completely added since the entry was last reset.</dd>
+ * <dt>Mean</dt> <dd>The running mean of each pixel, Naxis1*Naxis2 values. This is the master bias.</dd>
+ * <dt>M2</dt> <dd>The sum of squared differences from the running mean of each pixel.</dd>
+ * <dt>Count</dt> <dd>The number of values accepted into the running mean of each pixel.</dd>
+ * <dt>Rejected</dt> <dd>The number of values of each pixel clipped since its running mean was last restarted.</dd>
+ * <dt>M2_Sum</dt> <dd>The sum of M2 over all the pixels.</dd>
+ * <dt>Degrees_Of_Freedom</dt> <dd>The sum of Count-1 over all the pixels with values, so the pooled variance
+ *     of the pixels about their running means is M2_Sum/Degrees_Of_Freedom.</dd>
+ * <dt>Next</dt> <dd>The next entry in the list.</dd>
+ * </dl>
+ */
+struct Accumulator_Entry_Struct
+{
+	int X_Bin;
+	int Y_Bin;
+	int Naxis1;
+	int Naxis2;
+	int Frame_Count;
+	float *Mean;
+	float *M2;
+	unsigned short *Count;
+	unsigned short *Rejected;
+	double M2_Sum;
+	double Degrees_Of_Freedom;
+	struct Accumulator_Entry_Struct *Next;
+};
+
+/**
+ * Structure holding a copy of the running master bias of one binning, taken by DpRt_Accumulator_Master_Write so
+ * the master can be written without holding Accumulator_Mutex.
+ * <dl>
+ * <dt>X_Bin</dt> <dd>The X binning of the biases.</dd>
+ * <dt>Y_Bin</dt> <dd>The Y binning of the biases.</dd>
+ * <dt>Naxis1</dt> <dd>The number of columns in the biases.</dd>
+ * <dt>Naxis2</dt> <dd>The number of rows in the biases.</dd>
+ * <dt>Frame_Count</dt> <dd>The number of biases in the running mean when it was copied.</dd>
+ * <dt>Mean</dt> <dd>The copy of the running mean, Naxis1*Naxis2 values.</dd>
+ * <dt>Next</dt> <dd>The next copy in the list.</dd>
+ * </dl>
+ */
+struct Accumulator_Snapshot_Struct
+{
+	int X_Bin;
+	int Y_Bin;
+	int Naxis1;
+	int Naxis2;
+	int Frame_Count;
+	float *Mean;
+	struct Accumulator_Snapshot_Struct *Next;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The list of running master biases, one for each binning.
+ */
+static struct Accumulator_Entry_Struct *Accumulator_Entry_List = NULL;
+/**
+ * Mutex protecting the list of running master biases and their contents.
+ */
+static pthread_mutex_t Accumulator_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static struct Accumulator_Entry_Struct *Accumulator_Entry_Get(int x_bin,int y_bin);
+static struct Accumulator_Entry_Struct *Accumulator_Entry_Create(int x_bin,int y_bin,int naxis1,int naxis2);
+static void Accumulator_Entry_Reset(struct Accumulator_Entry_Struct *entry);
+static void Accumulator_Entry_Free(struct Accumulator_Entry_Struct *entry);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Start adding a bias to the running master bias of its binning. Memory to stage the bias's pixels in is
+ * allocated; nothing is added to the running master until DpRt_Accumulator_Frame_End. Each successful call must be
+ * followed by a call to DpRt_Accumulator_Frame_End or DpRt_Accumulator_Frame_Abort.
+ * @param header The header of the bias, giving its binning and dimensions.
+ * @param read_noise The read noise in counts, the least standard deviation the clip limit is based on.
+ * @param frame The address of a structure to fill in, passed to DpRt_Accumulator_Block_Add and
+ *        DpRt_Accumulator_Frame_End.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Accumulator_Frame_End
+ * @see #DpRt_Accumulator_Frame_Abort
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Accumulator_Frame_Start(struct DpRt_Fits_Header_Struct *header,double read_noise,
+				 struct DpRt_Accumulator_Frame_Struct *frame)
+{
+	if((header == NULL)||(frame == NULL))
+	{
+		DpRt_Error_Number = 1800;
+		strcpy(DpRt_Error_String,"DpRt_Accumulator_Frame_Start:Parameter was NULL.");
+		return FALSE;
+	}
+	frame->X_Bin = header->X_Bin;
+	frame->Y_Bin = header->Y_Bin;
+	frame->Naxis1 = header->Naxis1;
+	frame->Naxis2 = header->Naxis2;
+	frame->Read_Noise = read_noise;
+	frame->Pixel_Count = 0;
+	frame->Pixels = NULL;
+	if((header->Naxis1 > 0)&&(header->Naxis2 > 0))
+	{
+		frame->Pixels = (unsigned short *)malloc(((size_t)header->Naxis1)*header->Naxis2*
+							 sizeof(unsigned short));
+	}
+	if(frame->Pixels == NULL)
+	{
+		DpRt_Error_Number = 1801;
+		sprintf(DpRt_Error_String,"DpRt_Accumulator_Frame_Start:Failed to allocate bias(%d,%d).",
+			header->Naxis1,header->Naxis2);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Stage a block of rows of a bias, to be added to the running master bias of its binning by
+ * DpRt_Accumulator_Frame_End. Accumulator_Mutex is not needed, as the frame belongs to the calling reduction.
+ * @param frame The address of the structure filled in by DpRt_Accumulator_Frame_Start.
+ * @param block The pixels, row_count rows of the frame's width.
+ * @param start_row The frame row of the first row in the block.
+ * @param row_count The number of rows in the block.
+ * @param pixel_format The format of the pixels, a DPRT_KERNEL_PIXEL_FORMAT value.
+ * @see dprt_kernel.h#DPRT_KERNEL_FITS_PIXEL
+ */
+void DpRt_Accumulator_Block_Add(struct DpRt_Accumulator_Frame_Struct *frame,unsigned short *block,
+				int start_row,int row_count,int pixel_format)
+{
+	unsigned short *pixels = NULL;
+	long count,i;
+
+	if((frame == NULL)||(frame->Pixels == NULL)||(block == NULL)||(row_count < 1)||(start_row < 0)||
+	   (start_row+row_count > frame->Naxis2))
+		return;
+	count = ((long)row_count)*frame->Naxis1;
+	pixels = frame->Pixels+(((size_t)start_row)*frame->Naxis1);
+	if(pixel_format == DPRT_KERNEL_PIXEL_FORMAT_FITS)
+	{
+		for(i = 0; i < count; i++)
+			pixels[i] = DPRT_KERNEL_FITS_PIXEL(block+i);
+	}
+	else
+		memcpy(pixels,block,count*sizeof(unsigned short));
+	frame->Pixel_Count += count;
+}
+
+/**
+ * Finish adding a bias to the running master bias of its binning: the staged pixels are added to the running
+ * mean, and the bias counted towards the DPRT_MASTER_FRAME_COUNT_MIN frames needed to write the master. The
+ * running master is created if this is the first bias of the binning, and restarted with this bias if it has
+ * different dimensions (e.g. the detector was windowed). The clip limit is set from the pixels' current scatter.
+ * If not every row of the bias was staged, nothing is added. The staging memory is freed.
+ * @param frame The address of the structure filled in by DpRt_Accumulator_Frame_Start.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Accumulator_Entry_Get
+ * @see #Accumulator_Entry_Create
+ * @see #Accumulator_Entry_Free
+ * @see #DpRt_Accumulator_Frame_Abort
+ * @see dprt_accumulator.h#DPRT_ACCUMULATOR_CLIP_SIGMA
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Accumulator_Frame_End(struct DpRt_Accumulator_Frame_Struct *frame)
+{
+	struct Accumulator_Entry_Struct *entry = NULL;
+	float value,delta,delta2;
+	double sigma,scatter,clip_limit;
+	long count,rejected_count,i;
+	unsigned short n;
+
+	if((frame == NULL)||(frame->Pixels == NULL))
+	{
+		DpRt_Error_Number = 1804;
+		strcpy(DpRt_Error_String,"DpRt_Accumulator_Frame_End:Frame was NULL.");
+		return FALSE;
+	}
+	count = ((long)frame->Naxis1)*frame->Naxis2;
+	if(frame->Pixel_Count != count)
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"DpRt_Accumulator_Frame_End:Only %ld of %ld pixels read:"
+			"Not adding bias with binning %dx%d.",frame->Pixel_Count,count,frame->X_Bin,frame->Y_Bin);
+		DpRt_Accumulator_Frame_Abort(frame);
+		return TRUE;
+	}
+	pthread_mutex_lock(&Accumulator_Mutex);
+	entry = Accumulator_Entry_Get(frame->X_Bin,frame->Y_Bin);
+	if((entry != NULL)&&((entry->Naxis1 != frame->Naxis1)||(entry->Naxis2 != frame->Naxis2)))
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"DpRt_Accumulator_Frame_End:Bias dimensions changed from "
+			"(%d,%d) to (%d,%d) for binning %dx%d:Restarting master bias after %d biases.",entry->Naxis1,
+			entry->Naxis2,frame->Naxis1,frame->Naxis2,frame->X_Bin,frame->Y_Bin,entry->Frame_Count);
+		Accumulator_Entry_Free(entry);
+		entry = NULL;
+	}
+	if(entry == NULL)
+	{
+		entry = Accumulator_Entry_Create(frame->X_Bin,frame->Y_Bin,frame->Naxis1,frame->Naxis2);
+		if(entry == NULL)
+		{
+			pthread_mutex_unlock(&Accumulator_Mutex);
+			DpRt_Accumulator_Frame_Abort(frame);
+			DpRt_Error_Number = 1805;
+			sprintf(DpRt_Error_String,"DpRt_Accumulator_Frame_End:Failed to allocate master bias(%d,%d).",
+				frame->Naxis1,frame->Naxis2);
+			return FALSE;
+		}
+	}
+	sigma = frame->Read_Noise;
+	if(entry->Degrees_Of_Freedom > 0.0)
+	{
+		scatter = sqrt(entry->M2_Sum/entry->Degrees_Of_Freedom);
+		if(scatter > sigma)
+			sigma = scatter;
+	}
+	clip_limit = DPRT_ACCUMULATOR_CLIP_SIGMA*sigma;
+	rejected_count = 0;
+	for(i = 0; i < count; i++)
+	{
+		value = (float)frame->Pixels[i];
+		n = entry->Count[i];
+		/* a running mean of one value may itself be the outlier, so nothing is clipped until it has two */
+		if((n >= 2)&&(clip_limit > 0.0)&&(fabs(value-entry->Mean[i]) > clip_limit))
+		{
+			rejected_count++;
+			entry->Rejected[i]++;
+			if(entry->Rejected[i] < n)
+				continue;
+			/* as many values rejected as accepted, the running mean is the outlier, restart it */
+			entry->M2_Sum -= entry->M2[i];
+			entry->Degrees_Of_Freedom -= n-1;
+			entry->Mean[i] = value;
+			entry->M2[i] = 0.0f;
+			entry->Count[i] = 1;
+			entry->Rejected[i] = 0;
+			continue;
+		}
+		if(n == USHRT_MAX)
+			continue;
+		n++;
+		delta = value-entry->Mean[i];
+		entry->Mean[i] += delta/n;
+		delta2 = delta*(value-entry->Mean[i]);
+		entry->M2[i] += delta2;
+		entry->M2_Sum += delta2;
+		if(n > 1)
+			entry->Degrees_Of_Freedom += 1.0;
+		entry->Count[i] = n;
+	}
+	entry->Frame_Count++;
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Accumulator_Frame_End:Added bias %d with binning %dx%d:"
+		"Clip Limit:%.2f:%ld pixels rejected.",entry->Frame_Count,frame->X_Bin,frame->Y_Bin,clip_limit,
+		rejected_count);
+	pthread_mutex_unlock(&Accumulator_Mutex);
+	DpRt_Accumulator_Frame_Abort(frame);
+	return TRUE;
+}
+
+/**
+ * Abandon adding a bias to the running master bias of its binning, e.g. because its reduction failed or was
+ * aborted part way through. The staged pixels are freed, and the running master is left untouched.
+ * @param frame The address of the structure filled in by DpRt_Accumulator_Frame_Start.
+ */
+void DpRt_Accumulator_Frame_Abort(struct DpRt_Accumulator_Frame_Struct *frame)
+{
+	if(frame == NULL)
+		return;
+	if(frame->Pixels != NULL)
+		free(frame->Pixels);
+	frame->Pixels = NULL;
+	frame->Pixel_Count = 0;
+}
+
+/**
+ * Write the running master bias of each binning with at least DPRT_MASTER_FRAME_COUNT_MIN biases to the
+ * directory, using DPRT_MASTER_BIAS_FILENAME_FORMAT. The running means are copied under Accumulator_Mutex and
+ * written without it, so biases being reduced meanwhile are not held up by the writes. Each master written is
+ * restarted, so the next master of that binning is made from the biases reduced after this call; a bias added
+ * while its master was being written is left out of both, and a warning logged.
+ * @param directory_name The directory to write the master biases to.
+ * @param written_list The address of a pointer, set to an allocated list of the binnings of the master biases
+ *        written, so the caller can make the masters of the other binnings some other way. This should be freed
+ *        by the caller. If no master biases are written this is set to NULL.
+ * @param written_count The address of an integer to set to the number of master biases written.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Accumulator_Snapshot_Struct
+ * @see #Accumulator_Entry_Reset
+ * @see dprt_master.h#DPRT_MASTER_BIAS_FILENAME_FORMAT
+ * @see dprt_master.h#DPRT_MASTER_FRAME_COUNT_MIN
+ * @see dprt_fits.html#DpRt_Fits_Write_Float_Image
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Accumulator_Master_Write(char *directory_name,struct DpRt_Master_Binning_Struct **written_list,
+				  int *written_count)
+{
+	struct Accumulator_Entry_Struct *entry = NULL;
+	struct Accumulator_Snapshot_Struct *snapshot_list = NULL;
+	struct Accumulator_Snapshot_Struct *snapshot = NULL;
+	struct DpRt_Fits_Header_Struct header;
+	char master_filename[DPRT_FITS_FILENAME_LENGTH];
+	size_t pixel_count;
+	int snapshot_count,retval;
+
+	if((directory_name == NULL)||(written_list == NULL)||(written_count == NULL))
+	{
+		DpRt_Error_Number = 1802;
+		strcpy(DpRt_Error_String,"DpRt_Accumulator_Master_Write:Parameter was NULL.");
+		return FALSE;
+	}
+	(*written_list) = NULL;
+	(*written_count) = 0;
+	/* leave room for the master filename */
+	if(strlen(directory_name)+strlen(DPRT_MASTER_BIAS_FILENAME_FORMAT)+16 > DPRT_FITS_FILENAME_LENGTH)
+	{
+		DpRt_Error_Number = 1803;
+		sprintf(DpRt_Error_String,"DpRt_Accumulator_Master_Write:directory name too long(%d).",
+			(int)strlen(directory_name));
+		return FALSE;
+	}
+	/* copy the running means to write */
+	retval = TRUE;
+	snapshot_count = 0;
+	pthread_mutex_lock(&Accumulator_Mutex);
+	for(entry = Accumulator_Entry_List; (entry != NULL) && retval; entry = entry->Next)
+	{
+		if(entry->Frame_Count < DPRT_MASTER_FRAME_COUNT_MIN)
+		{
+			DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"DpRt_Accumulator_Master_Write:Only %d biases with "
+				"binning %dx%d:Not writing master bias.",entry->Frame_Count,entry->X_Bin,entry->Y_Bin);
+			continue;
+		}
+		pixel_count = ((size_t)entry->Naxis1)*entry->Naxis2;
+		snapshot = (struct Accumulator_Snapshot_Struct *)calloc(1,sizeof(struct Accumulator_Snapshot_Struct));
+		if(snapshot != NULL)
+		{
+			snapshot->Mean = (float *)malloc(pixel_count*sizeof(float));
+			if(snapshot->Mean == NULL)
+			{
+				free(snapshot);
+				snapshot = NULL;
+			}
+		}
+		if(snapshot == NULL)
+		{
+			DpRt_Error_Number = 1806;
+			sprintf(DpRt_Error_String,"DpRt_Accumulator_Master_Write:Failed to copy master bias(%d,%d).",
+				entry->Naxis1,entry->Naxis2);
+			retval = FALSE;
+			break;
+		}
+		snapshot->X_Bin = entry->X_Bin;
+		snapshot->Y_Bin = entry->Y_Bin;
+		snapshot->Naxis1 = entry->Naxis1;
+		snapshot->Naxis2 = entry->Naxis2;
+		snapshot->Frame_Count = entry->Frame_Count;
+		memcpy(snapshot->Mean,entry->Mean,pixel_count*sizeof(float));
+		snapshot->Next = snapshot_list;
+		snapshot_list = snapshot;
+		snapshot_count++;
+	}
+	pthread_mutex_unlock(&Accumulator_Mutex);
+	if(retval && (snapshot_count > 0))
+	{
+		(*written_list) = (struct DpRt_Master_Binning_Struct *)malloc(snapshot_count*
+			sizeof(struct DpRt_Master_Binning_Struct));
+		if((*written_list) == NULL)
+		{
+			DpRt_Error_Number = 1808;
+			sprintf(DpRt_Error_String,"DpRt_Accumulator_Master_Write:Failed to allocate written list(%d).",
+				snapshot_count);
+			retval = FALSE;
+		}
+	}
+	/* write the copies, and restart the running masters written */
+	while(snapshot_list != NULL)
+	{
+		snapshot = snapshot_list;
+		snapshot_list = snapshot->Next;
+		if(retval)
+		{
+			if(snprintf(master_filename,DPRT_FITS_FILENAME_LENGTH,DPRT_MASTER_BIAS_FILENAME_FORMAT,
+				    directory_name,snapshot->X_Bin,snapshot->Y_Bin) >= DPRT_FITS_FILENAME_LENGTH)
+			{
+				DpRt_Error_Number = 1807;
+				sprintf(DpRt_Error_String,"DpRt_Accumulator_Master_Write:Master bias filename for "
+					"binning %dx%d too long.",snapshot->X_Bin,snapshot->Y_Bin);
+				retval = FALSE;
+			}
+		}
+		if(retval)
+		{
+			DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Accumulator_Master_Write:Writing running mean of %d "
+				"biases with binning %dx%d to %s.",snapshot->Frame_Count,snapshot->X_Bin,snapshot->Y_Bin,
+				master_filename);
+			memset(&header,0,sizeof(struct DpRt_Fits_Header_Struct));
+			strcpy(header.Obstype,ACCUMULATOR_BIAS_OBSTYPE);
+			header.Naxis1 = snapshot->Naxis1;
+			header.Naxis2 = snapshot->Naxis2;
+			header.X_Bin = snapshot->X_Bin;
+			header.Y_Bin = snapshot->Y_Bin;
+			header.Exposure_Length = 0.0;
+			DpRt_Fits_Lock();
+			retval = DpRt_Fits_Write_Float_Image(master_filename,&header,snapshot->Mean,
+							     snapshot->Frame_Count);
+			DpRt_Fits_Unlock();
+			if(retval)
+			{
+				pthread_mutex_lock(&Accumulator_Mutex);
+				entry = Accumulator_Entry_Get(snapshot->X_Bin,snapshot->Y_Bin);
+				if((entry != NULL)&&(entry->Naxis1 == snapshot->Naxis1)&&
+				   (entry->Naxis2 == snapshot->Naxis2))
+				{
+					if(entry->Frame_Count != snapshot->Frame_Count)
+					{
+						DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"DpRt_Accumulator_Master_Write:"
+							"%d biases with binning %dx%d added while writing:Discarded.",
+							entry->Frame_Count-snapshot->Frame_Count,snapshot->X_Bin,
+							snapshot->Y_Bin);
+					}
+					Accumulator_Entry_Reset(entry);
+				}
+				pthread_mutex_unlock(&Accumulator_Mutex);
+				(*written_list)[(*written_count)].X_Bin = snapshot->X_Bin;
+				(*written_list)[(*written_count)].Y_Bin = snapshot->Y_Bin;
+				(*written_count)++;
+			}
+		}
+		free(snapshot->Mean);
+		free(snapshot);
+	}
+	if((*written_count) == 0)
+	{
+		if((*written_list) != NULL)
+			free(*written_list);
+		(*written_list) = NULL;
+	}
+	return retval;
+}
+
+/**
+ * Free all the running master biases. Biases accumulated but not written are lost.
+ * @return The routine returns TRUE.
+ * @see #Accumulator_Entry_Free
+ */
+int DpRt_Accumulator_Shutdown(void)
+{
+	pthread_mutex_lock(&Accumulator_Mutex);
+	while(Accumulator_Entry_List != NULL)
+	{
+		if(Accumulator_Entry_List->Frame_Count > 0)
+		{
+			DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Accumulator_Shutdown:Discarding %d unwritten biases "
+				"with binning %dx%d.",Accumulator_Entry_List->Frame_Count,Accumulator_Entry_List->X_Bin,
+				Accumulator_Entry_List->Y_Bin);
+		}
+		Accumulator_Entry_Free(Accumulator_Entry_List);
+	}
+	pthread_mutex_unlock(&Accumulator_Mutex);
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Find the running master bias of a binning. Accumulator_Mutex must be held.
+ * @param x_bin The X binning.
+ * @param y_bin The Y binning.
+ * @return The entry, or NULL if there is no running master bias of that binning.
+ * @see #Accumulator_Entry_List
+ */
+static struct Accumulator_Entry_Struct *Accumulator_Entry_Get(int x_bin,int y_bin)
+{
+	struct Accumulator_Entry_Struct *entry = NULL;
+
+	for(entry = Accumulator_Entry_List; entry != NULL; entry = entry->Next)
+	{
+		if((entry->X_Bin == x_bin)&&(entry->Y_Bin == y_bin))
+			return entry;
+	}
+	return NULL;
+}
+
+/**
+ * Create an empty running master bias and add it to the list. Accumulator_Mutex must be held.
+ * @param x_bin The X binning.
+ * @param y_bin The Y binning.
+ * @param naxis1 The number of columns in the biases.
+ * @param naxis2 The number of rows in the biases.
+ * @return The new entry, or NULL if it could not be allocated.
+ * @see #Accumulator_Entry_List
+ * @see #Accumulator_Entry_Free
+ */
+static struct Accumulator_Entry_Struct *Accumulator_Entry_Create(int x_bin,int y_bin,int naxis1,int naxis2)
+{
+	struct Accumulator_Entry_Struct *entry = NULL;
+	size_t pixel_count;
+
+	if((naxis1 < 1)||(naxis2 < 1))
+		return NULL;
+	pixel_count = ((size_t)naxis1)*naxis2;
+	entry = (struct Accumulator_Entry_Struct *)calloc(1,sizeof(struct Accumulator_Entry_Struct));
+	if(entry == NULL)
+		return NULL;
+	entry->X_Bin = x_bin;
+	entry->Y_Bin = y_bin;
+	entry->Naxis1 = naxis1;
+	entry->Naxis2 = naxis2;
+	entry->Mean = (float *)calloc(pixel_count,sizeof(float));
+	entry->M2 = (float *)calloc(pixel_count,sizeof(float));
+	entry->Count = (unsigned short *)calloc(pixel_count,sizeof(unsigned short));
+	entry->Rejected = (unsigned short *)calloc(pixel_count,sizeof(unsigned short));
+	entry->Next = Accumulator_Entry_List;
+	Accumulator_Entry_List = entry;
+	if((entry->Mean == NULL)||(entry->M2 == NULL)||(entry->Count == NULL)||(entry->Rejected == NULL))
+	{
+		Accumulator_Entry_Free(entry);
+		return NULL;
+	}
+	return entry;
+}
+
+/**
+ * Empty a running master bias, keeping its memory for the next biases of its binning.
+ * @param entry The entry.
+ */
+static void Accumulator_Entry_Reset(struct Accumulator_Entry_Struct *entry)
+{
+	size_t pixel_count;
+
+	pixel_count = ((size_t)entry->Naxis1)*entry->Naxis2;
+	memset(entry->Mean,0,pixel_count*sizeof(float));
+	memset(entry->M2,0,pixel_count*sizeof(float));
+	memset(entry->Count,0,pixel_count*sizeof(unsigned short));
+	memset(entry->Rejected,0,pixel_count*sizeof(unsigned short));
+	entry->Frame_Count = 0;
+	entry->M2_Sum = 0.0;
+	entry->Degrees_Of_Freedom = 0.0;
+}
+
+/**
+ * Remove a running master bias from the list and free it. Accumulator_Mutex must be held.
+ * @param entry The entry.
+ * @see #Accumulator_Entry_List
+ */
+static void Accumulator_Entry_Free(struct Accumulator_Entry_Struct *entry)
+{
+	struct Accumulator_Entry_Struct **previous_next = NULL;
+
+	previous_next = &Accumulator_Entry_List;
+	while(((*previous_next) != NULL)&&((*previous_next) != entry))
+		previous_next = &((*previous_next)->Next);
+	if((*previous_next) == entry)
+		(*previous_next) = entry->Next;
+	if(entry->Mean != NULL)
+		free(entry->Mean);
+	if(entry->M2 != NULL)
+		free(entry->M2);
+	if(entry->Count != NULL)
+		free(entry->Count);
+	if(entry->Rejected != NULL)
+		free(entry->Rejected);
+	free(entry);
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
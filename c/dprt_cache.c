@@ -0,0 +1,472 @@
+/* dprt_cache.c
+** Resident master calibration frame cache for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_cache.c holds master bias and flat frames in memory between DpRt_Initialise and DpRt_Shutdown, so they
+ * are not re-read for every frame reduced. Entries are keyed on the master type, binning and frame
+ * dimensions. Each lookup checks the master file on disk, and reloads it if a newer master has been written
+ * since it was cached. Masters handed out by DpRt_Cache_Master_Get are reference counted, so a master being
+ * used by one reduction is not freed if another lookup reloads it. Masters are read without holding the cache
+ * mutex, so lookups of other masters are not held up by the read; lookups of a master being read wait for it.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_fits.h"
+#include "dprt_master.h"
+#include "dprt_config.h"
+#include "dprt_cache.h"
+#include "dprt_context.h"
+#include "dprt_metrics.h"
+#include "dprt_log.h"
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding one cached master frame.
+ * <dl>
+ * <dt>Type</dt> <dd>The type of master frame.</dd>
+ * <dt>X_Bin</dt> <dd>The X binning of the master.</dd>
+ * <dt>Y_Bin</dt> <dd>The Y binning of the master.</dd>
+ * <dt>Naxis1</dt> <dd>The number of columns in the master.</dd>
+ * <dt>Naxis2</dt> <dd>The number of rows in the master.</dd>
+ * <dt>Filename</dt> <dd>The file the master was read from.</dd>
+ * <dt>Modification_Time</dt> <dd>The modification time of the file when it was read.</dd>
+ * <dt>File_Size</dt> <dd>The size of the file when it was read.</dd>
+ * <dt>Inode</dt> <dd>The inode of the file when it was read.</dd>
+ * <dt>Data</dt> <dd>The master frame data, Naxis1*Naxis2 pixels. This is NULL while the entry is Loading.</dd>
+ * <dt>Reference_Count</dt> <dd>The number of callers currently using Data.</dd>
+ * <dt>Stale</dt> <dd>TRUE if a newer master has replaced this one. The entry is freed when it is no longer
+ *     referenced.</dd>
+ * <dt>Loading</dt> <dd>TRUE while the master is being read into Data, without Cache_Mutex held.</dd>
+ * <dt>Next</dt> <dd>The next entry in the cache.</dd>
+ * </dl>
+ */
+struct Cache_Entry_Struct
+{
+	enum DPRT_CACHE_TYPE Type;
+	int X_Bin;
+	int Y_Bin;
+	int Naxis1;
+	int Naxis2;
+	char Filename[DPRT_FITS_FILENAME_LENGTH];
+	time_t Modification_Time;
+	off_t File_Size;
+	ino_t Inode;
+	float *Data;
+	int Reference_Count;
+	int Stale;
+	int Loading;
+	struct Cache_Entry_Struct *Next;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The list of cached master frames.
+ */
+static struct Cache_Entry_Struct *Cache_Entry_List = NULL;
+/**
+ * The directory master frames are looked for in. An empty string means no master directory is known yet.
+ */
+static char Cache_Master_Directory[DPRT_FITS_FILENAME_LENGTH] = "";
+/**
+ * The cache's hit and miss counts.
+ */
+static struct DpRt_Cache_Statistics_Struct Cache_Statistics = {0,0,0,0,0};
+/**
+ * Mutex protecting all the cache's variables.
+ */
+static pthread_mutex_t Cache_Mutex = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * Condition signalled (with Cache_Mutex) when an entry has finished loading.
+ */
+static pthread_cond_t Cache_Condition = PTHREAD_COND_INITIALIZER;
+/**
+ * The number of entries currently Loading.
+ */
+static int Cache_Loading_Count = 0;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static struct Cache_Entry_Struct *Cache_Entry_Find(enum DPRT_CACHE_TYPE type,int x_bin,int y_bin,int naxis1,
+	int naxis2);
+static void Cache_Entry_Retire(struct Cache_Entry_Struct *entry);
+static void Cache_Entry_Free(struct Cache_Entry_Struct *entry);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Initialise the cache. Any cached masters are freed and the statistics reset. The master directory is set from
+ * the configuration's master directory; if this is not set, no masters are available until a
+ * master bias or flat is made. Any masters being loaded are waited for before the cache is emptied.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Cache_Loading_Count
+ * @see #Cache_Entry_Free
+ * @see #DpRt_Cache_Master_Directory_Set
+ * @see dprt_config.html#DpRt_Config_Get
+ */
+int DpRt_Cache_Initialise(void)
+{
+	struct DpRt_Config_Struct config;
+
+	pthread_mutex_lock(&Cache_Mutex);
+	while(Cache_Loading_Count > 0)
+		pthread_cond_wait(&Cache_Condition,&Cache_Mutex);
+	while(Cache_Entry_List != NULL)
+		Cache_Entry_Free(Cache_Entry_List);
+	Cache_Master_Directory[0] = '\0';
+	memset(&Cache_Statistics,0,sizeof(struct DpRt_Cache_Statistics_Struct));
+	pthread_mutex_unlock(&Cache_Mutex);
+	DpRt_Config_Get(&config);
+	if(strlen(config.Master_Directory) > 0)
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Cache_Initialise:Master directory:%s.",config.Master_Directory);
+		if(!DpRt_Cache_Master_Directory_Set(config.Master_Directory))
+			return FALSE;
+	}
+	else
+		DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Cache_Initialise:No master directory configured.");
+	return TRUE;
+}
+
+/**
+ * Shutdown the cache, logging its statistics and freeing all the cached masters. Any masters being loaded are
+ * waited for first.
+ * @return The routine returns TRUE.
+ * @see #DpRt_Cache_Statistics_Get
+ * @see #Cache_Loading_Count
+ * @see #Cache_Entry_Free
+ */
+int DpRt_Cache_Shutdown(void)
+{
+	struct DpRt_Cache_Statistics_Struct statistics;
+
+	DpRt_Cache_Statistics_Get(&statistics);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Cache_Shutdown:%d entries:%lu bytes:%ld hits:%ld misses:%ld reloads.",
+		statistics.Entry_Count,(unsigned long)statistics.Memory_Size,statistics.Hit_Count,
+		statistics.Miss_Count,statistics.Reload_Count);
+	pthread_mutex_lock(&Cache_Mutex);
+	while(Cache_Loading_Count > 0)
+		pthread_cond_wait(&Cache_Condition,&Cache_Mutex);
+	while(Cache_Entry_List != NULL)
+		Cache_Entry_Free(Cache_Entry_List);
+	Cache_Master_Directory[0] = '\0';
+	pthread_mutex_unlock(&Cache_Mutex);
+	return TRUE;
+}
+
+/**
+ * Set the directory master frames are looked for in. This is called when new masters are made, so later lookups
+ * find the newest masters.
+ * @param directory_name The directory name.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Cache_Master_Directory
+ */
+int DpRt_Cache_Master_Directory_Set(char *directory_name)
+{
+	if(directory_name == NULL)
+	{
+		DpRt_Error_Number = 500;
+		strcpy(DpRt_Error_String,"DpRt_Cache_Master_Directory_Set:directory name was NULL.");
+		return FALSE;
+	}
+	/* leave room for the master filename */
+	if(strlen(directory_name)+strlen(DPRT_MASTER_FLAT_FILENAME_FORMAT)+16 > DPRT_FITS_FILENAME_LENGTH)
+	{
+		DpRt_Error_Number = 501;
+		sprintf(DpRt_Error_String,"DpRt_Cache_Master_Directory_Set:directory name too long(%d).",
+			(int)strlen(directory_name));
+		return FALSE;
+	}
+	pthread_mutex_lock(&Cache_Mutex);
+	strcpy(Cache_Master_Directory,directory_name);
+	pthread_mutex_unlock(&Cache_Mutex);
+	return TRUE;
+}
+
+/**
+ * Get a master frame. If the master is cached, and the master file on disk has not changed since it was read,
+ * the cached copy is returned. Otherwise the master is (re)read from the master directory.
+ * The read is done without Cache_Mutex held: a Loading entry is added to the cache first, so lookups of the same
+ * master wait on Cache_Condition for the read to finish, while lookups of other masters carry on. If the master
+ * file changed during the read, the master read is handed to this caller but not kept in the cache.
+ * Each successful lookup that returns data must be matched by a call to DpRt_Cache_Master_Release.
+ * @param type The type of master.
+ * @param x_bin The X binning of the frame being reduced.
+ * @param y_bin The Y binning of the frame being reduced.
+ * @param naxis1 The number of columns in the frame being reduced.
+ * @param naxis2 The number of rows in the frame being reduced.
+ * @param data The address of a float pointer, set to the master data (naxis1*naxis2 pixels), or NULL if
+ *        no master of this type and binning exists. The data belongs to the cache and must not be modified.
+ * @return The routine returns TRUE on success (including when no master exists) and FALSE on failure.
+ * @see #DpRt_Cache_Master_Release
+ * @see #Cache_Entry_Find
+ * @see #Cache_Entry_Retire
+ * @see #Cache_Entry_Free
+ * @see #Cache_Condition
+ * @see #Cache_Loading_Count
+ * @see dprt_master.h#DPRT_MASTER_BIAS_FILENAME_FORMAT
+ * @see dprt_master.h#DPRT_MASTER_FLAT_FILENAME_FORMAT
+ * @see dprt_fits.html#DpRt_Fits_Read_Float_Image
+ * @see dprt_metrics.html#DpRt_Metrics_Count_Add
+ */
+int DpRt_Cache_Master_Get(enum DPRT_CACHE_TYPE type,int x_bin,int y_bin,int naxis1,int naxis2,float **data)
+{
+	struct Cache_Entry_Struct *entry = NULL;
+	struct Cache_Entry_Struct *new_entry = NULL;
+	struct stat stat_buffer;
+	char filename[DPRT_FITS_FILENAME_LENGTH];
+	float *master_data = NULL;
+	int master_naxis1,master_naxis2,length,retval;
+
+	if(data == NULL)
+	{
+		DpRt_Error_Number = 502;
+		strcpy(DpRt_Error_String,"DpRt_Cache_Master_Get:data was NULL.");
+		return FALSE;
+	}
+	(*data) = NULL;
+	pthread_mutex_lock(&Cache_Mutex);
+	if(strlen(Cache_Master_Directory) == 0)
+	{
+		pthread_mutex_unlock(&Cache_Mutex);
+		return TRUE;
+	}
+	if(type == DPRT_CACHE_TYPE_BIAS)
+	{
+		length = snprintf(filename,DPRT_FITS_FILENAME_LENGTH,DPRT_MASTER_BIAS_FILENAME_FORMAT,
+				  Cache_Master_Directory,x_bin,y_bin);
+	}
+	else
+	{
+		length = snprintf(filename,DPRT_FITS_FILENAME_LENGTH,DPRT_MASTER_FLAT_FILENAME_FORMAT,
+				  Cache_Master_Directory,x_bin,y_bin);
+	}
+	if(length >= DPRT_FITS_FILENAME_LENGTH)
+	{
+		pthread_mutex_unlock(&Cache_Mutex);
+		DpRt_Error_Number = 505;
+		sprintf(DpRt_Error_String,"DpRt_Cache_Master_Get:Master filename for binning %dx%d too long.",x_bin,
+			y_bin);
+		return FALSE;
+	}
+	/* find the current entry for this key, waiting for any read of it to finish */
+	entry = Cache_Entry_Find(type,x_bin,y_bin,naxis1,naxis2);
+	while((entry != NULL)&&(entry->Loading))
+	{
+		pthread_cond_wait(&Cache_Condition,&Cache_Mutex);
+		entry = Cache_Entry_Find(type,x_bin,y_bin,naxis1,naxis2);
+	}
+	if(stat(filename,&stat_buffer) != 0)
+	{
+		/* no master of this type and binning (any more) */
+		if(entry != NULL)
+			Cache_Entry_Retire(entry);
+		pthread_mutex_unlock(&Cache_Mutex);
+		return TRUE;
+	}
+	if((entry != NULL)&&(strcmp(entry->Filename,filename) == 0)&&
+	   (entry->Modification_Time == stat_buffer.st_mtime)&&(entry->File_Size == stat_buffer.st_size)&&
+	   (entry->Inode == stat_buffer.st_ino))
+	{
+		Cache_Statistics.Hit_Count++;
+		DpRt_Metrics_Count_Add(DPRT_METRICS_COUNTER_CACHE_HITS,1);
+		entry->Reference_Count++;
+		(*data) = entry->Data;
+		pthread_mutex_unlock(&Cache_Mutex);
+		return TRUE;
+	}
+	Cache_Statistics.Miss_Count++;
+	DpRt_Metrics_Count_Add(DPRT_METRICS_COUNTER_CACHE_MISSES,1);
+	if(entry != NULL)
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Cache_Master_Get:Newer master %s:Reloading.",filename);
+		Cache_Statistics.Reload_Count++;
+		Cache_Entry_Retire(entry);
+	}
+	/* add a Loading entry, referenced by this lookup, then read the master without the mutex held */
+	new_entry = (struct Cache_Entry_Struct *)malloc(sizeof(struct Cache_Entry_Struct));
+	if(new_entry == NULL)
+	{
+		pthread_mutex_unlock(&Cache_Mutex);
+		DpRt_Error_Number = 504;
+		strcpy(DpRt_Error_String,"DpRt_Cache_Master_Get:Failed to allocate cache entry.");
+		return FALSE;
+	}
+	new_entry->Type = type;
+	new_entry->X_Bin = x_bin;
+	new_entry->Y_Bin = y_bin;
+	new_entry->Naxis1 = naxis1;
+	new_entry->Naxis2 = naxis2;
+	strcpy(new_entry->Filename,filename);
+	new_entry->Modification_Time = stat_buffer.st_mtime;
+	new_entry->File_Size = stat_buffer.st_size;
+	new_entry->Inode = stat_buffer.st_ino;
+	new_entry->Data = NULL;
+	new_entry->Reference_Count = 1;
+	new_entry->Stale = FALSE;
+	new_entry->Loading = TRUE;
+	new_entry->Next = Cache_Entry_List;
+	Cache_Entry_List = new_entry;
+	Cache_Loading_Count++;
+	pthread_mutex_unlock(&Cache_Mutex);
+	retval = DpRt_Fits_Read_Float_Image(filename,&master_naxis1,&master_naxis2,&master_data);
+	if(retval && ((master_naxis1 != naxis1)||(master_naxis2 != naxis2)))
+	{
+		free(master_data);
+		master_data = NULL;
+		DpRt_Error_Number = 503;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Cache_Master_Get:Master %.128s has "
+			"dimensions (%d,%d) not (%d,%d).",filename,master_naxis1,master_naxis2,naxis1,naxis2);
+		retval = FALSE;
+	}
+	pthread_mutex_lock(&Cache_Mutex);
+	new_entry->Loading = FALSE;
+	Cache_Loading_Count--;
+	if(retval)
+	{
+		new_entry->Data = master_data;
+		/* a master rewritten during the read is not kept, the next lookup reloads it */
+		if((stat(filename,&stat_buffer) != 0)||(new_entry->Modification_Time != stat_buffer.st_mtime)||
+		   (new_entry->File_Size != stat_buffer.st_size)||(new_entry->Inode != stat_buffer.st_ino))
+		{
+			new_entry->Stale = TRUE;
+		}
+		(*data) = new_entry->Data;
+	}
+	else
+		Cache_Entry_Free(new_entry);
+	pthread_cond_broadcast(&Cache_Condition);
+	pthread_mutex_unlock(&Cache_Mutex);
+	return retval;
+}
+
+/**
+ * Release a master frame returned by DpRt_Cache_Master_Get. If the master has since been replaced by a newer
+ * one, and this was the last reference to it, it is freed.
+ * @param data The master data pointer returned by DpRt_Cache_Master_Get. If this is NULL nothing is done.
+ * @see #DpRt_Cache_Master_Get
+ * @see #Cache_Entry_Free
+ */
+void DpRt_Cache_Master_Release(float *data)
+{
+	struct Cache_Entry_Struct *entry = NULL;
+
+	if(data == NULL)
+		return;
+	pthread_mutex_lock(&Cache_Mutex);
+	entry = Cache_Entry_List;
+	while((entry != NULL)&&(entry->Data != data))
+		entry = entry->Next;
+	if(entry != NULL)
+	{
+		if(entry->Reference_Count > 0)
+			entry->Reference_Count--;
+		if(entry->Stale && (entry->Reference_Count == 0))
+			Cache_Entry_Free(entry);
+	}
+	pthread_mutex_unlock(&Cache_Mutex);
+}
+
+/**
+ * Get the cache's current memory footprint and hit/miss statistics.
+ * @param statistics The address of a structure to fill in.
+ */
+void DpRt_Cache_Statistics_Get(struct DpRt_Cache_Statistics_Struct *statistics)
+{
+	struct Cache_Entry_Struct *entry = NULL;
+
+	if(statistics == NULL)
+		return;
+	pthread_mutex_lock(&Cache_Mutex);
+	(*statistics) = Cache_Statistics;
+	statistics->Entry_Count = 0;
+	statistics->Memory_Size = 0;
+	for(entry = Cache_Entry_List; entry != NULL; entry = entry->Next)
+	{
+		statistics->Entry_Count++;
+		if(entry->Data != NULL)
+			statistics->Memory_Size += ((size_t)entry->Naxis1)*entry->Naxis2*sizeof(float);
+	}
+	pthread_mutex_unlock(&Cache_Mutex);
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Find the current (not Stale) entry for a master. Cache_Mutex must be held.
+ * @param type The type of master.
+ * @param x_bin The X binning of the master.
+ * @param y_bin The Y binning of the master.
+ * @param naxis1 The number of columns in the master.
+ * @param naxis2 The number of rows in the master.
+ * @return The entry, or NULL if the master is not cached.
+ * @see #Cache_Entry_List
+ */
+static struct Cache_Entry_Struct *Cache_Entry_Find(enum DPRT_CACHE_TYPE type,int x_bin,int y_bin,int naxis1,
+	int naxis2)
+{
+	struct Cache_Entry_Struct *entry = NULL;
+
+	entry = Cache_Entry_List;
+	while((entry != NULL)&&((entry->Stale)||(entry->Type != type)||(entry->X_Bin != x_bin)||
+				(entry->Y_Bin != y_bin)||(entry->Naxis1 != naxis1)||(entry->Naxis2 != naxis2)))
+	{
+		entry = entry->Next;
+	}
+	return entry;
+}
+
+/**
+ * Mark an entry as replaced. It is freed now if it is not referenced, otherwise when the last reference is
+ * released. Cache_Mutex must be held.
+ * @param entry The entry.
+ * @see #Cache_Entry_Free
+ */
+static void Cache_Entry_Retire(struct Cache_Entry_Struct *entry)
+{
+	entry->Stale = TRUE;
+	if(entry->Reference_Count == 0)
+		Cache_Entry_Free(entry);
+}
+
+/**
+ * Remove an entry from the cache list and free it. Cache_Mutex must be held.
+ * @param entry The entry.
+ * @see #Cache_Entry_List
+ */
+static void Cache_Entry_Free(struct Cache_Entry_Struct *entry)
+{
+	struct Cache_Entry_Struct **previous_next = NULL;
+
+	previous_next = &Cache_Entry_List;
+	while(((*previous_next) != NULL)&&((*previous_next) != entry))
+		previous_next = &((*previous_next)->Next);
+	if((*previous_next) == entry)
+		(*previous_next) = entry->Next;
+	if(entry->Data != NULL)
+		free(entry->Data);
+	free(entry);
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
@@ -0,0 +1,796 @@
+/* dprt_combine.c
+** Parallel tiled frame combination for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_combine.c combines a stack of frames into one (master) frame. The detector is split into tiles
+ * of complete rows. A pool of worker threads each take the next uncombined tile, read that tile's rows from
+ * every frame in the stack, and combine the pixels. Only the workers' tile stacks are held in memory, and the
+ * tiles shrink as the stack grows so they fit in the dprt.combine.memory_mb ceiling, so memory use does not grow
+ * with the number of frames. Reading a tile from every frame seeks between the files, so the next tiles are
+ * prefetched by the kernel (posix_fadvise) while the current ones are combined, and dropped from the page cache
+ * once read. Frames can be median combined,
+ * or bias subtracted, scaled and combined with an iterative sigma clipped mean. Each worker polls the abort flag
+ * as it reads and combines its tile, and the first worker to see it stops the others taking new tiles.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "fitsio.h"
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_fits.h"
+#include "dprt_combine.h"
+#include "dprt_config.h"
+#include "dprt_abort.h"
+#include "dprt_context.h"
+#include "dprt_log.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The minimum number of tiles per worker thread. Having more tiles than threads balances the load
+ * when some workers are held up waiting for I/O.
+ */
+#define COMBINE_TILES_PER_THREAD	(4)
+/**
+ * The maximum number of clipping iterations done on each pixel by the sigma clip combine.
+ */
+#define COMBINE_SIGMA_CLIP_ITERATIONS_MAX	(5)
+/**
+ * The number of bytes cfitsio holds in memory for each open file (its 40 I/O buffers of one 2880 byte FITS block).
+ * Every frame in the stack is open while it is combined, so this is taken off the memory ceiling before the
+ * tiles are sized.
+ */
+#define COMBINE_FITS_FILE_MEMORY	(40*2880)
+
+/* ------------------------------------------------------- */
+/* enums */
+/* ------------------------------------------------------- */
+/**
+ * The ways the combine can combine the stack at each pixel.
+ * <ul>
+ * <li>COMBINE_METHOD_MEDIAN The median of the raw values.
+ * <li>COMBINE_METHOD_SIGMA_CLIP The mean of the bias subtracted and scaled values, after iteratively
+ *     rejecting values more than Sigma standard deviations from the median.
+ * </ul>
+ */
+enum COMBINE_METHOD
+{
+	COMBINE_METHOD_MEDIAN,COMBINE_METHOD_SIGMA_CLIP
+};
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure shared between the combine worker threads.
+ * <dl>
+ * <dt>Method</dt> <dd>How to combine the stack at each pixel.</dd>
+ * <dt>Bias</dt> <dd>For COMBINE_METHOD_SIGMA_CLIP, an optional Naxis1*Naxis2 bias frame subtracted from each
+ *     frame, or NULL.</dd>
+ * <dt>Scale_List</dt> <dd>For COMBINE_METHOD_SIGMA_CLIP, an optional list of Frame_Count values each
+ *     (bias subtracted) frame is divided by, or NULL.</dd>
+ * <dt>Sigma</dt> <dd>For COMBINE_METHOD_SIGMA_CLIP, the clipping threshold in standard deviations.</dd>
+ * <dt>Fits_Fp_List</dt> <dd>A list of open cfitsio file pointers, one per frame.</dd>
+ * <dt>Prefetch_Fd_List</dt> <dd>A list of file descriptors, one per frame, used to tell the kernel which rows
+ *     of the frame will be read next. A frame whose pixels are not stored raw (e.g. a compressed image) has -1,
+ *     and is not prefetched.</dd>
+ * <dt>Data_Start_List</dt> <dd>A list of the byte offsets of the first pixel in each frame's file.</dd>
+ * <dt>Frame_Count</dt> <dd>The number of frames in the stack.</dd>
+ * <dt>Naxis1</dt> <dd>The number of columns in each frame.</dd>
+ * <dt>Naxis2</dt> <dd>The number of rows in each frame.</dd>
+ * <dt>Thread_Count</dt> <dd>The number of worker threads, and hence the number of tiles combined at once.</dd>
+ * <dt>Tile_Rows</dt> <dd>The number of rows in each tile.</dd>
+ * <dt>Tile_Count</dt> <dd>The number of tiles the frame is split into.</dd>
+ * <dt>Next_Tile</dt> <dd>The index of the next tile to be combined.</dd>
+ * <dt>Output</dt> <dd>The combined frame, Naxis1*Naxis2 pixels.</dd>
+ * <dt>Mutex</dt> <dd>Mutex protecting Next_Tile and the error fields.</dd>
+ * <dt>Error_Number</dt> <dd>The error number of the first worker to fail, or zero.</dd>
+ * <dt>Error_String</dt> <dd>The error string of the first worker to fail.</dd>
+ * <dt>Log_Tag</dt> <dd>The log tag of the calling thread, which the workers log under.</dd>
+ * <dt>Abort_Generation</dt> <dd>The abort generation of the calling thread, which the workers are aborted
+ *     with.</dd>
+ * </dl>
+ */
+struct Combine_Struct
+{
+	enum COMBINE_METHOD Method;
+	float *Bias;
+	double *Scale_List;
+	double Sigma;
+	fitsfile **Fits_Fp_List;
+	int *Prefetch_Fd_List;
+	LONGLONG *Data_Start_List;
+	int Frame_Count;
+	int Naxis1;
+	int Naxis2;
+	int Thread_Count;
+	int Tile_Rows;
+	int Tile_Count;
+	int Next_Tile;
+	float *Output;
+	pthread_mutex_t Mutex;
+	int Error_Number;
+	char Error_String[DPRT_ERROR_STRING_LENGTH];
+	unsigned long Log_Tag;
+	unsigned long Abort_Generation;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Combine_Frames(struct Combine_Struct *combine,char **filename_list);
+static int Combine_Run(struct Combine_Struct *combine);
+static void *Combine_Worker(void *user_arg);
+static int Combine_Tile_Get(struct Combine_Struct *combine,int *tile);
+static void Combine_Tile_Advise(struct Combine_Struct *combine,int tile,int advice);
+static void Combine_Error_Set(struct Combine_Struct *combine,int error_number,char *error_string);
+static float Combine_Median(unsigned short *values,int count);
+static float Combine_Sigma_Clip(float *values,int count,double sigma);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Median combine a stack of frames. The frames must all be 16 bit images of naxis1 by naxis2 pixels.
+ * @param filename_list A list of FITS filenames to combine.
+ * @param frame_count The number of filenames in the list.
+ * @param naxis1 The number of columns in each frame.
+ * @param naxis2 The number of rows in each frame.
+ * @param output A previously allocated array of naxis1*naxis2 floats, filled in with the median of the
+ *        stack at each pixel.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Combine_Frames
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Combine_Median(char **filename_list,int frame_count,int naxis1,int naxis2,float *output)
+{
+	struct Combine_Struct combine;
+
+	if((filename_list == NULL)||(output == NULL))
+	{
+		DpRt_Error_Number = 300;
+		strcpy(DpRt_Error_String,"DpRt_Combine_Median:filename list or output was NULL.");
+		return FALSE;
+	}
+	combine.Method = COMBINE_METHOD_MEDIAN;
+	combine.Bias = NULL;
+	combine.Scale_List = NULL;
+	combine.Sigma = 0.0;
+	combine.Frame_Count = frame_count;
+	combine.Naxis1 = naxis1;
+	combine.Naxis2 = naxis2;
+	combine.Output = output;
+	return Combine_Frames(&combine,filename_list);
+}
+
+/**
+ * Combine a stack of frames using an iterative sigma clipped mean. Each frame has the bias frame subtracted
+ * and is then divided by its scale factor before combination. At each pixel values more than sigma standard
+ * deviations from the median are rejected, until no more values are rejected or
+ * COMBINE_SIGMA_CLIP_ITERATIONS_MAX iterations have been done. The mean of the remaining values is used.
+ * The frames must all be 16 bit images of naxis1 by naxis2 pixels.
+ * @param filename_list A list of FITS filenames to combine.
+ * @param frame_count The number of filenames in the list.
+ * @param naxis1 The number of columns in each frame.
+ * @param naxis2 The number of rows in each frame.
+ * @param bias A naxis1*naxis2 bias frame to subtract from each frame, or NULL.
+ * @param scale_list A list of frame_count values to divide each bias subtracted frame by, or NULL.
+ * @param sigma The clipping threshold, in standard deviations.
+ * @param output A previously allocated array of naxis1*naxis2 floats, filled in with the combined frame.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Combine_Frames
+ * @see #COMBINE_SIGMA_CLIP_ITERATIONS_MAX
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Combine_Sigma_Clip(char **filename_list,int frame_count,int naxis1,int naxis2,float *bias,
+			    double *scale_list,double sigma,float *output)
+{
+	struct Combine_Struct combine;
+	int i;
+
+	if((filename_list == NULL)||(output == NULL))
+	{
+		DpRt_Error_Number = 306;
+		strcpy(DpRt_Error_String,"DpRt_Combine_Sigma_Clip:filename list or output was NULL.");
+		return FALSE;
+	}
+	if(sigma <= 0.0)
+	{
+		DpRt_Error_Number = 307;
+		sprintf(DpRt_Error_String,"DpRt_Combine_Sigma_Clip:Illegal sigma %.2f.",sigma);
+		return FALSE;
+	}
+	if(scale_list != NULL)
+	{
+		for(i = 0; i < frame_count; i++)
+		{
+			if(scale_list[i] == 0.0)
+			{
+				DpRt_Error_Number = 308;
+				snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Combine_Sigma_Clip:Frame %.128s has a scale of zero.",
+					filename_list[i]);
+				return FALSE;
+			}
+		}
+	}
+	combine.Method = COMBINE_METHOD_SIGMA_CLIP;
+	combine.Bias = bias;
+	combine.Scale_List = scale_list;
+	combine.Sigma = sigma;
+	combine.Frame_Count = frame_count;
+	combine.Naxis1 = naxis1;
+	combine.Naxis2 = naxis2;
+	combine.Output = output;
+	return Combine_Frames(&combine,filename_list);
+}
+
+/**
+ * Find the median of a list of floating point values, using Wirth's selection algorithm. For an even number of
+ * values the mean of the two middle values is returned.
+ * @param values The list of values. The list is re-ordered.
+ * @param count The number of values in the list.
+ * @return The median value, or 0.0 if count is less than 1.
+ */
+float DpRt_Combine_Median_Float(float *values,int count)
+{
+	float pivot,tmp,lower_max;
+	int left,right,i,j,k;
+
+	if(count < 1)
+		return 0.0f;
+	k = count/2;
+	left = 0;
+	right = count-1;
+	while(left < right)
+	{
+		pivot = values[k];
+		i = left;
+		j = right;
+		do
+		{
+			while(values[i] < pivot)
+				i++;
+			while(pivot < values[j])
+				j--;
+			if(i <= j)
+			{
+				tmp = values[i];
+				values[i] = values[j];
+				values[j] = tmp;
+				i++;
+				j--;
+			}
+		} while(i <= j);
+		if(j < k)
+			left = i;
+		if(k < i)
+			right = j;
+	}
+	if((count % 2) == 1)
+		return values[k];
+	lower_max = values[0];
+	for(i = 1; i < k; i++)
+	{
+		if(values[i] > lower_max)
+			lower_max = values[i];
+	}
+	return (lower_max+values[k])/2.0f;
+}
+
+/**
+ * Return the number of combine worker threads to use. This is the number of online processors,
+ * limited to DPRT_COMBINE_THREAD_COUNT_MAX.
+ * @return The number of threads, at least 1.
+ * @see dprt_combine.h#DPRT_COMBINE_THREAD_COUNT_MAX
+ */
+int DpRt_Combine_Thread_Count_Get(void)
+{
+	long processor_count;
+
+	processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+	if(processor_count < 1)
+		return 1;
+	if(processor_count > DPRT_COMBINE_THREAD_COUNT_MAX)
+		return DPRT_COMBINE_THREAD_COUNT_MAX;
+	return (int)processor_count;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Open all the frames in the stack, checking they are the same size, combine them and close them again.
+ * Each frame whose pixels are stored raw is also opened for prefetching; a frame that cannot be is still combined,
+ * without prefetching.
+ * @param combine The address of the combine structure, with Method, Bias, Scale_List, Sigma, Frame_Count,
+ *        Naxis1, Naxis2 and Output filled in.
+ * @param filename_list A list of Frame_Count FITS filenames.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Combine_Run
+ * @see dprt_fits.html#DpRt_Fits_Image_Open
+ * @see dprt_fits.html#DpRt_Fits_Image_Raw_Data_Get
+ * @see dprt_fits.html#DpRt_Fits_Image_Close
+ */
+static int Combine_Frames(struct Combine_Struct *combine,char **filename_list)
+{
+	LONGLONG data_end;
+	int i,frame_naxis1,frame_naxis2,retval;
+
+	if(combine->Frame_Count < 1)
+	{
+		DpRt_Error_Number = 301;
+		sprintf(DpRt_Error_String,"Combine_Frames:Illegal frame count %d.",combine->Frame_Count);
+		return FALSE;
+	}
+	combine->Fits_Fp_List = (fitsfile **)calloc(combine->Frame_Count,sizeof(fitsfile *));
+	combine->Prefetch_Fd_List = (int *)malloc(combine->Frame_Count*sizeof(int));
+	combine->Data_Start_List = (LONGLONG *)calloc(combine->Frame_Count,sizeof(LONGLONG));
+	if((combine->Fits_Fp_List == NULL)||(combine->Prefetch_Fd_List == NULL)||(combine->Data_Start_List == NULL))
+	{
+		if(combine->Fits_Fp_List != NULL)
+			free(combine->Fits_Fp_List);
+		if(combine->Prefetch_Fd_List != NULL)
+			free(combine->Prefetch_Fd_List);
+		if(combine->Data_Start_List != NULL)
+			free(combine->Data_Start_List);
+		DpRt_Error_Number = 302;
+		sprintf(DpRt_Error_String,"Combine_Frames:Failed to allocate file list(%d).",combine->Frame_Count);
+		return FALSE;
+	}
+	for(i = 0; i < combine->Frame_Count; i++)
+		combine->Prefetch_Fd_List[i] = -1;
+	/* open all the frames, checking they are the same size */
+	retval = TRUE;
+	for(i = 0; (i < combine->Frame_Count) && retval; i++)
+	{
+		retval = DpRt_Fits_Image_Open(filename_list[i],&(combine->Fits_Fp_List[i]),&frame_naxis1,
+					      &frame_naxis2);
+		if(retval && ((frame_naxis1 != combine->Naxis1)||(frame_naxis2 != combine->Naxis2)))
+		{
+			DpRt_Error_Number = 303;
+			snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"Combine_Frames:%.128s has dimensions (%d,%d) not (%d,%d).",
+				filename_list[i],frame_naxis1,frame_naxis2,combine->Naxis1,combine->Naxis2);
+			retval = FALSE;
+		}
+		if(retval && DpRt_Fits_Image_Raw_Data_Get(combine->Fits_Fp_List[i],combine->Naxis1,combine->Naxis2,
+							  &(combine->Data_Start_List[i]),&data_end))
+		{
+			combine->Prefetch_Fd_List[i] = open(filename_list[i],O_RDONLY);
+		}
+	}
+	if(retval)
+		retval = Combine_Run(combine);
+	for(i = 0; i < combine->Frame_Count; i++)
+	{
+		if(combine->Fits_Fp_List[i] != NULL)
+		{
+			/* don't overwrite an earlier error with a close error */
+			if(retval)
+				retval = DpRt_Fits_Image_Close(combine->Fits_Fp_List[i]);
+			else
+				DpRt_Fits_Image_Close(combine->Fits_Fp_List[i]);
+		}
+		if(combine->Prefetch_Fd_List[i] >= 0)
+			close(combine->Prefetch_Fd_List[i]);
+	}
+	free(combine->Fits_Fp_List);
+	free(combine->Prefetch_Fd_List);
+	free(combine->Data_Start_List);
+	combine->Fits_Fp_List = NULL;
+	combine->Prefetch_Fd_List = NULL;
+	combine->Data_Start_List = NULL;
+	return retval;
+}
+
+/**
+ * Split the frame into tiles, start the worker threads and wait for them to combine every tile.
+ * The tile size is chosen so all the workers' tile stacks, and cfitsio's buffers for every open frame, fit in the
+ * dprt.combine.memory_mb ceiling, and so there are at least COMBINE_TILES_PER_THREAD tiles per worker. If the
+ * ceiling does not leave room for a row of every frame per worker, fewer workers are used. The first tile of
+ * each worker is prefetched before the workers start.
+ * @param combine The address of the combine structure, with the frames opened.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Combine_Worker
+ * @see #Combine_Tile_Advise
+ * @see #COMBINE_TILES_PER_THREAD
+ * @see #COMBINE_FITS_FILE_MEMORY
+ * @see #DpRt_Combine_Thread_Count_Get
+ * @see dprt_config.html#DpRt_Config_Get
+ */
+static int Combine_Run(struct Combine_Struct *combine)
+{
+	struct DpRt_Config_Struct config;
+	pthread_t thread_list[DPRT_COMBINE_THREAD_COUNT_MAX];
+	size_t memory_budget,file_memory,row_stack_size;
+	int thread_count,started_count,i,retval;
+
+	DpRt_Config_Get(&config);
+	memory_budget = ((size_t)config.Combine_Memory_MB)*1024*1024;
+	file_memory = ((size_t)combine->Frame_Count)*COMBINE_FITS_FILE_MEMORY;
+	if(file_memory < memory_budget)
+		memory_budget -= file_memory;
+	else
+		memory_budget = 0;
+	row_stack_size = ((size_t)combine->Frame_Count)*combine->Naxis1*sizeof(unsigned short);
+	thread_count = DpRt_Combine_Thread_Count_Get();
+	if(thread_count > combine->Naxis2)
+		thread_count = combine->Naxis2;
+	/* each worker holds at least one row of every frame */
+	if(((size_t)thread_count) > memory_budget/row_stack_size)
+		thread_count = (int)(memory_budget/row_stack_size);
+	if(thread_count < 1)
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"Combine_Run:%d MB is too little to combine %d frames of %d "
+			"columns:Using one row at a time.",config.Combine_Memory_MB,combine->Frame_Count,combine->Naxis1);
+		thread_count = 1;
+	}
+	combine->Thread_Count = thread_count;
+	combine->Tile_Rows = (int)(memory_budget/(row_stack_size*thread_count));
+	if(combine->Tile_Rows > combine->Naxis2/(thread_count*COMBINE_TILES_PER_THREAD))
+		combine->Tile_Rows = combine->Naxis2/(thread_count*COMBINE_TILES_PER_THREAD);
+	if(combine->Tile_Rows < 1)
+		combine->Tile_Rows = 1;
+	combine->Tile_Count = (combine->Naxis2+combine->Tile_Rows-1)/combine->Tile_Rows;
+	combine->Next_Tile = 0;
+	combine->Error_Number = 0;
+	combine->Error_String[0] = '\0';
+	combine->Log_Tag = DpRt_Error_Current_Get()->Log_Tag;
+	combine->Abort_Generation = DpRt_Error_Current_Get()->Abort_Generation;
+	pthread_mutex_init(&(combine->Mutex),NULL);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_DEBUG,"Combine_Run:Combining %d frames of %d x %d using %d threads and "
+		"%d tiles of %d rows within %d MB.",combine->Frame_Count,combine->Naxis1,combine->Naxis2,thread_count,
+		combine->Tile_Count,combine->Tile_Rows,config.Combine_Memory_MB);
+	for(i = 0; i < thread_count; i++)
+		Combine_Tile_Advise(combine,i,POSIX_FADV_WILLNEED);
+	started_count = 0;
+	for(i = 0; i < thread_count; i++)
+	{
+		if(pthread_create(&(thread_list[i]),NULL,Combine_Worker,(void *)combine) != 0)
+		{
+			Combine_Error_Set(combine,304,"Combine_Run:Failed to create worker thread.");
+			break;
+		}
+		started_count++;
+	}
+	for(i = 0; i < started_count; i++)
+		pthread_join(thread_list[i],NULL);
+	pthread_mutex_destroy(&(combine->Mutex));
+	retval = TRUE;
+	if(combine->Error_Number != 0)
+	{
+		DpRt_Error_Number = combine->Error_Number;
+		strcpy(DpRt_Error_String,combine->Error_String);
+		retval = FALSE;
+	}
+	return retval;
+}
+
+/**
+ * Combine worker thread. Repeatedly takes the next tile, reads its rows from every frame (holding the cfitsio
+ * lock) and combines each pixel of the tile into the output frame, using the combine's Method. While it combines
+ * a tile, the tile one round of workers ahead is prefetched. The abort flag
+ * is polled after each DPRT_FITS_BLOCK_PIXELS block is read and before each row is combined. On an abort the
+ * worker records a DPRT_ABORT_ERROR_NUMBER error, which also stops the other workers taking new tiles. Each
+ * worker binds its own error state, so a failure is recorded with its own message, logging under the caller's tag.
+ * @param user_arg The address of the shared combine structure.
+ * @return NULL.
+ * @see #Combine_Tile_Get
+ * @see #Combine_Tile_Advise
+ * @see #Combine_Median
+ * @see #Combine_Sigma_Clip
+ * @see #Combine_Error_Set
+ * @see dprt_fits.html#DpRt_Fits_Lock
+ * @see dprt_fits.html#DpRt_Fits_Image_Read_Rows
+ * @see dprt_fits.html#DpRt_Fits_Unlock
+ * @see dprt_abort.html#DpRt_Abort_Checkpoint
+ * @see dprt_context.html#DpRt_Error_Bind
+ */
+static void *Combine_Worker(void *user_arg)
+{
+	struct DpRt_Error_Struct error;
+	struct DpRt_Abort_Checkpoint_Struct checkpoint;
+	struct Combine_Struct *combine = NULL;
+	unsigned short *tile_stack = NULL;
+	unsigned short *values = NULL;
+	float *float_values = NULL;
+	size_t tile_pixels,pixel_count,output_pixel,p;
+	float bias;
+	int tile,start_row,row_count,block_rows,row,read_rows,frame,retval;
+
+	combine = (struct Combine_Struct *)user_arg;
+	error.Number = 0;
+	error.String[0] = '\0';
+	error.Log_Tag = combine->Log_Tag;
+	error.Abort_Generation = combine->Abort_Generation;
+	DpRt_Error_Bind(&error);
+	block_rows = DPRT_FITS_BLOCK_PIXELS/combine->Naxis1;
+	if(block_rows < 1)
+		block_rows = 1;
+	tile_pixels = ((size_t)combine->Tile_Rows)*combine->Naxis1;
+	tile_stack = (unsigned short *)malloc(tile_pixels*combine->Frame_Count*sizeof(unsigned short));
+	values = (unsigned short *)malloc(combine->Frame_Count*sizeof(unsigned short));
+	float_values = (float *)malloc(combine->Frame_Count*sizeof(float));
+	if((tile_stack == NULL)||(values == NULL)||(float_values == NULL))
+	{
+		if(tile_stack != NULL)
+			free(tile_stack);
+		if(values != NULL)
+			free(values);
+		if(float_values != NULL)
+			free(float_values);
+		Combine_Error_Set(combine,305,"Combine_Worker:Failed to allocate tile stack.");
+		return NULL;
+	}
+	DpRt_Abort_Checkpoint_Initialise(&checkpoint);
+	while(Combine_Tile_Get(combine,&tile))
+	{
+		start_row = tile*combine->Tile_Rows;
+		row_count = combine->Tile_Rows;
+		if(start_row+row_count > combine->Naxis2)
+			row_count = combine->Naxis2-start_row;
+		pixel_count = ((size_t)row_count)*combine->Naxis1;
+		/* read this tile from every frame */
+		DpRt_Fits_Lock();
+		retval = TRUE;
+		for(frame = 0; (frame < combine->Frame_Count) && retval; frame++)
+		{
+			/* read each frame's tile a block of rows at a time, so large tiles do not delay an abort */
+			for(row = 0; (row < row_count) && retval; row += block_rows)
+			{
+				read_rows = row_count-row;
+				if(read_rows > block_rows)
+					read_rows = block_rows;
+				retval = DpRt_Fits_Image_Read_Rows(combine->Fits_Fp_List[frame],combine->Naxis1,
+								   start_row+row,read_rows,tile_stack+(frame*tile_pixels)+
+								   (((size_t)row)*combine->Naxis1));
+				if(retval == FALSE)
+					Combine_Error_Set(combine,DpRt_Error_Number,DpRt_Error_String);
+				else if(!DpRt_Abort_Checkpoint(&checkpoint,((long)read_rows)*combine->Naxis1,NULL))
+				{
+					Combine_Error_Set(combine,DPRT_ABORT_ERROR_NUMBER,"Combine_Worker:Aborted.");
+					retval = FALSE;
+				}
+			}
+		}
+		DpRt_Fits_Unlock();
+		if(retval == FALSE)
+			break;
+		/* the tile read is not needed again, and the tile this worker is likely to take next can be read while
+		** this one is combined */
+		Combine_Tile_Advise(combine,tile,POSIX_FADV_DONTNEED);
+		Combine_Tile_Advise(combine,tile+combine->Thread_Count,POSIX_FADV_WILLNEED);
+		/* combine each pixel across the stack, polling the abort flag at the start of each row */
+		for(p = 0; p < pixel_count; p++)
+		{
+			if(((p%combine->Naxis1) == 0)&&
+			   (!DpRt_Abort_Checkpoint(&checkpoint,((long)combine->Naxis1)*combine->Frame_Count,NULL)))
+			{
+				Combine_Error_Set(combine,DPRT_ABORT_ERROR_NUMBER,"Combine_Worker:Aborted.");
+				break;
+			}
+			output_pixel = (((size_t)start_row)*combine->Naxis1)+p;
+			if(combine->Method == COMBINE_METHOD_MEDIAN)
+			{
+				for(frame = 0; frame < combine->Frame_Count; frame++)
+					values[frame] = tile_stack[(frame*tile_pixels)+p];
+				combine->Output[output_pixel] = Combine_Median(values,combine->Frame_Count);
+			}
+			else
+			{
+				bias = 0.0f;
+				if(combine->Bias != NULL)
+					bias = combine->Bias[output_pixel];
+				for(frame = 0; frame < combine->Frame_Count; frame++)
+				{
+					float_values[frame] = (float)(tile_stack[(frame*tile_pixels)+p])-bias;
+					if(combine->Scale_List != NULL)
+						float_values[frame] /= (float)(combine->Scale_List[frame]);
+				}
+				combine->Output[output_pixel] = Combine_Sigma_Clip(float_values,combine->Frame_Count,
+										   combine->Sigma);
+			}
+		}
+	}
+	free(tile_stack);
+	free(values);
+	free(float_values);
+	return NULL;
+}
+
+/**
+ * Get the index of the next tile to combine.
+ * @param combine The address of the shared combine structure.
+ * @param tile The address of an integer to store the tile index in.
+ * @return TRUE if there was a tile to combine, FALSE if all tiles have been taken or a worker has failed.
+ */
+static int Combine_Tile_Get(struct Combine_Struct *combine,int *tile)
+{
+	int retval;
+
+	pthread_mutex_lock(&(combine->Mutex));
+	retval = (combine->Next_Tile < combine->Tile_Count)&&(combine->Error_Number == 0);
+	if(retval)
+	{
+		(*tile) = combine->Next_Tile;
+		combine->Next_Tile++;
+	}
+	pthread_mutex_unlock(&(combine->Mutex));
+	return retval;
+}
+
+/**
+ * Tell the kernel how a tile's rows of every frame will be used, so it can read them before a worker asks
+ * for them, or drop them from the page cache once read. This only advises the kernel, so it cannot fail, and the
+ * rows are not held in this process's memory. Frames without a prefetch file descriptor are skipped.
+ * @param combine The address of the shared combine structure.
+ * @param tile The index of the tile. Nothing is done if this is beyond the last tile.
+ * @param advice The posix_fadvise advice, POSIX_FADV_WILLNEED or POSIX_FADV_DONTNEED.
+ */
+static void Combine_Tile_Advise(struct Combine_Struct *combine,int tile,int advice)
+{
+	off_t offset,length;
+	int row_count,frame;
+
+	if((tile < 0)||(tile >= combine->Tile_Count))
+		return;
+	row_count = combine->Tile_Rows;
+	if(((tile*combine->Tile_Rows)+row_count) > combine->Naxis2)
+		row_count = combine->Naxis2-(tile*combine->Tile_Rows);
+	length = ((off_t)row_count)*combine->Naxis1*2;
+	for(frame = 0; frame < combine->Frame_Count; frame++)
+	{
+		if(combine->Prefetch_Fd_List[frame] < 0)
+			continue;
+		offset = ((off_t)combine->Data_Start_List[frame])+(((off_t)tile)*combine->Tile_Rows*combine->Naxis1*2);
+		posix_fadvise(combine->Prefetch_Fd_List[frame],offset,length,advice);
+	}
+}
+
+/**
+ * Record a worker error. Only the first error is kept; once an error is set the other workers stop
+ * taking new tiles.
+ * @param combine The address of the shared combine structure.
+ * @param error_number The error number.
+ * @param error_string The error string.
+ */
+static void Combine_Error_Set(struct Combine_Struct *combine,int error_number,char *error_string)
+{
+	pthread_mutex_lock(&(combine->Mutex));
+	if(combine->Error_Number == 0)
+	{
+		combine->Error_Number = error_number;
+		strncpy(combine->Error_String,error_string,DPRT_ERROR_STRING_LENGTH-1);
+		combine->Error_String[DPRT_ERROR_STRING_LENGTH-1] = '\0';
+	}
+	pthread_mutex_unlock(&(combine->Mutex));
+}
+
+/**
+ * Find the median of a list of values, using Wirth's selection algorithm. For an even number of values the
+ * mean of the two middle values is returned.
+ * @param values The list of values. The list is re-ordered.
+ * @param count The number of values in the list.
+ * @return The median value.
+ */
+static float Combine_Median(unsigned short *values,int count)
+{
+	unsigned short pivot,tmp,lower_max;
+	int left,right,i,j,k;
+
+	k = count/2;
+	left = 0;
+	right = count-1;
+	while(left < right)
+	{
+		pivot = values[k];
+		i = left;
+		j = right;
+		do
+		{
+			while(values[i] < pivot)
+				i++;
+			while(pivot < values[j])
+				j--;
+			if(i <= j)
+			{
+				tmp = values[i];
+				values[i] = values[j];
+				values[j] = tmp;
+				i++;
+				j--;
+			}
+		} while(i <= j);
+		if(j < k)
+			left = i;
+		if(k < i)
+			right = j;
+	}
+	if((count % 2) == 1)
+		return (float)(values[k]);
+	/* values below k are all <= values[k], the other middle value is the largest of them */
+	lower_max = values[0];
+	for(i = 1; i < k; i++)
+	{
+		if(values[i] > lower_max)
+			lower_max = values[i];
+	}
+	return ((float)lower_max+(float)values[k])/2.0f;
+}
+
+/**
+ * Combine a list of values with an iterative sigma clipped mean. Values more than sigma standard deviations
+ * from the median of the remaining values are rejected, until no more are rejected or
+ * COMBINE_SIGMA_CLIP_ITERATIONS_MAX iterations have been done.
+ * @param values The list of values. The list is re-ordered.
+ * @param count The number of values in the list.
+ * @param sigma The clipping threshold, in standard deviations.
+ * @return The mean of the values that were not rejected.
+ * @see #COMBINE_SIGMA_CLIP_ITERATIONS_MAX
+ * @see #DpRt_Combine_Median_Float
+ */
+static float Combine_Sigma_Clip(float *values,int count,double sigma)
+{
+	double sum,sum_squares,mean,variance,limit;
+	float median,tmp;
+	int iteration,kept_count,i;
+
+	for(iteration = 0; iteration < COMBINE_SIGMA_CLIP_ITERATIONS_MAX; iteration++)
+	{
+		if(count < 3)
+			break;
+		sum = 0.0;
+		sum_squares = 0.0;
+		for(i = 0; i < count; i++)
+		{
+			sum += values[i];
+			sum_squares += ((double)values[i])*values[i];
+		}
+		mean = sum/count;
+		variance = (sum_squares/count)-(mean*mean);
+		if(variance <= 0.0)
+			break;
+		limit = sigma*sqrt(variance);
+		median = DpRt_Combine_Median_Float(values,count);
+		/* move the values we keep to the front of the list */
+		kept_count = 0;
+		for(i = 0; i < count; i++)
+		{
+			if(fabs(values[i]-median) <= limit)
+			{
+				tmp = values[kept_count];
+				values[kept_count] = values[i];
+				values[i] = tmp;
+				kept_count++;
+			}
+		}
+		if((kept_count == count)||(kept_count == 0))
+			break;
+		count = kept_count;
+	}
+	sum = 0.0;
+	for(i = 0; i < count; i++)
+		sum += values[i];
+	return (float)(sum/count);
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
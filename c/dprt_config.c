@@ -0,0 +1,380 @@
+/* dprt_config.c
+** Configuration property snapshot for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_config.c reads all the library's "dprt.*" configuration properties in one go, into a typed snapshot
+ * structure. The properties are loaded by DpRt_Initialise, and again whenever a reload is requested.
+ * Reduction routines take a copy of the snapshot with DpRt_Config_Get, which does not call the property
+ * functions, so a frame reduction under JNI does not call back into Java to read its configuration.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_extract.h"
+#include "dprt_wavelength.h"
+#include "dprt_cosmic.h"
+#include "dprt_config.h"
+#include "dprt_context.h"
+#include "dprt_log.h"
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The current configuration snapshot.
+ */
+static struct DpRt_Config_Struct Config;
+/**
+ * Mutex protecting Config, so a reload does not change it while it is being copied.
+ */
+static pthread_mutex_t Config_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static void Config_Boolean_Get(char *keyword,int default_value,int *value);
+static void Config_Integer_Get(char *keyword,int default_value,int *value);
+static void Config_Double_Get(char *keyword,double default_value,double *value);
+static int Config_String_Get(char *keyword,char *value,int value_length);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Load the configuration snapshot from the "dprt.*" properties. The properties are read into a new snapshot,
+ * which only replaces the current one if all the properties were read successfully.
+ * Boolean properties that are not set default to FALSE, other properties that are not set have the defaults
+ * defined in dprt_config.h.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Config
+ * @see #Config_Boolean_Get
+ * @see #Config_Integer_Get
+ * @see #Config_Double_Get
+ * @see #Config_String_Get
+ */
+int DpRt_Config_Load(void)
+{
+	struct DpRt_Config_Struct config;
+	char compression[FLEN_VALUE];
+	char log_level[FLEN_VALUE];
+
+	Config_Boolean_Get("dprt.full_reduction",FALSE,&(config.Full_Reduction));
+	Config_Boolean_Get("dprt.make_master_bias",FALSE,&(config.Make_Master_Bias));
+	Config_Boolean_Get("dprt.make_master_flat",FALSE,&(config.Make_Master_Flat));
+	if(!Config_String_Get("dprt.master.directory",config.Master_Directory,DPRT_FITS_FILENAME_LENGTH))
+		return FALSE;
+	Config_Integer_Get("dprt.quick.time_budget",DPRT_CONFIG_QUICK_TIME_BUDGET_DEFAULT,
+			   &(config.Quick_Time_Budget));
+	Config_Integer_Get("dprt.quick.decimation",DPRT_CONFIG_QUICK_DECIMATION_DEFAULT,&(config.Quick_Decimation));
+	if(config.Quick_Decimation < 1)
+	{
+		DpRt_Error_Number = 601;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.quick.decimation %d.",
+			config.Quick_Decimation);
+		return FALSE;
+	}
+	Config_Double_Get("dprt.saturation_level",DPRT_CONFIG_SATURATION_LEVEL_DEFAULT,&(config.Saturation_Level));
+	Config_Double_Get("dprt.ccd.gain",DPRT_CONFIG_GAIN_DEFAULT,&(config.Gain));
+	if(config.Gain <= 0.0)
+	{
+		DpRt_Error_Number = 602;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.ccd.gain %.2f.",config.Gain);
+		return FALSE;
+	}
+	Config_Double_Get("dprt.ccd.read_noise",DPRT_CONFIG_READ_NOISE_DEFAULT,&(config.Read_Noise));
+	if(config.Read_Noise <= 0.0)
+	{
+		DpRt_Error_Number = 617;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.ccd.read_noise %.2f.",config.Read_Noise);
+		return FALSE;
+	}
+	Config_Integer_Get("dprt.extract.trace_order",DPRT_CONFIG_TRACE_ORDER_DEFAULT,&(config.Trace_Order));
+	if((config.Trace_Order < 0)||(config.Trace_Order > DPRT_EXTRACT_TRACE_ORDER_MAX))
+	{
+		DpRt_Error_Number = 603;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.extract.trace_order %d.",
+			config.Trace_Order);
+		return FALSE;
+	}
+	if(!Config_String_Get("dprt.wavelength.line_list",config.Wavelength_Line_List,DPRT_FITS_FILENAME_LENGTH))
+		return FALSE;
+	Config_Double_Get("dprt.wavelength.centre",DPRT_CONFIG_WAVELENGTH_CENTRE_DEFAULT,&(config.Wavelength_Centre));
+	Config_Double_Get("dprt.wavelength.dispersion",DPRT_CONFIG_WAVELENGTH_DISPERSION_DEFAULT,
+			  &(config.Wavelength_Dispersion));
+	Config_Integer_Get("dprt.wavelength.order",DPRT_CONFIG_WAVELENGTH_ORDER_DEFAULT,&(config.Wavelength_Order));
+	if((config.Wavelength_Order < 1)||(config.Wavelength_Order > DPRT_WAVELENGTH_ORDER_MAX))
+	{
+		DpRt_Error_Number = 604;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.wavelength.order %d.",
+			config.Wavelength_Order);
+		return FALSE;
+	}
+	Config_Double_Get("dprt.wavelength.match_tolerance",DPRT_CONFIG_WAVELENGTH_MATCH_TOLERANCE_DEFAULT,
+			  &(config.Wavelength_Match_Tolerance));
+	if(config.Wavelength_Match_Tolerance <= 0.0)
+	{
+		DpRt_Error_Number = 605;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.wavelength.match_tolerance %.2f.",
+			config.Wavelength_Match_Tolerance);
+		return FALSE;
+	}
+	Config_Integer_Get("dprt.abort.check_pixels",DPRT_CONFIG_ABORT_CHECK_PIXELS_DEFAULT,
+			   &(config.Abort_Check_Pixels));
+	if(config.Abort_Check_Pixels < 1)
+	{
+		DpRt_Error_Number = 606;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.abort.check_pixels %d.",
+			config.Abort_Check_Pixels);
+		return FALSE;
+	}
+	Config_Boolean_Get("dprt.writer.async",FALSE,&(config.Writer_Async));
+	Config_Integer_Get("dprt.writer.queue_length",DPRT_CONFIG_WRITER_QUEUE_LENGTH_DEFAULT,
+			   &(config.Writer_Queue_Length));
+	if(config.Writer_Queue_Length < 1)
+	{
+		DpRt_Error_Number = 607;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.writer.queue_length %d.",
+			config.Writer_Queue_Length);
+		return FALSE;
+	}
+	Config_Integer_Get("dprt.writer.thread_count",DPRT_CONFIG_WRITER_THREAD_COUNT_DEFAULT,
+			   &(config.Writer_Thread_Count));
+	if((config.Writer_Thread_Count < 1)||(config.Writer_Thread_Count > DPRT_CONFIG_WRITER_THREAD_COUNT_MAX))
+	{
+		DpRt_Error_Number = 608;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.writer.thread_count %d.",
+			config.Writer_Thread_Count);
+		return FALSE;
+	}
+	if(!Config_String_Get("dprt.writer.compression",compression,FLEN_VALUE))
+		return FALSE;
+	if((strlen(compression) == 0)||(strcmp(compression,"none") == 0))
+		config.Writer_Compression = 0;
+	else if(strcmp(compression,"rice") == 0)
+		config.Writer_Compression = RICE_1;
+	else if(strcmp(compression,"gzip") == 0)
+		config.Writer_Compression = GZIP_1;
+	else
+	{
+		DpRt_Error_Number = 609;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.writer.compression %s.",compression);
+		return FALSE;
+	}
+	if(!Config_String_Get("dprt.log.level",log_level,FLEN_VALUE))
+		return FALSE;
+	if((strlen(log_level) == 0)||(strcmp(log_level,"info") == 0))
+		config.Log_Level = DPRT_LOG_LEVEL_INFO;
+	else if(strcmp(log_level,"error") == 0)
+		config.Log_Level = DPRT_LOG_LEVEL_ERROR;
+	else if(strcmp(log_level,"warning") == 0)
+		config.Log_Level = DPRT_LOG_LEVEL_WARNING;
+	else if(strcmp(log_level,"debug") == 0)
+		config.Log_Level = DPRT_LOG_LEVEL_DEBUG;
+	else
+	{
+		DpRt_Error_Number = 610;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.log.level %s.",log_level);
+		return FALSE;
+	}
+	if(!Config_String_Get("dprt.log.filename",config.Log_Filename,DPRT_FITS_FILENAME_LENGTH))
+		return FALSE;
+	Config_Boolean_Get("dprt.cosmic.reject",FALSE,&(config.Cosmic_Reject));
+	Config_Double_Get("dprt.cosmic.sigma_clip",DPRT_CONFIG_COSMIC_SIGMA_CLIP_DEFAULT,&(config.Cosmic_Sigma_Clip));
+	if(config.Cosmic_Sigma_Clip <= 0.0)
+	{
+		DpRt_Error_Number = 611;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.cosmic.sigma_clip %.2f.",
+			config.Cosmic_Sigma_Clip);
+		return FALSE;
+	}
+	Config_Double_Get("dprt.cosmic.sigma_fraction",DPRT_CONFIG_COSMIC_SIGMA_FRACTION_DEFAULT,
+			  &(config.Cosmic_Sigma_Fraction));
+	if((config.Cosmic_Sigma_Fraction <= 0.0)||(config.Cosmic_Sigma_Fraction > 1.0))
+	{
+		DpRt_Error_Number = 612;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.cosmic.sigma_fraction %.2f.",
+			config.Cosmic_Sigma_Fraction);
+		return FALSE;
+	}
+	Config_Double_Get("dprt.cosmic.object_limit",DPRT_CONFIG_COSMIC_OBJECT_LIMIT_DEFAULT,
+			  &(config.Cosmic_Object_Limit));
+	if(config.Cosmic_Object_Limit < 0.0)
+	{
+		DpRt_Error_Number = 613;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.cosmic.object_limit %.2f.",
+			config.Cosmic_Object_Limit);
+		return FALSE;
+	}
+	Config_Integer_Get("dprt.cosmic.iterations",DPRT_CONFIG_COSMIC_ITERATIONS_DEFAULT,
+			   &(config.Cosmic_Iterations));
+	if((config.Cosmic_Iterations < 1)||(config.Cosmic_Iterations > DPRT_COSMIC_ITERATIONS_MAX))
+	{
+		DpRt_Error_Number = 614;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.cosmic.iterations %d.",
+			config.Cosmic_Iterations);
+		return FALSE;
+	}
+	Config_Boolean_Get("dprt.overscan.correct",FALSE,&(config.Overscan_Correct));
+	Config_Integer_Get("dprt.overscan.smooth",DPRT_CONFIG_OVERSCAN_SMOOTH_DEFAULT,&(config.Overscan_Smooth));
+	if(config.Overscan_Smooth < 0)
+	{
+		DpRt_Error_Number = 615;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.overscan.smooth %d.",config.Overscan_Smooth);
+		return FALSE;
+	}
+	Config_Boolean_Get("dprt.bias.accumulate",FALSE,&(config.Bias_Accumulate));
+	Config_Integer_Get("dprt.combine.memory_mb",DPRT_CONFIG_COMBINE_MEMORY_MB_DEFAULT,
+			   &(config.Combine_Memory_MB));
+	if(config.Combine_Memory_MB < 1)
+	{
+		DpRt_Error_Number = 616;
+		sprintf(DpRt_Error_String,"DpRt_Config_Load:Illegal dprt.combine.memory_mb %d.",
+			config.Combine_Memory_MB);
+		return FALSE;
+	}
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Config_Load:Full Reduction:%d:Make Master Bias:%d:Make Master Flat:%d:"
+		"Master Directory:%s.",config.Full_Reduction,config.Make_Master_Bias,config.Make_Master_Flat,
+		config.Master_Directory);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Config_Load:Quick Time Budget:%d ms:Quick Decimation:%d:"
+		"Saturation Level:%.1f.",config.Quick_Time_Budget,config.Quick_Decimation,config.Saturation_Level);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Config_Load:Gain:%.2f:Read Noise:%.2f:Trace Order:%d.",config.Gain,
+		config.Read_Noise,config.Trace_Order);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Config_Load:Wavelength Line List:%s:Centre:%.2f:Dispersion:%.4f:Order:%d:"
+		"Match Tolerance:%.2f.",config.Wavelength_Line_List,config.Wavelength_Centre,
+		config.Wavelength_Dispersion,config.Wavelength_Order,config.Wavelength_Match_Tolerance);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Config_Load:Abort Check Pixels:%d.",config.Abort_Check_Pixels);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Config_Load:Writer Async:%d:Queue Length:%d:Thread Count:%d:"
+		"Compression:%d.",config.Writer_Async,config.Writer_Queue_Length,config.Writer_Thread_Count,
+		config.Writer_Compression);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Config_Load:Log Level:%d:Log Filename:%s.",config.Log_Level,
+		config.Log_Filename);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Config_Load:Cosmic Reject:%d:Sigma Clip:%.2f:Sigma Fraction:%.2f:"
+		"Object Limit:%.2f:Iterations:%d.",config.Cosmic_Reject,config.Cosmic_Sigma_Clip,
+		config.Cosmic_Sigma_Fraction,config.Cosmic_Object_Limit,config.Cosmic_Iterations);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Config_Load:Overscan Correct:%d:Overscan Smooth:%d.",
+		config.Overscan_Correct,config.Overscan_Smooth);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Config_Load:Bias Accumulate:%d:Combine Memory:%d MB.",
+		config.Bias_Accumulate,config.Combine_Memory_MB);
+	pthread_mutex_lock(&Config_Mutex);
+	Config = config;
+	pthread_mutex_unlock(&Config_Mutex);
+	return TRUE;
+}
+
+/**
+ * Get a copy of the current configuration snapshot.
+ * @param config The address of a structure to copy the snapshot into.
+ * @see #Config
+ */
+void DpRt_Config_Get(struct DpRt_Config_Struct *config)
+{
+	if(config == NULL)
+		return;
+	pthread_mutex_lock(&Config_Mutex);
+	(*config) = Config;
+	pthread_mutex_unlock(&Config_Mutex);
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Get a boolean property, using a default value if it cannot be retrieved.
+ * @param keyword The property keyword.
+ * @param default_value The value to use if the property is not set.
+ * @param value The address of an integer to store the value in.
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
+ */
+static void Config_Boolean_Get(char *keyword,int default_value,int *value)
+{
+	if(!DpRt_JNI_Get_Property_Boolean(keyword,value))
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_DEBUG,"Config_Boolean_Get:%s not set:Using default %d.",keyword,default_value);
+		(*value) = default_value;
+		DpRt_JNI_Error_Number = 0;
+		DpRt_JNI_Error_String[0] = '\0';
+	}
+}
+
+/**
+ * Get an integer property, using a default value if it cannot be retrieved.
+ * @param keyword The property keyword.
+ * @param default_value The value to use if the property is not set.
+ * @param value The address of an integer to store the value in.
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Integer
+ */
+static void Config_Integer_Get(char *keyword,int default_value,int *value)
+{
+	if(!DpRt_JNI_Get_Property_Integer(keyword,value))
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_DEBUG,"Config_Integer_Get:%s not set:Using default %d.",keyword,default_value);
+		(*value) = default_value;
+		DpRt_JNI_Error_Number = 0;
+		DpRt_JNI_Error_String[0] = '\0';
+	}
+}
+
+/**
+ * Get a double property, using a default value if it cannot be retrieved.
+ * @param keyword The property keyword.
+ * @param default_value The value to use if the property is not set.
+ * @param value The address of a double to store the value in.
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Double
+ */
+static void Config_Double_Get(char *keyword,double default_value,double *value)
+{
+	if(!DpRt_JNI_Get_Property_Double(keyword,value))
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_DEBUG,"Config_Double_Get:%s not set:Using default %.2f.",keyword,default_value);
+		(*value) = default_value;
+		DpRt_JNI_Error_Number = 0;
+		DpRt_JNI_Error_String[0] = '\0';
+	}
+}
+
+/**
+ * Get an optional string property. If it is not set, value is set to an empty string.
+ * @param keyword The property keyword.
+ * @param value A string to store the value in.
+ * @param value_length The length of value, including the terminating NULL.
+ * @return The routine returns TRUE on success and FALSE if the value is too long.
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property
+ */
+static int Config_String_Get(char *keyword,char *value,int value_length)
+{
+	char *property_value = NULL;
+
+	value[0] = '\0';
+	if(!DpRt_JNI_Get_Property(keyword,&property_value))
+	{
+		DpRt_JNI_Error_Number = 0;
+		DpRt_JNI_Error_String[0] = '\0';
+		return TRUE;
+	}
+	if(property_value == NULL)
+		return TRUE;
+	if((int)strlen(property_value) >= value_length)
+	{
+		DpRt_Error_Number = 600;
+		sprintf(DpRt_Error_String,"Config_String_Get:%s value too long(%d).",keyword,
+			(int)strlen(property_value));
+		free(property_value);
+		return FALSE;
+	}
+	strcpy(value,property_value);
+	free(property_value);
+	return TRUE;
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
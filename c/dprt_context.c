@@ -0,0 +1,295 @@
+/* dprt_context.c
+** Per-call reduction contexts for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_context.c holds reduction contexts, so several frames can be reduced at the same time on different
+ * threads. Each context carries its own error state, configuration snapshot and frame scratch buffers. The
+ * library routines report errors through DpRt_Error_Number and DpRt_Error_String, which refer to the error
+ * state bound to the calling thread by DpRt_Error_Bind. A thread with no error state bound uses the default
+ * context's, which the original DpRt_* entry points also use.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt_config.h"
+#include "dprt_kernel.h"
+#include "dprt_context.h"
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The default context, used by the DpRt_* entry points that do not take a context.
+ */
+static struct DpRt_Context_Struct Default_Context;
+/**
+ * The key of the thread-specific pointer to the error state bound to each thread.
+ */
+static pthread_key_t Error_Key;
+/**
+ * Used to create Error_Key once.
+ */
+static pthread_once_t Error_Key_Once = PTHREAD_ONCE_INIT;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static void Error_Key_Create(void);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Get the error state bound to the calling thread. This is used by the DpRt_Error_Number and DpRt_Error_String
+ * macros.
+ * @return The address of the error state bound to the calling thread, or of the default context's error state
+ *         if none is bound.
+ * @see #Error_Key
+ * @see #Default_Context
+ */
+struct DpRt_Error_Struct *DpRt_Error_Current_Get(void)
+{
+	struct DpRt_Error_Struct *error = NULL;
+
+	pthread_once(&Error_Key_Once,Error_Key_Create);
+	error = (struct DpRt_Error_Struct *)pthread_getspecific(Error_Key);
+	if(error == NULL)
+		return &(Default_Context.Error);
+	return error;
+}
+
+/**
+ * Bind an error state to the calling thread, so errors set by the library routines it calls are stored there.
+ * @param error The error state to bind, or NULL to revert to the default context's error state.
+ * @return The error state previously bound to the thread (NULL if none was), so the caller can restore it.
+ * @see #Error_Key
+ */
+struct DpRt_Error_Struct *DpRt_Error_Bind(struct DpRt_Error_Struct *error)
+{
+	struct DpRt_Error_Struct *previous_error = NULL;
+
+	pthread_once(&Error_Key_Once,Error_Key_Create);
+	previous_error = (struct DpRt_Error_Struct *)pthread_getspecific(Error_Key);
+	pthread_setspecific(Error_Key,error);
+	return previous_error;
+}
+
+/**
+ * Create a reduction context. Its error state is cleared, its configuration snapshot is copied from the current
+ * "dprt.*" properties snapshot, and it has no scratch buffers until a reduction needs them.
+ * @param context The address of a context pointer, set to the allocated context. This should be freed with
+ *        DpRt_Context_Destroy.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Context_Config_Refresh
+ * @see #DpRt_Context_Destroy
+ */
+int DpRt_Context_Create(struct DpRt_Context_Struct **context)
+{
+	if(context == NULL)
+	{
+		DpRt_Error_Number = 1200;
+		strcpy(DpRt_Error_String,"DpRt_Context_Create:context was NULL.");
+		return FALSE;
+	}
+	(*context) = (struct DpRt_Context_Struct *)calloc(1,sizeof(struct DpRt_Context_Struct));
+	if((*context) == NULL)
+	{
+		DpRt_Error_Number = 1201;
+		strcpy(DpRt_Error_String,"DpRt_Context_Create:Failed to allocate context.");
+		return FALSE;
+	}
+	DpRt_Context_Config_Refresh(*context);
+	return TRUE;
+}
+
+/**
+ * Destroy a reduction context created by DpRt_Context_Create, freeing its scratch buffers.
+ * @param context The context to destroy.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Context_Scratch_Free
+ */
+int DpRt_Context_Destroy(struct DpRt_Context_Struct *context)
+{
+	if((context == NULL)||(context == &Default_Context))
+	{
+		DpRt_Error_Number = 1202;
+		strcpy(DpRt_Error_String,"DpRt_Context_Destroy:Illegal context.");
+		return FALSE;
+	}
+	DpRt_Context_Scratch_Free(context);
+	free(context);
+	return TRUE;
+}
+
+/**
+ * Get the default context.
+ * @return The address of the default context.
+ * @see #Default_Context
+ */
+struct DpRt_Context_Struct *DpRt_Context_Default_Get(void)
+{
+	return &Default_Context;
+}
+
+/**
+ * Copy the current "dprt.*" properties snapshot into a context's configuration snapshot. A context keeps using
+ * its snapshot until this is called again, even if the properties are reloaded.
+ * @param context The context.
+ * @see dprt_config.html#DpRt_Config_Get
+ */
+void DpRt_Context_Config_Refresh(struct DpRt_Context_Struct *context)
+{
+	DpRt_Config_Get(&(context->Config));
+}
+
+/**
+ * Get one of a context's frame scratch buffers, and its saturation mask buffer, large enough for a frame of
+ * pixel_count pixels. The buffers are enlarged if necessary, and kept for the next reduction in the context.
+ * The mask is cleared.
+ * @param context The context.
+ * @param slot Which scratch buffer to get, from 0 to DPRT_CONTEXT_SCRATCH_COUNT-1.
+ * @param pixel_count The number of pixels in the frame.
+ * @param frame The address of a float pointer, set to the frame buffer.
+ * @param mask The address of a pointer, set to the mask buffer, DPRT_KERNEL_MASK_LENGTH(pixel_count) bytes long.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DPRT_CONTEXT_SCRATCH_COUNT
+ * @see dprt_kernel.html#DPRT_KERNEL_MASK_LENGTH
+ */
+int DpRt_Context_Scratch_Get(struct DpRt_Context_Struct *context,int slot,long pixel_count,float **frame,
+			     unsigned char **mask)
+{
+	float *new_frame = NULL;
+	unsigned char *new_mask = NULL;
+	size_t mask_length;
+
+	if((slot < 0)||(slot >= DPRT_CONTEXT_SCRATCH_COUNT))
+	{
+		DpRt_Error_Number = 1203;
+		sprintf(DpRt_Error_String,"DpRt_Context_Scratch_Get:Illegal slot %d.",slot);
+		return FALSE;
+	}
+	mask_length = DPRT_KERNEL_MASK_LENGTH(pixel_count);
+	if(context->Frame_Scratch_Length_List[slot] < (size_t)pixel_count)
+	{
+		new_frame = (float *)realloc(context->Frame_Scratch_List[slot],pixel_count*sizeof(float));
+		if(new_frame == NULL)
+		{
+			DpRt_Error_Number = 1204;
+			sprintf(DpRt_Error_String,"DpRt_Context_Scratch_Get:Failed to allocate frame(%ld).",
+				pixel_count);
+			return FALSE;
+		}
+		context->Frame_Scratch_List[slot] = new_frame;
+		context->Frame_Scratch_Length_List[slot] = pixel_count;
+	}
+	if(context->Mask_Scratch_Length_List[slot] < mask_length)
+	{
+		new_mask = (unsigned char *)realloc(context->Mask_Scratch_List[slot],mask_length*sizeof(unsigned char));
+		if(new_mask == NULL)
+		{
+			DpRt_Error_Number = 1205;
+			sprintf(DpRt_Error_String,"DpRt_Context_Scratch_Get:Failed to allocate mask(%ld).",
+				(long)mask_length);
+			return FALSE;
+		}
+		context->Mask_Scratch_List[slot] = new_mask;
+		context->Mask_Scratch_Length_List[slot] = mask_length;
+	}
+	memset(context->Mask_Scratch_List[slot],0,mask_length*sizeof(unsigned char));
+	(*frame) = context->Frame_Scratch_List[slot];
+	(*mask) = context->Mask_Scratch_List[slot];
+	return TRUE;
+}
+
+/**
+ * Get one of a context's cosmic ray mask buffers, large enough for a frame of pixel_count pixels. The buffer is
+ * enlarged if necessary, and kept for the next reduction in the context. The mask is not cleared, as
+ * DpRt_Cosmic_Reject clears it.
+ * @param context The context.
+ * @param slot Which scratch buffer's cosmic ray mask to get, from 0 to DPRT_CONTEXT_SCRATCH_COUNT-1.
+ * @param pixel_count The number of pixels in the frame.
+ * @param mask The address of a pointer, set to the mask buffer, DPRT_KERNEL_MASK_LENGTH(pixel_count) bytes long.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DPRT_CONTEXT_SCRATCH_COUNT
+ * @see dprt_kernel.html#DPRT_KERNEL_MASK_LENGTH
+ * @see dprt_cosmic.html#DpRt_Cosmic_Reject
+ */
+int DpRt_Context_Cosmic_Mask_Get(struct DpRt_Context_Struct *context,int slot,long pixel_count,
+				 unsigned char **mask)
+{
+	unsigned char *new_mask = NULL;
+	size_t mask_length;
+
+	if((slot < 0)||(slot >= DPRT_CONTEXT_SCRATCH_COUNT))
+	{
+		DpRt_Error_Number = 1206;
+		sprintf(DpRt_Error_String,"DpRt_Context_Cosmic_Mask_Get:Illegal slot %d.",slot);
+		return FALSE;
+	}
+	mask_length = DPRT_KERNEL_MASK_LENGTH(pixel_count);
+	if(context->Cosmic_Mask_Scratch_Length_List[slot] < mask_length)
+	{
+		new_mask = (unsigned char *)realloc(context->Cosmic_Mask_Scratch_List[slot],
+						    mask_length*sizeof(unsigned char));
+		if(new_mask == NULL)
+		{
+			DpRt_Error_Number = 1207;
+			sprintf(DpRt_Error_String,"DpRt_Context_Cosmic_Mask_Get:Failed to allocate mask(%ld).",
+				(long)mask_length);
+			return FALSE;
+		}
+		context->Cosmic_Mask_Scratch_List[slot] = new_mask;
+		context->Cosmic_Mask_Scratch_Length_List[slot] = mask_length;
+	}
+	(*mask) = context->Cosmic_Mask_Scratch_List[slot];
+	return TRUE;
+}
+
+/**
+ * Free a context's scratch buffers. They are reallocated by the next reduction that needs them.
+ * @param context The context.
+ */
+void DpRt_Context_Scratch_Free(struct DpRt_Context_Struct *context)
+{
+	int slot;
+
+	for(slot = 0; slot < DPRT_CONTEXT_SCRATCH_COUNT; slot++)
+	{
+		if(context->Frame_Scratch_List[slot] != NULL)
+			free(context->Frame_Scratch_List[slot]);
+		context->Frame_Scratch_List[slot] = NULL;
+		context->Frame_Scratch_Length_List[slot] = 0;
+		if(context->Mask_Scratch_List[slot] != NULL)
+			free(context->Mask_Scratch_List[slot]);
+		context->Mask_Scratch_List[slot] = NULL;
+		context->Mask_Scratch_Length_List[slot] = 0;
+		if(context->Cosmic_Mask_Scratch_List[slot] != NULL)
+			free(context->Cosmic_Mask_Scratch_List[slot]);
+		context->Cosmic_Mask_Scratch_List[slot] = NULL;
+		context->Cosmic_Mask_Scratch_Length_List[slot] = 0;
+	}
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Create the key of the thread-specific error state pointer. Called once, through pthread_once.
+ * @see #Error_Key
+ */
+static void Error_Key_Create(void)
+{
+	pthread_key_create(&Error_Key,NULL);
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
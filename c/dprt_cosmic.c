@@ -0,0 +1,712 @@
+/* dprt_cosmic.c
+** Parallel tiled cosmic ray rejection for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_cosmic.c finds the cosmic rays in a single calibrated frame, with the Laplacian edge detection of
+ * L.A.Cosmic (van Dokkum 2001, PASP 113, 1420). Cosmic rays have sharper edges than anything the optics can
+ * produce, so they stand out in the Laplacian of the frame:
+ * <ul>
+ * <li>The positive Laplacian L+ of the frame subsampled by two is computed (DpRt_Kernel_Laplacian_Row).
+ * <li>Its significance S = L+/2N is found from a noise model N, from the 5x5 median of the frame and the CCD
+ *     gain and read noise. The 5x5 median of S is subtracted, to remove sampling flux of smooth features,
+ *     giving S'.
+ * <li>Pixels with S' above Sigma_Clip are candidates. Candidates whose contrast against the fine structure
+ *     (the 3x3 median less the 7x7 median of the 3x3 median) is below Object_Limit are sharp features of the
+ *     spectrum, and are kept.
+ * <li>The neighbours of each cosmic ray are added if their S' is above Sigma_Clip, then their neighbours if
+ *     their S' is above Sigma_Fraction*Sigma_Clip.
+ * <li>The cosmic ray pixels are replaced by the median of their good 5x5 neighbours, and the detection is
+ *     repeated on the cleaned pixels, until an iteration finds nothing new.
+ * </ul>
+ * The frame is split into tiles of complete rows, which a pool of worker threads take in turn. Each worker
+ * copies its tile with a halo of COSMIC_TILE_HALO rows either side, and iterates on its copy independently, so
+ * a quiet tile stops after one iteration however busy the others are. Only the tile's own rows are written to
+ * the bit-packed cosmic ray mask. The frame itself is not changed: extraction ignores the masked pixels.
+ * The median filters are only evaluated where they can change the result: the noise model where L+ is positive,
+ * S' where S is above the lower threshold, and the fine structure at candidates.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_kernel.h"
+#include "dprt_combine.h"
+#include "dprt_cosmic.h"
+#include "dprt_abort.h"
+#include "dprt_context.h"
+#include "dprt_log.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The number of rows either side of a tile copied with it. This covers the footprint of the filters used to
+ * detect a cosmic ray (the 7x7 median of a 3x3 median, and the 5x5 median of the significance with one pixel
+ * of growth), so on the first iteration a tile's own rows are detected as they would be in the whole frame.
+ */
+#define COSMIC_TILE_HALO		(8)
+/**
+ * The minimum number of rows in a tile, so the halo does not dominate the work.
+ */
+#define COSMIC_TILE_ROWS_MIN		(16)
+/**
+ * The minimum number of tiles per worker thread, to balance the load between tiles with many cosmic rays
+ * (which take more iterations) and quiet ones.
+ */
+#define COSMIC_TILES_PER_THREAD		(4)
+/**
+ * The most memory, in bytes, all the workers' tile buffers may use.
+ */
+#define COSMIC_MEMORY_BUDGET		(32*1024*1024)
+/**
+ * The number of bytes each worker holds per tile pixel: four float buffers and a flag buffer.
+ * @see #Cosmic_Tile_Struct
+ */
+#define COSMIC_TILE_PIXEL_SIZE		((4*sizeof(float))+sizeof(unsigned char))
+/**
+ * The smallest fine structure contrast, in units of the noise, a candidate is divided by.
+ */
+#define COSMIC_FINE_STRUCTURE_MINIMUM	(0.01)
+/**
+ * Tile pixel flag. The pixel was found to be a cosmic ray by this or an earlier iteration.
+ */
+#define COSMIC_FLAG_HIT			(1<<0)
+/**
+ * Tile pixel flag. The pixel was found to be a cosmic ray by this iteration.
+ */
+#define COSMIC_FLAG_NEW			(1<<1)
+/**
+ * Tile pixel flag. The pixel is a cosmic ray candidate in this iteration, before the second growth step.
+ */
+#define COSMIC_FLAG_GROW		(1<<2)
+/**
+ * Tile pixel flag. The pixel is saturated, and is never a cosmic ray.
+ */
+#define COSMIC_FLAG_SATURATED		(1<<3)
+/**
+ * Tile pixel flag. Used by Cosmic_Grow to mark the pixels a growth step will set, until the step has looked at
+ * every pixel.
+ */
+#define COSMIC_FLAG_MARK		(1<<7)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding the state shared by the cosmic ray rejection worker threads.
+ * <dl>
+ * <dt>Frame</dt> <dd>The calibrated frame, Naxis1*Naxis2 pixels.</dd>
+ * <dt>Saturation_Mask</dt> <dd>A bit-packed mask of saturated pixels, or NULL.</dd>
+ * <dt>Naxis1</dt> <dd>The number of columns in the frame.</dd>
+ * <dt>Naxis2</dt> <dd>The number of rows in the frame.</dd>
+ * <dt>Parameters</dt> <dd>The rejection parameters.</dd>
+ * <dt>Cosmic_Mask</dt> <dd>The bit-packed mask cosmic ray pixels are set in.</dd>
+ * <dt>Tile_Rows</dt> <dd>The number of rows in each tile, excluding the halo.</dd>
+ * <dt>Tile_Count</dt> <dd>The number of tiles the frame is split into.</dd>
+ * <dt>Next_Tile</dt> <dd>The index of the next tile to be processed.</dd>
+ * <dt>Cosmic_Count</dt> <dd>The number of cosmic ray pixels found so far.</dd>
+ * <dt>Iteration_Count</dt> <dd>The total number of iterations done by all the tiles so far.</dd>
+ * <dt>Mutex</dt> <dd>Mutex protecting Next_Tile, the counts and the error fields.</dd>
+ * <dt>Error_Number</dt> <dd>The error number of the first worker to fail, or zero.</dd>
+ * <dt>Error_String</dt> <dd>The error string of the first worker to fail.</dd>
+ * <dt>Log_Tag</dt> <dd>The log tag of the calling thread, which the workers log under.</dd>
+ * <dt>Abort_Generation</dt> <dd>The abort generation of the calling thread, which the workers are aborted
+ *     with.</dd>
+ * </dl>
+ */
+struct Cosmic_Struct
+{
+	float *Frame;
+	unsigned char *Saturation_Mask;
+	int Naxis1;
+	int Naxis2;
+	struct DpRt_Cosmic_Parameter_Struct Parameters;
+	unsigned char *Cosmic_Mask;
+	int Tile_Rows;
+	int Tile_Count;
+	int Next_Tile;
+	long Cosmic_Count;
+	long Iteration_Count;
+	pthread_mutex_t Mutex;
+	int Error_Number;
+	char Error_String[DPRT_ERROR_STRING_LENGTH];
+	unsigned long Log_Tag;
+	unsigned long Abort_Generation;
+};
+
+/**
+ * Structure holding a worker's copy of one tile and its halo, and the images derived from it.
+ * <dl>
+ * <dt>Start_Row</dt> <dd>The frame row of the first row of the copy.</dd>
+ * <dt>Row_Count</dt> <dd>The number of rows in the copy, including the halo.</dd>
+ * <dt>Own_Start_Row</dt> <dd>The row of the copy where the tile's own rows start.</dd>
+ * <dt>Own_Row_Count</dt> <dd>The number of the tile's own rows.</dd>
+ * <dt>Naxis1</dt> <dd>The number of columns in each row.</dd>
+ * <dt>Data</dt> <dd>The tile's pixels, with the cosmic rays found so far replaced.</dd>
+ * <dt>Laplacian</dt> <dd>The positive Laplacian L+ of Data.</dd>
+ * <dt>Significance</dt> <dd>The significance S of the Laplacian.</dd>
+ * <dt>Significance_Residual</dt> <dd>S less its 5x5 median (S'), where S is above the lower threshold,
+ *     otherwise 0.</dd>
+ * <dt>Flag</dt> <dd>The COSMIC_FLAG_ bits of each pixel.</dd>
+ * </dl>
+ * @see #COSMIC_FLAG_HIT
+ */
+struct Cosmic_Tile_Struct
+{
+	int Start_Row;
+	int Row_Count;
+	int Own_Start_Row;
+	int Own_Row_Count;
+	int Naxis1;
+	float *Data;
+	float *Laplacian;
+	float *Significance;
+	float *Significance_Residual;
+	unsigned char *Flag;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Cosmic_Run(struct Cosmic_Struct *cosmic);
+static void *Cosmic_Worker(void *user_arg);
+static int Cosmic_Tile_Iterate(struct Cosmic_Struct *cosmic,struct Cosmic_Tile_Struct *tile,
+			       struct DpRt_Abort_Checkpoint_Struct *checkpoint,long *new_count);
+static int Cosmic_Tile_Get(struct Cosmic_Struct *cosmic,int *tile_index);
+static void Cosmic_Error_Set(struct Cosmic_Struct *cosmic,int error_number,char *error_string);
+static float Cosmic_Window_Median(float *image,struct Cosmic_Tile_Struct *tile,int x,int row,int half_width,
+				  int exclude_flags);
+static float Cosmic_Fine_Structure(struct Cosmic_Tile_Struct *tile,int x,int row);
+static int Cosmic_Grow(struct Cosmic_Tile_Struct *tile,int from_flags,int to_flag,float threshold);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Find the cosmic rays in a calibrated frame. The frame is split into tiles processed in parallel by up to
+ * DpRt_Combine_Thread_Count_Get worker threads. The frame is not changed.
+ * @param frame The frame, naxis1*naxis2 pixels, bias subtracted (and flat fielded).
+ * @param saturation_mask A bit-packed mask of saturated pixels, which are never cosmic rays, or NULL.
+ * @param naxis1 The number of columns in the frame.
+ * @param naxis2 The number of rows in the frame.
+ * @param parameters The address of the rejection parameters.
+ * @param cosmic_mask A bit-packed mask, DPRT_KERNEL_MASK_LENGTH(naxis1*naxis2) bytes long. It is cleared, and
+ *        the cosmic ray pixels set.
+ * @param cosmic_count The address of a long, set to the number of cosmic ray pixels found.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Cosmic_Run
+ * @see dprt_kernel.h#DPRT_KERNEL_MASK_LENGTH
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Cosmic_Reject(float *frame,unsigned char *saturation_mask,int naxis1,int naxis2,
+		       struct DpRt_Cosmic_Parameter_Struct *parameters,unsigned char *cosmic_mask,
+		       long *cosmic_count)
+{
+	struct Cosmic_Struct cosmic;
+
+	if((frame == NULL)||(parameters == NULL)||(cosmic_mask == NULL)||(cosmic_count == NULL))
+	{
+		DpRt_Error_Number = 1500;
+		strcpy(DpRt_Error_String,"DpRt_Cosmic_Reject:Parameter was NULL.");
+		return FALSE;
+	}
+	if((naxis1 < 1)||(naxis2 < 1))
+	{
+		DpRt_Error_Number = 1501;
+		sprintf(DpRt_Error_String,"DpRt_Cosmic_Reject:Illegal dimensions (%d,%d).",naxis1,naxis2);
+		return FALSE;
+	}
+	if((parameters->Gain <= 0.0)||(parameters->Sigma_Clip <= 0.0)||(parameters->Iteration_Count < 1)||
+	   (parameters->Iteration_Count > DPRT_COSMIC_ITERATIONS_MAX))
+	{
+		DpRt_Error_Number = 1502;
+		sprintf(DpRt_Error_String,"DpRt_Cosmic_Reject:Illegal parameters:Gain %.2f:Sigma Clip %.2f:"
+			"Iterations %d.",parameters->Gain,parameters->Sigma_Clip,parameters->Iteration_Count);
+		return FALSE;
+	}
+	memset(cosmic_mask,0,DPRT_KERNEL_MASK_LENGTH(((size_t)naxis1)*naxis2));
+	cosmic.Frame = frame;
+	cosmic.Saturation_Mask = saturation_mask;
+	cosmic.Naxis1 = naxis1;
+	cosmic.Naxis2 = naxis2;
+	cosmic.Parameters = (*parameters);
+	cosmic.Cosmic_Mask = cosmic_mask;
+	if(!Cosmic_Run(&cosmic))
+		return FALSE;
+	(*cosmic_count) = cosmic.Cosmic_Count;
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Split the frame into tiles, start the worker threads and wait for them to process every tile.
+ * The tile size is chosen so all the workers' tile buffers fit in COSMIC_MEMORY_BUDGET, and so there are
+ * at least COSMIC_TILES_PER_THREAD tiles per worker, but no fewer than COSMIC_TILE_ROWS_MIN rows per tile.
+ * @param cosmic The address of the cosmic structure, with the frame, mask and parameters filled in.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Cosmic_Worker
+ * @see #COSMIC_MEMORY_BUDGET
+ * @see #COSMIC_TILES_PER_THREAD
+ * @see #COSMIC_TILE_ROWS_MIN
+ * @see dprt_combine.html#DpRt_Combine_Thread_Count_Get
+ */
+static int Cosmic_Run(struct Cosmic_Struct *cosmic)
+{
+	pthread_t thread_list[DPRT_COMBINE_THREAD_COUNT_MAX];
+	size_t row_size;
+	int thread_count,started_count,i,retval;
+
+	thread_count = DpRt_Combine_Thread_Count_Get();
+	row_size = ((size_t)cosmic->Naxis1)*COSMIC_TILE_PIXEL_SIZE;
+	cosmic->Tile_Rows = (int)(COSMIC_MEMORY_BUDGET/(row_size*thread_count))-(2*COSMIC_TILE_HALO);
+	if(cosmic->Tile_Rows > cosmic->Naxis2/(thread_count*COSMIC_TILES_PER_THREAD))
+		cosmic->Tile_Rows = cosmic->Naxis2/(thread_count*COSMIC_TILES_PER_THREAD);
+	if(cosmic->Tile_Rows < COSMIC_TILE_ROWS_MIN)
+		cosmic->Tile_Rows = COSMIC_TILE_ROWS_MIN;
+	cosmic->Tile_Count = (cosmic->Naxis2+cosmic->Tile_Rows-1)/cosmic->Tile_Rows;
+	if(thread_count > cosmic->Tile_Count)
+		thread_count = cosmic->Tile_Count;
+	cosmic->Next_Tile = 0;
+	cosmic->Cosmic_Count = 0;
+	cosmic->Iteration_Count = 0;
+	cosmic->Error_Number = 0;
+	cosmic->Error_String[0] = '\0';
+	cosmic->Log_Tag = DpRt_Error_Current_Get()->Log_Tag;
+	cosmic->Abort_Generation = DpRt_Error_Current_Get()->Abort_Generation;
+	pthread_mutex_init(&(cosmic->Mutex),NULL);
+	started_count = 0;
+	for(i = 0; i < thread_count; i++)
+	{
+		if(pthread_create(&(thread_list[i]),NULL,Cosmic_Worker,(void *)cosmic) != 0)
+		{
+			Cosmic_Error_Set(cosmic,1503,"Cosmic_Run:Failed to create worker thread.");
+			break;
+		}
+		started_count++;
+	}
+	for(i = 0; i < started_count; i++)
+		pthread_join(thread_list[i],NULL);
+	pthread_mutex_destroy(&(cosmic->Mutex));
+	retval = TRUE;
+	if(cosmic->Error_Number != 0)
+	{
+		DpRt_Error_Number = cosmic->Error_Number;
+		strcpy(DpRt_Error_String,cosmic->Error_String);
+		retval = FALSE;
+	}
+	else
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_DEBUG,"Cosmic_Run:%d x %d:%d threads:%d tiles of %d rows:"
+			"%ld iterations:%ld cosmic ray pixels.",cosmic->Naxis1,cosmic->Naxis2,started_count,
+			cosmic->Tile_Count,cosmic->Tile_Rows,cosmic->Iteration_Count,cosmic->Cosmic_Count);
+	}
+	return retval;
+}
+
+/**
+ * Cosmic ray rejection worker thread. Repeatedly takes the next tile, copies it and its halo from the frame,
+ * and iterates the detection on the copy until an iteration finds no new cosmic rays, or the parameters'
+ * Iteration_Count iterations are done. The cosmic rays in the tile's own rows are then set in the mask. Tiles
+ * share mask bytes at their edges, so the bits are set atomically. On an abort the worker records a
+ * DPRT_ABORT_ERROR_NUMBER error, which also stops the other workers taking new tiles.
+ * @param user_arg The address of the shared cosmic structure.
+ * @return NULL.
+ * @see #Cosmic_Tile_Get
+ * @see #Cosmic_Tile_Iterate
+ * @see #Cosmic_Error_Set
+ * @see #COSMIC_TILE_HALO
+ * @see dprt_abort.html#DpRt_Abort_Checkpoint
+ * @see dprt_context.html#DpRt_Error_Bind
+ */
+static void *Cosmic_Worker(void *user_arg)
+{
+	struct DpRt_Error_Struct error;
+	struct DpRt_Abort_Checkpoint_Struct checkpoint;
+	struct Cosmic_Struct *cosmic = NULL;
+	struct Cosmic_Tile_Struct tile;
+	size_t tile_pixels,pixel,frame_pixel;
+	long new_count,cosmic_count;
+	int tile_index,iteration,retval;
+
+	cosmic = (struct Cosmic_Struct *)user_arg;
+	error.Number = 0;
+	error.String[0] = '\0';
+	error.Log_Tag = cosmic->Log_Tag;
+	error.Abort_Generation = cosmic->Abort_Generation;
+	DpRt_Error_Bind(&error);
+	tile.Naxis1 = cosmic->Naxis1;
+	tile_pixels = ((size_t)(cosmic->Tile_Rows+(2*COSMIC_TILE_HALO)))*cosmic->Naxis1;
+	tile.Data = (float *)malloc(tile_pixels*sizeof(float));
+	tile.Laplacian = (float *)malloc(tile_pixels*sizeof(float));
+	tile.Significance = (float *)malloc(tile_pixels*sizeof(float));
+	tile.Significance_Residual = (float *)malloc(tile_pixels*sizeof(float));
+	tile.Flag = (unsigned char *)malloc(tile_pixels*sizeof(unsigned char));
+	retval = (tile.Data != NULL)&&(tile.Laplacian != NULL)&&(tile.Significance != NULL)&&
+		(tile.Significance_Residual != NULL)&&(tile.Flag != NULL);
+	if(retval == FALSE)
+		Cosmic_Error_Set(cosmic,1504,"Cosmic_Worker:Failed to allocate tile buffers.");
+	DpRt_Abort_Checkpoint_Initialise(&checkpoint);
+	while(retval && Cosmic_Tile_Get(cosmic,&tile_index))
+	{
+		/* copy the tile and its halo, and flag its saturated pixels */
+		tile.Own_Start_Row = COSMIC_TILE_HALO;
+		tile.Start_Row = (tile_index*cosmic->Tile_Rows)-COSMIC_TILE_HALO;
+		if(tile.Start_Row < 0)
+		{
+			tile.Own_Start_Row += tile.Start_Row;
+			tile.Start_Row = 0;
+		}
+		tile.Own_Row_Count = cosmic->Tile_Rows;
+		if((tile_index*cosmic->Tile_Rows)+tile.Own_Row_Count > cosmic->Naxis2)
+			tile.Own_Row_Count = cosmic->Naxis2-(tile_index*cosmic->Tile_Rows);
+		tile.Row_Count = tile.Own_Start_Row+tile.Own_Row_Count+COSMIC_TILE_HALO;
+		if(tile.Start_Row+tile.Row_Count > cosmic->Naxis2)
+			tile.Row_Count = cosmic->Naxis2-tile.Start_Row;
+		tile_pixels = ((size_t)tile.Row_Count)*cosmic->Naxis1;
+		frame_pixel = ((size_t)tile.Start_Row)*cosmic->Naxis1;
+		memcpy(tile.Data,cosmic->Frame+frame_pixel,tile_pixels*sizeof(float));
+		for(pixel = 0; pixel < tile_pixels; pixel++)
+		{
+			tile.Flag[pixel] = 0;
+			if((cosmic->Saturation_Mask != NULL)&&
+			   DPRT_KERNEL_MASK_TEST(cosmic->Saturation_Mask,frame_pixel+pixel))
+				tile.Flag[pixel] = COSMIC_FLAG_SATURATED;
+		}
+		/* iterate until nothing new is found */
+		for(iteration = 0; iteration < cosmic->Parameters.Iteration_Count; iteration++)
+		{
+			retval = Cosmic_Tile_Iterate(cosmic,&tile,&checkpoint,&new_count);
+			if((retval == FALSE)||(new_count == 0))
+				break;
+		}
+		if(retval == FALSE)
+		{
+			Cosmic_Error_Set(cosmic,DpRt_Error_Number,DpRt_Error_String);
+			break;
+		}
+		/* set the tile's own cosmic rays in the mask */
+		cosmic_count = 0;
+		for(pixel = ((size_t)tile.Own_Start_Row)*cosmic->Naxis1;
+		    pixel < ((size_t)(tile.Own_Start_Row+tile.Own_Row_Count))*cosmic->Naxis1; pixel++)
+		{
+			if(tile.Flag[pixel]&COSMIC_FLAG_HIT)
+			{
+				__atomic_fetch_or(&(cosmic->Cosmic_Mask[(frame_pixel+pixel)>>3]),
+						  (unsigned char)(1<<((frame_pixel+pixel)&7)),__ATOMIC_RELAXED);
+				cosmic_count++;
+			}
+		}
+		pthread_mutex_lock(&(cosmic->Mutex));
+		cosmic->Cosmic_Count += cosmic_count;
+		cosmic->Iteration_Count += iteration+((iteration < cosmic->Parameters.Iteration_Count) ? 1 : 0);
+		pthread_mutex_unlock(&(cosmic->Mutex));
+	}
+	if(tile.Data != NULL)
+		free(tile.Data);
+	if(tile.Laplacian != NULL)
+		free(tile.Laplacian);
+	if(tile.Significance != NULL)
+		free(tile.Significance);
+	if(tile.Significance_Residual != NULL)
+		free(tile.Significance_Residual);
+	if(tile.Flag != NULL)
+		free(tile.Flag);
+	DpRt_Error_Bind(NULL);
+	return NULL;
+}
+
+/**
+ * Do one detection iteration on a tile. The Laplacian, its significance and (where needed) the significance
+ * residual are computed from the tile's current pixels. Candidates are found, grown, and the new cosmic rays
+ * replaced in the tile's pixels by the median of their 5x5 neighbours that are not cosmic rays, ready for the
+ * next iteration.
+ * @param cosmic The address of the shared cosmic structure.
+ * @param tile The address of the worker's tile.
+ * @param checkpoint The worker's abort checkpoint.
+ * @param new_count The address of a long, set to the number of new cosmic ray pixels found in the tile and
+ *        its halo.
+ * @return The routine returns TRUE on success, and FALSE if an abort was requested.
+ * @see #Cosmic_Window_Median
+ * @see #Cosmic_Fine_Structure
+ * @see #Cosmic_Grow
+ * @see dprt_kernel.html#DpRt_Kernel_Laplacian_Row
+ * @see dprt_abort.html#DpRt_Abort_Checkpoint
+ */
+static int Cosmic_Tile_Iterate(struct Cosmic_Struct *cosmic,struct Cosmic_Tile_Struct *tile,
+			       struct DpRt_Abort_Checkpoint_Struct *checkpoint,long *new_count)
+{
+	struct DpRt_Cosmic_Parameter_Struct *parameters = NULL;
+	float *row_data = NULL;
+	double read_noise_squared,noise,fine;
+	float median,sigma_low;
+	size_t pixel;
+	int row,x,naxis1;
+
+	parameters = &(cosmic->Parameters);
+	naxis1 = tile->Naxis1;
+	read_noise_squared = parameters->Read_Noise*parameters->Read_Noise;
+	sigma_low = (float)(parameters->Sigma_Fraction*parameters->Sigma_Clip);
+	/* Laplacian, significance and significance residual */
+	for(row = 0; row < tile->Row_Count; row++)
+	{
+		if(!DpRt_Abort_Checkpoint(checkpoint,naxis1,"Cosmic_Tile_Iterate"))
+			return FALSE;
+		row_data = tile->Data+(((size_t)row)*naxis1);
+		DpRt_Kernel_Laplacian_Row((row > 0) ? row_data-naxis1 : row_data,row_data,
+					  (row < tile->Row_Count-1) ? row_data+naxis1 : row_data,naxis1,
+					  tile->Laplacian+(((size_t)row)*naxis1));
+		for(x = 0; x < naxis1; x++)
+		{
+			pixel = (((size_t)row)*naxis1)+x;
+			tile->Significance[pixel] = 0.0f;
+			if(tile->Laplacian[pixel] <= 0.0f)
+				continue;
+			median = Cosmic_Window_Median(tile->Data,tile,x,row,2,0);
+			if(median < 0.0f)
+				median = 0.0f;
+			noise = sqrt((median*parameters->Gain)+read_noise_squared)/parameters->Gain;
+			if(noise > 0.0)
+				tile->Significance[pixel] = (float)(tile->Laplacian[pixel]/(2.0*noise));
+		}
+	}
+	for(row = 0; row < tile->Row_Count; row++)
+	{
+		for(x = 0; x < naxis1; x++)
+		{
+			pixel = (((size_t)row)*naxis1)+x;
+			tile->Flag[pixel] &= ~(COSMIC_FLAG_NEW|COSMIC_FLAG_GROW);
+			tile->Significance_Residual[pixel] = 0.0f;
+			/* the 5x5 median of S is never negative, so S' cannot pass a threshold S does not */
+			if(tile->Significance[pixel] > sigma_low)
+			{
+				tile->Significance_Residual[pixel] = tile->Significance[pixel]-
+					Cosmic_Window_Median(tile->Significance,tile,x,row,2,0);
+			}
+		}
+	}
+	/* candidates: significant, and sharper than the fine structure */
+	for(row = 0; row < tile->Row_Count; row++)
+	{
+		for(x = 0; x < naxis1; x++)
+		{
+			pixel = (((size_t)row)*naxis1)+x;
+			if(tile->Flag[pixel]&(COSMIC_FLAG_HIT|COSMIC_FLAG_SATURATED))
+				continue;
+			if(tile->Significance_Residual[pixel] <= parameters->Sigma_Clip)
+				continue;
+			/* the noise, in counts, at this pixel */
+			noise = tile->Laplacian[pixel]/(2.0*tile->Significance[pixel]);
+			fine = Cosmic_Fine_Structure(tile,x,row)/noise;
+			if(fine < COSMIC_FINE_STRUCTURE_MINIMUM)
+				fine = COSMIC_FINE_STRUCTURE_MINIMUM;
+			if(tile->Significance_Residual[pixel]/fine > parameters->Object_Limit)
+				tile->Flag[pixel] |= COSMIC_FLAG_GROW;
+		}
+	}
+	/* grow into neighbours above the clip, then their neighbours above the lower threshold */
+	Cosmic_Grow(tile,COSMIC_FLAG_GROW,COSMIC_FLAG_GROW,(float)(parameters->Sigma_Clip));
+	(*new_count) = Cosmic_Grow(tile,COSMIC_FLAG_GROW,COSMIC_FLAG_NEW,sigma_low);
+	if((*new_count) == 0)
+		return TRUE;
+	for(pixel = 0; pixel < ((size_t)tile->Row_Count)*naxis1; pixel++)
+	{
+		if(tile->Flag[pixel]&COSMIC_FLAG_NEW)
+			tile->Flag[pixel] |= COSMIC_FLAG_HIT;
+	}
+	/* replace the new cosmic rays, from neighbours that are not cosmic rays */
+	for(row = 0; row < tile->Row_Count; row++)
+	{
+		for(x = 0; x < naxis1; x++)
+		{
+			pixel = (((size_t)row)*naxis1)+x;
+			if(tile->Flag[pixel]&COSMIC_FLAG_NEW)
+				tile->Data[pixel] = Cosmic_Window_Median(tile->Data,tile,x,row,2,COSMIC_FLAG_HIT);
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Get the index of the next tile to process.
+ * @param cosmic The address of the shared cosmic structure.
+ * @param tile_index The address of an integer to store the tile index in.
+ * @return TRUE if there was a tile to process, FALSE if all tiles have been taken or a worker has failed.
+ */
+static int Cosmic_Tile_Get(struct Cosmic_Struct *cosmic,int *tile_index)
+{
+	int retval;
+
+	pthread_mutex_lock(&(cosmic->Mutex));
+	retval = (cosmic->Next_Tile < cosmic->Tile_Count)&&(cosmic->Error_Number == 0);
+	if(retval)
+	{
+		(*tile_index) = cosmic->Next_Tile;
+		cosmic->Next_Tile++;
+	}
+	pthread_mutex_unlock(&(cosmic->Mutex));
+	return retval;
+}
+
+/**
+ * Record a worker error. Only the first error is kept; once an error is set the other workers stop
+ * taking new tiles.
+ * @param cosmic The address of the shared cosmic structure.
+ * @param error_number The error number.
+ * @param error_string The error string.
+ */
+static void Cosmic_Error_Set(struct Cosmic_Struct *cosmic,int error_number,char *error_string)
+{
+	pthread_mutex_lock(&(cosmic->Mutex));
+	if(cosmic->Error_Number == 0)
+	{
+		cosmic->Error_Number = error_number;
+		strncpy(cosmic->Error_String,error_string,DPRT_ERROR_STRING_LENGTH-1);
+		cosmic->Error_String[DPRT_ERROR_STRING_LENGTH-1] = '\0';
+	}
+	pthread_mutex_unlock(&(cosmic->Mutex));
+}
+
+/**
+ * Find the median of a square window of one of a tile's images, clipped to the tile.
+ * @param image The image, one of the tile's buffers.
+ * @param tile The address of the tile.
+ * @param x The column of the centre of the window.
+ * @param row The tile row of the centre of the window.
+ * @param half_width The half width of the window, at most 3 (a 7x7 window).
+ * @param exclude_flags Pixels with any of these COSMIC_FLAG_ bits set are left out of the median.
+ * @return The median, or the image value at the centre if every pixel in the window was left out.
+ * @see dprt_combine.html#DpRt_Combine_Median_Float
+ */
+static float Cosmic_Window_Median(float *image,struct Cosmic_Tile_Struct *tile,int x,int row,int half_width,
+				  int exclude_flags)
+{
+	float values[49];
+	size_t pixel;
+	int value_count,r,c;
+
+	value_count = 0;
+	for(r = row-half_width; r <= row+half_width; r++)
+	{
+		if((r < 0)||(r >= tile->Row_Count))
+			continue;
+		for(c = x-half_width; c <= x+half_width; c++)
+		{
+			if((c < 0)||(c >= tile->Naxis1))
+				continue;
+			pixel = (((size_t)r)*tile->Naxis1)+c;
+			if(tile->Flag[pixel]&exclude_flags)
+				continue;
+			values[value_count++] = image[pixel];
+		}
+	}
+	if(value_count == 0)
+		return image[(((size_t)row)*tile->Naxis1)+x];
+	return DpRt_Combine_Median_Float(values,value_count);
+}
+
+/**
+ * Find the fine structure of a tile's pixels at one pixel: the 3x3 median of the pixels, less the 7x7 median
+ * of the 3x3 median. This is only needed at candidates, so the 3x3 medians are computed here as needed.
+ * @param tile The address of the tile.
+ * @param x The column of the pixel.
+ * @param row The tile row of the pixel.
+ * @return The fine structure, in counts.
+ * @see #Cosmic_Window_Median
+ */
+static float Cosmic_Fine_Structure(struct Cosmic_Tile_Struct *tile,int x,int row)
+{
+	float median3_list[49];
+	float median3;
+	int value_count,r,c;
+
+	median3 = Cosmic_Window_Median(tile->Data,tile,x,row,1,0);
+	value_count = 0;
+	for(r = row-3; r <= row+3; r++)
+	{
+		if((r < 0)||(r >= tile->Row_Count))
+			continue;
+		for(c = x-3; c <= x+3; c++)
+		{
+			if((c < 0)||(c >= tile->Naxis1))
+				continue;
+			median3_list[value_count++] = Cosmic_Window_Median(tile->Data,tile,c,r,1,0);
+		}
+	}
+	return median3-DpRt_Combine_Median_Float(median3_list,value_count);
+}
+
+/**
+ * One growth step: every pixel that has from_flags set, or is next to one that does, and whose significance
+ * residual is above the threshold, gets to_flag set. Pixels already found to be cosmic rays, and saturated
+ * pixels, are not grown into. The pixels that get to_flag are found before any are set, so growing into the
+ * same flag grows by one pixel only.
+ * @param tile The address of the tile.
+ * @param from_flags The COSMIC_FLAG_ bits to grow from.
+ * @param to_flag The COSMIC_FLAG_ bit to set.
+ * @param threshold The significance residual a pixel must be above to be grown into.
+ * @return The number of pixels with to_flag set.
+ * @see #COSMIC_FLAG_GROW
+ * @see #COSMIC_FLAG_MARK
+ */
+static int Cosmic_Grow(struct Cosmic_Tile_Struct *tile,int from_flags,int to_flag,float threshold)
+{
+	size_t pixel;
+	int count,naxis1,row,x,r,c,found;
+
+	naxis1 = tile->Naxis1;
+	count = 0;
+	/* mark the pixels to set, so this pass does not see its own results */
+	for(row = 0; row < tile->Row_Count; row++)
+	{
+		for(x = 0; x < naxis1; x++)
+		{
+			pixel = (((size_t)row)*naxis1)+x;
+			if(tile->Flag[pixel]&(COSMIC_FLAG_HIT|COSMIC_FLAG_SATURATED))
+				continue;
+			if(tile->Significance_Residual[pixel] <= threshold)
+				continue;
+			found = FALSE;
+			for(r = row-1; (r <= row+1) && (!found); r++)
+			{
+				if((r < 0)||(r >= tile->Row_Count))
+					continue;
+				for(c = x-1; (c <= x+1) && (!found); c++)
+				{
+					if((c >= 0)&&(c < naxis1)&&(tile->Flag[(((size_t)r)*naxis1)+c]&from_flags))
+						found = TRUE;
+				}
+			}
+			if(found)
+				tile->Flag[pixel] |= COSMIC_FLAG_MARK;
+		}
+	}
+	for(pixel = 0; pixel < ((size_t)tile->Row_Count)*naxis1; pixel++)
+	{
+		if(tile->Flag[pixel]&COSMIC_FLAG_MARK)
+		{
+			tile->Flag[pixel] = (unsigned char)((tile->Flag[pixel]&~COSMIC_FLAG_MARK)|to_flag);
+			count++;
+		}
+	}
+	return count;
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
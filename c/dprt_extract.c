@@ -0,0 +1,842 @@
+/* dprt_extract.c
+** Spectral trace finding and optimal extraction for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_extract.c finds the spectrum in a reduced FTSpec frame, and optimally extracts it.
+ * The dispersion axis is along NAXIS1 (columns), the spatial axis along NAXIS2 (rows).
+ * <ul>
+ * <li>DpRt_Extract_Trace_Find collapses the frame along the dispersion axis to find the spectrum, measures
+ *     the trace centre in bins of columns (following the trace outwards from the middle of the frame), and
+ *     fits the centres with a low order polynomial.
+ * <li>DpRt_Extract_Optimal does a Horne (1986, PASP 98, 609) style optimal extraction, using a gaussian spatial
+ *     profile of the measured width centred on the trace, with a variance model from the CCD gain and read
+ *     noise. Outlying pixels (cosmic rays) are rejected against the model.
+ * </ul>
+ * Columns are extracted in groups of four. The aperture pixels of each group are gathered into structure of
+ * arrays buffers (four adjacent columns are adjacent in memory in each frame row), and the weighted sums over
+ * the aperture are then done four columns at a time. Where the compiler supports SSE2 (__SSE2__ is defined)
+ * the sums use SSE intrinsics, otherwise a plain C version is used.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_kernel.h"
+#include "dprt_combine.h"
+#include "dprt_extract.h"
+#include "dprt_abort.h"
+#include "dprt_context.h"
+#include "dprt_log.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The number of standard deviations (of the collapsed spatial profile about its median) the profile's peak
+ * must be above the background for a spectrum to be found.
+ */
+#define EXTRACT_DETECT_SIGMA		(5.0)
+/**
+ * The nominal number of columns collapsed into each bin when measuring the trace centre.
+ */
+#define EXTRACT_TRACE_BIN_WIDTH		(32)
+/**
+ * The minimum number of bins the trace centre is measured in, for narrow frames.
+ */
+#define EXTRACT_TRACE_BIN_COUNT_MIN	(8)
+/**
+ * The number of rows either side of the previous trace centre searched for the trace in each bin.
+ */
+#define EXTRACT_TRACE_SEARCH_HALF_WIDTH	(15)
+/**
+ * A bin's profile peak must be at least this fraction of the collapsed profile's peak (both above background)
+ * for its trace centre to be used.
+ */
+#define EXTRACT_TRACE_SIGNAL_FRACTION	(0.2)
+/**
+ * Trace centres further than this many RMS from the first polynomial fit are rejected before refitting.
+ */
+#define EXTRACT_TRACE_CLIP_SIGMA	(3.0)
+/**
+ * The conversion between the gaussian sigma and full width half maximum.
+ */
+#define EXTRACT_FWHM_PER_SIGMA		(2.35482)
+/**
+ * The extraction aperture half width, in multiples of the profile FWHM.
+ */
+#define EXTRACT_APERTURE_FWHM		(1.5)
+/**
+ * The minimum extraction aperture half width, in pixels.
+ */
+#define EXTRACT_APERTURE_HALF_WIDTH_MIN	(2.0)
+/**
+ * The maximum extraction aperture half width, in pixels.
+ */
+#define EXTRACT_APERTURE_HALF_WIDTH_MAX	(30.0)
+/**
+ * The maximum number of rows gathered for one group of columns. This is enough for the maximum aperture
+ * plus the trace curvature across a group.
+ */
+#define EXTRACT_APERTURE_ROWS_MAX	((2*(int)EXTRACT_APERTURE_HALF_WIDTH_MAX)+8)
+/**
+ * The number of columns extracted together.
+ */
+#define EXTRACT_GROUP_COLUMNS		(4)
+/**
+ * The number of rows between the aperture edge and the sky regions.
+ */
+#define EXTRACT_SKY_GAP			(2)
+/**
+ * The number of rows in each of the two sky regions either side of the aperture.
+ */
+#define EXTRACT_SKY_WIDTH		(10)
+/**
+ * Aperture pixels further than this many standard deviations from the profile model are rejected.
+ */
+#define EXTRACT_REJECT_SIGMA		(5.0)
+/**
+ * The fractional error allowed in the gaussian profile model when rejecting pixels, so real profiles that are
+ * not quite gaussian do not lose their brightest pixels.
+ */
+#define EXTRACT_PROFILE_TOLERANCE	(0.1)
+/**
+ * The number of model variance / rejection iterations after the initial extraction.
+ */
+#define EXTRACT_REJECT_ITERATIONS	(2)
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Extract_Bin_Measure(float *frame,int naxis1,int naxis2,int x_start,int x_end,double guess,
+			       double minimum_signal,double *centre,double *fwhm);
+static double Extract_Sky_Get(float *frame,unsigned char *saturation_mask,unsigned char *cosmic_mask,int naxis1,
+			      int naxis2,int x,double centre,double half_width);
+static long Extract_Group_Solve(float *data,float *profile,float *weight,float *sky,int row_count,double v0,
+				double inv_gain,float *flux,float *variance);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Find the spectral trace in a frame. The frame is collapsed along the dispersion axis to find the row the
+ * spectrum is on. The trace centre and FWHM are then measured in bins of columns, starting from the middle
+ * bin and working outwards so each bin's search follows the trace curvature, and a polynomial is fitted to
+ * the bin centres.
+ * @param frame The frame, naxis1*naxis2 pixels. It should be bias subtracted, but need not be sky subtracted.
+ * @param naxis1 The number of columns in the frame.
+ * @param naxis2 The number of rows in the frame.
+ * @param order The order of polynomial to fit, 0 to DPRT_EXTRACT_TRACE_ORDER_MAX. A lower order is used if
+ *        there are too few bin centres.
+ * @param trace The address of a trace structure, filled in if a trace is found.
+ * @param found The address of an integer, set to TRUE if a trace was found and FALSE if not.
+ * @return The routine returns TRUE on success (whether or not a trace was found) and FALSE on failure or
+ *         if an abort was requested.
+ * @see #Extract_Bin_Measure
+ * @see dprt_kernel.html#DpRt_Kernel_Polynomial_Fit
+ * @see dprt_combine.html#DpRt_Combine_Median_Float
+ * @see dprt_abort.html#DpRt_Abort_Checkpoint
+ */
+int DpRt_Extract_Trace_Find(float *frame,int naxis1,int naxis2,int order,struct DpRt_Extract_Trace_Struct *trace,
+			    int *found)
+{
+	struct DpRt_Abort_Checkpoint_Struct checkpoint;
+	float *profile = NULL;
+	float *work = NULL;
+	double *x_list = NULL;
+	double *y_list = NULL;
+	double *fwhm_list = NULL;
+	double sum,background,noise,signal,guess,centre,fwhm,residual,rms;
+	int bin_count,bin_width,middle_bin,peak_row,point_count,keep_count,direction,bin,x,y,i;
+
+	if((frame == NULL)||(trace == NULL)||(found == NULL))
+	{
+		DpRt_Error_Number = 800;
+		strcpy(DpRt_Error_String,"DpRt_Extract_Trace_Find:Parameter was NULL.");
+		return FALSE;
+	}
+	if((order < 0)||(order > DPRT_EXTRACT_TRACE_ORDER_MAX))
+	{
+		DpRt_Error_Number = 801;
+		sprintf(DpRt_Error_String,"DpRt_Extract_Trace_Find:Illegal order %d.",order);
+		return FALSE;
+	}
+	(*found) = FALSE;
+	bin_count = naxis1/EXTRACT_TRACE_BIN_WIDTH;
+	if(bin_count < EXTRACT_TRACE_BIN_COUNT_MIN)
+		bin_count = EXTRACT_TRACE_BIN_COUNT_MIN;
+	if(bin_count > naxis1)
+		bin_count = naxis1;
+	bin_width = naxis1/bin_count;
+	profile = (float *)malloc(((2*naxis2)+bin_count)*sizeof(float));
+	x_list = (double *)malloc(3*bin_count*sizeof(double));
+	if((profile == NULL)||(x_list == NULL))
+	{
+		if(profile != NULL)
+			free(profile);
+		if(x_list != NULL)
+			free(x_list);
+		DpRt_Error_Number = 802;
+		sprintf(DpRt_Error_String,"DpRt_Extract_Trace_Find:Failed to allocate work space(%d,%d).",naxis2,
+			bin_count);
+		return FALSE;
+	}
+	work = profile+naxis2;
+	y_list = x_list+bin_count;
+	fwhm_list = y_list+bin_count;
+	/* collapse along the dispersion axis */
+	DpRt_Abort_Checkpoint_Initialise(&checkpoint);
+	for(y = 0; y < naxis2; y++)
+	{
+		sum = 0.0;
+		for(x = 0; x < naxis1; x++)
+			sum += frame[(((size_t)y)*naxis1)+x];
+		profile[y] = (float)(sum/naxis1);
+		work[y] = profile[y];
+		if(!DpRt_Abort_Checkpoint(&checkpoint,naxis1,"DpRt_Extract_Trace_Find"))
+		{
+			free(profile);
+			free(x_list);
+			return FALSE;
+		}
+	}
+	background = DpRt_Combine_Median_Float(work,naxis2);
+	for(y = 0; y < naxis2; y++)
+		work[y] = (float)fabs(profile[y]-background);
+	noise = 1.4826*DpRt_Combine_Median_Float(work,naxis2);
+	peak_row = 0;
+	for(y = 1; y < naxis2; y++)
+	{
+		if(profile[y] > profile[peak_row])
+			peak_row = y;
+	}
+	signal = profile[peak_row]-background;
+	if((signal <= 0.0)||(signal < EXTRACT_DETECT_SIGMA*noise))
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"DpRt_Extract_Trace_Find:No spectrum found:Peak %.2f:"
+			"Background %.2f:Noise %.2f.",profile[peak_row],background,noise);
+		free(profile);
+		free(x_list);
+		return TRUE;
+	}
+	/* measure the trace centre in each bin, following the trace out from the middle of the frame */
+	point_count = 0;
+	middle_bin = bin_count/2;
+	for(direction = 1; direction >= -1; direction -= 2)
+	{
+		guess = peak_row;
+		if(point_count > 0)
+			guess = y_list[0];
+		if(direction == 1)
+			bin = middle_bin;
+		else
+			bin = middle_bin-1;
+		while((bin >= 0)&&(bin < bin_count))
+		{
+			x = bin*bin_width;
+			if(Extract_Bin_Measure(frame,naxis1,naxis2,x,(bin == bin_count-1) ? naxis1 : x+bin_width,guess,
+					       EXTRACT_TRACE_SIGNAL_FRACTION*signal,&centre,&fwhm))
+			{
+				x_list[point_count] = (x+((bin == bin_count-1) ? naxis1 : x+bin_width)-1)/2.0;
+				y_list[point_count] = centre;
+				fwhm_list[point_count] = fwhm;
+				point_count++;
+				guess = centre;
+			}
+			bin += direction;
+		}
+	}
+	if(point_count < 1)
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"DpRt_Extract_Trace_Find:No trace centres measured.");
+		free(profile);
+		free(x_list);
+		return TRUE;
+	}
+	trace->X_Centre = (naxis1-1)/2.0;
+	trace->X_Scale = (naxis1 > 1) ? (naxis1-1)/2.0 : 1.0;
+	trace->Order = order;
+	if(trace->Order > point_count-1)
+		trace->Order = point_count-1;
+	while(!DpRt_Kernel_Polynomial_Fit(x_list,y_list,point_count,trace->Order,trace->X_Centre,trace->X_Scale,
+					  trace->Coefficient_List))
+	{
+		trace->Order--;
+	}
+	/* reject outlying centres and refit */
+	rms = 0.0;
+	for(i = 0; i < point_count; i++)
+	{
+		residual = y_list[i]-DpRt_Extract_Trace_Centre_Get(trace,x_list[i]);
+		rms += residual*residual;
+	}
+	rms = sqrt(rms/point_count);
+	keep_count = 0;
+	for(i = 0; i < point_count; i++)
+	{
+		residual = y_list[i]-DpRt_Extract_Trace_Centre_Get(trace,x_list[i]);
+		if(fabs(residual) <= EXTRACT_TRACE_CLIP_SIGMA*rms)
+		{
+			x_list[keep_count] = x_list[i];
+			y_list[keep_count] = y_list[i];
+			fwhm_list[keep_count] = fwhm_list[i];
+			keep_count++;
+		}
+	}
+	if((keep_count < point_count)&&(keep_count > trace->Order))
+	{
+		point_count = keep_count;
+		while(!DpRt_Kernel_Polynomial_Fit(x_list,y_list,point_count,trace->Order,trace->X_Centre,trace->X_Scale,
+						  trace->Coefficient_List))
+		{
+			trace->Order--;
+		}
+	}
+	trace->Point_Count = point_count;
+	/* profile width, the median of the bin widths */
+	for(i = 0; i < point_count; i++)
+		work[i] = (float)(fwhm_list[i]);
+	trace->Fwhm = DpRt_Combine_Median_Float(work,point_count);
+	trace->Sigma = trace->Fwhm/EXTRACT_FWHM_PER_SIGMA;
+	trace->Aperture_Half_Width = EXTRACT_APERTURE_FWHM*trace->Fwhm;
+	if(trace->Aperture_Half_Width < EXTRACT_APERTURE_HALF_WIDTH_MIN)
+		trace->Aperture_Half_Width = EXTRACT_APERTURE_HALF_WIDTH_MIN;
+	if(trace->Aperture_Half_Width > EXTRACT_APERTURE_HALF_WIDTH_MAX)
+		trace->Aperture_Half_Width = EXTRACT_APERTURE_HALF_WIDTH_MAX;
+	DpRt_Log_Format(DPRT_LOG_LEVEL_DEBUG,"DpRt_Extract_Trace_Find:Trace found:%d centres:Order %d:"
+		"Centre row %.2f:FWHM %.2f.",point_count,trace->Order,trace->Coefficient_List[0],trace->Fwhm);
+	free(profile);
+	free(x_list);
+	(*found) = TRUE;
+	return TRUE;
+}
+
+/**
+ * Get the trace centre at a column.
+ * @param trace The trace.
+ * @param x The column (0 based).
+ * @return The trace centre, as a 0 based row.
+ * @see dprt_kernel.html#DpRt_Kernel_Polynomial_Evaluate
+ */
+double DpRt_Extract_Trace_Centre_Get(struct DpRt_Extract_Trace_Struct *trace,double x)
+{
+	return DpRt_Kernel_Polynomial_Evaluate(trace->Coefficient_List,trace->Order,trace->X_Centre,
+					       trace->X_Scale,x);
+}
+
+/**
+ * Optimally extract the spectrum along a trace. For each column the sky is the median of the sky regions
+ * either side of the aperture, the spatial profile is a gaussian of the trace's sigma centred on the trace,
+ * normalised over the aperture. An initial extraction uses the data for its variance estimate, then
+ * EXTRACT_REJECT_ITERATIONS iterations re-estimate the variance from the model and reject outlying pixels
+ * (allowing for a EXTRACT_PROFILE_TOLERANCE fractional error in the profile model).
+ * Pixels flagged in the saturation mask or the cosmic ray mask are excluded from the extraction, and from the sky.
+ * The mean of the columns' sky levels is returned in the spectrum's Sky_Level.
+ * @param frame The frame, naxis1*naxis2 pixels, bias subtracted (and flat fielded).
+ * @param saturation_mask A bit-packed mask of saturated pixels (see DPRT_KERNEL_MASK_TEST), or NULL.
+ * @param cosmic_mask A bit-packed mask of cosmic ray pixels, from DpRt_Cosmic_Reject, or NULL.
+ * @param naxis1 The number of columns in the frame.
+ * @param naxis2 The number of rows in the frame.
+ * @param trace The trace to extract along, from DpRt_Extract_Trace_Find.
+ * @param gain The CCD gain, in electrons per count.
+ * @param read_noise The CCD read noise, in electrons. This must be positive, so no pixel has zero variance.
+ * @param spectrum The address of a spectrum structure to fill in. The Flux and Variance arrays are allocated
+ *        here, and should be freed with DpRt_Extract_Spectrum_Free.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Extract_Sky_Get
+ * @see #Extract_Group_Solve
+ * @see #DpRt_Extract_Spectrum_Free
+ * @see dprt_kernel.h#DPRT_KERNEL_MASK_TEST
+ * @see dprt_abort.html#DpRt_Abort_Checkpoint
+ * @see dprt_cosmic.html#DpRt_Cosmic_Reject
+ */
+int DpRt_Extract_Optimal(float *frame,unsigned char *saturation_mask,unsigned char *cosmic_mask,int naxis1,
+			 int naxis2,struct DpRt_Extract_Trace_Struct *trace,double gain,double read_noise,
+			 struct DpRt_Extract_Spectrum_Struct *spectrum)
+{
+	struct DpRt_Abort_Checkpoint_Struct checkpoint;
+	float data[EXTRACT_APERTURE_ROWS_MAX*EXTRACT_GROUP_COLUMNS];
+	float profile[EXTRACT_APERTURE_ROWS_MAX*EXTRACT_GROUP_COLUMNS];
+	float weight[EXTRACT_APERTURE_ROWS_MAX*EXTRACT_GROUP_COLUMNS];
+	float sky[EXTRACT_GROUP_COLUMNS];
+	float flux[EXTRACT_GROUP_COLUMNS];
+	float variance[EXTRACT_GROUP_COLUMNS];
+	double centre[EXTRACT_GROUP_COLUMNS];
+	double profile_sum[EXTRACT_GROUP_COLUMNS];
+	int low_row[EXTRACT_GROUP_COLUMNS];
+	int high_row[EXTRACT_GROUP_COLUMNS];
+	double v0,inv_gain,offset,sky_sum;
+	size_t pixel;
+	long sky_count;
+	int x0,lane_count,lane,row_low,row_high,row_count,row,r;
+
+	if((frame == NULL)||(trace == NULL)||(spectrum == NULL))
+	{
+		DpRt_Error_Number = 803;
+		strcpy(DpRt_Error_String,"DpRt_Extract_Optimal:Parameter was NULL.");
+		return FALSE;
+	}
+	if(gain <= 0.0)
+	{
+		DpRt_Error_Number = 804;
+		sprintf(DpRt_Error_String,"DpRt_Extract_Optimal:Illegal gain %.2f.",gain);
+		return FALSE;
+	}
+	if(read_noise <= 0.0)
+	{
+		DpRt_Error_Number = 806;
+		sprintf(DpRt_Error_String,"DpRt_Extract_Optimal:Illegal read noise %.2f.",read_noise);
+		return FALSE;
+	}
+	spectrum->Length = naxis1;
+	spectrum->Peak_Counts = 0.0;
+	spectrum->Peak_Column = 0;
+	spectrum->Saturated = FALSE;
+	spectrum->Rejected_Count = 0;
+	spectrum->Cosmic_Count = 0;
+	spectrum->Sky_Level = 0.0;
+	spectrum->Flux = (float *)malloc(naxis1*sizeof(float));
+	spectrum->Variance = (float *)malloc(naxis1*sizeof(float));
+	if((spectrum->Flux == NULL)||(spectrum->Variance == NULL))
+	{
+		DpRt_Extract_Spectrum_Free(spectrum);
+		DpRt_Error_Number = 805;
+		sprintf(DpRt_Error_String,"DpRt_Extract_Optimal:Failed to allocate spectrum(%d).",naxis1);
+		return FALSE;
+	}
+	v0 = (read_noise/gain)*(read_noise/gain);
+	inv_gain = 1.0/gain;
+	sky_sum = 0.0;
+	sky_count = 0;
+	DpRt_Abort_Checkpoint_Initialise(&checkpoint);
+	for(x0 = 0; x0 < naxis1; x0 += EXTRACT_GROUP_COLUMNS)
+	{
+		/* count the most aperture and sky pixels a group can use */
+		if(!DpRt_Abort_Checkpoint(&checkpoint,(EXTRACT_APERTURE_ROWS_MAX+(4*EXTRACT_SKY_WIDTH))*
+					  EXTRACT_GROUP_COLUMNS,"DpRt_Extract_Optimal"))
+		{
+			DpRt_Extract_Spectrum_Free(spectrum);
+			return FALSE;
+		}
+		lane_count = naxis1-x0;
+		if(lane_count > EXTRACT_GROUP_COLUMNS)
+			lane_count = EXTRACT_GROUP_COLUMNS;
+		/* aperture and sky of each column in the group */
+		row_low = naxis2;
+		row_high = -1;
+		for(lane = 0; lane < EXTRACT_GROUP_COLUMNS; lane++)
+		{
+			sky[lane] = 0.0f;
+			profile_sum[lane] = 0.0;
+			if(lane >= lane_count)
+				continue;
+			centre[lane] = DpRt_Extract_Trace_Centre_Get(trace,x0+lane);
+			low_row[lane] = (int)ceil(centre[lane]-trace->Aperture_Half_Width);
+			high_row[lane] = (int)floor(centre[lane]+trace->Aperture_Half_Width);
+			if(low_row[lane] < 0)
+				low_row[lane] = 0;
+			if(high_row[lane] > naxis2-1)
+				high_row[lane] = naxis2-1;
+			if(low_row[lane] > high_row[lane])
+				continue;
+			if(low_row[lane] < row_low)
+				row_low = low_row[lane];
+			if(high_row[lane] > row_high)
+				row_high = high_row[lane];
+			sky[lane] = (float)Extract_Sky_Get(frame,saturation_mask,cosmic_mask,naxis1,naxis2,x0+lane,
+							   centre[lane],trace->Aperture_Half_Width);
+			sky_sum += sky[lane];
+			sky_count++;
+		}
+		if(row_low > row_high)
+		{
+			/* the trace is off the frame for the whole group */
+			for(lane = 0; lane < lane_count; lane++)
+			{
+				spectrum->Flux[x0+lane] = 0.0f;
+				spectrum->Variance[x0+lane] = 0.0f;
+			}
+			continue;
+		}
+		row_count = row_high-row_low+1;
+		if(row_count > EXTRACT_APERTURE_ROWS_MAX)
+			row_count = EXTRACT_APERTURE_ROWS_MAX;
+		/* gather the group's aperture pixels, structure of arrays, four columns per row */
+		for(r = 0; r < row_count; r++)
+		{
+			row = row_low+r;
+			for(lane = 0; lane < EXTRACT_GROUP_COLUMNS; lane++)
+			{
+				data[(r*EXTRACT_GROUP_COLUMNS)+lane] = 0.0f;
+				profile[(r*EXTRACT_GROUP_COLUMNS)+lane] = 0.0f;
+				weight[(r*EXTRACT_GROUP_COLUMNS)+lane] = 0.0f;
+				if((lane >= lane_count)||(row < low_row[lane])||(row > high_row[lane]))
+					continue;
+				pixel = (((size_t)row)*naxis1)+x0+lane;
+				offset = (row-centre[lane])/trace->Sigma;
+				profile[(r*EXTRACT_GROUP_COLUMNS)+lane] = (float)exp(-0.5*offset*offset);
+				profile_sum[lane] += profile[(r*EXTRACT_GROUP_COLUMNS)+lane];
+				data[(r*EXTRACT_GROUP_COLUMNS)+lane] = frame[pixel]-sky[lane];
+				if((saturation_mask != NULL)&&DPRT_KERNEL_MASK_TEST(saturation_mask,pixel))
+				{
+					spectrum->Saturated = TRUE;
+					continue;
+				}
+				if((cosmic_mask != NULL)&&DPRT_KERNEL_MASK_TEST(cosmic_mask,pixel))
+				{
+					spectrum->Cosmic_Count++;
+					continue;
+				}
+				weight[(r*EXTRACT_GROUP_COLUMNS)+lane] = 1.0f;
+				if(frame[pixel] > spectrum->Peak_Counts)
+				{
+					spectrum->Peak_Counts = frame[pixel];
+					spectrum->Peak_Column = x0+lane;
+				}
+			}
+		}
+		for(r = 0; r < row_count; r++)
+		{
+			for(lane = 0; lane < lane_count; lane++)
+			{
+				if(profile_sum[lane] > 0.0)
+					profile[(r*EXTRACT_GROUP_COLUMNS)+lane] /= (float)(profile_sum[lane]);
+			}
+		}
+		spectrum->Rejected_Count += Extract_Group_Solve(data,profile,weight,sky,row_count,v0,inv_gain,
+								flux,variance);
+		for(lane = 0; lane < lane_count; lane++)
+		{
+			spectrum->Flux[x0+lane] = flux[lane];
+			spectrum->Variance[x0+lane] = variance[lane];
+		}
+	}
+	if(sky_count > 0)
+		spectrum->Sky_Level = sky_sum/sky_count;
+	return TRUE;
+}
+
+/**
+ * Free the arrays allocated in a spectrum structure by DpRt_Extract_Optimal.
+ * @param spectrum The address of the spectrum structure.
+ */
+void DpRt_Extract_Spectrum_Free(struct DpRt_Extract_Spectrum_Struct *spectrum)
+{
+	if(spectrum == NULL)
+		return;
+	if(spectrum->Flux != NULL)
+		free(spectrum->Flux);
+	spectrum->Flux = NULL;
+	if(spectrum->Variance != NULL)
+		free(spectrum->Variance);
+	spectrum->Variance = NULL;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Measure the trace centre and FWHM in a bin of columns. The rows within EXTRACT_TRACE_SEARCH_HALF_WIDTH of
+ * the guess are collapsed over the bin's columns, and the background is the median of this profile.
+ * @param frame The frame.
+ * @param naxis1 The number of columns in the frame.
+ * @param naxis2 The number of rows in the frame.
+ * @param x_start The first column in the bin.
+ * @param x_end One more than the last column in the bin.
+ * @param guess The expected trace centre (0 based row).
+ * @param minimum_signal The minimum peak height above background for the centre to be accepted.
+ * @param centre The address of a double, set to the trace centre. This is the peak of a gaussian through the
+ *        peak row and its neighbours, or if that is not possible the flux weighted centre of the rows above half
+ *        maximum.
+ * @param fwhm The address of a double, set to the FWHM of the profile.
+ * @return The routine returns TRUE if the bin's trace centre was measured, and FALSE if it was not.
+ * @see dprt_combine.html#DpRt_Combine_Median_Float
+ */
+static int Extract_Bin_Measure(float *frame,int naxis1,int naxis2,int x_start,int x_end,double guess,
+			       double minimum_signal,double *centre,double *fwhm)
+{
+	float profile[(2*EXTRACT_TRACE_SEARCH_HALF_WIDTH)+1];
+	float work[(2*EXTRACT_TRACE_SEARCH_HALF_WIDTH)+1];
+	double sum,background,half_maximum,low_edge,high_edge,weight,weighted_sum;
+	double low_value,peak_value,high_value;
+	int row_low,row_high,row_count,peak,low,high,x,r;
+
+	row_low = (int)floor(guess+0.5)-EXTRACT_TRACE_SEARCH_HALF_WIDTH;
+	row_high = (int)floor(guess+0.5)+EXTRACT_TRACE_SEARCH_HALF_WIDTH;
+	if(row_low < 0)
+		row_low = 0;
+	if(row_high > naxis2-1)
+		row_high = naxis2-1;
+	row_count = row_high-row_low+1;
+	if(row_count < 5)
+		return FALSE;
+	for(r = 0; r < row_count; r++)
+	{
+		sum = 0.0;
+		for(x = x_start; x < x_end; x++)
+			sum += frame[(((size_t)(row_low+r))*naxis1)+x];
+		profile[r] = (float)(sum/(x_end-x_start));
+		work[r] = profile[r];
+	}
+	background = DpRt_Combine_Median_Float(work,row_count);
+	peak = 0;
+	for(r = 1; r < row_count; r++)
+	{
+		if(profile[r] > profile[peak])
+			peak = r;
+	}
+	if((profile[peak]-background) < minimum_signal)
+		return FALSE;
+	/* the peak must not be at the edge of the search window, or it may be a different feature */
+	if((peak == 0)||(peak == row_count-1))
+		return FALSE;
+	half_maximum = (profile[peak]-background)/2.0;
+	low = peak;
+	while((low > 0)&&((profile[low-1]-background) > half_maximum))
+		low--;
+	high = peak;
+	while((high < row_count-1)&&((profile[high+1]-background) > half_maximum))
+		high++;
+	low_edge = low;
+	if(low > 0)
+		low_edge -= ((profile[low]-background)-half_maximum)/(profile[low]-profile[low-1]);
+	high_edge = high;
+	if(high < row_count-1)
+		high_edge += ((profile[high]-background)-half_maximum)/(profile[high]-profile[high+1]);
+	(*fwhm) = high_edge-low_edge;
+	/* the log of a gaussian is a parabola, so fit one through the peak and its neighbours */
+	low_value = profile[peak-1]-background;
+	peak_value = profile[peak]-background;
+	high_value = profile[peak+1]-background;
+	if((low_value > 0.0)&&(high_value > 0.0))
+	{
+		low_value = log(low_value);
+		peak_value = log(peak_value);
+		high_value = log(high_value);
+		if((low_value-(2.0*peak_value)+high_value) < 0.0)
+		{
+			(*centre) = row_low+peak+(0.5*(low_value-high_value)/(low_value-(2.0*peak_value)+high_value));
+			return TRUE;
+		}
+	}
+	/* otherwise use the flux weighted centre of the rows above half maximum */
+	weight = 0.0;
+	weighted_sum = 0.0;
+	for(r = low; r <= high; r++)
+	{
+		weight += profile[r]-background;
+		weighted_sum += (profile[r]-background)*(row_low+r);
+	}
+	(*centre) = weighted_sum/weight;
+	return TRUE;
+}
+
+/**
+ * Get the sky level in a column, the median of the unmasked pixels in two regions of EXTRACT_SKY_WIDTH rows,
+ * EXTRACT_SKY_GAP rows beyond either edge of the aperture.
+ * @param frame The frame.
+ * @param saturation_mask A bit-packed mask of saturated pixels, or NULL.
+ * @param cosmic_mask A bit-packed mask of cosmic ray pixels, or NULL.
+ * @param naxis1 The number of columns in the frame.
+ * @param naxis2 The number of rows in the frame.
+ * @param x The column.
+ * @param centre The trace centre in this column.
+ * @param half_width The aperture half width.
+ * @return The sky level, or 0.0 if there are no sky pixels on the frame.
+ * @see dprt_combine.html#DpRt_Combine_Median_Float
+ */
+static double Extract_Sky_Get(float *frame,unsigned char *saturation_mask,unsigned char *cosmic_mask,int naxis1,
+			      int naxis2,int x,double centre,double half_width)
+{
+	float values[2*EXTRACT_SKY_WIDTH];
+	size_t pixel;
+	int start_list[2];
+	int value_count,side,row;
+
+	start_list[0] = (int)floor(centre-half_width)-EXTRACT_SKY_GAP-EXTRACT_SKY_WIDTH;
+	start_list[1] = (int)ceil(centre+half_width)+EXTRACT_SKY_GAP+1;
+	value_count = 0;
+	for(side = 0; side < 2; side++)
+	{
+		for(row = start_list[side]; row < start_list[side]+EXTRACT_SKY_WIDTH; row++)
+		{
+			if((row < 0)||(row >= naxis2))
+				continue;
+			pixel = (((size_t)row)*naxis1)+x;
+			if((saturation_mask != NULL)&&DPRT_KERNEL_MASK_TEST(saturation_mask,pixel))
+				continue;
+			if((cosmic_mask != NULL)&&DPRT_KERNEL_MASK_TEST(cosmic_mask,pixel))
+				continue;
+			values[value_count++] = frame[pixel];
+		}
+	}
+	if(value_count == 0)
+		return 0.0;
+	return DpRt_Combine_Median_Float(values,value_count);
+}
+
+/**
+ * Optimally extract a group of EXTRACT_GROUP_COLUMNS columns. The arrays are structure of arrays, each row
+ * holding one value per column. On entry weight is 1 for pixels to use and 0 for pixels to ignore; rejected
+ * pixels have their weight set to 0.
+ * @param data The sky subtracted aperture pixels.
+ * @param profile The normalised spatial profile.
+ * @param weight The pixel weights (mask).
+ * @param sky The sky level of each column.
+ * @param row_count The number of rows in the arrays.
+ * @param v0 The read noise variance, in counts squared.
+ * @param inv_gain The reciprocal of the gain, in counts per electron.
+ * @param flux An array set to the optimal flux of each column.
+ * @param variance An array set to the variance of the optimal flux of each column.
+ * @return The number of pixels rejected.
+ * @see #EXTRACT_REJECT_SIGMA
+ * @see #EXTRACT_REJECT_ITERATIONS
+ * @see #EXTRACT_PROFILE_TOLERANCE
+ */
+static long Extract_Group_Solve(float *data,float *profile,float *weight,float *sky,int row_count,double v0,
+				double inv_gain,float *flux,float *variance)
+{
+	float numerator[EXTRACT_GROUP_COLUMNS];
+	float denominator[EXTRACT_GROUP_COLUMNS];
+	float profile_weight[EXTRACT_GROUP_COLUMNS];
+	long rejected_count;
+	int iteration,lane,r;
+#ifdef __SSE2__
+	__m128 d,p,w,v,sky_v,v0_v,inv_gain_v,flux_v,zero_v,limit_v,tolerance_v,num_v,den_v,pw_v,model,residual,reject;
+	int reject_bits;
+#else
+	float d,p,w,v,model,residual,pw;
+#endif
+
+	rejected_count = 0;
+	for(lane = 0; lane < EXTRACT_GROUP_COLUMNS; lane++)
+		flux[lane] = 0.0f;
+	for(iteration = 0; iteration <= EXTRACT_REJECT_ITERATIONS; iteration++)
+	{
+#ifdef __SSE2__
+		sky_v = _mm_loadu_ps(sky);
+		v0_v = _mm_set1_ps((float)v0);
+		inv_gain_v = _mm_set1_ps((float)inv_gain);
+		flux_v = _mm_loadu_ps(flux);
+		zero_v = _mm_setzero_ps();
+		limit_v = _mm_set1_ps((float)(EXTRACT_REJECT_SIGMA*EXTRACT_REJECT_SIGMA));
+		tolerance_v = _mm_set1_ps((float)EXTRACT_PROFILE_TOLERANCE);
+		num_v = _mm_setzero_ps();
+		den_v = _mm_setzero_ps();
+		pw_v = _mm_setzero_ps();
+		for(r = 0; r < row_count; r++)
+		{
+			d = _mm_loadu_ps(data+(r*EXTRACT_GROUP_COLUMNS));
+			p = _mm_loadu_ps(profile+(r*EXTRACT_GROUP_COLUMNS));
+			w = _mm_loadu_ps(weight+(r*EXTRACT_GROUP_COLUMNS));
+			if(iteration == 0)
+			{
+				/* variance from the data */
+				v = _mm_add_ps(v0_v,_mm_mul_ps(_mm_max_ps(_mm_add_ps(d,sky_v),zero_v),inv_gain_v));
+			}
+			else
+			{
+				/* variance from the model, then reject outliers against it */
+				v = _mm_add_ps(v0_v,_mm_mul_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(flux_v,p),sky_v),zero_v),
+							       inv_gain_v));
+				model = _mm_mul_ps(_mm_mul_ps(flux_v,p),tolerance_v);
+				residual = _mm_sub_ps(d,_mm_mul_ps(flux_v,p));
+				reject = _mm_cmpgt_ps(_mm_mul_ps(residual,residual),
+						      _mm_mul_ps(limit_v,_mm_add_ps(v,_mm_mul_ps(model,model))));
+				reject = _mm_and_ps(reject,_mm_cmpgt_ps(w,zero_v));
+				reject_bits = _mm_movemask_ps(reject);
+				if(reject_bits)
+				{
+					for(lane = 0; lane < EXTRACT_GROUP_COLUMNS; lane++)
+						rejected_count += (reject_bits>>lane)&1;
+					w = _mm_andnot_ps(reject,w);
+					_mm_storeu_ps(weight+(r*EXTRACT_GROUP_COLUMNS),w);
+				}
+			}
+			w = _mm_mul_ps(w,p);
+			pw_v = _mm_add_ps(pw_v,w);
+			w = _mm_div_ps(w,v);
+			num_v = _mm_add_ps(num_v,_mm_mul_ps(w,d));
+			den_v = _mm_add_ps(den_v,_mm_mul_ps(w,p));
+		}
+		_mm_storeu_ps(numerator,num_v);
+		_mm_storeu_ps(denominator,den_v);
+		_mm_storeu_ps(profile_weight,pw_v);
+#else
+		for(lane = 0; lane < EXTRACT_GROUP_COLUMNS; lane++)
+		{
+			numerator[lane] = 0.0f;
+			denominator[lane] = 0.0f;
+			profile_weight[lane] = 0.0f;
+		}
+		for(r = 0; r < row_count; r++)
+		{
+			for(lane = 0; lane < EXTRACT_GROUP_COLUMNS; lane++)
+			{
+				d = data[(r*EXTRACT_GROUP_COLUMNS)+lane];
+				p = profile[(r*EXTRACT_GROUP_COLUMNS)+lane];
+				w = weight[(r*EXTRACT_GROUP_COLUMNS)+lane];
+				if(iteration == 0)
+				{
+					v = d+sky[lane];
+				}
+				else
+				{
+					v = (flux[lane]*p)+sky[lane];
+				}
+				if(v < 0.0f)
+					v = 0.0f;
+				v = (float)(v0+(v*inv_gain));
+				if((iteration > 0)&&(w > 0.0f))
+				{
+					model = (float)(EXTRACT_PROFILE_TOLERANCE*flux[lane]*p);
+					residual = d-(flux[lane]*p);
+					if((residual*residual) >
+					   (float)(EXTRACT_REJECT_SIGMA*EXTRACT_REJECT_SIGMA)*(v+(model*model)))
+					{
+						rejected_count++;
+						w = 0.0f;
+						weight[(r*EXTRACT_GROUP_COLUMNS)+lane] = 0.0f;
+					}
+				}
+				pw = (w*p)/v;
+				numerator[lane] += pw*d;
+				denominator[lane] += pw*p;
+				profile_weight[lane] += w*p;
+			}
+		}
+#endif
+		for(lane = 0; lane < EXTRACT_GROUP_COLUMNS; lane++)
+		{
+			if(denominator[lane] > 0.0f)
+			{
+				flux[lane] = numerator[lane]/denominator[lane];
+				variance[lane] = profile_weight[lane]/denominator[lane];
+			}
+			else
+			{
+				flux[lane] = 0.0f;
+				variance[lane] = 0.0f;
+			}
+		}
+	}
+	return rejected_count;
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
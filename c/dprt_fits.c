@@ -0,0 +1,1457 @@
+/* dprt_fits.c
+** FITS image routines for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_fits.c contains routines to read FTSpec FITS images. Images are read a block of rows at a time,
+ * so the calling routine can process each block whilst it is still in the cache, and the whole image
+ * never has to be held in memory. Uncompressed unsigned 16 bit images are memory mapped, and the blocks
+ * returned are views of the mapped data unit (in FITS byte order), so the pixels are never copied out of the
+ * page cache; other images are read through cfitsio. There are also routines to read the header keywords used
+ * to classify a frame (and its overscan and trim sections), either through cfitsio or by parsing the header
+ * cards directly (which needs no lock, so many headers can be parsed at once), and to write reduced floating
+ * point images.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fitsio.h"
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_fits.h"
+#include "dprt_kernel.h"
+#include "dprt_abort.h"
+#include "dprt_context.h"
+#include "dprt_metrics.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * This program only accepts FITS files with the bits per pixel of this value.
+ */
+#define FITS_GET_DATA_BITPIX		(16)
+/**
+ * This program only accepts FITS files with this number of axes.
+ */
+#define FITS_GET_DATA_NAXIS		(2)
+/**
+ * The length of a FITS header or data block, in bytes.
+ */
+#define FITS_BLOCK_LENGTH		(2880)
+/**
+ * The length of a FITS header card, in bytes.
+ */
+#define FITS_CARD_LENGTH		(80)
+/**
+ * The number of header blocks DpRt_Fits_Header_Parse reads looking for the END card, before giving up on the file.
+ */
+#define FITS_HEADER_PARSE_BLOCK_MAX	(64)
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * Mutex used to serialise cfitsio calls made from more than one thread, as the installed cfitsio
+ * may not have been built re-entrant.
+ * @see #DpRt_Fits_Lock
+ * @see #DpRt_Fits_Unlock
+ */
+static pthread_mutex_t Fits_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Fits_Read_Key_Integer(fitsfile *fits_fp,char *keyword,int default_value,int *value,int *status);
+static int Fits_Read_Key_Section(fitsfile *fits_fp,char *keyword,int naxis1,int naxis2,int *found,
+				 struct DpRt_Fits_Section_Struct *section,int *status);
+static void Fits_Section_Parse(char *value,int naxis1,int naxis2,int *found,struct DpRt_Fits_Section_Struct *section);
+static void Fits_Card_Parse(char *card,char *keyword,char *value);
+static int Fits_Reader_Map(char *filename,struct DpRt_Fits_Reader_Struct *reader);
+static int Fits_Write_Float_Rows(fitsfile *fits_fp,int naxis1,int naxis2,float *data,int lock,
+				 char *function_name,int *status);
+static void Fits_Private_Lock(void);
+static void Fits_Private_Unlock(void);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Open a FITS image for reading. The image is checked to be FITS_GET_DATA_NAXIS dimensional with
+ * FITS_GET_DATA_BITPIX bits per pixel.
+ * @param filename The FITS filename to open.
+ * @param fits_fp The address of a cfitsio file pointer, set to the opened file.
+ * @param naxis1 The address of an integer, set to the number of columns in the image.
+ * @param naxis2 The address of an integer, set to the number of rows in the image.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #FITS_GET_DATA_BITPIX
+ * @see #FITS_GET_DATA_NAXIS
+ * @see #DpRt_Fits_Image_Close
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Image_Open(char *filename,fitsfile **fits_fp,int *naxis1,int *naxis2)
+{
+	char buff[FLEN_STATUS];
+	long naxes[FITS_GET_DATA_NAXIS];
+	int status = 0,bitpix,naxis;
+
+	if(filename == NULL)
+	{
+		DpRt_Error_Number = 200;
+		strcpy(DpRt_Error_String,"DpRt_Fits_Image_Open:filename was NULL.");
+		return FALSE;
+	}
+	if((fits_fp == NULL)||(naxis1 == NULL)||(naxis2 == NULL))
+	{
+		DpRt_Error_Number = 201;
+		strcpy(DpRt_Error_String,"DpRt_Fits_Image_Open:return parameter was NULL.");
+		return FALSE;
+	}
+	(*fits_fp) = NULL;
+	/* open file */
+	if(fits_open_file(fits_fp,filename,READONLY,&status))
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		DpRt_Error_Number = 202;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Image_Open:Open failed(%.128s,%d):%s.",filename,
+			status,buff);
+		(*fits_fp) = NULL;
+		return FALSE;
+	}
+	/* check the image format */
+	if(fits_get_img_param((*fits_fp),FITS_GET_DATA_NAXIS,&bitpix,&naxis,naxes,&status))
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		DpRt_Error_Number = 203;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Image_Open:Getting image parameters "
+			"failed(%.128s,%d):%s.",filename,status,buff);
+		DpRt_Fits_Image_Close(*fits_fp);
+		(*fits_fp) = NULL;
+		return FALSE;
+	}
+	if(naxis != FITS_GET_DATA_NAXIS)
+	{
+		DpRt_Error_Number = 204;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Image_Open:%.128s has wrong NAXIS value(%d).",
+			filename,naxis);
+		DpRt_Fits_Image_Close(*fits_fp);
+		(*fits_fp) = NULL;
+		return FALSE;
+	}
+	if(bitpix != FITS_GET_DATA_BITPIX)
+	{
+		DpRt_Error_Number = 205;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Image_Open:%.128s has wrong BITPIX value(%d).",
+			filename,bitpix);
+		DpRt_Fits_Image_Close(*fits_fp);
+		(*fits_fp) = NULL;
+		return FALSE;
+	}
+	(*naxis1) = (int)(naxes[0]);
+	(*naxis2) = (int)(naxes[1]);
+	if(((*naxis1) < 1)||((*naxis2) < 1))
+	{
+		DpRt_Error_Number = 206;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Image_Open:%.128s has illegal dimensions(%d,%d).",
+			filename,(*naxis1),(*naxis2));
+		DpRt_Fits_Image_Close(*fits_fp);
+		(*fits_fp) = NULL;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Read a block of complete rows from an image opened with DpRt_Fits_Image_Open.
+ * @param fits_fp The cfitsio file pointer.
+ * @param naxis1 The number of columns in the image.
+ * @param start_row The first row to read (0 based).
+ * @param row_count The number of rows to read.
+ * @param buffer The buffer to read into, of at least row_count*naxis1 unsigned shorts.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Image_Read_Rows(fitsfile *fits_fp,int naxis1,int start_row,int row_count,unsigned short *buffer)
+{
+	char buff[FLEN_STATUS];
+	long first_pixel[FITS_GET_DATA_NAXIS];
+	int status = 0;
+
+	if((fits_fp == NULL)||(buffer == NULL))
+	{
+		DpRt_Error_Number = 208;
+		strcpy(DpRt_Error_String,"DpRt_Fits_Image_Read_Rows:file pointer or buffer was NULL.");
+		return FALSE;
+	}
+	if(row_count < 1)
+		return TRUE;
+	first_pixel[0] = 1;
+	first_pixel[1] = start_row+1;
+	if(fits_read_pix(fits_fp,TUSHORT,first_pixel,((LONGLONG)row_count)*naxis1,NULL,buffer,NULL,&status))
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		DpRt_Error_Number = 210;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Image_Read_Rows:Reading rows %d to %d failed(%d):%s.",
+			start_row,start_row+row_count-1,status,buff);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Find where the pixels of an image opened with DpRt_Fits_Image_Open lie in its file, if they can be read without
+ * cfitsio. This is the case for an uncompressed image of unsigned 16 bit pixels (BITPIX 16, BZERO 32768,
+ * BSCALE 1), whose pixels are stored row by row in the FITS encoding, starting at data_start.
+ * @param fits_fp The cfitsio file pointer.
+ * @param naxis1 The number of columns in the image.
+ * @param naxis2 The number of rows in the image.
+ * @param data_start The address of a variable to store the byte offset of the first pixel in.
+ * @param data_end The address of a variable to store the byte offset of the end of the data unit in.
+ * @return The routine returns TRUE if the pixels are stored raw, and FALSE if they must be read through cfitsio.
+ *         This is not an error.
+ * @see dprt_kernel.h#DPRT_KERNEL_PIXEL_FORMAT
+ */
+int DpRt_Fits_Image_Raw_Data_Get(fitsfile *fits_fp,int naxis1,int naxis2,LONGLONG *data_start,LONGLONG *data_end)
+{
+	LONGLONG header_start;
+	int status = 0,image_type;
+
+	if((fits_fp == NULL)||(data_start == NULL)||(data_end == NULL))
+		return FALSE;
+	fits_get_img_equivtype(fits_fp,&image_type,&status);
+	if((status != 0)||(image_type != USHORT_IMG))
+		return FALSE;
+	if(fits_is_compressed_image(fits_fp,&status))
+		return FALSE;
+	if(fits_get_hduaddrll(fits_fp,&header_start,data_start,data_end,&status))
+		return FALSE;
+	if(((*data_end)-(*data_start)) < ((LONGLONG)naxis1)*naxis2*2)
+		return FALSE;
+	return TRUE;
+}
+
+/**
+ * Close a FITS image opened with DpRt_Fits_Image_Open.
+ * @param fits_fp The cfitsio file pointer. If this is NULL nothing is done.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Fits_Image_Open
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Image_Close(fitsfile *fits_fp)
+{
+	char buff[FLEN_STATUS];
+	int status = 0;
+
+	if(fits_fp == NULL)
+		return TRUE;
+	fits_close_file(fits_fp,&status);
+	if(status)
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		DpRt_Error_Number = 211;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Image_Close:Close failed(%d):%s.",status,buff);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Open a FITS image for reading a block of rows at a time. If the image can be memory mapped (see
+ * Fits_Reader_Map) the blocks are views of the mapped file, otherwise a row block buffer of
+ * around DPRT_FITS_BLOCK_PIXELS pixels is allocated and the blocks are read through cfitsio.
+ * @param filename The FITS filename to open.
+ * @param reader The address of a reader structure to fill in.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Fits_Image_Open
+ * @see #DpRt_Fits_Reader_Close
+ * @see #Fits_Reader_Map
+ * @see dprt_fits.h#DPRT_FITS_BLOCK_PIXELS
+ * @see dprt_metrics.html#DpRt_Metrics_Timer_Start
+ * @see dprt_metrics.html#DpRt_Metrics_Timer_Stop
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Reader_Open(char *filename,struct DpRt_Fits_Reader_Struct *reader)
+{
+	struct timespec start_time;
+
+	if(reader == NULL)
+	{
+		DpRt_Error_Number = 219;
+		strcpy(DpRt_Error_String,"DpRt_Fits_Reader_Open:reader was NULL.");
+		return FALSE;
+	}
+	reader->Fits_Fp = NULL;
+	reader->Buffer = NULL;
+	reader->Map = NULL;
+	reader->Map_Length = 0;
+	reader->Data = NULL;
+	reader->Pixel_Format = DPRT_KERNEL_PIXEL_FORMAT_NATIVE;
+	reader->Current_Row = 0;
+	DpRt_Metrics_Timer_Start(&start_time);
+	if(!DpRt_Fits_Image_Open(filename,&(reader->Fits_Fp),&(reader->Naxis1),&(reader->Naxis2)))
+		return FALSE;
+	reader->Block_Rows = DPRT_FITS_BLOCK_PIXELS/reader->Naxis1;
+	if(reader->Block_Rows < 1)
+		reader->Block_Rows = 1;
+	if(reader->Block_Rows > reader->Naxis2)
+		reader->Block_Rows = reader->Naxis2;
+	if(Fits_Reader_Map(filename,reader))
+	{
+		DpRt_Metrics_Timer_Stop(DPRT_METRICS_STAGE_OPEN,&start_time);
+		return TRUE;
+	}
+	/* allocate row block buffer */
+	reader->Buffer = (unsigned short *)malloc(reader->Block_Rows*reader->Naxis1*sizeof(unsigned short));
+	if(reader->Buffer == NULL)
+	{
+		DpRt_Error_Number = 207;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Reader_Open:Failed to allocate buffer(%d,%d).",
+			reader->Naxis1,reader->Block_Rows);
+		DpRt_Fits_Reader_Close(reader);
+		return FALSE;
+	}
+	DpRt_Metrics_Timer_Stop(DPRT_METRICS_STAGE_OPEN,&start_time);
+	return TRUE;
+}
+
+/**
+ * Open an image already in memory (e.g. a camera readout buffer passed in from Java) for reading a block of rows
+ * at a time. The blocks are views of the pixels, which are not copied, so they must not be freed or modified
+ * until the reader is closed. No cfitsio routines are called.
+ * @param pixels The image's pixels, naxis2 rows of naxis1 pixels.
+ * @param naxis1 The number of columns in the image.
+ * @param naxis2 The number of rows in the image.
+ * @param pixel_format The format of the pixels, a DPRT_KERNEL_PIXEL_FORMAT value.
+ * @param reader The address of a reader structure to fill in.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Fits_Reader_Close
+ * @see dprt_fits.h#DPRT_FITS_BLOCK_PIXELS
+ * @see dprt_kernel.h#DPRT_KERNEL_PIXEL_FORMAT
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Reader_Open_Buffer(unsigned short *pixels,int naxis1,int naxis2,int pixel_format,
+				 struct DpRt_Fits_Reader_Struct *reader)
+{
+	if((pixels == NULL)||(reader == NULL))
+	{
+		DpRt_Error_Number = 235;
+		strcpy(DpRt_Error_String,"DpRt_Fits_Reader_Open_Buffer:Parameter was NULL.");
+		return FALSE;
+	}
+	if((naxis1 < 1)||(naxis2 < 1)||((pixel_format != DPRT_KERNEL_PIXEL_FORMAT_NATIVE)&&
+					  (pixel_format != DPRT_KERNEL_PIXEL_FORMAT_FITS)))
+	{
+		DpRt_Error_Number = 236;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Reader_Open_Buffer:Illegal image(%d,%d,%d).",naxis1,naxis2,
+			pixel_format);
+		return FALSE;
+	}
+	reader->Fits_Fp = NULL;
+	reader->Buffer = NULL;
+	reader->Map = NULL;
+	reader->Map_Length = 0;
+	reader->Data = (unsigned char *)pixels;
+	reader->Pixel_Format = pixel_format;
+	reader->Current_Row = 0;
+	reader->Naxis1 = naxis1;
+	reader->Naxis2 = naxis2;
+	reader->Block_Rows = DPRT_FITS_BLOCK_PIXELS/naxis1;
+	if(reader->Block_Rows < 1)
+		reader->Block_Rows = 1;
+	if(reader->Block_Rows > naxis2)
+		reader->Block_Rows = naxis2;
+	return TRUE;
+}
+
+/**
+ * Read the next block of rows from the image. For a memory mapped or in memory image the block is a view of the
+ * image data, otherwise the rows are read into the reader's buffer. Rows read through cfitsio are timed as the
+ * read stage. Rows of a file, mapped or not, are counted as bytes read; rows of an image opened with
+ * DpRt_Fits_Reader_Open_Buffer are not, they were never read from disk.
+ * @param reader The address of a reader structure opened by DpRt_Fits_Reader_Open or
+ *        DpRt_Fits_Reader_Open_Buffer.
+ * @param block The address of a pointer, set to the start of the block of pixels read. The pixels are
+ *        stored row by row, with reader->Naxis1 pixels per row, in the format given by reader->Pixel_Format.
+ *        The memory belongs to the reader.
+ * @param start_row The address of an integer, set to the image row (0 based) of the first row in the block.
+ * @param row_count The address of an integer, set to the number of rows read. This is zero when the
+ *        whole image has been read.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Fits_Reader_Open
+ * @see #DpRt_Fits_Reader_Open_Buffer
+ * @see #DpRt_Fits_Image_Read_Rows
+ * @see dprt_metrics.html#DpRt_Metrics_Timer_Stop
+ * @see dprt_metrics.html#DpRt_Metrics_Count_Add
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Reader_Read_Block(struct DpRt_Fits_Reader_Struct *reader,unsigned short **block,
+				int *start_row,int *row_count)
+{
+	struct timespec start_time;
+	int rows;
+
+	if((reader == NULL)||((reader->Data == NULL)&&((reader->Fits_Fp == NULL)||(reader->Buffer == NULL))))
+	{
+		DpRt_Error_Number = 220;
+		strcpy(DpRt_Error_String,"DpRt_Fits_Reader_Read_Block:reader was not open.");
+		return FALSE;
+	}
+	if((block == NULL)||(start_row == NULL)||(row_count == NULL))
+	{
+		DpRt_Error_Number = 209;
+		strcpy(DpRt_Error_String,"DpRt_Fits_Reader_Read_Block:return parameter was NULL.");
+		return FALSE;
+	}
+	(*start_row) = reader->Current_Row;
+	rows = reader->Naxis2-reader->Current_Row;
+	if(rows > reader->Block_Rows)
+		rows = reader->Block_Rows;
+	(*row_count) = rows;
+	if(reader->Data != NULL)
+	{
+		(*block) = (unsigned short *)(reader->Data+(((size_t)reader->Current_Row)*reader->Naxis1*2));
+		if(rows > 0)
+		{
+			reader->Current_Row += rows;
+			if(reader->Map != NULL)
+			{
+				DpRt_Metrics_Count_Add(DPRT_METRICS_COUNTER_BYTES_READ,
+						       ((long)rows)*reader->Naxis1*sizeof(unsigned short));
+			}
+		}
+		return TRUE;
+	}
+	(*block) = reader->Buffer;
+	if(rows < 1)
+		return TRUE;
+	DpRt_Metrics_Timer_Start(&start_time);
+	if(!DpRt_Fits_Image_Read_Rows(reader->Fits_Fp,reader->Naxis1,reader->Current_Row,rows,reader->Buffer))
+		return FALSE;
+	DpRt_Metrics_Timer_Stop(DPRT_METRICS_STAGE_READ,&start_time);
+	DpRt_Metrics_Count_Add(DPRT_METRICS_COUNTER_BYTES_READ,((long)rows)*reader->Naxis1*sizeof(unsigned short));
+	reader->Current_Row += rows;
+	return TRUE;
+}
+
+/**
+ * Read a rectangular section of the image, e.g. its overscan region, as floats. The section may be read at any
+ * time while the reader is open, and does not affect the blocks returned by DpRt_Fits_Reader_Read_Block. Sections
+ * of a memory mapped or in memory image are converted from the image data, otherwise they are read through
+ * cfitsio, so the cfitsio lock should be held.
+ * @param reader The address of a reader structure opened by DpRt_Fits_Reader_Open or
+ *        DpRt_Fits_Reader_Open_Buffer.
+ * @param section The section to read, which must lie within the image.
+ * @param data Where to write the section's pixels, stored row by row, (X_End-X_Start+1)*(Y_End-Y_Start+1) floats.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Fits_Reader_Open
+ * @see #DpRt_Fits_Reader_Open_Buffer
+ * @see dprt_fits.h#DpRt_Fits_Section_Struct
+ * @see dprt_kernel.h#DPRT_KERNEL_FITS_PIXEL
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Reader_Read_Section(struct DpRt_Fits_Reader_Struct *reader,struct DpRt_Fits_Section_Struct *section,
+				  float *data)
+{
+	unsigned short *row_pixels = NULL;
+	char buff[FLEN_STATUS];
+	long first_pixel[2];
+	long last_pixel[2];
+	long increment[2];
+	int x,y,status = 0;
+
+	if((reader == NULL)||(section == NULL)||(data == NULL)||
+	   ((reader->Data == NULL)&&(reader->Fits_Fp == NULL)))
+	{
+		DpRt_Error_Number = 237;
+		strcpy(DpRt_Error_String,"DpRt_Fits_Reader_Read_Section:Parameter was NULL or reader was not open.");
+		return FALSE;
+	}
+	if((section->X_Start < 0)||(section->X_End < section->X_Start)||(section->X_End >= reader->Naxis1)||
+	   (section->Y_Start < 0)||(section->Y_End < section->Y_Start)||(section->Y_End >= reader->Naxis2))
+	{
+		DpRt_Error_Number = 238;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Reader_Read_Section:Illegal section [%d:%d,%d:%d] of (%d,%d).",
+			section->X_Start+1,section->X_End+1,section->Y_Start+1,section->Y_End+1,reader->Naxis1,
+			reader->Naxis2);
+		return FALSE;
+	}
+	if(reader->Data != NULL)
+	{
+		for(y = section->Y_Start; y <= section->Y_End; y++)
+		{
+			row_pixels = ((unsigned short *)reader->Data)+(((size_t)y)*reader->Naxis1);
+			if(reader->Pixel_Format == DPRT_KERNEL_PIXEL_FORMAT_FITS)
+			{
+				for(x = section->X_Start; x <= section->X_End; x++)
+					(*data++) = (float)DPRT_KERNEL_FITS_PIXEL(row_pixels+x);
+			}
+			else
+			{
+				for(x = section->X_Start; x <= section->X_End; x++)
+					(*data++) = (float)(row_pixels[x]);
+			}
+		}
+		return TRUE;
+	}
+	/* cfitsio subset pixel coordinates are 1 based and inclusive */
+	first_pixel[0] = section->X_Start+1;
+	first_pixel[1] = section->Y_Start+1;
+	last_pixel[0] = section->X_End+1;
+	last_pixel[1] = section->Y_End+1;
+	increment[0] = 1;
+	increment[1] = 1;
+	if(fits_read_subset(reader->Fits_Fp,TFLOAT,first_pixel,last_pixel,increment,NULL,data,NULL,&status))
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		DpRt_Error_Number = 239;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Reader_Read_Section:Reading section [%d:%d,%d:%d] failed:%s.",
+			section->X_Start+1,section->X_End+1,section->Y_Start+1,section->Y_End+1,buff);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Close a FITS image opened with DpRt_Fits_Reader_Open, and unmap the file or free the row block buffer.
+ * An image opened with DpRt_Fits_Reader_Open_Buffer is left alone, it belongs to the caller.
+ * It is safe to call this routine on a partially opened reader.
+ * @param reader The address of the reader structure.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Fits_Reader_Open
+ * @see #DpRt_Fits_Image_Close
+ */
+int DpRt_Fits_Reader_Close(struct DpRt_Fits_Reader_Struct *reader)
+{
+	fitsfile *fits_fp = NULL;
+
+	if(reader == NULL)
+		return TRUE;
+	if(reader->Buffer != NULL)
+		free(reader->Buffer);
+	reader->Buffer = NULL;
+	if(reader->Map != NULL)
+		munmap(reader->Map,reader->Map_Length);
+	reader->Map = NULL;
+	reader->Data = NULL;
+	fits_fp = reader->Fits_Fp;
+	reader->Fits_Fp = NULL;
+	return DpRt_Fits_Image_Close(fits_fp);
+}
+
+/**
+ * Read the header keywords used to classify a frame (OBSTYPE, NAXIS1, NAXIS2, CCDXBIN, CCDYBIN and EXPTIME),
+ * and the overscan and trim sections (BIASSEC and TRIMSEC).
+ * Missing OBSTYPE, binning and exposure length keywords are not an error, defaults are used instead. Missing or
+ * unparsable sections are not an error either, they are marked as not found.
+ * @param filename The FITS filename to read.
+ * @param header The address of a header structure to fill in.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Fits_Read_Key_Integer
+ * @see #Fits_Read_Key_Section
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Header_Read(char *filename,struct DpRt_Fits_Header_Struct *header)
+{
+	fitsfile *fits_fp = NULL;
+	char buff[FLEN_STATUS];
+	long naxes[FITS_GET_DATA_NAXIS];
+	int status = 0,naxis;
+
+	if((filename == NULL)||(header == NULL))
+	{
+		DpRt_Error_Number = 212;
+		strcpy(DpRt_Error_String,"DpRt_Fits_Header_Read:filename or header was NULL.");
+		return FALSE;
+	}
+	if(fits_open_file(&fits_fp,filename,READONLY,&status))
+	{
+		fits_get_errstatus(status,buff);
+		DpRt_Error_Number = 213;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Header_Read:Open failed(%.128s,%d):%s.",filename,
+			status,buff);
+		return FALSE;
+	}
+	naxes[0] = 0;
+	naxes[1] = 0;
+	fits_get_img_param(fits_fp,FITS_GET_DATA_NAXIS,NULL,&naxis,naxes,&status);
+	header->Naxis1 = (int)(naxes[0]);
+	header->Naxis2 = (int)(naxes[1]);
+	if(fits_read_key(fits_fp,TSTRING,"OBSTYPE",header->Obstype,NULL,&status))
+	{
+		if(status == KEY_NO_EXIST)
+		{
+			status = 0;
+			header->Obstype[0] = '\0';
+		}
+	}
+	Fits_Read_Key_Integer(fits_fp,"CCDXBIN",1,&(header->X_Bin),&status);
+	Fits_Read_Key_Integer(fits_fp,"CCDYBIN",1,&(header->Y_Bin),&status);
+	if(fits_read_key(fits_fp,TDOUBLE,"EXPTIME",&(header->Exposure_Length),NULL,&status))
+	{
+		if(status == KEY_NO_EXIST)
+		{
+			status = 0;
+			header->Exposure_Length = 0.0;
+		}
+	}
+	Fits_Read_Key_Section(fits_fp,"BIASSEC",header->Naxis1,header->Naxis2,&(header->Bias_Section_Found),
+			      &(header->Bias_Section),&status);
+	Fits_Read_Key_Section(fits_fp,"TRIMSEC",header->Naxis1,header->Naxis2,&(header->Trim_Section_Found),
+			      &(header->Trim_Section),&status);
+	if(status)
+	{
+		fits_get_errstatus(status,buff);
+		fits_close_file(fits_fp,&status);
+		DpRt_Error_Number = 214;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Header_Read:Reading header of %.128s failed:%s.",
+			filename,buff);
+		return FALSE;
+	}
+	fits_close_file(fits_fp,&status);
+	return TRUE;
+}
+
+/**
+ * Read the overscan and trim sections (BIASSEC and TRIMSEC) of an image already open, e.g. by
+ * DpRt_Fits_Image_Open. Missing or unparsable sections are not an error, they are marked as not found.
+ * @param fits_fp The cfitsio file pointer.
+ * @param header The address of a header structure, with Naxis1 and Naxis2 filled in. Bias_Section_Found,
+ *        Bias_Section, Trim_Section_Found and Trim_Section are filled in.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Fits_Read_Key_Section
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Sections_Read(fitsfile *fits_fp,struct DpRt_Fits_Header_Struct *header)
+{
+	char buff[FLEN_STATUS];
+	int status = 0;
+
+	if((fits_fp == NULL)||(header == NULL))
+	{
+		DpRt_Error_Number = 240;
+		strcpy(DpRt_Error_String,"DpRt_Fits_Sections_Read:Parameter was NULL.");
+		return FALSE;
+	}
+	Fits_Read_Key_Section(fits_fp,"BIASSEC",header->Naxis1,header->Naxis2,&(header->Bias_Section_Found),
+			      &(header->Bias_Section),&status);
+	Fits_Read_Key_Section(fits_fp,"TRIMSEC",header->Naxis1,header->Naxis2,&(header->Trim_Section_Found),
+			      &(header->Trim_Section),&status);
+	if(status)
+	{
+		fits_get_errstatus(status,buff);
+		DpRt_Error_Number = 241;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Sections_Read:Reading sections failed:%s.",buff);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Read the same header keywords as DpRt_Fits_Header_Read, by reading the primary header's cards directly rather
+ * than through cfitsio. As cfitsio is not used, DpRt_Fits_Lock need not be held, and headers can be parsed from
+ * several threads at once. Only a primary HDU holding a 2 dimensional image can be parsed, so any other file
+ * (e.g. a tile compressed image, whose primary HDU is empty) fails, and the caller should fall back to
+ * DpRt_Fits_Header_Read. As DpRt_Fits_Image_Open does, a frame whose BITPIX is not FITS_GET_DATA_BITPIX (e.g. a
+ * reduced frame) is rejected, with the error number DPRT_FITS_BITPIX_ERROR_NUMBER.
+ * @param filename The FITS filename to read. cfitsio's extended filename syntax is not supported.
+ * @param header The address of a header structure to fill in.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Fits_Header_Read
+ * @see #Fits_Card_Parse
+ * @see #Fits_Section_Parse
+ * @see #FITS_HEADER_PARSE_BLOCK_MAX
+ * @see #FITS_GET_DATA_BITPIX
+ * @see dprt_fits.h#DPRT_FITS_BITPIX_ERROR_NUMBER
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Header_Parse(char *filename,struct DpRt_Fits_Header_Struct *header)
+{
+	char block[FITS_BLOCK_LENGTH];
+	char keyword[FLEN_KEYWORD];
+	char value[FLEN_VALUE];
+	char bias_section[FLEN_VALUE];
+	char trim_section[FLEN_VALUE];
+	char *ch = NULL;
+	int fd,block_index,card,simple,bitpix,naxis,end_found;
+
+	if((filename == NULL)||(header == NULL))
+	{
+		DpRt_Error_Number = 242;
+		strcpy(DpRt_Error_String,"DpRt_Fits_Header_Parse:filename or header was NULL.");
+		return FALSE;
+	}
+	header->Obstype[0] = '\0';
+	header->Naxis1 = 0;
+	header->Naxis2 = 0;
+	header->X_Bin = 1;
+	header->Y_Bin = 1;
+	header->Exposure_Length = 0.0;
+	bias_section[0] = '\0';
+	trim_section[0] = '\0';
+	simple = FALSE;
+	bitpix = 0;
+	naxis = 0;
+	end_found = FALSE;
+	fd = open(filename,O_RDONLY);
+	if(fd < 0)
+	{
+		DpRt_Error_Number = 243;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Header_Parse:Open failed(%.128s).",filename);
+		return FALSE;
+	}
+	for(block_index = 0; (end_found == FALSE)&&(block_index < FITS_HEADER_PARSE_BLOCK_MAX); block_index++)
+	{
+		if(read(fd,block,FITS_BLOCK_LENGTH) != FITS_BLOCK_LENGTH)
+			break;
+		for(card = 0; (end_found == FALSE)&&(card < FITS_BLOCK_LENGTH/FITS_CARD_LENGTH); card++)
+		{
+			Fits_Card_Parse(block+(card*FITS_CARD_LENGTH),keyword,value);
+			if((block_index == 0)&&(card == 0))
+				simple = ((strcmp(keyword,"SIMPLE") == 0)&&(strcmp(value,"T") == 0));
+			if(strcmp(keyword,"END") == 0)
+				end_found = TRUE;
+			else if(strcmp(keyword,"BITPIX") == 0)
+				bitpix = atoi(value);
+			else if(strcmp(keyword,"NAXIS") == 0)
+				naxis = atoi(value);
+			else if(strcmp(keyword,"NAXIS1") == 0)
+				header->Naxis1 = atoi(value);
+			else if(strcmp(keyword,"NAXIS2") == 0)
+				header->Naxis2 = atoi(value);
+			else if(strcmp(keyword,"OBSTYPE") == 0)
+				strcpy(header->Obstype,value);
+			else if(strcmp(keyword,"CCDXBIN") == 0)
+				header->X_Bin = (int)strtod(value,NULL);
+			else if(strcmp(keyword,"CCDYBIN") == 0)
+				header->Y_Bin = (int)strtod(value,NULL);
+			else if(strcmp(keyword,"EXPTIME") == 0)
+			{
+				/* FITS allows a D exponent, which strtod does not */
+				for(ch = value; (*ch) != '\0'; ch++)
+				{
+					if(((*ch) == 'D')||((*ch) == 'd'))
+						(*ch) = 'E';
+				}
+				header->Exposure_Length = strtod(value,NULL);
+			}
+			else if(strcmp(keyword,"BIASSEC") == 0)
+				strcpy(bias_section,value);
+			else if(strcmp(keyword,"TRIMSEC") == 0)
+				strcpy(trim_section,value);
+		}
+	}
+	close(fd);
+	if(end_found == FALSE)
+	{
+		DpRt_Error_Number = 244;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Header_Parse:No END card found in %.128s.",filename);
+		return FALSE;
+	}
+	if((simple == FALSE)||(naxis != FITS_GET_DATA_NAXIS))
+	{
+		DpRt_Error_Number = 245;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Header_Parse:%.128s primary HDU is not a 2 "
+			"dimensional image(%d,%d).",filename,simple,naxis);
+		return FALSE;
+	}
+	if(bitpix != FITS_GET_DATA_BITPIX)
+	{
+		DpRt_Error_Number = DPRT_FITS_BITPIX_ERROR_NUMBER;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Header_Parse:%.200s has wrong BITPIX "
+			"value(%d).",filename,bitpix);
+		return FALSE;
+	}
+	Fits_Section_Parse(bias_section,header->Naxis1,header->Naxis2,&(header->Bias_Section_Found),
+			   &(header->Bias_Section));
+	Fits_Section_Parse(trim_section,header->Naxis1,header->Naxis2,&(header->Trim_Section_Found),
+			   &(header->Trim_Section));
+	return TRUE;
+}
+
+/**
+ * Read a whole 2 dimensional image (of any BITPIX) into an allocated floating point array. This is used for
+ * reading reduced (e.g. master) frames. The image is read DPRT_FITS_BLOCK_PIXELS at a time, polling the abort
+ * flag between blocks.
+ * @param filename The FITS filename to read.
+ * @param naxis1 The address of an integer, set to the number of columns in the image.
+ * @param naxis2 The address of an integer, set to the number of rows in the image.
+ * @param data The address of a float pointer, set to an allocated array of naxis1*naxis2 pixels.
+ *        This should be freed by the caller.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see dprt_abort.html#DpRt_Abort_Checkpoint
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Read_Float_Image(char *filename,int *naxis1,int *naxis2,float **data)
+{
+	struct DpRt_Abort_Checkpoint_Struct checkpoint;
+	fitsfile *fits_fp = NULL;
+	char buff[FLEN_STATUS];
+	long naxes[FITS_GET_DATA_NAXIS];
+	long first_pixel[FITS_GET_DATA_NAXIS];
+	int status = 0,naxis,block_rows,row,row_count;
+
+	if((filename == NULL)||(naxis1 == NULL)||(naxis2 == NULL)||(data == NULL))
+	{
+		DpRt_Error_Number = 221;
+		strcpy(DpRt_Error_String,"DpRt_Fits_Read_Float_Image:Parameter was NULL.");
+		return FALSE;
+	}
+	(*data) = NULL;
+	if(fits_open_file(&fits_fp,filename,READONLY,&status))
+	{
+		fits_get_errstatus(status,buff);
+		DpRt_Error_Number = 222;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Read_Float_Image:Open failed(%.128s,%d):%s.",
+			filename,status,buff);
+		return FALSE;
+	}
+	fits_get_img_param(fits_fp,FITS_GET_DATA_NAXIS,NULL,&naxis,naxes,&status);
+	if((status == 0)&&((naxis != FITS_GET_DATA_NAXIS)||(naxes[0] < 1)||(naxes[1] < 1)))
+	{
+		fits_close_file(fits_fp,&status);
+		DpRt_Error_Number = 223;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Read_Float_Image:%.128s has illegal dimensions.",
+			filename);
+		return FALSE;
+	}
+	if(status == 0)
+	{
+		(*naxis1) = (int)(naxes[0]);
+		(*naxis2) = (int)(naxes[1]);
+		(*data) = (float *)malloc(((size_t)(*naxis1))*(*naxis2)*sizeof(float));
+		if((*data) == NULL)
+		{
+			fits_close_file(fits_fp,&status);
+			DpRt_Error_Number = 224;
+			sprintf(DpRt_Error_String,"DpRt_Fits_Read_Float_Image:Failed to allocate data(%d,%d).",
+				(*naxis1),(*naxis2));
+			return FALSE;
+		}
+		/* read a block of rows at a time, so an abort is seen part way through a large image */
+		block_rows = DPRT_FITS_BLOCK_PIXELS/(*naxis1);
+		if(block_rows < 1)
+			block_rows = 1;
+		DpRt_Abort_Checkpoint_Initialise(&checkpoint);
+		first_pixel[0] = 1;
+		for(row = 0; (row < (*naxis2))&&(status == 0); row += block_rows)
+		{
+			row_count = (*naxis2)-row;
+			if(row_count > block_rows)
+				row_count = block_rows;
+			first_pixel[1] = row+1;
+			fits_read_pix(fits_fp,TFLOAT,first_pixel,((LONGLONG)(*naxis1))*row_count,NULL,
+				      (*data)+(((size_t)row)*(*naxis1)),NULL,&status);
+			if((status == 0)&&(!DpRt_Abort_Checkpoint(&checkpoint,((long)(*naxis1))*row_count,
+								    "DpRt_Fits_Read_Float_Image")))
+			{
+				free(*data);
+				(*data) = NULL;
+				fits_close_file(fits_fp,&status);
+				return FALSE;
+			}
+		}
+	}
+	if(status)
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		if((*data) != NULL)
+			free(*data);
+		(*data) = NULL;
+		status = 0;
+		fits_close_file(fits_fp,&status);
+		DpRt_Error_Number = 225;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Read_Float_Image:Reading %.128s failed:%s.",filename,
+			buff);
+		return FALSE;
+	}
+	fits_close_file(fits_fp,&status);
+	return TRUE;
+}
+
+/**
+ * Write a 2 dimensional floating point image to a new FITS file, overwriting any existing file of
+ * the same name. The classification keywords in header are written to the new file, together with
+ * a NCOMBINE keyword. The image is written a block of rows at a time, and if an abort is requested part way
+ * through the incomplete file is deleted.
+ * @param filename The FITS filename to write.
+ * @param header The address of a header structure. Naxis1 and Naxis2 give the image dimensions.
+ * @param data The image data, Naxis1*Naxis2 pixels stored row by row.
+ * @param combine_count The number of frames combined to make this image.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Fits_Write_Float_Rows
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Write_Float_Image(char *filename,struct DpRt_Fits_Header_Struct *header,float *data,
+				int combine_count)
+{
+	fitsfile *fits_fp = NULL;
+	char clobber_filename[DPRT_FITS_FILENAME_LENGTH+1];
+	char buff[FLEN_STATUS];
+	long naxes[FITS_GET_DATA_NAXIS];
+	int status = 0;
+
+	if((filename == NULL)||(header == NULL)||(data == NULL))
+	{
+		DpRt_Error_Number = 215;
+		strcpy(DpRt_Error_String,"DpRt_Fits_Write_Float_Image:filename, header or data was NULL.");
+		return FALSE;
+	}
+	if(strlen(filename) >= DPRT_FITS_FILENAME_LENGTH)
+	{
+		DpRt_Error_Number = 216;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Write_Float_Image:filename too long(%d).",
+			(int)strlen(filename));
+		return FALSE;
+	}
+	/* a leading '!' tells cfitsio to overwrite any existing file */
+	sprintf(clobber_filename,"!%s",filename);
+	naxes[0] = header->Naxis1;
+	naxes[1] = header->Naxis2;
+	fits_create_file(&fits_fp,clobber_filename,&status);
+	fits_create_img(fits_fp,FLOAT_IMG,FITS_GET_DATA_NAXIS,naxes,&status);
+	fits_write_key(fits_fp,TSTRING,"OBSTYPE",header->Obstype,"Observation type",&status);
+	fits_write_key(fits_fp,TINT,"CCDXBIN",&(header->X_Bin),"X binning factor",&status);
+	fits_write_key(fits_fp,TINT,"CCDYBIN",&(header->Y_Bin),"Y binning factor",&status);
+	fits_write_key(fits_fp,TDOUBLE,"EXPTIME",&(header->Exposure_Length),"Exposure length (s)",&status);
+	fits_write_key(fits_fp,TINT,"NCOMBINE",&combine_count,"Number of frames combined",&status);
+	if(!Fits_Write_Float_Rows(fits_fp,header->Naxis1,header->Naxis2,data,FALSE,"DpRt_Fits_Write_Float_Image",
+				  &status))
+	{
+		/* aborted, the file is incomplete so remove it */
+		status = 0;
+		fits_delete_file(fits_fp,&status);
+		return FALSE;
+	}
+	if(status)
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		if(fits_fp != NULL)
+		{
+			/* the file is incomplete, remove it */
+			status = 0;
+			fits_delete_file(fits_fp,&status);
+		}
+		DpRt_Error_Number = 217;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Write_Float_Image:Writing %.128s failed:%s.",
+			filename,buff);
+		return FALSE;
+	}
+	fits_close_file(fits_fp,&status);
+	if(status)
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		DpRt_Error_Number = 218;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Write_Float_Image:Closing %.128s failed:%s.",
+			filename,buff);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Write a reduced 2 dimensional floating point image to a new FITS file, overwriting any existing file of
+ * the same name. All the header keywords of the input frame, apart from the structural and scaling keywords
+ * that describe the original data, are copied to the new file. If the image has been trimmed (its dimensions
+ * differ from the input frame's) the BIASSEC and TRIMSEC keywords no longer describe it, and are not copied.
+ * The image is written a block of rows at a time, and if an abort is requested part way through the incomplete
+ * file is deleted.
+ * If a compression type is given the image is written as a cfitsio tile compressed image extension, one row per
+ * tile, following an empty primary HDU. RICE_1 quantises the floating point pixels at cfitsio's default level,
+ * GZIP_1 is lossless.
+ * The routine takes the cfitsio lock itself, around the header copy, each block of rows and the close, so
+ * another thread's cfitsio calls can run between the blocks, and not at all if cfitsio was built reentrant, as
+ * the file pointers are private to this call. The caller must not hold the lock.
+ * @param input_filename The FITS filename of the frame that was reduced.
+ * @param output_filename The FITS filename to write.
+ * @param naxis1 The number of columns in the image.
+ * @param naxis2 The number of rows in the image.
+ * @param data The image data, naxis1*naxis2 pixels stored row by row.
+ * @param compression_type The cfitsio tile compression algorithm, RICE_1 or GZIP_1, or 0 to write the image
+ *        uncompressed.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Fits_Write_Float_Rows
+ * @see #Fits_Private_Lock
+ * @see #Fits_Private_Unlock
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Write_Reduced_Image(char *input_filename,char *output_filename,int naxis1,int naxis2,float *data,
+				  int compression_type)
+{
+	fitsfile *input_fits_fp = NULL;
+	fitsfile *fits_fp = NULL;
+	char clobber_filename[DPRT_FITS_FILENAME_LENGTH+1];
+	char card[FLEN_CARD];
+	char buff[FLEN_STATUS];
+	long naxes[FITS_GET_DATA_NAXIS];
+	long input_naxes[FITS_GET_DATA_NAXIS];
+	long tile_dimension[FITS_GET_DATA_NAXIS];
+	int status = 0,input_status = 0,keyword_count,trimmed,i;
+
+	if((input_filename == NULL)||(output_filename == NULL)||(data == NULL))
+	{
+		DpRt_Error_Number = 226;
+		strcpy(DpRt_Error_String,"DpRt_Fits_Write_Reduced_Image:filename or data was NULL.");
+		return FALSE;
+	}
+	if(strlen(output_filename) >= DPRT_FITS_FILENAME_LENGTH)
+	{
+		DpRt_Error_Number = 227;
+		sprintf(DpRt_Error_String,"DpRt_Fits_Write_Reduced_Image:filename too long(%d).",
+			(int)strlen(output_filename));
+		return FALSE;
+	}
+	Fits_Private_Lock();
+	if(fits_open_file(&input_fits_fp,input_filename,READONLY,&status))
+	{
+		Fits_Private_Unlock();
+		fits_get_errstatus(status,buff);
+		DpRt_Error_Number = 228;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Write_Reduced_Image:Open failed(%.128s,%d):%s.",
+			input_filename,status,buff);
+		return FALSE;
+	}
+	/* a leading '!' tells cfitsio to overwrite any existing file */
+	sprintf(clobber_filename,"!%s",output_filename);
+	naxes[0] = naxis1;
+	naxes[1] = naxis2;
+	fits_create_file(&fits_fp,clobber_filename,&status);
+	if((compression_type != 0)&&(status == 0))
+	{
+		tile_dimension[0] = naxis1;
+		tile_dimension[1] = 1;
+		fits_set_compression_type(fits_fp,compression_type,&status);
+		fits_set_tile_dim(fits_fp,FITS_GET_DATA_NAXIS,tile_dimension,&status);
+	}
+	fits_create_img(fits_fp,FLOAT_IMG,FITS_GET_DATA_NAXIS,naxes,&status);
+	input_naxes[0] = naxis1;
+	input_naxes[1] = naxis2;
+	fits_get_img_param(input_fits_fp,FITS_GET_DATA_NAXIS,NULL,NULL,input_naxes,&status);
+	trimmed = ((input_naxes[0] != naxis1)||(input_naxes[1] != naxis2));
+	fits_get_hdrspace(input_fits_fp,&keyword_count,NULL,&status);
+	for(i = 1; (i <= keyword_count)&&(status == 0); i++)
+	{
+		fits_read_record(input_fits_fp,i,card,&status);
+		/* skip structural, compression, scaling and checksum keywords */
+		if((status != 0)||(fits_get_keyclass(card) <= TYP_SCAL_KEY)||(fits_get_keyclass(card) == TYP_CKSUM_KEY))
+			continue;
+		if(trimmed && ((strncmp(card,"BIASSEC ",8) == 0)||(strncmp(card,"TRIMSEC ",8) == 0)))
+			continue;
+		fits_write_record(fits_fp,card,&status);
+	}
+	/* the input header has been copied, so the input file can be closed before the pixels are written */
+	fits_close_file(input_fits_fp,&input_status);
+	if(status == 0)
+		status = input_status;
+	Fits_Private_Unlock();
+	if(!Fits_Write_Float_Rows(fits_fp,naxis1,naxis2,data,TRUE,"DpRt_Fits_Write_Reduced_Image",&status))
+	{
+		/* aborted, the file is incomplete so remove it */
+		Fits_Private_Lock();
+		status = 0;
+		fits_delete_file(fits_fp,&status);
+		Fits_Private_Unlock();
+		return FALSE;
+	}
+	Fits_Private_Lock();
+	if(status)
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		if(fits_fp != NULL)
+		{
+			/* the file is incomplete, remove it */
+			status = 0;
+			fits_delete_file(fits_fp,&status);
+		}
+		Fits_Private_Unlock();
+		DpRt_Error_Number = 229;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Write_Reduced_Image:Writing %.128s failed:%s.",
+			output_filename,buff);
+		return FALSE;
+	}
+	fits_close_file(fits_fp,&status);
+	Fits_Private_Unlock();
+	if(status)
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		DpRt_Error_Number = 230;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Write_Reduced_Image:Closing %.128s failed:%s.",
+			output_filename,buff);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Append a one dimensional floating point image extension, e.g. an extracted spectrum, to an existing FITS file.
+ * The routine takes the cfitsio lock itself (unless cfitsio was built reentrant), so the caller must not hold it.
+ * @param filename The FITS filename to append the extension to.
+ * @param extension_name The value of the extension's EXTNAME keyword.
+ * @param data The image data.
+ * @param length The number of pixels in the image.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Fits_Private_Lock
+ * @see #Fits_Private_Unlock
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Fits_Write_Spectrum(char *filename,char *extension_name,float *data,int length)
+{
+	fitsfile *fits_fp = NULL;
+	char buff[FLEN_STATUS];
+	long naxes[1];
+	long first_pixel[1];
+	int status = 0;
+
+	if((filename == NULL)||(extension_name == NULL)||(data == NULL))
+	{
+		DpRt_Error_Number = 231;
+		strcpy(DpRt_Error_String,"DpRt_Fits_Write_Spectrum:filename, extension name or data was NULL.");
+		return FALSE;
+	}
+	Fits_Private_Lock();
+	if(fits_open_file(&fits_fp,filename,READWRITE,&status))
+	{
+		Fits_Private_Unlock();
+		fits_get_errstatus(status,buff);
+		DpRt_Error_Number = 232;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Write_Spectrum:Open failed(%.128s,%d):%s.",filename,
+			status,buff);
+		return FALSE;
+	}
+	naxes[0] = length;
+	first_pixel[0] = 1;
+	/* creating an image in a file that already has a primary HDU appends an IMAGE extension */
+	fits_create_img(fits_fp,FLOAT_IMG,1,naxes,&status);
+	fits_write_key(fits_fp,TSTRING,"EXTNAME",extension_name,"Extension name",&status);
+	fits_write_pix(fits_fp,TFLOAT,first_pixel,(LONGLONG)length,data,&status);
+	if(status)
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		status = 0;
+		fits_close_file(fits_fp,&status);
+		Fits_Private_Unlock();
+		DpRt_Error_Number = 233;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Write_Spectrum:Writing %.32s to %.128s failed:%s.",
+			extension_name,filename,buff);
+		return FALSE;
+	}
+	fits_close_file(fits_fp,&status);
+	Fits_Private_Unlock();
+	if(status)
+	{
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		DpRt_Error_Number = 234;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Fits_Write_Spectrum:Closing %.128s failed:%s.",filename,
+			buff);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Lock the cfitsio mutex. Routines that call cfitsio from more than one thread at once
+ * should hold this lock around their cfitsio calls.
+ * @see #Fits_Mutex
+ */
+void DpRt_Fits_Lock(void)
+{
+	pthread_mutex_lock(&Fits_Mutex);
+}
+
+/**
+ * Unlock the cfitsio mutex.
+ * @see #Fits_Mutex
+ */
+void DpRt_Fits_Unlock(void)
+{
+	pthread_mutex_unlock(&Fits_Mutex);
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Read an integer keyword, using a default value if the keyword does not exist.
+ * @param fits_fp The cfitsio file pointer.
+ * @param keyword The keyword name.
+ * @param default_value The value to use if the keyword does not exist.
+ * @param value The address of an integer to store the value in.
+ * @param status The address of the cfitsio status. If this is non-zero on entry nothing is done.
+ * @return The cfitsio status.
+ */
+static int Fits_Read_Key_Integer(fitsfile *fits_fp,char *keyword,int default_value,int *value,int *status)
+{
+	if((*status) != 0)
+		return (*status);
+	if(fits_read_key(fits_fp,TINT,keyword,value,NULL,status))
+	{
+		if((*status) == KEY_NO_EXIST)
+		{
+			(*status) = 0;
+			(*value) = default_value;
+		}
+	}
+	return (*status);
+}
+
+/**
+ * Read a FITS section keyword, e.g. BIASSEC, of the form '[x1:x2,y1:y2]' (1 based and inclusive). Reversed ranges
+ * are put in increasing order. A missing keyword, or one that does not parse or lie within the image, is not an
+ * error: found is set to FALSE.
+ * @param fits_fp The cfitsio file pointer.
+ * @param keyword The keyword name.
+ * @param naxis1 The number of columns in the image.
+ * @param naxis2 The number of rows in the image.
+ * @param found The address of an integer, set to TRUE if a valid section was read.
+ * @param section The address of a section structure, filled in (0 based) if found is TRUE.
+ * @param status The address of the cfitsio status. If this is non-zero on entry nothing is done.
+ * @return The cfitsio status.
+ * @see #Fits_Section_Parse
+ */
+static int Fits_Read_Key_Section(fitsfile *fits_fp,char *keyword,int naxis1,int naxis2,int *found,
+				 struct DpRt_Fits_Section_Struct *section,int *status)
+{
+	char value[FLEN_VALUE];
+
+	(*found) = FALSE;
+	if((*status) != 0)
+		return (*status);
+	if(fits_read_key(fits_fp,TSTRING,keyword,value,NULL,status))
+	{
+		if((*status) == KEY_NO_EXIST)
+			(*status) = 0;
+		return (*status);
+	}
+	Fits_Section_Parse(value,naxis1,naxis2,found,section);
+	return (*status);
+}
+
+/**
+ * Parse the value of a FITS section keyword, of the form '[x1:x2,y1:y2]' (1 based and inclusive). Reversed ranges
+ * are put in increasing order. A value that does not parse, or does not lie within the image, sets found to FALSE.
+ * @param value The keyword's value, without quotes.
+ * @param naxis1 The number of columns in the image.
+ * @param naxis2 The number of rows in the image.
+ * @param found The address of an integer, set to TRUE if the section is valid.
+ * @param section The address of a section structure, filled in (0 based) if found is TRUE.
+ * @see dprt_fits.h#DpRt_Fits_Section_Struct
+ */
+static void Fits_Section_Parse(char *value,int naxis1,int naxis2,int *found,struct DpRt_Fits_Section_Struct *section)
+{
+	int x1,x2,y1,y2;
+
+	(*found) = FALSE;
+	if(sscanf(value," [ %d : %d , %d : %d ]",&x1,&x2,&y1,&y2) != 4)
+		return;
+	section->X_Start = ((x1 < x2) ? x1 : x2)-1;
+	section->X_End = ((x1 < x2) ? x2 : x1)-1;
+	section->Y_Start = ((y1 < y2) ? y1 : y2)-1;
+	section->Y_End = ((y1 < y2) ? y2 : y1)-1;
+	(*found) = ((section->X_Start >= 0)&&(section->X_End < naxis1)&&(section->Y_Start >= 0)&&
+		    (section->Y_End < naxis2));
+}
+
+/**
+ * Split a FITS header card into its keyword and value. String values have their quotes removed, doubled quotes
+ * within them replaced by one, and trailing spaces removed. Other values have any comment and surrounding spaces
+ * removed. Cards without a value indicator ("= " in columns 9 and 10), e.g. COMMENT and END, have an empty value.
+ * @param card The card, FITS_CARD_LENGTH characters (not NUL terminated).
+ * @param keyword A string of at least FLEN_KEYWORD characters, set to the keyword without trailing spaces.
+ * @param value A string of at least FLEN_VALUE characters, set to the value.
+ * @see #FITS_CARD_LENGTH
+ */
+static void Fits_Card_Parse(char *card,char *keyword,char *value)
+{
+	int i,length;
+
+	for(i = 0; (i < 8)&&(card[i] != ' '); i++)
+		keyword[i] = card[i];
+	keyword[i] = '\0';
+	value[0] = '\0';
+	if((card[8] != '=')||(card[9] != ' '))
+		return;
+	i = 10;
+	while((i < FITS_CARD_LENGTH)&&(card[i] == ' '))
+		i++;
+	length = 0;
+	if((i < FITS_CARD_LENGTH)&&(card[i] == '\''))
+	{
+		for(i++; (i < FITS_CARD_LENGTH)&&(length < FLEN_VALUE-1); i++)
+		{
+			if(card[i] == '\'')
+			{
+				/* a doubled quote is a quote in the string, a single one ends it */
+				if((i+1 >= FITS_CARD_LENGTH)||(card[i+1] != '\''))
+					break;
+				i++;
+			}
+			value[length++] = card[i];
+		}
+	}
+	else
+	{
+		for(; (i < FITS_CARD_LENGTH)&&(card[i] != '/')&&(length < FLEN_VALUE-1); i++)
+			value[length++] = card[i];
+	}
+	while((length > 0)&&(value[length-1] == ' '))
+		length--;
+	value[length] = '\0';
+}
+
+/**
+ * Try to memory map an image opened for reading a block of rows at a time. The image is mapped if it is an
+ * uncompressed image of unsigned 16 bit pixels whose data unit lies wholly within the file. The data unit's
+ * offset is taken from the header cfitsio has parsed, after which the cfitsio file is closed. Images that cannot
+ * be mapped (including filenames using cfitsio's extended syntax) are left open in cfitsio, and this is not an
+ * error.
+ * @param filename The FITS filename.
+ * @param reader The address of a reader structure, with Fits_Fp, Naxis1 and Naxis2 filled in. On success
+ *        Map, Map_Length, Data and Pixel_Format are filled in and Fits_Fp is closed.
+ * @return The routine returns TRUE if the image was memory mapped, and FALSE if it should be read through
+ *         cfitsio.
+ * @see #DpRt_Fits_Image_Raw_Data_Get
+ * @see dprt_kernel.h#DPRT_KERNEL_PIXEL_FORMAT
+ */
+static int Fits_Reader_Map(char *filename,struct DpRt_Fits_Reader_Struct *reader)
+{
+	struct stat file_stat;
+	LONGLONG data_start,data_end;
+	void *map = NULL;
+	int fd;
+
+	if(!DpRt_Fits_Image_Raw_Data_Get(reader->Fits_Fp,reader->Naxis1,reader->Naxis2,&data_start,&data_end))
+		return FALSE;
+	fd = open(filename,O_RDONLY);
+	if(fd < 0)
+		return FALSE;
+	if((fstat(fd,&file_stat) != 0)||(((LONGLONG)file_stat.st_size) < data_end))
+	{
+		close(fd);
+		return FALSE;
+	}
+	map = mmap(NULL,(size_t)(file_stat.st_size),PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if(map == MAP_FAILED)
+		return FALSE;
+	/* the blocks are processed in order, so ask for aggressive read ahead */
+	posix_madvise(map,(size_t)(file_stat.st_size),POSIX_MADV_SEQUENTIAL);
+	reader->Map = (unsigned char *)map;
+	reader->Map_Length = (size_t)(file_stat.st_size);
+	reader->Data = reader->Map+data_start;
+	reader->Pixel_Format = DPRT_KERNEL_PIXEL_FORMAT_FITS;
+	DpRt_Fits_Image_Close(reader->Fits_Fp);
+	reader->Fits_Fp = NULL;
+	return TRUE;
+}
+
+/**
+ * Write a 2 dimensional floating point image's pixels to the current HDU, DPRT_FITS_BLOCK_PIXELS at a time,
+ * polling the abort generation between blocks. Nothing is written if status is already set.
+ * @param fits_fp The cfitsio file pointer, with the image HDU created.
+ * @param naxis1 The number of columns in the image.
+ * @param naxis2 The number of rows in the image.
+ * @param data The image data, naxis1*naxis2 pixels stored row by row.
+ * @param lock If TRUE, the cfitsio lock is taken around the write of each block (unless cfitsio was built
+ *        reentrant), and the caller must not hold it. If FALSE, the caller holds the lock.
+ * @param function_name The name of the calling function, used in the abort error string.
+ * @param status The address of the cfitsio status, set if a write fails.
+ * @return The routine returns FALSE if an abort was requested (with the error number and string set), and TRUE
+ *         otherwise. cfitsio errors are returned in status.
+ * @see dprt_fits.h#DPRT_FITS_BLOCK_PIXELS
+ * @see #Fits_Private_Lock
+ * @see #Fits_Private_Unlock
+ * @see dprt_abort.html#DpRt_Abort_Checkpoint
+ */
+static int Fits_Write_Float_Rows(fitsfile *fits_fp,int naxis1,int naxis2,float *data,int lock,
+				 char *function_name,int *status)
+{
+	struct DpRt_Abort_Checkpoint_Struct checkpoint;
+	long first_pixel[FITS_GET_DATA_NAXIS];
+	int block_rows,row,row_count;
+
+	block_rows = DPRT_FITS_BLOCK_PIXELS/naxis1;
+	if(block_rows < 1)
+		block_rows = 1;
+	DpRt_Abort_Checkpoint_Initialise(&checkpoint);
+	first_pixel[0] = 1;
+	for(row = 0; (row < naxis2)&&((*status) == 0); row += block_rows)
+	{
+		if(!DpRt_Abort_Checkpoint(&checkpoint,((long)naxis1)*block_rows,function_name))
+			return FALSE;
+		row_count = naxis2-row;
+		if(row_count > block_rows)
+			row_count = block_rows;
+		first_pixel[1] = row+1;
+		if(lock)
+			Fits_Private_Lock();
+		fits_write_pix(fits_fp,TFLOAT,first_pixel,((LONGLONG)naxis1)*row_count,data+(((size_t)row)*naxis1),
+			       status);
+		if(lock)
+			Fits_Private_Unlock();
+	}
+	return TRUE;
+}
+
+/**
+ * Lock the cfitsio mutex around cfitsio calls on file pointers that only the calling thread uses, e.g. a file
+ * being written. A reentrant cfitsio build keeps no shared state between file pointers, so if fits_is_reentrant
+ * says cfitsio was built reentrant the mutex is not taken, and several threads can write different files at
+ * once. File pointers shared between threads (e.g. by the combine workers) still need DpRt_Fits_Lock.
+ * @see #DpRt_Fits_Lock
+ * @see #Fits_Private_Unlock
+ */
+static void Fits_Private_Lock(void)
+{
+	if(!fits_is_reentrant())
+		DpRt_Fits_Lock();
+}
+
+/**
+ * Unlock the cfitsio mutex taken by Fits_Private_Lock.
+ * @see #DpRt_Fits_Unlock
+ * @see #Fits_Private_Lock
+ */
+static void Fits_Private_Unlock(void)
+{
+	if(!fits_is_reentrant())
+		DpRt_Fits_Unlock();
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
@@ -0,0 +1,591 @@
+/* dprt_index.c
+** Calibration directory header index for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_index.c keeps an index of the classification keywords of the FITS files in a directory, so a directory of
+ * calibration frames does not have to have every file opened each time it is searched. The index is a small text
+ * file (DPRT_INDEX_FILENAME) kept in the directory itself, with one line per file, keyed on the file's name, size
+ * and modification time. When a directory is searched only the files that are new or have changed since the
+ * index was written have their headers read, and these are read by several threads at once, parsing the header
+ * cards directly so no cfitsio lock is needed. The index is rewritten whenever the directory has changed.
+ * A missing, unreadable or out of date index is never an error, the headers are just read again.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_fits.h"
+#include "dprt_combine.h"
+#include "dprt_index.h"
+#include "dprt_abort.h"
+#include "dprt_context.h"
+#include "dprt_log.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The first line of an index file. An index file starting with anything else (e.g. one written by a later
+ * version with a different format) is ignored.
+ */
+#define INDEX_FILE_VERSION		("DPRT_INDEX 1")
+/**
+ * The longest line read from an index file. This is enough for the numeric fields, an OBSTYPE value and a
+ * filename of DPRT_FITS_FILENAME_LENGTH characters.
+ */
+#define INDEX_LINE_LENGTH		(1024)
+/**
+ * The number of fields before the OBSTYPE value on each line of an index file.
+ */
+#define INDEX_NUMERIC_FIELD_COUNT	(19)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure shared by the threads reading the headers of the new and changed files in a directory.
+ * <dl>
+ * <dt>Entry_List</dt> <dd>The list of files in the directory.</dd>
+ * <dt>Parse_List</dt> <dd>The indices in Entry_List of the files whose headers need reading.</dd>
+ * <dt>Parse_Count</dt> <dd>The number of indices in Parse_List.</dd>
+ * <dt>Next_Parse</dt> <dd>The index in Parse_List of the next file to be taken by a worker.</dd>
+ * <dt>Mutex</dt> <dd>Mutex protecting Next_Parse and the error fields.</dd>
+ * <dt>Error_Number</dt> <dd>The error number of the first worker to fail, or zero.</dd>
+ * <dt>Error_String</dt> <dd>The error string of the first worker to fail.</dd>
+ * <dt>Log_Tag</dt> <dd>The log tag of the calling thread, which the workers log under.</dd>
+ * <dt>Abort_Generation</dt> <dd>The abort generation of the calling thread, which the workers are aborted
+ *     with.</dd>
+ * </dl>
+ */
+struct Index_Struct
+{
+	struct DpRt_Index_Entry_Struct *Entry_List;
+	int *Parse_List;
+	int Parse_Count;
+	int Next_Parse;
+	pthread_mutex_t Mutex;
+	int Error_Number;
+	char Error_String[DPRT_ERROR_STRING_LENGTH];
+	unsigned long Log_Tag;
+	unsigned long Abort_Generation;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Index_Load(char *directory_name,struct DpRt_Index_Entry_Struct **entry_list,int *entry_count);
+static int Index_Line_Parse(char *directory_name,char *line,struct DpRt_Index_Entry_Struct *entry);
+static void Index_Save(char *directory_name,struct DpRt_Index_Entry_Struct *entry_list,int entry_count);
+static int Index_Parse_Run(struct Index_Struct *index);
+static void *Index_Worker(void *user_arg);
+static int Index_Parse_Get(struct Index_Struct *index,int *entry_index);
+static void Index_Error_Set(struct Index_Struct *index,int error_number,char *error_string);
+static int Index_Entry_Compare(const void *p1,const void *p2);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Get the classification keywords of every regular file in a directory ending in extension. The directory's
+ * index is loaded, and the keywords of each file whose size and modification time match its index entry are
+ * taken from the index. The headers of the remaining files are read by several threads at once. Files whose
+ * headers cannot be read are returned with Valid set to FALSE. If any file was new, changed or removed the index
+ * is rewritten. The list is sorted by filename.
+ * @param directory_name The directory to search.
+ * @param extension The filename extension a file must have to be included, e.g. ".fits".
+ * @param entry_list The address of a pointer, set to an allocated list of entries. This should be freed
+ *        by the caller. If no files are found this is set to NULL.
+ * @param entry_count The address of an integer, set to the number of entries in the list.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Index_Load
+ * @see #Index_Parse_Run
+ * @see #Index_Save
+ * @see #Index_Entry_Compare
+ * @see dprt_abort.html#DpRt_Abort_Check
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Index_Get(char *directory_name,char *extension,struct DpRt_Index_Entry_Struct **entry_list,
+		   int *entry_count)
+{
+	struct Index_Struct index;
+	struct DpRt_Index_Entry_Struct entry;
+	struct DpRt_Index_Entry_Struct *old_list = NULL;
+	struct DpRt_Index_Entry_Struct *old_entry = NULL;
+	struct DpRt_Index_Entry_Struct *new_list = NULL;
+	struct dirent *directory_entry = NULL;
+	struct stat stat_buffer;
+	DIR *dir = NULL;
+	size_t name_length,extension_length;
+	int *new_parse_list = NULL;
+	int old_count,allocated_count,retval;
+
+	if((directory_name == NULL)||(extension == NULL)||(entry_list == NULL)||(entry_count == NULL))
+	{
+		DpRt_Error_Number = 1700;
+		strcpy(DpRt_Error_String,"DpRt_Index_Get:Parameter was NULL.");
+		return FALSE;
+	}
+	(*entry_list) = NULL;
+	(*entry_count) = 0;
+	if(!Index_Load(directory_name,&old_list,&old_count))
+		return FALSE;
+	dir = opendir(directory_name);
+	if(dir == NULL)
+	{
+		if(old_list != NULL)
+			free(old_list);
+		DpRt_Error_Number = 1701;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Index_Get:Failed to open directory %.128s.",
+			directory_name);
+		return FALSE;
+	}
+	index.Entry_List = NULL;
+	index.Parse_List = NULL;
+	index.Parse_Count = 0;
+	allocated_count = 0;
+	retval = TRUE;
+	extension_length = strlen(extension);
+	while(retval && ((directory_entry = readdir(dir)) != NULL))
+	{
+		if(!DpRt_Abort_Check("DpRt_Index_Get"))
+		{
+			retval = FALSE;
+			break;
+		}
+		name_length = strlen(directory_entry->d_name);
+		if((name_length <= extension_length)||
+		   (strcmp(directory_entry->d_name+name_length-extension_length,extension) != 0))
+			continue;
+		if(snprintf(entry.Filename,DPRT_FITS_FILENAME_LENGTH,"%s/%s",directory_name,
+			    directory_entry->d_name) >= DPRT_FITS_FILENAME_LENGTH)
+		{
+			DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"DpRt_Index_Get:Filename too long:Skipping %s.",
+				directory_entry->d_name);
+			continue;
+		}
+		if((stat(entry.Filename,&stat_buffer) != 0)||(!S_ISREG(stat_buffer.st_mode)))
+			continue;
+		entry.Modification_Time = stat_buffer.st_mtime;
+		entry.Modification_Time_Nsec = stat_buffer.st_mtim.tv_nsec;
+		entry.File_Size = stat_buffer.st_size;
+		entry.Valid = FALSE;
+		if((*entry_count) >= allocated_count)
+		{
+			allocated_count = (allocated_count*2)+16;
+			new_list = (struct DpRt_Index_Entry_Struct *)realloc(index.Entry_List,
+						allocated_count*sizeof(struct DpRt_Index_Entry_Struct));
+			if(new_list != NULL)
+				index.Entry_List = new_list;
+			new_parse_list = (int *)realloc(index.Parse_List,allocated_count*sizeof(int));
+			if(new_parse_list != NULL)
+				index.Parse_List = new_parse_list;
+			if((new_list == NULL)||(new_parse_list == NULL))
+			{
+				DpRt_Error_Number = 1702;
+				sprintf(DpRt_Error_String,"DpRt_Index_Get:Failed to allocate entry list(%d).",
+					allocated_count);
+				retval = FALSE;
+				break;
+			}
+		}
+		old_entry = NULL;
+		if(old_list != NULL)
+		{
+			old_entry = (struct DpRt_Index_Entry_Struct *)bsearch(&entry,old_list,old_count,
+						sizeof(struct DpRt_Index_Entry_Struct),Index_Entry_Compare);
+		}
+		if((old_entry != NULL)&&(old_entry->Modification_Time == entry.Modification_Time)&&
+		   (old_entry->Modification_Time_Nsec == entry.Modification_Time_Nsec)&&
+		   (old_entry->File_Size == entry.File_Size))
+		{
+			entry.Valid = old_entry->Valid;
+			entry.Header = old_entry->Header;
+		}
+		else
+			index.Parse_List[index.Parse_Count++] = (*entry_count);
+		index.Entry_List[(*entry_count)++] = entry;
+	}
+	closedir(dir);
+	if(old_list != NULL)
+		free(old_list);
+	if(retval && (index.Parse_Count > 0))
+		retval = Index_Parse_Run(&index);
+	if(index.Parse_List != NULL)
+		free(index.Parse_List);
+	if(retval == FALSE)
+	{
+		if(index.Entry_List != NULL)
+			free(index.Entry_List);
+		(*entry_count) = 0;
+		return FALSE;
+	}
+	if((*entry_count) > 1)
+	{
+		qsort(index.Entry_List,(*entry_count),sizeof(struct DpRt_Index_Entry_Struct),Index_Entry_Compare);
+	}
+	/* a file removed since the index was written leaves an entry unmatched */
+	if((index.Parse_Count > 0)||((*entry_count) != old_count))
+		Index_Save(directory_name,index.Entry_List,(*entry_count));
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Index_Get:%s:%d files:%d headers read:%d from the index.",
+		directory_name,(*entry_count),index.Parse_Count,(*entry_count)-index.Parse_Count);
+	(*entry_list) = index.Entry_List;
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Load a directory's index file. A missing index, or one whose version line does not match INDEX_FILE_VERSION,
+ * gives an empty list. Lines that do not parse are left out, so their files have their headers read again.
+ * The list is sorted by filename, for bsearch.
+ * @param directory_name The directory.
+ * @param entry_list The address of a pointer, set to an allocated list of entries, or NULL if there are none.
+ *        This should be freed by the caller.
+ * @param entry_count The address of an integer, set to the number of entries in the list.
+ * @return The routine returns TRUE on success and FALSE on failure (a failed allocation).
+ * @see #Index_Line_Parse
+ * @see #INDEX_FILE_VERSION
+ * @see dprt_index.h#DPRT_INDEX_FILENAME
+ */
+static int Index_Load(char *directory_name,struct DpRt_Index_Entry_Struct **entry_list,int *entry_count)
+{
+	struct DpRt_Index_Entry_Struct entry;
+	struct DpRt_Index_Entry_Struct *new_list = NULL;
+	FILE *fp = NULL;
+	char filename[DPRT_FITS_FILENAME_LENGTH];
+	char line[INDEX_LINE_LENGTH];
+	int allocated_count;
+
+	(*entry_list) = NULL;
+	(*entry_count) = 0;
+	if(strlen(directory_name)+strlen(DPRT_INDEX_FILENAME)+2 > DPRT_FITS_FILENAME_LENGTH)
+		return TRUE;
+	sprintf(filename,"%s/%s",directory_name,DPRT_INDEX_FILENAME);
+	fp = fopen(filename,"r");
+	if(fp == NULL)
+		return TRUE;
+	if((fgets(line,INDEX_LINE_LENGTH,fp) == NULL)||
+	   (strncmp(line,INDEX_FILE_VERSION,strlen(INDEX_FILE_VERSION)) != 0)||(line[strlen(INDEX_FILE_VERSION)] != '\n'))
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"Index_Load:%s is not a version '%s' index:Ignoring it.",
+			filename,INDEX_FILE_VERSION);
+		fclose(fp);
+		return TRUE;
+	}
+	allocated_count = 0;
+	while(fgets(line,INDEX_LINE_LENGTH,fp) != NULL)
+	{
+		if(!Index_Line_Parse(directory_name,line,&entry))
+			continue;
+		if((*entry_count) >= allocated_count)
+		{
+			allocated_count = (allocated_count*2)+16;
+			new_list = (struct DpRt_Index_Entry_Struct *)realloc((*entry_list),
+						allocated_count*sizeof(struct DpRt_Index_Entry_Struct));
+			if(new_list == NULL)
+			{
+				fclose(fp);
+				if((*entry_list) != NULL)
+					free(*entry_list);
+				(*entry_list) = NULL;
+				(*entry_count) = 0;
+				DpRt_Error_Number = 1703;
+				sprintf(DpRt_Error_String,"Index_Load:Failed to allocate entry list(%d).",allocated_count);
+				return FALSE;
+			}
+			(*entry_list) = new_list;
+		}
+		(*entry_list)[(*entry_count)++] = entry;
+	}
+	fclose(fp);
+	/* the index is written sorted, but it may have been edited */
+	if((*entry_count) > 1)
+	{
+		qsort((*entry_list),(*entry_count),sizeof(struct DpRt_Index_Entry_Struct),Index_Entry_Compare);
+	}
+	return TRUE;
+}
+
+/**
+ * Parse one line of an index file. The line holds the numeric fields written by Index_Save separated by spaces,
+ * then a tab, the OBSTYPE value, another tab, and the filename (without the directory).
+ * @param directory_name The directory the index is in, prepended to the filename.
+ * @param line The line, including its newline.
+ * @param entry The address of an entry to fill in.
+ * @return The routine returns TRUE if the line parsed, and FALSE if it did not.
+ * @see #Index_Save
+ * @see #INDEX_NUMERIC_FIELD_COUNT
+ */
+static int Index_Line_Parse(char *directory_name,char *line,struct DpRt_Index_Entry_Struct *entry)
+{
+	struct DpRt_Fits_Header_Struct *header = NULL;
+	char *obstype = NULL;
+	char *name = NULL;
+	char *tab = NULL;
+	long modification_time,file_size;
+	int length,offset = 0;
+
+	header = &(entry->Header);
+	if(sscanf(line,"%ld %ld %ld %d %d %d %d %d %lf %d %d %d %d %d %d %d %d %d %d%n",&modification_time,
+		  &(entry->Modification_Time_Nsec),&file_size,&(entry->Valid),&(header->Naxis1),&(header->Naxis2),
+		  &(header->X_Bin),&(header->Y_Bin),&(header->Exposure_Length),&(header->Bias_Section_Found),
+		  &(header->Bias_Section.X_Start),&(header->Bias_Section.X_End),&(header->Bias_Section.Y_Start),
+		  &(header->Bias_Section.Y_End),&(header->Trim_Section_Found),&(header->Trim_Section.X_Start),
+		  &(header->Trim_Section.X_End),&(header->Trim_Section.Y_Start),&(header->Trim_Section.Y_End),
+		  &offset) != INDEX_NUMERIC_FIELD_COUNT)
+		return FALSE;
+	entry->Modification_Time = (time_t)modification_time;
+	entry->File_Size = (off_t)file_size;
+	if(line[offset] != '\t')
+		return FALSE;
+	obstype = line+offset+1;
+	tab = strchr(obstype,'\t');
+	if((tab == NULL)||(tab-obstype >= FLEN_VALUE))
+		return FALSE;
+	(*tab) = '\0';
+	strcpy(header->Obstype,obstype);
+	name = tab+1;
+	length = strlen(name);
+	if((length < 2)||(name[length-1] != '\n'))
+		return FALSE;
+	name[length-1] = '\0';
+	if(snprintf(entry->Filename,DPRT_FITS_FILENAME_LENGTH,"%s/%s",directory_name,name) >=
+	   DPRT_FITS_FILENAME_LENGTH)
+		return FALSE;
+	return TRUE;
+}
+
+/**
+ * Write a directory's index file. The index is written to a temporary file, which is then renamed over the old
+ * index, so a reader never sees a partly written index. Failing to write the index (e.g. the directory is read
+ * only) is not an error, the headers are just read again next time. Files whose names contain a tab or newline
+ * are left out.
+ * @param directory_name The directory.
+ * @param entry_list The list of entries, with filenames in directory_name.
+ * @param entry_count The number of entries in the list.
+ * @see #Index_Line_Parse
+ * @see #INDEX_FILE_VERSION
+ * @see dprt_index.h#DPRT_INDEX_FILENAME
+ */
+static void Index_Save(char *directory_name,struct DpRt_Index_Entry_Struct *entry_list,int entry_count)
+{
+	struct DpRt_Fits_Header_Struct empty_header;
+	struct DpRt_Fits_Header_Struct *header = NULL;
+	FILE *fp = NULL;
+	char filename[DPRT_FITS_FILENAME_LENGTH];
+	char temporary_filename[DPRT_FITS_FILENAME_LENGTH+16];
+	char *name = NULL;
+	int i,retval;
+
+	if(strlen(directory_name)+strlen(DPRT_INDEX_FILENAME)+2 > DPRT_FITS_FILENAME_LENGTH)
+		return;
+	sprintf(filename,"%s/%s",directory_name,DPRT_INDEX_FILENAME);
+	/* the process id keeps two processes indexing the same directory from sharing a temporary file */
+	sprintf(temporary_filename,"%s.%d",filename,(int)getpid());
+	fp = fopen(temporary_filename,"w");
+	if(fp == NULL)
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"Index_Save:Failed to open %s:Not saving index.",
+			temporary_filename);
+		return;
+	}
+	/* files whose headers could not be read are written with zero keywords */
+	memset(&empty_header,0,sizeof(struct DpRt_Fits_Header_Struct));
+	retval = (fprintf(fp,"%s\n",INDEX_FILE_VERSION) > 0);
+	for(i = 0; retval && (i < entry_count); i++)
+	{
+		name = entry_list[i].Filename+strlen(directory_name)+1;
+		if(strpbrk(name,"\t\n") != NULL)
+			continue;
+		if(entry_list[i].Valid)
+			header = &(entry_list[i].Header);
+		else
+			header = &empty_header;
+		retval = (fprintf(fp,"%ld %ld %ld %d %d %d %d %d %.17g %d %d %d %d %d %d %d %d %d %d\t%s\t%s\n",
+				  (long)(entry_list[i].Modification_Time),entry_list[i].Modification_Time_Nsec,
+				  (long)(entry_list[i].File_Size),entry_list[i].Valid,header->Naxis1,header->Naxis2,
+				  header->X_Bin,header->Y_Bin,header->Exposure_Length,header->Bias_Section_Found,
+				  header->Bias_Section.X_Start,header->Bias_Section.X_End,header->Bias_Section.Y_Start,
+				  header->Bias_Section.Y_End,header->Trim_Section_Found,header->Trim_Section.X_Start,
+				  header->Trim_Section.X_End,header->Trim_Section.Y_Start,header->Trim_Section.Y_End,
+				  header->Obstype,name) > 0);
+	}
+	if(fclose(fp) != 0)
+		retval = FALSE;
+	if((retval == FALSE)||(rename(temporary_filename,filename) != 0))
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"Index_Save:Failed to write %s:Not saving index.",filename);
+		remove(temporary_filename);
+	}
+}
+
+/**
+ * Start the worker threads and wait for them to read the header of every file in the index's Parse_List.
+ * @param index The address of the index structure, with Entry_List, Parse_List and Parse_Count filled in.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Index_Worker
+ * @see dprt_combine.html#DpRt_Combine_Thread_Count_Get
+ */
+static int Index_Parse_Run(struct Index_Struct *index)
+{
+	pthread_t thread_list[DPRT_COMBINE_THREAD_COUNT_MAX];
+	int thread_count,started_count,i;
+
+	thread_count = DpRt_Combine_Thread_Count_Get();
+	if(thread_count > index->Parse_Count)
+		thread_count = index->Parse_Count;
+	index->Next_Parse = 0;
+	index->Error_Number = 0;
+	index->Error_String[0] = '\0';
+	index->Log_Tag = DpRt_Error_Current_Get()->Log_Tag;
+	index->Abort_Generation = DpRt_Error_Current_Get()->Abort_Generation;
+	pthread_mutex_init(&(index->Mutex),NULL);
+	started_count = 0;
+	for(i = 0; i < thread_count; i++)
+	{
+		if(pthread_create(&(thread_list[i]),NULL,Index_Worker,(void *)index) != 0)
+		{
+			Index_Error_Set(index,1704,"Index_Parse_Run:Failed to create worker thread.");
+			break;
+		}
+		started_count++;
+	}
+	for(i = 0; i < started_count; i++)
+		pthread_join(thread_list[i],NULL);
+	pthread_mutex_destroy(&(index->Mutex));
+	if(index->Error_Number != 0)
+	{
+		DpRt_Error_Number = index->Error_Number;
+		strcpy(DpRt_Error_String,index->Error_String);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Header reading worker thread. Repeatedly takes the next file to be read, and parses its header cards
+ * directly. Files that cannot be parsed directly (e.g. tile compressed images) have their headers read through
+ * cfitsio, holding the cfitsio lock. Files that cannot be read either way, or that were parsed but are not raw
+ * frames (their BITPIX is wrong), are marked as not valid, with a warning. On an abort the worker records a
+ * DPRT_ABORT_ERROR_NUMBER error, which also stops the other workers.
+ * @param user_arg The address of the shared index structure.
+ * @return NULL.
+ * @see #Index_Parse_Get
+ * @see #Index_Error_Set
+ * @see dprt_fits.html#DpRt_Fits_Header_Parse
+ * @see dprt_fits.html#DpRt_Fits_Header_Read
+ * @see dprt_fits.h#DPRT_FITS_BITPIX_ERROR_NUMBER
+ * @see dprt_abort.html#DpRt_Abort_Check
+ * @see dprt_context.html#DpRt_Error_Bind
+ */
+static void *Index_Worker(void *user_arg)
+{
+	struct DpRt_Error_Struct error;
+	struct DpRt_Index_Entry_Struct *entry = NULL;
+	struct Index_Struct *index = NULL;
+	int entry_index;
+
+	index = (struct Index_Struct *)user_arg;
+	error.Number = 0;
+	error.String[0] = '\0';
+	error.Log_Tag = index->Log_Tag;
+	error.Abort_Generation = index->Abort_Generation;
+	DpRt_Error_Bind(&error);
+	while(Index_Parse_Get(index,&entry_index))
+	{
+		if(!DpRt_Abort_Check("Index_Worker"))
+		{
+			Index_Error_Set(index,DpRt_Error_Number,DpRt_Error_String);
+			break;
+		}
+		entry = &(index->Entry_List[entry_index]);
+		entry->Valid = DpRt_Fits_Header_Parse(entry->Filename,&(entry->Header));
+		if((entry->Valid == FALSE)&&(DpRt_Error_Number != DPRT_FITS_BITPIX_ERROR_NUMBER))
+		{
+			DpRt_Fits_Lock();
+			entry->Valid = DpRt_Fits_Header_Read(entry->Filename,&(entry->Header));
+			DpRt_Fits_Unlock();
+		}
+		if(entry->Valid == FALSE)
+		{
+			DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"Index_Worker:Skipping %s:%s",entry->Filename,
+				DpRt_Error_String);
+		}
+		DpRt_Error_Number = 0;
+		DpRt_Error_String[0] = '\0';
+	}
+	DpRt_Error_Bind(NULL);
+	return NULL;
+}
+
+/**
+ * Take the next file whose header is to be read.
+ * @param index The address of the shared index structure.
+ * @param entry_index The address of an integer, set to the index in Entry_List of the file.
+ * @return The routine returns TRUE if a file was taken, and FALSE if there are none left or a worker has failed.
+ */
+static int Index_Parse_Get(struct Index_Struct *index,int *entry_index)
+{
+	int retval;
+
+	pthread_mutex_lock(&(index->Mutex));
+	retval = ((index->Error_Number == 0)&&(index->Next_Parse < index->Parse_Count));
+	if(retval)
+		(*entry_index) = index->Parse_List[index->Next_Parse++];
+	pthread_mutex_unlock(&(index->Mutex));
+	return retval;
+}
+
+/**
+ * Record a worker's error, unless another worker has already failed.
+ * @param index The address of the shared index structure.
+ * @param error_number The error number.
+ * @param error_string The error string.
+ */
+static void Index_Error_Set(struct Index_Struct *index,int error_number,char *error_string)
+{
+	pthread_mutex_lock(&(index->Mutex));
+	if(index->Error_Number == 0)
+	{
+		index->Error_Number = error_number;
+		strncpy(index->Error_String,error_string,DPRT_ERROR_STRING_LENGTH-1);
+		index->Error_String[DPRT_ERROR_STRING_LENGTH-1] = '\0';
+	}
+	pthread_mutex_unlock(&(index->Mutex));
+}
+
+/**
+ * Comparison routine for qsort and bsearch, ordering index entries by filename.
+ * @param p1 The address of the first entry.
+ * @param p2 The address of the second entry.
+ * @return The strcmp of the filenames.
+ */
+static int Index_Entry_Compare(const void *p1,const void *p2)
+{
+	const struct DpRt_Index_Entry_Struct *entry1 = (const struct DpRt_Index_Entry_Struct *)p1;
+	const struct DpRt_Index_Entry_Struct *entry2 = (const struct DpRt_Index_Entry_Struct *)p2;
+
+	return strcmp(entry1->Filename,entry2->Filename);
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
@@ -0,0 +1,392 @@
+/* dprt_job.c
+** Asynchronous reduction job queue for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_job.c runs expose reductions asynchronously. DpRt_Job_Expose_Submit queues a frame and returns a job
+ * handle at once. A single native worker thread, started by the first submit, reduces queued frames in the
+ * order they were submitted in its own reduction context, and passes each result to the job's callback. Job
+ * handles are allocated in increasing order, so a job's state can be derived from the handles of the running
+ * and last completed jobs. Each job records the abort generation it was submitted in: an abort requested
+ * through DpRt_Abort stops the job running, and cancels the jobs still queued when the worker reaches them.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_abort.h"
+#include "dprt_job.h"
+#include "dprt_context.h"
+#include "dprt_log.h"
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding one queued reduction job.
+ * <dl>
+ * <dt>Id</dt> <dd>The job handle returned to the submitter.</dd>
+ * <dt>Input_Filename</dt> <dd>An allocated copy of the FITS filename to be reduced.</dd>
+ * <dt>Callback</dt> <dd>The routine called by the worker thread with the job's result.</dd>
+ * <dt>User_Arg</dt> <dd>A pointer passed unchanged to the callback.</dd>
+ * <dt>Abort_Generation</dt> <dd>The abort generation the job was submitted in. The job is aborted (or
+ *     cancelled, if it has not started) once the abort generation moves on.</dd>
+ * <dt>Next</dt> <dd>The next job in the queue.</dd>
+ * </dl>
+ */
+struct Job_Struct
+{
+	int Id;
+	char *Input_Filename;
+	void (*Callback)(int job_id,struct DpRt_Expose_Result_Struct *result,void *user_arg);
+	void *User_Arg;
+	unsigned long Abort_Generation;
+	struct Job_Struct *Next;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The first job in the queue, the next one the worker thread will reduce.
+ */
+static struct Job_Struct *Job_Queue_Head = NULL;
+/**
+ * The last job in the queue, which newly submitted jobs are appended after.
+ */
+static struct Job_Struct *Job_Queue_Tail = NULL;
+/**
+ * The handle that will be given to the next job submitted. Handles start at 1.
+ */
+static int Job_Next_Id = 1;
+/**
+ * The handle of the job the worker thread is reducing, or 0 if it is idle.
+ */
+static int Job_Running_Id = 0;
+/**
+ * The handle of the last job whose callback has returned, or 0.
+ */
+static int Job_Completed_Id = 0;
+/**
+ * Whether the worker thread has been started.
+ */
+static int Job_Worker_Started = FALSE;
+/**
+ * Set by DpRt_Job_Shutdown to tell the worker thread to cancel the queued jobs and exit.
+ */
+static int Job_Shutdown_Flag = FALSE;
+/**
+ * The worker thread.
+ */
+static pthread_t Job_Worker_Thread;
+/**
+ * Mutex protecting all the job queue's variables.
+ */
+static pthread_mutex_t Job_Mutex = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * Condition signalled when a job is queued, or shutdown is requested.
+ */
+static pthread_cond_t Job_Condition = PTHREAD_COND_INITIALIZER;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static void *Job_Worker(void *user_arg);
+static void Job_Cancel(struct Job_Struct *job,int error_number,char *reason);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Submit an expose frame for asynchronous reduction. The frame is queued and the routine returns at once. The
+ * worker thread is started if it is not already running. When the job has been reduced (or cancelled by
+ * DpRt_Job_Shutdown), callback is called from the worker thread with the job's handle, its result, and
+ * user_arg. The result's Output_Filename is freed when the callback returns, so the callback should copy it.
+ * The worker thread reduces jobs in its own context, so other reductions may run while a job is running.
+ * @param input_filename The FITS filename to be processed. A copy is taken.
+ * @param callback The routine to call with the result of the job.
+ * @param user_arg A pointer passed unchanged to the callback.
+ * @param job_id The address of an integer, set to the handle of the queued job.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Job_Struct
+ * @see #Job_Worker
+ * @see #Job_Mutex
+ * @see #Job_Condition
+ * @see dprt_abort.html#DpRt_Abort_Generation_Get
+ */
+int DpRt_Job_Expose_Submit(char *input_filename,
+			   void (*callback)(int job_id,struct DpRt_Expose_Result_Struct *result,void *user_arg),
+			   void *user_arg,int *job_id)
+{
+	struct Job_Struct *job = NULL;
+
+	if(input_filename == NULL)
+	{
+		DpRt_Error_Number = 1100;
+		strcpy(DpRt_Error_String,"DpRt_Job_Expose_Submit:input filename was NULL.");
+		return FALSE;
+	}
+	if(callback == NULL)
+	{
+		DpRt_Error_Number = 1101;
+		strcpy(DpRt_Error_String,"DpRt_Job_Expose_Submit:callback was NULL.");
+		return FALSE;
+	}
+	if(job_id == NULL)
+	{
+		DpRt_Error_Number = 1102;
+		strcpy(DpRt_Error_String,"DpRt_Job_Expose_Submit:job id was NULL.");
+		return FALSE;
+	}
+	job = (struct Job_Struct *)malloc(sizeof(struct Job_Struct));
+	if(job == NULL)
+	{
+		DpRt_Error_Number = 1103;
+		strcpy(DpRt_Error_String,"DpRt_Job_Expose_Submit:Failed to allocate job.");
+		return FALSE;
+	}
+	job->Input_Filename = (char *)malloc((strlen(input_filename)+1)*sizeof(char));
+	if(job->Input_Filename == NULL)
+	{
+		free(job);
+		DpRt_Error_Number = 1104;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Job_Expose_Submit:Failed to allocate filename(%.128s).",
+			input_filename);
+		return FALSE;
+	}
+	strcpy(job->Input_Filename,input_filename);
+	job->Callback = callback;
+	job->User_Arg = user_arg;
+	job->Abort_Generation = DpRt_Abort_Generation_Get();
+	job->Next = NULL;
+	pthread_mutex_lock(&Job_Mutex);
+	if(Job_Shutdown_Flag)
+	{
+		pthread_mutex_unlock(&Job_Mutex);
+		free(job->Input_Filename);
+		free(job);
+		DpRt_Error_Number = 1105;
+		strcpy(DpRt_Error_String,"DpRt_Job_Expose_Submit:Job queue is shutting down.");
+		return FALSE;
+	}
+	if(!Job_Worker_Started)
+	{
+		if(pthread_create(&Job_Worker_Thread,NULL,Job_Worker,NULL) != 0)
+		{
+			pthread_mutex_unlock(&Job_Mutex);
+			free(job->Input_Filename);
+			free(job);
+			DpRt_Error_Number = 1106;
+			strcpy(DpRt_Error_String,"DpRt_Job_Expose_Submit:Failed to create worker thread.");
+			return FALSE;
+		}
+		Job_Worker_Started = TRUE;
+	}
+	job->Id = Job_Next_Id++;
+	if(Job_Queue_Tail != NULL)
+		Job_Queue_Tail->Next = job;
+	else
+		Job_Queue_Head = job;
+	Job_Queue_Tail = job;
+	(*job_id) = job->Id;
+	pthread_cond_signal(&Job_Condition);
+	pthread_mutex_unlock(&Job_Mutex);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Job_Expose_Submit:Queued job %d:%s.",(*job_id),input_filename);
+	return TRUE;
+}
+
+/**
+ * Get the state of a submitted job.
+ * @param job_id The handle of the job, as returned by DpRt_Job_Expose_Submit.
+ * @param state The address of an enum, set to the state of the job.
+ * @return The routine returns TRUE on success and FALSE if job_id is not the handle of a submitted job.
+ * @see #DPRT_JOB_STATE
+ * @see #Job_Running_Id
+ * @see #Job_Completed_Id
+ */
+int DpRt_Job_State_Get(int job_id,enum DPRT_JOB_STATE *state)
+{
+	int retval;
+
+	retval = TRUE;
+	pthread_mutex_lock(&Job_Mutex);
+	if((job_id < 1)||(job_id >= Job_Next_Id))
+		retval = FALSE;
+	else if(job_id <= Job_Completed_Id)
+		(*state) = DPRT_JOB_STATE_DONE;
+	else if(job_id == Job_Running_Id)
+		(*state) = DPRT_JOB_STATE_RUNNING;
+	else
+		(*state) = DPRT_JOB_STATE_QUEUED;
+	pthread_mutex_unlock(&Job_Mutex);
+	if(!retval)
+	{
+		DpRt_Error_Number = 1107;
+		sprintf(DpRt_Error_String,"DpRt_Job_State_Get:Unknown job %d.",job_id);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Shut down the job queue. The job being reduced (if any) is allowed to finish, the jobs still queued are
+ * cancelled (their callbacks are called with a failed result), and the worker thread is joined. Jobs can be
+ * submitted again afterwards.
+ * @return The routine returns TRUE.
+ * @see #Job_Shutdown_Flag
+ * @see #Job_Worker
+ */
+int DpRt_Job_Shutdown(void)
+{
+	int started;
+
+	pthread_mutex_lock(&Job_Mutex);
+	started = Job_Worker_Started;
+	Job_Shutdown_Flag = TRUE;
+	pthread_cond_signal(&Job_Condition);
+	pthread_mutex_unlock(&Job_Mutex);
+	if(started)
+		pthread_join(Job_Worker_Thread,NULL);
+	pthread_mutex_lock(&Job_Mutex);
+	Job_Worker_Started = FALSE;
+	Job_Shutdown_Flag = FALSE;
+	pthread_mutex_unlock(&Job_Mutex);
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * The worker thread. Repeatedly takes the job at the head of the queue, reduces its frame with
+ * DpRt_Expose_Reduce_Context, and calls the job's callback with the result. The thread creates its own
+ * reduction context, so its errors and scratch buffers are not shared with other callers, and refreshes the
+ * context's configuration snapshot before each job. If the context cannot be created, the default context is
+ * used. Each job is reduced in the abort generation it was submitted in (through the context's
+ * Abort_Generation), so an abort requested while it was queued or running stops it. A job whose abort
+ * generation has already moved on when it reaches the head of the queue is cancelled without being started.
+ * When DpRt_Job_Shutdown is called, the remaining queued jobs are cancelled and the thread exits.
+ * @param user_arg Not used.
+ * @return NULL.
+ * @see #Job_Cancel
+ * @see dprt_abort.html#DpRt_Abort_Generation_Get
+ * @see dprt.html#DpRt_Expose_Reduce_Context
+ * @see dprt_context.html#DpRt_Context_Create
+ * @see dprt_context.html#DpRt_Context_Config_Refresh
+ * @see dprt_context.html#DpRt_Context_Destroy
+ */
+static void *Job_Worker(void *user_arg)
+{
+	struct DpRt_Expose_Result_Struct result;
+	struct DpRt_Context_Struct *context = NULL;
+	struct Job_Struct *job = NULL;
+	int shutdown;
+
+	if(!DpRt_Context_Create(&context))
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"Job_Worker:Failed to create context:%s:Using default context.",
+			DpRt_Error_String);
+		context = DpRt_Context_Default_Get();
+	}
+
+	while(TRUE)
+	{
+		pthread_mutex_lock(&Job_Mutex);
+		while((Job_Queue_Head == NULL)&&(!Job_Shutdown_Flag))
+			pthread_cond_wait(&Job_Condition,&Job_Mutex);
+		job = Job_Queue_Head;
+		if(job != NULL)
+		{
+			Job_Queue_Head = job->Next;
+			if(Job_Queue_Head == NULL)
+				Job_Queue_Tail = NULL;
+			Job_Running_Id = job->Id;
+		}
+		shutdown = Job_Shutdown_Flag;
+		pthread_mutex_unlock(&Job_Mutex);
+		if(job == NULL)
+			break;
+		if(shutdown)
+			Job_Cancel(job,1108,"shutdown");
+		else if(job->Abort_Generation != DpRt_Abort_Generation_Get())
+			Job_Cancel(job,DPRT_ABORT_ERROR_NUMBER,"abort");
+		else
+		{
+			result.Output_Filename = NULL;
+			DpRt_Context_Config_Refresh(context);
+			context->Abort_Generation = job->Abort_Generation;
+			result.Successful = DpRt_Expose_Reduce_Context(context,job->Input_Filename,
+								      &(result.Output_Filename),&(result.Seeing),
+								      &(result.Counts),&(result.X_Pix),&(result.Y_Pix),
+								      &(result.Photometricity),&(result.Sky_Brightness),
+								      &(result.Saturated));
+			context->Abort_Generation = 0;
+			result.Error_Number = context->Error.Number;
+			strcpy(result.Error_String,context->Error.String);
+			if(!result.Successful)
+			{
+				result.Seeing = 0.0;
+				result.Counts = 0.0;
+				result.X_Pix = 0.0;
+				result.Y_Pix = 0.0;
+				result.Photometricity = 0.0;
+				result.Sky_Brightness = 0.0;
+				result.Saturated = FALSE;
+			}
+			DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"Job_Worker:Job %d:%s:Successful %d.",job->Id,job->Input_Filename,
+				result.Successful);
+			(*(job->Callback))(job->Id,&result,job->User_Arg);
+			if(result.Output_Filename != NULL)
+				free(result.Output_Filename);
+		}
+		pthread_mutex_lock(&Job_Mutex);
+		Job_Completed_Id = job->Id;
+		Job_Running_Id = 0;
+		pthread_mutex_unlock(&Job_Mutex);
+		free(job->Input_Filename);
+		free(job);
+	}
+	if(context != DpRt_Context_Default_Get())
+		DpRt_Context_Destroy(context);
+	return NULL;
+}
+
+/**
+ * Cancel a queued job, because the job queue is shutting down or an abort was requested after the job was
+ * submitted, calling its callback with a failed result.
+ * @param job The job to cancel.
+ * @param error_number The error number of the failed result: 1108 for a shutdown, DPRT_ABORT_ERROR_NUMBER for
+ *        an abort.
+ * @param reason What cancelled the job, used in the error string.
+ * @see dprt_abort.h#DPRT_ABORT_ERROR_NUMBER
+ */
+static void Job_Cancel(struct Job_Struct *job,int error_number,char *reason)
+{
+	struct DpRt_Expose_Result_Struct result;
+
+	result.Successful = FALSE;
+	result.Error_Number = error_number;
+	sprintf(result.Error_String,"Job_Cancel:Job %d cancelled by %s.",job->Id,reason);
+	result.Output_Filename = NULL;
+	result.Seeing = 0.0;
+	result.Counts = 0.0;
+	result.X_Pix = 0.0;
+	result.Y_Pix = 0.0;
+	result.Photometricity = 0.0;
+	result.Sky_Brightness = 0.0;
+	result.Saturated = FALSE;
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"Job_Cancel:Job %d:%s cancelled by %s.",job->Id,job->Input_Filename,
+		reason);
+	(*(job->Callback))(job->Id,&result,job->User_Arg);
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
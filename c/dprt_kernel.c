@@ -0,0 +1,743 @@
+/* dprt_kernel.c
+** Pixel processing kernels for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_kernel.c contains the inner loops that process blocks of pixels. Where the compiler supports SSE2
+ * (__SSE2__ is defined) the loops are vectorised with SSE2 intrinsics, otherwise a plain C version is used.
+ * Both versions give identical pixel values; floating point sums may differ in rounding, as the SSE2 version
+ * accumulates them in a different order.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <float.h>
+#include "dprt.h"
+#include "dprt_kernel.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The number of SSE2 iterations the statistics kernel accumulates in 32 bit lanes, before adding the lanes
+ * into the double precision sum. Each iteration adds at most 2*65535 to a lane, so this must be
+ * less than 32768 to avoid overflow.
+ */
+#define KERNEL_STATS_LANE_ITERATIONS	(16384)
+/**
+ * The number of SSE2 iterations the calibration kernel accumulates its sums in single precision lanes, before
+ * adding the lanes into the double precision sums. This keeps the rounding error of the single precision
+ * sums small.
+ */
+#define KERNEL_CALIBRATE_LANE_ITERATIONS	(256)
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static float Kernel_Laplacian_Pixel(float *above,float *row,float *below,long count,long i);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Reset a statistics structure, ready to accumulate a new image.
+ * @param stats The address of the statistics structure.
+ */
+void DpRt_Kernel_Stats_Initialise(struct DpRt_Kernel_Stats_Struct *stats)
+{
+	stats->Sum = 0.0;
+	stats->Peak = 0;
+	stats->Count = 0;
+}
+
+/**
+ * Add a block of pixels into a running statistics structure. The sum, peak and pixel count are all updated
+ * in a single pass over the data.
+ * @param stats The address of the statistics structure.
+ * @param data The block of pixels.
+ * @param count The number of pixels in the block.
+ * @param pixel_format The format of the pixels, a DPRT_KERNEL_PIXEL_FORMAT value. FITS format pixels are byte
+ *        swapped and have BZERO applied as they are loaded.
+ * @see #KERNEL_STATS_LANE_ITERATIONS
+ * @see #DPRT_KERNEL_FITS_PIXEL
+ */
+void DpRt_Kernel_Stats_Accumulate(struct DpRt_Kernel_Stats_Struct *stats,unsigned short *data,long count,
+				  int pixel_format)
+{
+	unsigned long lane_sum;
+	unsigned short peak,value;
+	long i;
+#ifdef __SSE2__
+	__m128i sign,zero,sum_lo,sum_hi,max_v,pixels;
+	unsigned int lanes[4];
+	unsigned short max_lanes[8];
+	long vector_count,iteration;
+	int j;
+#endif
+
+	peak = stats->Peak;
+	i = 0;
+#ifdef __SSE2__
+	/* SSE2 has no unsigned 16 bit max, so flip the sign bit and use the signed max */
+	sign = _mm_set1_epi16((short)0x8000);
+	zero = _mm_setzero_si128();
+	max_v = _mm_set1_epi16((short)(peak^0x8000));
+	vector_count = count/8;
+	while(i < vector_count*8)
+	{
+		sum_lo = _mm_setzero_si128();
+		sum_hi = _mm_setzero_si128();
+		for(iteration = 0;(iteration < KERNEL_STATS_LANE_ITERATIONS)&&(i < vector_count*8);iteration++,i += 8)
+		{
+			pixels = _mm_loadu_si128((__m128i *)(data+i));
+			if(pixel_format == DPRT_KERNEL_PIXEL_FORMAT_FITS)
+			{
+				pixels = _mm_xor_si128(_mm_or_si128(_mm_slli_epi16(pixels,8),_mm_srli_epi16(pixels,8)),
+						       sign);
+			}
+			sum_lo = _mm_add_epi32(sum_lo,_mm_unpacklo_epi16(pixels,zero));
+			sum_hi = _mm_add_epi32(sum_hi,_mm_unpackhi_epi16(pixels,zero));
+			max_v = _mm_max_epi16(max_v,_mm_xor_si128(pixels,sign));
+		}
+		/* each lane of sum_lo+sum_hi is at most 2*65535*KERNEL_STATS_LANE_ITERATIONS */
+		_mm_storeu_si128((__m128i *)lanes,_mm_add_epi32(sum_lo,sum_hi));
+		stats->Sum += (double)lanes[0]+(double)lanes[1]+(double)lanes[2]+(double)lanes[3];
+	}
+	_mm_storeu_si128((__m128i *)max_lanes,_mm_xor_si128(max_v,sign));
+	for(j = 0; j < 8; j++)
+	{
+		if(max_lanes[j] > peak)
+			peak = max_lanes[j];
+	}
+#endif
+	/* remaining pixels, flushing lane_sum often enough that it cannot overflow 32 bits */
+	lane_sum = 0;
+	for(;i < count; i++)
+	{
+		if(pixel_format == DPRT_KERNEL_PIXEL_FORMAT_FITS)
+			value = DPRT_KERNEL_FITS_PIXEL(data+i);
+		else
+			value = data[i];
+		lane_sum += value;
+		if(value > peak)
+			peak = value;
+		if((i % KERNEL_STATS_LANE_ITERATIONS) == 0)
+		{
+			stats->Sum += (double)lane_sum;
+			lane_sum = 0;
+		}
+	}
+	stats->Sum += (double)lane_sum;
+	stats->Peak = peak;
+	stats->Count += count;
+}
+
+/**
+ * Return the mean pixel value of the pixels accumulated so far.
+ * @param stats The address of the statistics structure.
+ * @return The mean pixel value, or 0.0 if no pixels have been accumulated.
+ */
+double DpRt_Kernel_Stats_Mean(struct DpRt_Kernel_Stats_Struct *stats)
+{
+	if(stats->Count < 1)
+		return 0.0;
+	return stats->Sum/((double)(stats->Count));
+}
+
+/**
+ * Reset a calibration statistics structure, ready to accumulate a new frame.
+ * @param stats The address of the calibration statistics structure.
+ */
+void DpRt_Kernel_Calibrate_Stats_Initialise(struct DpRt_Kernel_Calibrate_Stats_Struct *stats)
+{
+	stats->Sum = 0.0;
+	stats->Sum_Squares = 0.0;
+	stats->Minimum = FLT_MAX;
+	stats->Maximum = -FLT_MAX;
+	stats->Count = 0;
+	stats->Saturated_Count = 0;
+}
+
+/**
+ * Calibrate a block of raw pixels in a single pass. Each raw pixel is read once: it is flagged in the
+ * saturation mask if it is at or above the saturation level, the overscan bias level and master bias are
+ * subtracted, it is divided by the master flat (where the flat is positive, unilluminated or bad flat pixels are
+ * left unflattened), the running statistics are updated, and the calibrated value is written to the output.
+ * This replaces separate conversion, bias, flat and statistics passes over the frame.
+ * @param data The block of raw pixels.
+ * @param pixel_format The format of the raw pixels, a DPRT_KERNEL_PIXEL_FORMAT value. FITS format pixels are byte
+ *        swapped and have BZERO applied as they are loaded, so a memory mapped data unit can be calibrated
+ *        without first being copied.
+ * @param bias The master bias pixels corresponding to the block, or NULL if there is no master bias.
+ * @param flat The master flat pixels corresponding to the block, or NULL if there is no master flat.
+ * @param overscan The overscan bias level of each pixel in the block, or NULL if there is no overscan correction.
+ * @param count The number of pixels in the block.
+ * @param saturation_level The number of counts at or above which a raw pixel is saturated.
+ * @param saturation_mask A bit-packed mask of the whole frame, in which saturated pixels are set.
+ * @param first_pixel The index in the frame (and saturation mask) of the first pixel in the block.
+ * @param output The block's calibrated pixels are written here, count floats.
+ * @param stats The address of the calibration statistics structure to update.
+ * @see #KERNEL_CALIBRATE_LANE_ITERATIONS
+ * @see #DPRT_KERNEL_FITS_PIXEL
+ * @see #DPRT_KERNEL_MASK_SET
+ */
+void DpRt_Kernel_Calibrate_Block(unsigned short *data,int pixel_format,float *bias,float *flat,float *overscan,
+				 long count,float saturation_level,unsigned char *saturation_mask,long first_pixel,
+				 float *output,struct DpRt_Kernel_Calibrate_Stats_Struct *stats)
+{
+	float value,minimum,maximum;
+	long i;
+#ifdef __SSE2__
+	__m128i zero,sign,pixels;
+	__m128 level,flat_zero,value_lo,value_hi,flat_v,select,sum_v,sum_squares_v,min_v,max_v;
+	float lanes[4];
+	long vector_count,iteration;
+	int bits,j;
+#endif
+
+	minimum = stats->Minimum;
+	maximum = stats->Maximum;
+	i = 0;
+#ifdef __SSE2__
+	zero = _mm_setzero_si128();
+	sign = _mm_set1_epi16((short)0x8000);
+	level = _mm_set1_ps(saturation_level);
+	flat_zero = _mm_setzero_ps();
+	min_v = _mm_set1_ps(minimum);
+	max_v = _mm_set1_ps(maximum);
+	vector_count = count/8;
+	while(i < vector_count*8)
+	{
+		sum_v = _mm_setzero_ps();
+		sum_squares_v = _mm_setzero_ps();
+		for(iteration = 0;(iteration < KERNEL_CALIBRATE_LANE_ITERATIONS)&&(i < vector_count*8);
+		    iteration++,i += 8)
+		{
+			pixels = _mm_loadu_si128((__m128i *)(data+i));
+			if(pixel_format == DPRT_KERNEL_PIXEL_FORMAT_FITS)
+			{
+				pixels = _mm_xor_si128(_mm_or_si128(_mm_slli_epi16(pixels,8),_mm_srli_epi16(pixels,8)),
+						       sign);
+			}
+			value_lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(pixels,zero));
+			value_hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(pixels,zero));
+			bits = _mm_movemask_ps(_mm_cmpge_ps(value_lo,level))|
+				(_mm_movemask_ps(_mm_cmpge_ps(value_hi,level))<<4);
+			/* saturation is rare, so only go bit by bit when there is some */
+			if(bits != 0)
+			{
+				for(j = 0; j < 8; j++)
+				{
+					if((bits>>j)&1)
+					{
+						DPRT_KERNEL_MASK_SET(saturation_mask,first_pixel+i+j);
+						stats->Saturated_Count++;
+					}
+				}
+			}
+			if(overscan != NULL)
+			{
+				value_lo = _mm_sub_ps(value_lo,_mm_loadu_ps(overscan+i));
+				value_hi = _mm_sub_ps(value_hi,_mm_loadu_ps(overscan+i+4));
+			}
+			if(bias != NULL)
+			{
+				value_lo = _mm_sub_ps(value_lo,_mm_loadu_ps(bias+i));
+				value_hi = _mm_sub_ps(value_hi,_mm_loadu_ps(bias+i+4));
+			}
+			if(flat != NULL)
+			{
+				flat_v = _mm_loadu_ps(flat+i);
+				select = _mm_cmpgt_ps(flat_v,flat_zero);
+				value_lo = _mm_or_ps(_mm_and_ps(select,_mm_div_ps(value_lo,flat_v)),
+						     _mm_andnot_ps(select,value_lo));
+				flat_v = _mm_loadu_ps(flat+i+4);
+				select = _mm_cmpgt_ps(flat_v,flat_zero);
+				value_hi = _mm_or_ps(_mm_and_ps(select,_mm_div_ps(value_hi,flat_v)),
+						     _mm_andnot_ps(select,value_hi));
+			}
+			_mm_storeu_ps(output+i,value_lo);
+			_mm_storeu_ps(output+i+4,value_hi);
+			sum_v = _mm_add_ps(sum_v,_mm_add_ps(value_lo,value_hi));
+			sum_squares_v = _mm_add_ps(sum_squares_v,_mm_add_ps(_mm_mul_ps(value_lo,value_lo),
+									     _mm_mul_ps(value_hi,value_hi)));
+			min_v = _mm_min_ps(min_v,_mm_min_ps(value_lo,value_hi));
+			max_v = _mm_max_ps(max_v,_mm_max_ps(value_lo,value_hi));
+		}
+		_mm_storeu_ps(lanes,sum_v);
+		stats->Sum += (double)lanes[0]+(double)lanes[1]+(double)lanes[2]+(double)lanes[3];
+		_mm_storeu_ps(lanes,sum_squares_v);
+		stats->Sum_Squares += (double)lanes[0]+(double)lanes[1]+(double)lanes[2]+(double)lanes[3];
+	}
+	_mm_storeu_ps(lanes,min_v);
+	for(j = 0; j < 4; j++)
+	{
+		if(lanes[j] < minimum)
+			minimum = lanes[j];
+	}
+	_mm_storeu_ps(lanes,max_v);
+	for(j = 0; j < 4; j++)
+	{
+		if(lanes[j] > maximum)
+			maximum = lanes[j];
+	}
+#endif
+	/* remaining pixels */
+	for(;i < count; i++)
+	{
+		if(pixel_format == DPRT_KERNEL_PIXEL_FORMAT_FITS)
+			value = (float)DPRT_KERNEL_FITS_PIXEL(data+i);
+		else
+			value = (float)(data[i]);
+		if(value >= saturation_level)
+		{
+			DPRT_KERNEL_MASK_SET(saturation_mask,first_pixel+i);
+			stats->Saturated_Count++;
+		}
+		if(overscan != NULL)
+			value -= overscan[i];
+		if(bias != NULL)
+			value -= bias[i];
+		if((flat != NULL)&&(flat[i] > 0.0f))
+			value /= flat[i];
+		output[i] = value;
+		stats->Sum += value;
+		stats->Sum_Squares += ((double)value)*value;
+		if(value < minimum)
+			minimum = value;
+		if(value > maximum)
+			maximum = value;
+	}
+	stats->Minimum = minimum;
+	stats->Maximum = maximum;
+	stats->Count += count;
+}
+
+/**
+ * Return the mean of the calibrated pixels accumulated so far.
+ * @param stats The address of the calibration statistics structure.
+ * @return The mean calibrated pixel value, or 0.0 if no pixels have been accumulated.
+ */
+double DpRt_Kernel_Calibrate_Stats_Mean(struct DpRt_Kernel_Calibrate_Stats_Struct *stats)
+{
+	if(stats->Count < 1)
+		return 0.0;
+	return stats->Sum/((double)(stats->Count));
+}
+
+/**
+ * Return the standard deviation of the calibrated pixels accumulated so far.
+ * @param stats The address of the calibration statistics structure.
+ * @return The standard deviation of the calibrated pixel values, or 0.0 if fewer than two pixels have been
+ *         accumulated.
+ */
+double DpRt_Kernel_Calibrate_Stats_Sigma(struct DpRt_Kernel_Calibrate_Stats_Struct *stats)
+{
+	double mean,variance;
+
+	if(stats->Count < 2)
+		return 0.0;
+	mean = stats->Sum/((double)(stats->Count));
+	variance = (stats->Sum_Squares-(stats->Count*mean*mean))/((double)(stats->Count-1));
+	if(variance < 0.0)
+		return 0.0;
+	return sqrt(variance);
+}
+
+/**
+ * Compute one row of the positive Laplacian of a frame subsampled by two, block averaged back to the frame's
+ * pixels, as used by L.A.Cosmic (van Dokkum 2001, PASP 113, 1420). Subsampling a pixel of value v into 2x2
+ * and convolving with the Laplacian kernel gives each subpixel 2v less the value of the two pixels it borders,
+ * so the block average of the clipped Laplacian is:
+ * <pre>
+ * L+ = (max(0,2v-up-left)+max(0,2v-up-right)+max(0,2v-down-left)+max(0,2v-down-right))/4
+ * </pre>
+ * which is computed directly, without building the subsampled frame. The row's edge pixels use themselves as
+ * their missing neighbour.
+ * @param above The row above, count pixels. Pass row itself for the first row of a frame.
+ * @param row The row, count pixels.
+ * @param below The row below, count pixels. Pass row itself for the last row of a frame.
+ * @param count The number of pixels in each row.
+ * @param output The row's positive Laplacian is written here, count floats.
+ */
+void DpRt_Kernel_Laplacian_Row(float *above,float *row,float *below,long count,float *output)
+{
+	long i;
+#ifdef __SSE2__
+	__m128 zero,quarter,twice,up,down,left,right,sum;
+#endif
+
+	if(count < 1)
+		return;
+	output[0] = Kernel_Laplacian_Pixel(above,row,below,count,0);
+	i = 1;
+#ifdef __SSE2__
+	/* interior pixels, four at a time */
+	zero = _mm_setzero_ps();
+	quarter = _mm_set1_ps(0.25f);
+	for(; i+4 < count; i += 4)
+	{
+		twice = _mm_loadu_ps(row+i);
+		twice = _mm_add_ps(twice,twice);
+		up = _mm_sub_ps(twice,_mm_loadu_ps(above+i));
+		down = _mm_sub_ps(twice,_mm_loadu_ps(below+i));
+		left = _mm_loadu_ps(row+i-1);
+		right = _mm_loadu_ps(row+i+1);
+		sum = _mm_max_ps(_mm_sub_ps(up,left),zero);
+		sum = _mm_add_ps(sum,_mm_max_ps(_mm_sub_ps(up,right),zero));
+		sum = _mm_add_ps(sum,_mm_max_ps(_mm_sub_ps(down,left),zero));
+		sum = _mm_add_ps(sum,_mm_max_ps(_mm_sub_ps(down,right),zero));
+		_mm_storeu_ps(output+i,_mm_mul_ps(sum,quarter));
+	}
+#endif
+	/* remaining pixels */
+	for(; i < count; i++)
+		output[i] = Kernel_Laplacian_Pixel(above,row,below,count,i);
+}
+
+/**
+ * Find the sigma clipped mean of a vector of pixels, e.g. the overscan pixels of one row. The mean and standard
+ * deviation of all the pixels are found, then the mean of the pixels within clip_sigma standard deviations of it.
+ * The sums are accumulated about the first pixel, and then about the unclipped mean, so they stay small enough
+ * for single precision lanes.
+ * @param data The pixels.
+ * @param count The number of pixels.
+ * @param clip_sigma The number of standard deviations beyond which a pixel is left out.
+ * @return The clipped mean, or 0.0 if count is less than one.
+ */
+double DpRt_Kernel_Clipped_Mean(float *data,long count,double clip_sigma)
+{
+	double sum,sum_squares,clipped_sum,mean,variance,limit;
+	float pivot,difference;
+	long clipped_count,i;
+#ifdef __SSE2__
+	__m128 pivot_v,mean_v,limit_v,sign_v,one_v,value_v,select,sum_v,sum_squares_v,count_v;
+	float lanes[4];
+	int j;
+#endif
+
+	if(count < 1)
+		return 0.0;
+	pivot = data[0];
+	sum = 0.0;
+	sum_squares = 0.0;
+	i = 0;
+#ifdef __SSE2__
+	pivot_v = _mm_set1_ps(pivot);
+	sum_v = _mm_setzero_ps();
+	sum_squares_v = _mm_setzero_ps();
+	for(; i+4 <= count; i += 4)
+	{
+		value_v = _mm_sub_ps(_mm_loadu_ps(data+i),pivot_v);
+		sum_v = _mm_add_ps(sum_v,value_v);
+		sum_squares_v = _mm_add_ps(sum_squares_v,_mm_mul_ps(value_v,value_v));
+	}
+	_mm_storeu_ps(lanes,sum_v);
+	sum = (double)lanes[0]+(double)lanes[1]+(double)lanes[2]+(double)lanes[3];
+	_mm_storeu_ps(lanes,sum_squares_v);
+	sum_squares = (double)lanes[0]+(double)lanes[1]+(double)lanes[2]+(double)lanes[3];
+#endif
+	for(; i < count; i++)
+	{
+		difference = data[i]-pivot;
+		sum += difference;
+		sum_squares += ((double)difference)*difference;
+	}
+	mean = sum/count;
+	if(count < 2)
+		return pivot+mean;
+	variance = (sum_squares-(count*mean*mean))/(count-1);
+	limit = (variance > 0.0) ? clip_sigma*sqrt(variance) : 0.0;
+	mean += pivot;
+	/* second pass, about the unclipped mean */
+	clipped_sum = 0.0;
+	clipped_count = 0;
+	i = 0;
+#ifdef __SSE2__
+	mean_v = _mm_set1_ps((float)mean);
+	limit_v = _mm_set1_ps((float)limit);
+	sign_v = _mm_set1_ps(-0.0f);
+	one_v = _mm_set1_ps(1.0f);
+	sum_v = _mm_setzero_ps();
+	count_v = _mm_setzero_ps();
+	for(; i+4 <= count; i += 4)
+	{
+		value_v = _mm_sub_ps(_mm_loadu_ps(data+i),mean_v);
+		select = _mm_cmple_ps(_mm_andnot_ps(sign_v,value_v),limit_v);
+		sum_v = _mm_add_ps(sum_v,_mm_and_ps(select,value_v));
+		count_v = _mm_add_ps(count_v,_mm_and_ps(select,one_v));
+	}
+	_mm_storeu_ps(lanes,sum_v);
+	for(j = 0; j < 4; j++)
+		clipped_sum += lanes[j];
+	_mm_storeu_ps(lanes,count_v);
+	for(j = 0; j < 4; j++)
+		clipped_count += (long)lanes[j];
+#endif
+	for(; i < count; i++)
+	{
+		difference = data[i]-(float)mean;
+		if(fabs(difference) <= (float)limit)
+		{
+			clipped_sum += difference;
+			clipped_count++;
+		}
+	}
+	if(clipped_count < 1)
+		return mean;
+	return ((double)(float)mean)+(clipped_sum/clipped_count);
+}
+
+/**
+ * Find the sigma clipped mean of each column of a rectangle of pixels, e.g. a parallel overscan region. This is
+ * DpRt_Kernel_Clipped_Mean applied down each column, but the rows are accumulated a row at a time, so the
+ * columns are processed four at a time and the memory is read in order.
+ * @param data The first pixel of the rectangle.
+ * @param stride The number of pixels between the start of one row of the rectangle and the next.
+ * @param column_count The number of columns in the rectangle.
+ * @param row_count The number of rows in the rectangle.
+ * @param clip_sigma The number of standard deviations beyond which a pixel is left out.
+ * @param work Work space of 4*column_count floats.
+ * @param mean The clipped mean of each column is written here, column_count floats.
+ * @see #DpRt_Kernel_Clipped_Mean
+ */
+void DpRt_Kernel_Clipped_Mean_Columns(float *data,long stride,int column_count,int row_count,double clip_sigma,
+				      float *work,float *mean)
+{
+	float *sum = NULL;
+	float *sum_squares = NULL;
+	float *clipped_sum = NULL;
+	float *clipped_count = NULL;
+	float *row = NULL;
+	double column_mean,variance;
+	float difference;
+	int x,y;
+#ifdef __SSE2__
+	__m128 mean_v,limit_v,sign_v,one_v,value_v,select;
+#endif
+
+	if((column_count < 1)||(row_count < 1))
+		return;
+	sum = work;
+	sum_squares = work+column_count;
+	clipped_sum = work+(2*column_count);
+	clipped_count = work+(3*column_count);
+	memset(work,0,4*column_count*sizeof(float));
+	/* the first row is the pivot the sums are accumulated about */
+	for(y = 1; y < row_count; y++)
+	{
+		row = data+(y*stride);
+		x = 0;
+#ifdef __SSE2__
+		for(; x+4 <= column_count; x += 4)
+		{
+			value_v = _mm_sub_ps(_mm_loadu_ps(row+x),_mm_loadu_ps(data+x));
+			_mm_storeu_ps(sum+x,_mm_add_ps(_mm_loadu_ps(sum+x),value_v));
+			_mm_storeu_ps(sum_squares+x,_mm_add_ps(_mm_loadu_ps(sum_squares+x),_mm_mul_ps(value_v,value_v)));
+		}
+#endif
+		for(; x < column_count; x++)
+		{
+			difference = row[x]-data[x];
+			sum[x] += difference;
+			sum_squares[x] += difference*difference;
+		}
+	}
+	/* the column means and clip limits replace the sums */
+	for(x = 0; x < column_count; x++)
+	{
+		column_mean = ((double)sum[x])/row_count;
+		if(row_count > 1)
+			variance = (sum_squares[x]-(row_count*column_mean*column_mean))/(row_count-1);
+		else
+			variance = 0.0;
+		sum[x] = (float)(data[x]+column_mean);
+		sum_squares[x] = (variance > 0.0) ? (float)(clip_sigma*sqrt(variance)) : 0.0f;
+	}
+#ifdef __SSE2__
+	sign_v = _mm_set1_ps(-0.0f);
+	one_v = _mm_set1_ps(1.0f);
+#endif
+	for(y = 0; y < row_count; y++)
+	{
+		row = data+(y*stride);
+		x = 0;
+#ifdef __SSE2__
+		for(; x+4 <= column_count; x += 4)
+		{
+			mean_v = _mm_loadu_ps(sum+x);
+			limit_v = _mm_loadu_ps(sum_squares+x);
+			value_v = _mm_sub_ps(_mm_loadu_ps(row+x),mean_v);
+			select = _mm_cmple_ps(_mm_andnot_ps(sign_v,value_v),limit_v);
+			_mm_storeu_ps(clipped_sum+x,_mm_add_ps(_mm_loadu_ps(clipped_sum+x),_mm_and_ps(select,value_v)));
+			_mm_storeu_ps(clipped_count+x,_mm_add_ps(_mm_loadu_ps(clipped_count+x),_mm_and_ps(select,one_v)));
+		}
+#endif
+		for(; x < column_count; x++)
+		{
+			difference = row[x]-sum[x];
+			if(fabs(difference) <= sum_squares[x])
+			{
+				clipped_sum[x] += difference;
+				clipped_count[x] += 1.0f;
+			}
+		}
+	}
+	for(x = 0; x < column_count; x++)
+	{
+		if(clipped_count[x] > 0.0f)
+			mean[x] = sum[x]+(clipped_sum[x]/clipped_count[x]);
+		else
+			mean[x] = sum[x];
+	}
+}
+
+/**
+ * Least squares fit a polynomial in u = (x-x_centre)/x_scale, by solving the normal equations with gaussian
+ * elimination and partial pivoting.
+ * @param x_list The independent variable values.
+ * @param y_list The dependent variable values.
+ * @param count The number of values.
+ * @param order The polynomial order, at most DPRT_KERNEL_POLYNOMIAL_ORDER_MAX.
+ * @param x_centre The value x is centred on.
+ * @param x_scale The value x is scaled by.
+ * @param coefficient_list An array of at least order+1 doubles, set to the fitted coefficients.
+ * @return The routine returns TRUE if the fit succeeded, and FALSE if the normal equations were singular
+ *         (a lower order should be tried). An order 0 fit with count > 0 always succeeds.
+ */
+int DpRt_Kernel_Polynomial_Fit(double *x_list,double *y_list,int count,int order,double x_centre,double x_scale,
+			       double *coefficient_list)
+{
+	double matrix[DPRT_KERNEL_POLYNOMIAL_ORDER_MAX+1][DPRT_KERNEL_POLYNOMIAL_ORDER_MAX+2];
+	double power[(2*DPRT_KERNEL_POLYNOMIAL_ORDER_MAX)+1];
+	double u,factor,tmp;
+	int size,pivot,i,j,k;
+
+	size = order+1;
+	for(i = 0; i < size; i++)
+	{
+		for(j = 0; j <= size; j++)
+			matrix[i][j] = 0.0;
+	}
+	for(k = 0; k < count; k++)
+	{
+		u = (x_list[k]-x_centre)/x_scale;
+		power[0] = 1.0;
+		for(i = 1; i <= 2*order; i++)
+			power[i] = power[i-1]*u;
+		for(i = 0; i < size; i++)
+		{
+			for(j = 0; j < size; j++)
+				matrix[i][j] += power[i+j];
+			matrix[i][size] += power[i]*y_list[k];
+		}
+	}
+	for(i = 0; i < size; i++)
+	{
+		pivot = i;
+		for(j = i+1; j < size; j++)
+		{
+			if(fabs(matrix[j][i]) > fabs(matrix[pivot][i]))
+				pivot = j;
+		}
+		if(fabs(matrix[pivot][i]) < 1.0e-12)
+			return FALSE;
+		if(pivot != i)
+		{
+			for(j = 0; j <= size; j++)
+			{
+				tmp = matrix[i][j];
+				matrix[i][j] = matrix[pivot][j];
+				matrix[pivot][j] = tmp;
+			}
+		}
+		for(j = i+1; j < size; j++)
+		{
+			factor = matrix[j][i]/matrix[i][i];
+			for(k = i; k <= size; k++)
+				matrix[j][k] -= factor*matrix[i][k];
+		}
+	}
+	for(i = size-1; i >= 0; i--)
+	{
+		tmp = matrix[i][size];
+		for(j = i+1; j < size; j++)
+			tmp -= matrix[i][j]*coefficient_list[j];
+		coefficient_list[i] = tmp/matrix[i][i];
+	}
+	return TRUE;
+}
+
+/**
+ * Evaluate a polynomial in u = (x-x_centre)/x_scale, as fitted by DpRt_Kernel_Polynomial_Fit.
+ * @param coefficient_list The order+1 polynomial coefficients.
+ * @param order The polynomial order.
+ * @param x_centre The value x is centred on.
+ * @param x_scale The value x is scaled by.
+ * @param x The value to evaluate the polynomial at.
+ * @return The value of the polynomial at x.
+ * @see #DpRt_Kernel_Polynomial_Fit
+ */
+double DpRt_Kernel_Polynomial_Evaluate(double *coefficient_list,int order,double x_centre,double x_scale,double x)
+{
+	double u,value;
+	int i;
+
+	u = (x-x_centre)/x_scale;
+	value = 0.0;
+	for(i = order; i >= 0; i--)
+		value = (value*u)+coefficient_list[i];
+	return value;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Compute the positive Laplacian of one pixel of a row, for DpRt_Kernel_Laplacian_Row. The terms are summed in
+ * the same order as the SSE2 version, so both give identical values.
+ * @param above The row above.
+ * @param row The row.
+ * @param below The row below.
+ * @param count The number of pixels in each row.
+ * @param i The index of the pixel in the row.
+ * @return The pixel's positive Laplacian.
+ * @see #DpRt_Kernel_Laplacian_Row
+ */
+static float Kernel_Laplacian_Pixel(float *above,float *row,float *below,long count,long i)
+{
+	float twice,up,down,left,right,sum;
+
+	twice = row[i]+row[i];
+	up = twice-above[i];
+	down = twice-below[i];
+	left = (i > 0) ? row[i-1] : row[i];
+	right = (i < count-1) ? row[i+1] : row[i];
+	sum = 0.0f;
+	if(up-left > 0.0f)
+		sum += up-left;
+	if(up-right > 0.0f)
+		sum += up-right;
+	if(down-left > 0.0f)
+		sum += down-left;
+	if(down-right > 0.0f)
+		sum += down-right;
+	return sum*0.25f;
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
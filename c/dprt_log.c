@@ -0,0 +1,607 @@
+/* dprt_log.c
+** Asynchronous logging for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_log.c holds the library's log. A message is formatted into the next free entry of a ring buffer by the
+ * thread that logs it, which claims the entry with a compare and swap, so logging never takes a lock or waits
+ * for I/O. A drain thread, started when the first message is logged, takes the entries from the ring in order
+ * and delivers them to the log handler (under Java, DpRt_JNI_Log_Handler, set by the JNI layer), or if no handler
+ * is set, writes them to the log file (standard output unless a filename is configured). If the drain thread
+ * falls a whole ring behind, new messages are dropped and counted rather than making the reduction wait.
+ * Each message is tagged with the call number of the reduction that logged it, taken from the error state
+ * bound to the calling thread, so the lines of reductions running in parallel can be told apart.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt_config.h"
+#include "dprt_log.h"
+#include "dprt_context.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * How long the drain thread sleeps when the ring is empty, in milliseconds. This is the longest a message waits
+ * before it is delivered, unless the ring fills up to LOG_DRAIN_WAKE_COUNT first.
+ * @see #LOG_DRAIN_WAKE_COUNT
+ */
+#define LOG_DRAIN_PERIOD		(20)
+/**
+ * The number of undelivered messages in the ring at which a logger wakes the drain thread, rather than leaving
+ * them until its next period, so a burst of messages is not dropped.
+ * @see dprt_log.h#DPRT_LOG_RING_LENGTH
+ */
+#define LOG_DRAIN_WAKE_COUNT		(DPRT_LOG_RING_LENGTH/4)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding one entry of the ring buffer.
+ * <dl>
+ * <dt>Sequence</dt> <dd>The entry's sequence number. When it equals the position of the entry in the stream of
+ *     messages, the entry is free for that message; one more, and the message has been written into it and
+ *     can be delivered.</dd>
+ * <dt>Level</dt> <dd>The level of the message, a DPRT_LOG_LEVEL value.</dd>
+ * <dt>Tag</dt> <dd>The call number of the reduction that logged the message, or 0.</dd>
+ * <dt>Time</dt> <dd>When the message was logged.</dd>
+ * <dt>String</dt> <dd>The message.</dd>
+ * </dl>
+ * @see dprt_log.h#DPRT_LOG_LEVEL
+ * @see dprt_log.h#DPRT_LOG_STRING_LENGTH
+ */
+struct Log_Entry_Struct
+{
+	unsigned long Sequence;
+	int Level;
+	unsigned long Tag;
+	struct timespec Time;
+	char String[DPRT_LOG_STRING_LENGTH];
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The names of the log levels, indexed by DPRT_LOG_LEVEL, used when writing to the log file.
+ */
+static char *Level_Name_List[] = {"","ERROR","WARNING","INFO","DEBUG"};
+/**
+ * The ring buffer.
+ * @see dprt_log.h#DPRT_LOG_RING_LENGTH
+ */
+static struct Log_Entry_Struct Log_Ring[DPRT_LOG_RING_LENGTH];
+/**
+ * The position in the stream of messages of the next message to be logged. Loggers claim a position by
+ * incrementing this with a compare and swap.
+ */
+static unsigned long Enqueue_Position = 0;
+/**
+ * The position in the stream of messages of the next message to be delivered. Only the drain thread, or a
+ * caller holding Log_Mutex when the drain thread is not running, changes this. Loggers read it to decide
+ * whether to wake the drain thread.
+ */
+static unsigned long Dequeue_Position = 0;
+/**
+ * The number of messages dropped because the ring was full.
+ */
+static unsigned long Dropped_Count = 0;
+/**
+ * The value of Dropped_Count when the drain thread last reported the dropped messages. Protected by Log_Mutex.
+ */
+static unsigned long Dropped_Reported_Count = 0;
+/**
+ * The last call number handed out by DpRt_Log_Tag_Create.
+ */
+static unsigned long Tag_Count = 0;
+/**
+ * The highest level of message that is logged, a DPRT_LOG_LEVEL value.
+ */
+static volatile int Log_Level = DPRT_LOG_LEVEL_INFO;
+/**
+ * The log handler messages are delivered to, or NULL to write them to Log_File.
+ */
+static void (*Log_Handler)(int level,char *string) = NULL;
+/**
+ * Called by the drain thread when it starts, before it delivers any message, or NULL.
+ * @see #DpRt_Log_Thread_Hooks_Set
+ */
+static void (*Thread_Start_Hook)(void) = NULL;
+/**
+ * Called by the drain thread just before it exits, after it has delivered its last message, or NULL.
+ * @see #DpRt_Log_Thread_Hooks_Set
+ */
+static void (*Thread_Stop_Hook)(void) = NULL;
+/**
+ * The file messages are written to when no handler is set, or NULL for standard output.
+ */
+static FILE *Log_File = NULL;
+/**
+ * The filename of Log_File, or an empty string.
+ */
+static char Log_Filename[DPRT_FITS_FILENAME_LENGTH] = "";
+/**
+ * Whether the drain thread is running.
+ */
+static volatile int Drain_Running = FALSE;
+/**
+ * Set to tell the drain thread to deliver the remaining messages and exit.
+ */
+static int Drain_Stop = FALSE;
+/**
+ * Set by the logger that wakes the drain thread, so only one logger signals Drain_Condition per wake, and cleared
+ * by the drain thread each time it wakes.
+ * @see #LOG_DRAIN_WAKE_COUNT
+ */
+static int Drain_Wake_Pending = FALSE;
+/**
+ * The drain thread.
+ */
+static pthread_t Drain_Thread;
+/**
+ * Mutex protecting the handler, the log file and the drain thread's state. The drain thread holds it while it
+ * delivers messages; loggers never take it once the drain thread is running.
+ */
+static pthread_mutex_t Log_Mutex = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * Condition signalled to wake the drain thread early, by DpRt_Log_Flush and DpRt_Log_Shutdown, and by a logger
+ * that finds LOG_DRAIN_WAKE_COUNT messages waiting in the ring.
+ */
+static pthread_cond_t Drain_Condition = PTHREAD_COND_INITIALIZER;
+/**
+ * Condition broadcast by the drain thread each time it has delivered the messages in the ring.
+ */
+static pthread_cond_t Drained_Condition = PTHREAD_COND_INITIALIZER;
+/**
+ * Used to initialise the sequence numbers of the ring once.
+ */
+static pthread_once_t Log_Ring_Once = PTHREAD_ONCE_INIT;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static void Log_Ring_Initialise(void);
+static void Log_Drain_Start(void);
+static void *Log_Drain_Thread(void *user_arg);
+static int Log_Drain(void);
+static void Log_Entry_Deliver(struct Log_Entry_Struct *entry);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Log a message. The message is formatted straight into the next free entry of the ring buffer, and delivered
+ * later by the drain thread, so this routine does not wait for I/O. If the ring is full, the message is dropped.
+ * If LOG_DRAIN_WAKE_COUNT messages are waiting, the drain thread is woken; the signal needs no lock, and a
+ * signal the drain thread misses is made up for by its LOG_DRAIN_PERIOD timeout.
+ * Messages above the configured level are discarded without being formatted.
+ * @param level The level of the message, a DPRT_LOG_LEVEL value.
+ * @param format A printf format string, followed by its arguments. No trailing newline is needed.
+ * @see #Log_Ring
+ * @see #Log_Drain_Start
+ * @see #LOG_DRAIN_WAKE_COUNT
+ * @see #Drain_Wake_Pending
+ * @see dprt_log.h#DPRT_LOG_LEVEL
+ * @see dprt_context.html#DpRt_Error_Current_Get
+ */
+void DpRt_Log_Format(int level,char *format,...)
+{
+	struct Log_Entry_Struct *entry = NULL;
+	va_list ap;
+	unsigned long position,sequence;
+	long difference;
+
+	if(level > Log_Level)
+		return;
+	pthread_once(&Log_Ring_Once,Log_Ring_Initialise);
+	if(!Drain_Running)
+		Log_Drain_Start();
+	/* claim the next free entry */
+	position = __atomic_load_n(&Enqueue_Position,__ATOMIC_RELAXED);
+	while(TRUE)
+	{
+		entry = &(Log_Ring[position&(DPRT_LOG_RING_LENGTH-1)]);
+		sequence = __atomic_load_n(&(entry->Sequence),__ATOMIC_ACQUIRE);
+		difference = (long)(sequence-position);
+		if(difference == 0)
+		{
+			if(__atomic_compare_exchange_n(&Enqueue_Position,&position,position+1,TRUE,__ATOMIC_RELAXED,
+						       __ATOMIC_RELAXED))
+				break;
+		}
+		else if(difference < 0)
+		{
+			/* the ring is full */
+			__atomic_add_fetch(&Dropped_Count,1,__ATOMIC_RELAXED);
+			return;
+		}
+		else
+			position = __atomic_load_n(&Enqueue_Position,__ATOMIC_RELAXED);
+	}
+	entry->Level = level;
+	entry->Tag = DpRt_Error_Current_Get()->Log_Tag;
+	clock_gettime(CLOCK_REALTIME,&(entry->Time));
+	va_start(ap,format);
+	vsnprintf(entry->String,DPRT_LOG_STRING_LENGTH,format,ap);
+	va_end(ap);
+	/* publish the entry to the drain thread */
+	__atomic_store_n(&(entry->Sequence),position+1,__ATOMIC_RELEASE);
+	if(Drain_Running)
+	{
+		/* wake the drain thread if the ring is filling up */
+		if(((position+1)-__atomic_load_n(&Dequeue_Position,__ATOMIC_ACQUIRE) >= LOG_DRAIN_WAKE_COUNT)&&
+		   (!__atomic_exchange_n(&Drain_Wake_Pending,TRUE,__ATOMIC_ACQ_REL)))
+			pthread_cond_signal(&Drain_Condition);
+	}
+	else
+	{
+		/* deliver it now as there is no drain thread */
+		pthread_mutex_lock(&Log_Mutex);
+		if(!Drain_Running)
+			Log_Drain();
+		pthread_mutex_unlock(&Log_Mutex);
+	}
+}
+
+/**
+ * Create a new call number, used to tag the messages logged by one reduction.
+ * @return A call number, unique since the library was loaded. 0 is never returned.
+ * @see #Tag_Count
+ */
+unsigned long DpRt_Log_Tag_Create(void)
+{
+	return __atomic_add_fetch(&Tag_Count,1,__ATOMIC_RELAXED);
+}
+
+/**
+ * Set the highest level of message that is logged.
+ * @param level A DPRT_LOG_LEVEL value.
+ * @see #Log_Level
+ * @see dprt_log.h#DPRT_LOG_LEVEL
+ */
+void DpRt_Log_Level_Set(int level)
+{
+	Log_Level = level;
+}
+
+/**
+ * Set the handler messages are delivered to. Under Java, the JNI layer sets a handler that passes the messages
+ * to DpRt_JNI_Log_Handler. The handler is called on the drain thread, never on a reduction thread.
+ * @param handler A function taking the level of the message and the message, or NULL to write the messages to
+ *        the log file.
+ * @see #Log_Handler
+ */
+void DpRt_Log_Handler_Set(void (*handler)(int level,char *string))
+{
+	pthread_mutex_lock(&Log_Mutex);
+	Log_Handler = handler;
+	pthread_mutex_unlock(&Log_Mutex);
+}
+
+/**
+ * Set the routines the drain thread calls when it starts and just before it exits, on the drain thread itself.
+ * Under Java, the JNI layer uses them to attach the drain thread to the JVM once, rather than for each message.
+ * If the drain thread is already running, it is stopped, so the next message starts it again with the new hooks.
+ * @param start_hook The routine called when the drain thread starts, or NULL.
+ * @param stop_hook The routine called when the drain thread exits, or NULL.
+ * @see #Thread_Start_Hook
+ * @see #Thread_Stop_Hook
+ * @see #DpRt_Log_Shutdown
+ */
+void DpRt_Log_Thread_Hooks_Set(void (*start_hook)(void),void (*stop_hook)(void))
+{
+	DpRt_Log_Shutdown();
+	pthread_mutex_lock(&Log_Mutex);
+	Thread_Start_Hook = start_hook;
+	Thread_Stop_Hook = stop_hook;
+	pthread_mutex_unlock(&Log_Mutex);
+}
+
+/**
+ * Set the file messages are written to when no handler is set. The file is appended to. The previous log file,
+ * unless it was standard output, is closed.
+ * @param filename The filename to write to, or NULL or an empty string for standard output.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Log_File
+ * @see #Log_Filename
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Log_Filename_Set(char *filename)
+{
+	FILE *log_file = NULL;
+
+	if((filename != NULL)&&(strlen(filename) >= DPRT_FITS_FILENAME_LENGTH))
+	{
+		DpRt_Error_Number = 1400;
+		sprintf(DpRt_Error_String,"DpRt_Log_Filename_Set:Filename too long(%lu).",
+			(unsigned long)strlen(filename));
+		return FALSE;
+	}
+	if((filename != NULL)&&(strlen(filename) > 0))
+	{
+		log_file = fopen(filename,"a");
+		if(log_file == NULL)
+		{
+			DpRt_Error_Number = 1401;
+			snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Log_Filename_Set:Failed to open %.128s.",filename);
+			return FALSE;
+		}
+	}
+	pthread_mutex_lock(&Log_Mutex);
+	if(Log_File != NULL)
+		fclose(Log_File);
+	Log_File = log_file;
+	if(log_file != NULL)
+		strcpy(Log_Filename,filename);
+	else
+		Log_Filename[0] = '\0';
+	pthread_mutex_unlock(&Log_Mutex);
+	return TRUE;
+}
+
+/**
+ * Apply the logging configuration: the level, and if a log filename is configured that is not already open, the
+ * log file.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Log_Level_Set
+ * @see #DpRt_Log_Filename_Set
+ * @see dprt_config.html#DpRt_Config_Get
+ */
+int DpRt_Log_Initialise(void)
+{
+	struct DpRt_Config_Struct config;
+	int changed;
+
+	DpRt_Config_Get(&config);
+	DpRt_Log_Level_Set(config.Log_Level);
+	if(strlen(config.Log_Filename) == 0)
+		return TRUE;
+	pthread_mutex_lock(&Log_Mutex);
+	changed = (strcmp(config.Log_Filename,Log_Filename) != 0);
+	pthread_mutex_unlock(&Log_Mutex);
+	if(changed)
+		return DpRt_Log_Filename_Set(config.Log_Filename);
+	return TRUE;
+}
+
+/**
+ * Wait until every message logged before this routine was called has been delivered.
+ * @see #Drain_Condition
+ * @see #Drained_Condition
+ * @see #Log_Drain
+ */
+void DpRt_Log_Flush(void)
+{
+	struct timespec wait_time;
+	unsigned long position;
+
+	position = __atomic_load_n(&Enqueue_Position,__ATOMIC_ACQUIRE);
+	pthread_mutex_lock(&Log_Mutex);
+	while((long)(position-Dequeue_Position) > 0)
+	{
+		if(Drain_Running)
+		{
+			pthread_cond_signal(&Drain_Condition);
+			clock_gettime(CLOCK_REALTIME,&wait_time);
+			wait_time.tv_nsec += LOG_DRAIN_PERIOD*1000000L;
+			if(wait_time.tv_nsec >= 1000000000L)
+			{
+				wait_time.tv_sec++;
+				wait_time.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&Drained_Condition,&Log_Mutex,&wait_time);
+		}
+		else if(Log_Drain() == 0)
+		{
+			/* a logger has claimed an entry but not yet written it */
+			pthread_mutex_unlock(&Log_Mutex);
+			sched_yield();
+			pthread_mutex_lock(&Log_Mutex);
+		}
+	}
+	if(Log_File != NULL)
+		fflush(Log_File);
+	else
+		fflush(stdout);
+	pthread_mutex_unlock(&Log_Mutex);
+}
+
+/**
+ * Stop the drain thread, once it has delivered every message in the ring. Messages logged afterwards start it
+ * again.
+ * @see #Drain_Stop
+ * @see #Drain_Thread
+ */
+void DpRt_Log_Shutdown(void)
+{
+	pthread_mutex_lock(&Log_Mutex);
+	if(!Drain_Running)
+	{
+		pthread_mutex_unlock(&Log_Mutex);
+		DpRt_Log_Flush();
+		return;
+	}
+	Drain_Stop = TRUE;
+	pthread_cond_signal(&Drain_Condition);
+	pthread_mutex_unlock(&Log_Mutex);
+	pthread_join(Drain_Thread,NULL);
+	pthread_mutex_lock(&Log_Mutex);
+	Drain_Running = FALSE;
+	Drain_Stop = FALSE;
+	pthread_mutex_unlock(&Log_Mutex);
+	DpRt_Log_Flush();
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Set the sequence number of each ring entry to its index, marking it free for the first message to use it.
+ * @see #Log_Ring
+ */
+static void Log_Ring_Initialise(void)
+{
+	unsigned long i;
+
+	for(i = 0; i < DPRT_LOG_RING_LENGTH; i++)
+		__atomic_store_n(&(Log_Ring[i].Sequence),i,__ATOMIC_RELEASE);
+}
+
+/**
+ * Start the drain thread, if it is not already running. If it cannot be started, messages are delivered by the
+ * thread that logs them instead.
+ * @see #Log_Drain_Thread
+ * @see #Drain_Running
+ */
+static void Log_Drain_Start(void)
+{
+	pthread_mutex_lock(&Log_Mutex);
+	if((!Drain_Running)&&(!Drain_Stop))
+	{
+		if(pthread_create(&Drain_Thread,NULL,Log_Drain_Thread,NULL) == 0)
+			Drain_Running = TRUE;
+	}
+	pthread_mutex_unlock(&Log_Mutex);
+}
+
+/**
+ * The drain thread. It delivers the messages in the ring, then sleeps for LOG_DRAIN_PERIOD milliseconds or until
+ * woken, until told to stop. If messages have been dropped since it last looked, it says so. The thread hooks
+ * in place when it starts are called when it starts and when it exits.
+ * @param user_arg Not used.
+ * @return NULL.
+ * @see #Log_Drain
+ * @see #LOG_DRAIN_PERIOD
+ * @see #Drain_Wake_Pending
+ * @see #Dropped_Count
+ * @see #Dropped_Reported_Count
+ * @see #Thread_Start_Hook
+ * @see #Thread_Stop_Hook
+ */
+static void *Log_Drain_Thread(void *user_arg)
+{
+	struct timespec wait_time;
+	void (*stop_hook)(void) = NULL;
+	void (*start_hook)(void) = NULL;
+	unsigned long dropped_count;
+	int stop;
+
+	pthread_mutex_lock(&Log_Mutex);
+	start_hook = Thread_Start_Hook;
+	stop_hook = Thread_Stop_Hook;
+	pthread_mutex_unlock(&Log_Mutex);
+	if(start_hook != NULL)
+		(*start_hook)();
+	pthread_mutex_lock(&Log_Mutex);
+	do
+	{
+		stop = Drain_Stop;
+		__atomic_store_n(&Drain_Wake_Pending,FALSE,__ATOMIC_RELEASE);
+		Log_Drain();
+		dropped_count = __atomic_load_n(&Dropped_Count,__ATOMIC_RELAXED);
+		if(dropped_count != Dropped_Reported_Count)
+		{
+			pthread_mutex_unlock(&Log_Mutex);
+			DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"Log_Drain_Thread:Log ring full:%lu messages dropped.",
+				dropped_count-Dropped_Reported_Count);
+			pthread_mutex_lock(&Log_Mutex);
+			Dropped_Reported_Count = dropped_count;
+			Log_Drain();
+		}
+		pthread_cond_broadcast(&Drained_Condition);
+		if(!stop)
+		{
+			clock_gettime(CLOCK_REALTIME,&wait_time);
+			wait_time.tv_nsec += LOG_DRAIN_PERIOD*1000000L;
+			if(wait_time.tv_nsec >= 1000000000L)
+			{
+				wait_time.tv_sec++;
+				wait_time.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&Drain_Condition,&Log_Mutex,&wait_time);
+		}
+	}
+	while(!stop);
+	pthread_mutex_unlock(&Log_Mutex);
+	if(stop_hook != NULL)
+		(*stop_hook)();
+	return NULL;
+}
+
+/**
+ * Deliver the messages in the ring, in order, stopping at the first entry that has been claimed but not yet
+ * written. Log_Mutex should be held.
+ * @return The number of messages delivered.
+ * @see #Log_Entry_Deliver
+ * @see #Dequeue_Position
+ */
+static int Log_Drain(void)
+{
+	struct Log_Entry_Struct *entry = NULL;
+	int count = 0;
+
+	while(TRUE)
+	{
+		entry = &(Log_Ring[Dequeue_Position&(DPRT_LOG_RING_LENGTH-1)]);
+		if(__atomic_load_n(&(entry->Sequence),__ATOMIC_ACQUIRE) != Dequeue_Position+1)
+			break;
+		Log_Entry_Deliver(entry);
+		/* free the entry for the message a whole ring later */
+		__atomic_store_n(&(entry->Sequence),Dequeue_Position+DPRT_LOG_RING_LENGTH,__ATOMIC_RELEASE);
+		__atomic_store_n(&Dequeue_Position,Dequeue_Position+1,__ATOMIC_RELEASE);
+		count++;
+	}
+	if((count > 0)&&(Log_Handler == NULL))
+		fflush((Log_File != NULL) ? Log_File : stdout);
+	return count;
+}
+
+/**
+ * Deliver one message to the log handler, or if none is set, write it to the log file with its time and level.
+ * The message is prefixed with its call number, if it has one. Log_Mutex should be held.
+ * @param entry The ring entry holding the message.
+ * @see #Log_Handler
+ * @see #Log_File
+ * @see #Level_Name_List
+ */
+static void Log_Entry_Deliver(struct Log_Entry_Struct *entry)
+{
+	char buff[DPRT_LOG_STRING_LENGTH+32];
+	char time_string[32];
+	struct tm time_tm;
+	int level;
+
+	if(entry->Tag != 0)
+		snprintf(buff,sizeof(buff),"[%lu] %s",entry->Tag,entry->String);
+	else
+		snprintf(buff,sizeof(buff),"%s",entry->String);
+	if(Log_Handler != NULL)
+	{
+		(*Log_Handler)(entry->Level,buff);
+		return;
+	}
+	level = entry->Level;
+	if((level < DPRT_LOG_LEVEL_ERROR)||(level > DPRT_LOG_LEVEL_DEBUG))
+		level = 0;
+	localtime_r(&(entry->Time.tv_sec),&time_tm);
+	strftime(time_string,sizeof(time_string),"%Y-%m-%dT%H:%M:%S",&time_tm);
+	fprintf((Log_File != NULL) ? Log_File : stdout,"%s.%03ld %s %s\n",time_string,entry->Time.tv_nsec/1000000L,
+		Level_Name_List[level],buff);
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
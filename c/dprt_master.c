@@ -0,0 +1,732 @@
+/* dprt_master.c
+** Master calibration frame creation for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_master.c finds calibration frames in a directory (using the directory's header index), groups them by
+ * binning, and combines each group into a master calibration frame. FTSpec disperses along the rows of the
+ * detector, so wavelength changes with column (NAXIS1) and position along the slit changes with row (NAXIS2).
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_fits.h"
+#include "dprt_combine.h"
+#include "dprt_master.h"
+#include "dprt_index.h"
+#include "dprt_abort.h"
+#include "dprt_context.h"
+#include "dprt_log.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The filename extension a file must have to be considered as a calibration frame.
+ */
+#define MASTER_FITS_EXTENSION		(".fits")
+/**
+ * The number of evenly spaced rows of each flat sampled to estimate the flat's illumination level.
+ */
+#define MASTER_FLAT_LEVEL_SAMPLE_ROWS	(64)
+/**
+ * The width, in columns, of the boxcar used to smooth the lamp spectrum when normalising a master flat.
+ */
+#define MASTER_FLAT_SMOOTH_WIDTH	(31)
+/**
+ * Rows of the master flat whose median is less than this fraction of the brightest row's median are
+ * considered to be outside the slit illumination, and are set to 1.0 in the normalised flat.
+ */
+#define MASTER_FLAT_ILLUMINATED_FRACTION	(0.1)
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * NULL terminated list of OBSTYPE values of frames used to make a master bias.
+ */
+static char *Master_Bias_Obstype_List[] = {"BIAS",NULL};
+/**
+ * NULL terminated list of OBSTYPE values of frames used to make a master flat.
+ */
+static char *Master_Flat_Obstype_List[] = {"LAMPFLAT","FLAT",NULL};
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Master_Group_Get(struct DpRt_Master_Frame_Struct *frame_list,int frame_count,int *used_list,
+			    int first_index,char **group_filename_list,int *group_count,int *header_index,
+			    int *skipped_count);
+static int Master_Flat_Group_Make(char *directory_name,struct DpRt_Fits_Header_Struct *header,
+				  char **filename_list,int frame_count);
+static int Master_Flat_Level_Get(char *filename,int naxis1,int naxis2,float *bias,double *level);
+static int Master_Flat_Normalise(float *master,int naxis1,int naxis2);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Make a master bias for each binning of bias frame found in the directory. The biases of each binning are
+ * median combined, and the master is written to the directory using DPRT_MASTER_BIAS_FILENAME_FORMAT.
+ * Binnings with fewer than DPRT_MASTER_FRAME_COUNT_MIN frames are skipped. Biases whose dimensions differ from
+ * the most common dimensions of their binning are left out, with an error logged. Binnings in skip_list (e.g.
+ * those whose running master bias has just been written) are also skipped.
+ * @param directory_name The directory containing the bias frames.
+ * @param skip_list A list of binnings not to make a master bias for, or NULL.
+ * @param skip_count The number of binnings in skip_list.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Master_Frame_List_Get
+ * @see #Master_Group_Get
+ * @see #Master_Bias_Obstype_List
+ * @see dprt_master.h#DPRT_MASTER_BIAS_FILENAME_FORMAT
+ * @see dprt_master.h#DPRT_MASTER_FRAME_COUNT_MIN
+ * @see dprt_combine.html#DpRt_Combine_Median
+ * @see dprt_fits.html#DpRt_Fits_Write_Float_Image
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Master_Bias_Make(char *directory_name,struct DpRt_Master_Binning_Struct *skip_list,int skip_count)
+{
+	struct DpRt_Master_Frame_Struct *frame_list = NULL;
+	struct DpRt_Fits_Header_Struct header;
+	char master_filename[DPRT_FITS_FILENAME_LENGTH];
+	char **group_filename_list = NULL;
+	float *master = NULL;
+	int *used_list = NULL;
+	int frame_count,group_count,header_index,skipped_count,skip,i,j,retval;
+
+	if(directory_name == NULL)
+	{
+		DpRt_Error_Number = 400;
+		strcpy(DpRt_Error_String,"DpRt_Master_Bias_Make:directory name was NULL.");
+		return FALSE;
+	}
+	/* leave room for the master filename */
+	if(strlen(directory_name)+strlen(DPRT_MASTER_BIAS_FILENAME_FORMAT)+16 > DPRT_FITS_FILENAME_LENGTH)
+	{
+		DpRt_Error_Number = 406;
+		sprintf(DpRt_Error_String,"DpRt_Master_Bias_Make:directory name too long(%d).",
+			(int)strlen(directory_name));
+		return FALSE;
+	}
+	if(!DpRt_Master_Frame_List_Get(directory_name,Master_Bias_Obstype_List,&frame_list,&frame_count))
+		return FALSE;
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Master_Bias_Make:Found %d bias frames in %s.",frame_count,directory_name);
+	if(frame_count == 0)
+		return TRUE;
+	used_list = (int *)calloc(frame_count,sizeof(int));
+	group_filename_list = (char **)malloc(frame_count*sizeof(char *));
+	if((used_list == NULL)||(group_filename_list == NULL))
+	{
+		if(used_list != NULL)
+			free(used_list);
+		if(group_filename_list != NULL)
+			free(group_filename_list);
+		free(frame_list);
+		DpRt_Error_Number = 401;
+		sprintf(DpRt_Error_String,"DpRt_Master_Bias_Make:Failed to allocate group lists(%d).",frame_count);
+		return FALSE;
+	}
+	retval = TRUE;
+	for(i = 0; (i < frame_count) && retval; i++)
+	{
+		if(used_list[i])
+			continue;
+		Master_Group_Get(frame_list,frame_count,used_list,i,group_filename_list,&group_count,&header_index,
+				 &skipped_count);
+		header = frame_list[header_index].Header;
+		skip = FALSE;
+		for(j = 0; (skip_list != NULL) && (j < skip_count); j++)
+		{
+			if((skip_list[j].X_Bin == header.X_Bin)&&(skip_list[j].Y_Bin == header.Y_Bin))
+				skip = TRUE;
+		}
+		if(skip)
+		{
+			DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Master_Bias_Make:Master bias with binning %dx%d already "
+				"made:Skipping %d biases.",header.X_Bin,header.Y_Bin,group_count+skipped_count);
+			continue;
+		}
+		if(skipped_count > 0)
+		{
+			DpRt_Log_Format(DPRT_LOG_LEVEL_ERROR,"DpRt_Master_Bias_Make:Skipping %d biases with binning %dx%d whose "
+				"dimensions are not (%d,%d).",skipped_count,header.X_Bin,header.Y_Bin,header.Naxis1,
+				header.Naxis2);
+		}
+		if(group_count < DPRT_MASTER_FRAME_COUNT_MIN)
+		{
+			DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"DpRt_Master_Bias_Make:Only %d biases with binning %dx%d:"
+				"Not making master bias.",group_count,header.X_Bin,header.Y_Bin);
+			continue;
+		}
+		if(snprintf(master_filename,DPRT_FITS_FILENAME_LENGTH,DPRT_MASTER_BIAS_FILENAME_FORMAT,directory_name,
+			    header.X_Bin,header.Y_Bin) >= DPRT_FITS_FILENAME_LENGTH)
+		{
+			DpRt_Error_Number = 416;
+			sprintf(DpRt_Error_String,"DpRt_Master_Bias_Make:Master bias filename for binning %dx%d too long.",
+				header.X_Bin,header.Y_Bin);
+			retval = FALSE;
+			break;
+		}
+		DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Master_Bias_Make:Combining %d biases with binning %dx%d into %s.",
+			group_count,header.X_Bin,header.Y_Bin,master_filename);
+		master = (float *)malloc(((size_t)header.Naxis1)*header.Naxis2*sizeof(float));
+		if(master == NULL)
+		{
+			DpRt_Error_Number = 402;
+			sprintf(DpRt_Error_String,"DpRt_Master_Bias_Make:Failed to allocate master(%d,%d).",
+				header.Naxis1,header.Naxis2);
+			retval = FALSE;
+			break;
+		}
+		retval = DpRt_Combine_Median(group_filename_list,group_count,header.Naxis1,header.Naxis2,master);
+		if(retval)
+		{
+			header.Exposure_Length = 0.0;
+			DpRt_Fits_Lock();
+			retval = DpRt_Fits_Write_Float_Image(master_filename,&header,master,group_count);
+			DpRt_Fits_Unlock();
+		}
+		free(master);
+	}
+	free(group_filename_list);
+	free(used_list);
+	free(frame_list);
+	return retval;
+}
+
+/**
+ * Make a master flat for each binning of flat frame found in the directory. The flats of each binning are
+ * bias subtracted using the master bias of the same binning in the directory (which must already exist),
+ * scaled by their median level, sigma clip combined, and normalised along the dispersion axis to
+ * remove the lamp spectrum. The master is written to the directory using DPRT_MASTER_FLAT_FILENAME_FORMAT.
+ * Binnings with fewer than DPRT_MASTER_FRAME_COUNT_MIN frames are skipped. Flats whose dimensions differ from
+ * the most common dimensions of their binning are left out, with an error logged.
+ * @param directory_name The directory containing the flat frames.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Master_Frame_List_Get
+ * @see #Master_Group_Get
+ * @see #Master_Flat_Group_Make
+ * @see #Master_Flat_Obstype_List
+ * @see dprt_master.h#DPRT_MASTER_FRAME_COUNT_MIN
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Master_Flat_Make(char *directory_name)
+{
+	struct DpRt_Master_Frame_Struct *frame_list = NULL;
+	struct DpRt_Fits_Header_Struct header;
+	char **group_filename_list = NULL;
+	int *used_list = NULL;
+	int frame_count,group_count,header_index,skipped_count,i,retval;
+
+	if(directory_name == NULL)
+	{
+		DpRt_Error_Number = 407;
+		strcpy(DpRt_Error_String,"DpRt_Master_Flat_Make:directory name was NULL.");
+		return FALSE;
+	}
+	/* leave room for the master filenames */
+	if(strlen(directory_name)+strlen(DPRT_MASTER_FLAT_FILENAME_FORMAT)+16 > DPRT_FITS_FILENAME_LENGTH)
+	{
+		DpRt_Error_Number = 408;
+		sprintf(DpRt_Error_String,"DpRt_Master_Flat_Make:directory name too long(%d).",
+			(int)strlen(directory_name));
+		return FALSE;
+	}
+	if(!DpRt_Master_Frame_List_Get(directory_name,Master_Flat_Obstype_List,&frame_list,&frame_count))
+		return FALSE;
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Master_Flat_Make:Found %d flat frames in %s.",frame_count,directory_name);
+	if(frame_count == 0)
+		return TRUE;
+	used_list = (int *)calloc(frame_count,sizeof(int));
+	group_filename_list = (char **)malloc(frame_count*sizeof(char *));
+	if((used_list == NULL)||(group_filename_list == NULL))
+	{
+		if(used_list != NULL)
+			free(used_list);
+		if(group_filename_list != NULL)
+			free(group_filename_list);
+		free(frame_list);
+		DpRt_Error_Number = 409;
+		sprintf(DpRt_Error_String,"DpRt_Master_Flat_Make:Failed to allocate group lists(%d).",frame_count);
+		return FALSE;
+	}
+	retval = TRUE;
+	for(i = 0; (i < frame_count) && retval; i++)
+	{
+		if(used_list[i])
+			continue;
+		Master_Group_Get(frame_list,frame_count,used_list,i,group_filename_list,&group_count,&header_index,
+				 &skipped_count);
+		header = frame_list[header_index].Header;
+		if(skipped_count > 0)
+		{
+			DpRt_Log_Format(DPRT_LOG_LEVEL_ERROR,"DpRt_Master_Flat_Make:Skipping %d flats with binning %dx%d whose "
+				"dimensions are not (%d,%d).",skipped_count,header.X_Bin,header.Y_Bin,header.Naxis1,
+				header.Naxis2);
+		}
+		if(group_count < DPRT_MASTER_FRAME_COUNT_MIN)
+		{
+			DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"DpRt_Master_Flat_Make:Only %d flats with binning %dx%d:"
+				"Not making master flat.",group_count,header.X_Bin,header.Y_Bin);
+			continue;
+		}
+		retval = Master_Flat_Group_Make(directory_name,&header,group_filename_list,group_count);
+	}
+	free(group_filename_list);
+	free(used_list);
+	free(frame_list);
+	return retval;
+}
+
+/**
+ * Get a list of the calibration frames in a directory with one of the specified OBSTYPEs. Only files ending in
+ * MASTER_FITS_EXTENSION are considered, and files starting with DPRT_MASTER_FILENAME_PREFIX are ignored.
+ * The frames' headers are taken from the directory's header index, so only new and changed files are opened.
+ * Files whose headers cannot be read are skipped. The list is sorted by filename.
+ * @param directory_name The directory to search.
+ * @param obstype_list A NULL terminated list of OBSTYPE values to accept.
+ * @param frame_list The address of a pointer, set to an allocated list of frames. This should be freed
+ *        by the caller. If no frames are found this is set to NULL.
+ * @param frame_count The address of an integer, set to the number of frames in the list.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #MASTER_FITS_EXTENSION
+ * @see dprt_master.h#DPRT_MASTER_FILENAME_PREFIX
+ * @see dprt_index.html#DpRt_Index_Get
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Master_Frame_List_Get(char *directory_name,char **obstype_list,
+			       struct DpRt_Master_Frame_Struct **frame_list,int *frame_count)
+{
+	struct DpRt_Index_Entry_Struct *entry_list = NULL;
+	char *name = NULL;
+	int entry_count,i,j,found;
+
+	if((directory_name == NULL)||(obstype_list == NULL)||(frame_list == NULL)||(frame_count == NULL))
+	{
+		DpRt_Error_Number = 403;
+		strcpy(DpRt_Error_String,"DpRt_Master_Frame_List_Get:Parameter was NULL.");
+		return FALSE;
+	}
+	(*frame_list) = NULL;
+	(*frame_count) = 0;
+	if(!DpRt_Index_Get(directory_name,MASTER_FITS_EXTENSION,&entry_list,&entry_count))
+		return FALSE;
+	if(entry_count == 0)
+		return TRUE;
+	(*frame_list) = (struct DpRt_Master_Frame_Struct *)malloc(entry_count*sizeof(struct DpRt_Master_Frame_Struct));
+	if((*frame_list) == NULL)
+	{
+		free(entry_list);
+		DpRt_Error_Number = 405;
+		sprintf(DpRt_Error_String,"DpRt_Master_Frame_List_Get:Failed to allocate frame list(%d).",entry_count);
+		return FALSE;
+	}
+	/* the index is sorted by filename, so the frame list is too */
+	for(i = 0; i < entry_count; i++)
+	{
+		if(entry_list[i].Valid == FALSE)
+			continue;
+		name = entry_list[i].Filename+strlen(directory_name)+1;
+		if(strncmp(name,DPRT_MASTER_FILENAME_PREFIX,strlen(DPRT_MASTER_FILENAME_PREFIX)) == 0)
+			continue;
+		found = FALSE;
+		for(j = 0; obstype_list[j] != NULL; j++)
+		{
+			if(strcmp(entry_list[i].Header.Obstype,obstype_list[j]) == 0)
+				found = TRUE;
+		}
+		if(!found)
+			continue;
+		strcpy((*frame_list)[(*frame_count)].Filename,entry_list[i].Filename);
+		(*frame_list)[(*frame_count)].Header = entry_list[i].Header;
+		(*frame_count)++;
+	}
+	free(entry_list);
+	if((*frame_count) == 0)
+	{
+		free(*frame_list);
+		(*frame_list) = NULL;
+	}
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Get the group of frames with the same binning as the frame at first_index. The master filenames only encode
+ * the binning, so only one master of each binning can be made. If the frames of this binning do not all have
+ * the same dimensions (e.g. some were windowed), only the frames with the most common dimensions are put in
+ * the group, and the rest are counted in skipped_count. All frames of the binning are marked as used.
+ * @param frame_list The list of frames.
+ * @param frame_count The number of frames in the list.
+ * @param used_list A list of frame_count integers, TRUE for frames already put in a group.
+ * @param first_index The index of the first frame of the binning.
+ * @param group_filename_list A list of at least frame_count pointers, filled in with the filenames in the group.
+ *        The pointers point into frame_list.
+ * @param group_count The address of an integer, set to the number of frames in the group.
+ * @param header_index The address of an integer, set to the index in frame_list of the first frame in the group,
+ *        whose header describes the group.
+ * @param skipped_count The address of an integer, set to the number of frames of this binning left out of the
+ *        group because their dimensions differ.
+ * @return The routine returns TRUE.
+ */
+static int Master_Group_Get(struct DpRt_Master_Frame_Struct *frame_list,int frame_count,int *used_list,
+			    int first_index,char **group_filename_list,int *group_count,int *header_index,
+			    int *skipped_count)
+{
+	struct DpRt_Fits_Header_Struct *first_header = NULL;
+	struct DpRt_Fits_Header_Struct *best_header = NULL;
+	struct DpRt_Fits_Header_Struct *header = NULL;
+	int binning_count,count,best_count,i,j;
+
+	first_header = &(frame_list[first_index].Header);
+	/* find the most common dimensions of the frames with this binning */
+	(*header_index) = first_index;
+	binning_count = 0;
+	best_count = 0;
+	for(i = first_index; i < frame_count; i++)
+	{
+		header = &(frame_list[i].Header);
+		if(used_list[i]||(header->X_Bin != first_header->X_Bin)||(header->Y_Bin != first_header->Y_Bin))
+			continue;
+		binning_count++;
+		count = 0;
+		for(j = i; j < frame_count; j++)
+		{
+			if((!used_list[j])&&(frame_list[j].Header.X_Bin == header->X_Bin)&&
+			   (frame_list[j].Header.Y_Bin == header->Y_Bin)&&(frame_list[j].Header.Naxis1 == header->Naxis1)&&
+			   (frame_list[j].Header.Naxis2 == header->Naxis2))
+				count++;
+		}
+		if(count > best_count)
+		{
+			best_count = count;
+			(*header_index) = i;
+		}
+	}
+	best_header = &(frame_list[(*header_index)].Header);
+	(*group_count) = 0;
+	for(i = first_index; i < frame_count; i++)
+	{
+		header = &(frame_list[i].Header);
+		if(used_list[i]||(header->X_Bin != first_header->X_Bin)||(header->Y_Bin != first_header->Y_Bin))
+			continue;
+		used_list[i] = TRUE;
+		if((header->Naxis1 != best_header->Naxis1)||(header->Naxis2 != best_header->Naxis2))
+			continue;
+		group_filename_list[(*group_count)] = frame_list[i].Filename;
+		(*group_count)++;
+	}
+	(*skipped_count) = binning_count-(*group_count);
+	return TRUE;
+}
+
+/**
+ * Make a master flat from a group of flats with the same binning.
+ * @param directory_name The directory containing the flats, and the master bias.
+ * @param header The address of the header of the first flat in the group.
+ * @param filename_list The list of flat filenames.
+ * @param frame_count The number of flats in the list.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Master_Flat_Level_Get
+ * @see #Master_Flat_Normalise
+ * @see dprt_master.h#DPRT_MASTER_BIAS_FILENAME_FORMAT
+ * @see dprt_master.h#DPRT_MASTER_FLAT_FILENAME_FORMAT
+ * @see dprt_master.h#DPRT_MASTER_FLAT_CLIP_SIGMA
+ * @see dprt_combine.html#DpRt_Combine_Sigma_Clip
+ * @see dprt_fits.html#DpRt_Fits_Read_Float_Image
+ * @see dprt_fits.html#DpRt_Fits_Write_Float_Image
+ */
+static int Master_Flat_Group_Make(char *directory_name,struct DpRt_Fits_Header_Struct *header,
+				  char **filename_list,int frame_count)
+{
+	struct DpRt_Fits_Header_Struct master_header;
+	char bias_filename[DPRT_FITS_FILENAME_LENGTH];
+	char master_filename[DPRT_FITS_FILENAME_LENGTH];
+	double *scale_list = NULL;
+	float *bias = NULL;
+	float *master = NULL;
+	int bias_naxis1,bias_naxis2,i,retval;
+
+	if((snprintf(bias_filename,DPRT_FITS_FILENAME_LENGTH,DPRT_MASTER_BIAS_FILENAME_FORMAT,directory_name,
+		     header->X_Bin,header->Y_Bin) >= DPRT_FITS_FILENAME_LENGTH)||
+	   (snprintf(master_filename,DPRT_FITS_FILENAME_LENGTH,DPRT_MASTER_FLAT_FILENAME_FORMAT,directory_name,
+		     header->X_Bin,header->Y_Bin) >= DPRT_FITS_FILENAME_LENGTH))
+	{
+		DpRt_Error_Number = 417;
+		sprintf(DpRt_Error_String,"Master_Flat_Group_Make:Master filenames for binning %dx%d too long.",
+			header->X_Bin,header->Y_Bin);
+		return FALSE;
+	}
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"Master_Flat_Group_Make:Combining %d flats with binning %dx%d into %s "
+		"using bias %s.",frame_count,header->X_Bin,header->Y_Bin,master_filename,bias_filename);
+	DpRt_Fits_Lock();
+	retval = DpRt_Fits_Read_Float_Image(bias_filename,&bias_naxis1,&bias_naxis2,&bias);
+	DpRt_Fits_Unlock();
+	if(!retval)
+		return FALSE;
+	if((bias_naxis1 != header->Naxis1)||(bias_naxis2 != header->Naxis2))
+	{
+		free(bias);
+		DpRt_Error_Number = 410;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"Master_Flat_Group_Make:Master bias %.128s has "
+			"dimensions (%d,%d) not (%d,%d).",bias_filename,bias_naxis1,bias_naxis2,header->Naxis1,
+			header->Naxis2);
+		return FALSE;
+	}
+	scale_list = (double *)malloc(frame_count*sizeof(double));
+	master = (float *)malloc(((size_t)header->Naxis1)*header->Naxis2*sizeof(float));
+	if((scale_list == NULL)||(master == NULL))
+	{
+		free(bias);
+		if(scale_list != NULL)
+			free(scale_list);
+		if(master != NULL)
+			free(master);
+		DpRt_Error_Number = 411;
+		sprintf(DpRt_Error_String,"Master_Flat_Group_Make:Failed to allocate master(%d,%d).",
+			header->Naxis1,header->Naxis2);
+		return FALSE;
+	}
+	/* find each flat's illumination level */
+	retval = TRUE;
+	for(i = 0; (i < frame_count) && retval; i++)
+	{
+		DpRt_Fits_Lock();
+		retval = Master_Flat_Level_Get(filename_list[i],header->Naxis1,header->Naxis2,bias,&(scale_list[i]));
+		DpRt_Fits_Unlock();
+		if(retval && (scale_list[i] <= 0.0))
+		{
+			DpRt_Error_Number = 412;
+			snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"Master_Flat_Group_Make:Flat %.128s has an illegal level "
+				"%.2f.",filename_list[i],scale_list[i]);
+			retval = FALSE;
+		}
+	}
+	if(retval)
+	{
+		retval = DpRt_Combine_Sigma_Clip(filename_list,frame_count,header->Naxis1,header->Naxis2,bias,
+						 scale_list,DPRT_MASTER_FLAT_CLIP_SIGMA,master);
+	}
+	if(retval)
+		retval = Master_Flat_Normalise(master,header->Naxis1,header->Naxis2);
+	if(retval)
+	{
+		master_header = (*header);
+		master_header.Exposure_Length = 0.0;
+		DpRt_Fits_Lock();
+		retval = DpRt_Fits_Write_Float_Image(master_filename,&master_header,master,frame_count);
+		DpRt_Fits_Unlock();
+	}
+	free(bias);
+	free(scale_list);
+	free(master);
+	return retval;
+}
+
+/**
+ * Estimate the illumination level of a flat, as the median of the bias subtracted pixels in
+ * MASTER_FLAT_LEVEL_SAMPLE_ROWS evenly spaced rows. Only the sampled rows are read.
+ * @param filename The flat's filename.
+ * @param naxis1 The number of columns in the flat.
+ * @param naxis2 The number of rows in the flat.
+ * @param bias The naxis1*naxis2 master bias.
+ * @param level The address of a double, set to the estimated level.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #MASTER_FLAT_LEVEL_SAMPLE_ROWS
+ * @see dprt_fits.html#DpRt_Fits_Image_Open
+ * @see dprt_fits.html#DpRt_Fits_Image_Read_Rows
+ * @see dprt_fits.html#DpRt_Fits_Image_Close
+ * @see dprt_combine.html#DpRt_Combine_Median_Float
+ * @see dprt_abort.html#DpRt_Abort_Checkpoint
+ */
+static int Master_Flat_Level_Get(char *filename,int naxis1,int naxis2,float *bias,double *level)
+{
+	struct DpRt_Abort_Checkpoint_Struct checkpoint;
+	fitsfile *fits_fp = NULL;
+	unsigned short *row = NULL;
+	float *sample = NULL;
+	int frame_naxis1,frame_naxis2,sample_rows,sample_count,i,x,y;
+
+	if(!DpRt_Fits_Image_Open(filename,&fits_fp,&frame_naxis1,&frame_naxis2))
+		return FALSE;
+	if((frame_naxis1 != naxis1)||(frame_naxis2 != naxis2))
+	{
+		DpRt_Fits_Image_Close(fits_fp);
+		DpRt_Error_Number = 413;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"Master_Flat_Level_Get:%.128s has dimensions (%d,%d) not "
+			"(%d,%d).",filename,frame_naxis1,frame_naxis2,naxis1,naxis2);
+		return FALSE;
+	}
+	sample_rows = MASTER_FLAT_LEVEL_SAMPLE_ROWS;
+	if(sample_rows > naxis2)
+		sample_rows = naxis2;
+	row = (unsigned short *)malloc(naxis1*sizeof(unsigned short));
+	sample = (float *)malloc(((size_t)sample_rows)*naxis1*sizeof(float));
+	if((row == NULL)||(sample == NULL))
+	{
+		DpRt_Fits_Image_Close(fits_fp);
+		if(row != NULL)
+			free(row);
+		if(sample != NULL)
+			free(sample);
+		DpRt_Error_Number = 414;
+		sprintf(DpRt_Error_String,"Master_Flat_Level_Get:Failed to allocate sample(%d,%d).",naxis1,
+			sample_rows);
+		return FALSE;
+	}
+	sample_count = 0;
+	DpRt_Abort_Checkpoint_Initialise(&checkpoint);
+	for(i = 0; i < sample_rows; i++)
+	{
+		y = (int)((((double)i)+0.5)*naxis2/sample_rows);
+		if((!DpRt_Abort_Checkpoint(&checkpoint,naxis1,"Master_Flat_Level_Get"))||
+		   (!DpRt_Fits_Image_Read_Rows(fits_fp,naxis1,y,1,row)))
+		{
+			DpRt_Fits_Image_Close(fits_fp);
+			free(row);
+			free(sample);
+			return FALSE;
+		}
+		for(x = 0; x < naxis1; x++)
+			sample[sample_count++] = ((float)row[x])-bias[(((size_t)y)*naxis1)+x];
+	}
+	(*level) = (double)DpRt_Combine_Median_Float(sample,sample_count);
+	free(row);
+	free(sample);
+	return DpRt_Fits_Image_Close(fits_fp);
+}
+
+/**
+ * Normalise a combined flat along the dispersion axis, to remove the spectrum of the flat field lamp whilst
+ * keeping the pixel to pixel sensitivity variations. Rows within the slit illumination are found from
+ * their median levels, the lamp spectrum is the median of each column over those rows smoothed with a
+ * MASTER_FLAT_SMOOTH_WIDTH boxcar, and each illuminated pixel is divided by the lamp spectrum at that column.
+ * Pixels outside the illumination are set to 1.0.
+ * @param master The naxis1*naxis2 combined flat, normalised in place.
+ * @param naxis1 The number of columns (the dispersion axis).
+ * @param naxis2 The number of rows (the spatial axis).
+ * @return The routine returns TRUE on success and FALSE on failure, or if an abort was requested. On an abort the
+ *         master is left partly normalised.
+ * @see #MASTER_FLAT_SMOOTH_WIDTH
+ * @see #MASTER_FLAT_ILLUMINATED_FRACTION
+ * @see dprt_combine.html#DpRt_Combine_Median_Float
+ * @see dprt_abort.html#DpRt_Abort_Checkpoint
+ */
+static int Master_Flat_Normalise(float *master,int naxis1,int naxis2)
+{
+	struct DpRt_Abort_Checkpoint_Struct checkpoint;
+	float *values = NULL;
+	float *row_level = NULL;
+	double *lamp = NULL;
+	double *smooth_lamp = NULL;
+	double sum,max_row_level;
+	int *illuminated = NULL;
+	int illuminated_count,count,x,y,i,half_width,aborted;
+
+	values = (float *)malloc(((naxis1 > naxis2) ? naxis1 : naxis2)*sizeof(float));
+	row_level = (float *)malloc(naxis2*sizeof(float));
+	illuminated = (int *)malloc(naxis2*sizeof(int));
+	lamp = (double *)malloc(naxis1*sizeof(double));
+	smooth_lamp = (double *)malloc(naxis1*sizeof(double));
+	if((values == NULL)||(row_level == NULL)||(illuminated == NULL)||(lamp == NULL)||(smooth_lamp == NULL))
+	{
+		if(values != NULL)
+			free(values);
+		if(row_level != NULL)
+			free(row_level);
+		if(illuminated != NULL)
+			free(illuminated);
+		if(lamp != NULL)
+			free(lamp);
+		if(smooth_lamp != NULL)
+			free(smooth_lamp);
+		DpRt_Error_Number = 415;
+		sprintf(DpRt_Error_String,"Master_Flat_Normalise:Failed to allocate buffers(%d,%d).",naxis1,naxis2);
+		return FALSE;
+	}
+	/* find the rows within the slit illumination */
+	DpRt_Abort_Checkpoint_Initialise(&checkpoint);
+	aborted = FALSE;
+	max_row_level = 0.0;
+	for(y = 0; (y < naxis2)&&(!aborted); y++)
+	{
+		aborted = !DpRt_Abort_Checkpoint(&checkpoint,naxis1,"Master_Flat_Normalise");
+		memcpy(values,master+(((size_t)y)*naxis1),naxis1*sizeof(float));
+		row_level[y] = DpRt_Combine_Median_Float(values,naxis1);
+		if(row_level[y] > max_row_level)
+			max_row_level = row_level[y];
+	}
+	illuminated_count = 0;
+	for(y = 0; (y < naxis2)&&(!aborted); y++)
+	{
+		illuminated[y] = (max_row_level > 0.0)&&(row_level[y] >= MASTER_FLAT_ILLUMINATED_FRACTION*max_row_level);
+		if(illuminated[y])
+			illuminated_count++;
+	}
+	DpRt_Log_Format(DPRT_LOG_LEVEL_DEBUG,"Master_Flat_Normalise:%d of %d rows are illuminated.",illuminated_count,
+		naxis2);
+	/* lamp spectrum is the median of each column over the illuminated rows */
+	for(x = 0; (x < naxis1)&&(!aborted); x++)
+	{
+		aborted = !DpRt_Abort_Checkpoint(&checkpoint,naxis2,"Master_Flat_Normalise");
+		count = 0;
+		for(y = 0; y < naxis2; y++)
+		{
+			if(illuminated[y])
+				values[count++] = master[(((size_t)y)*naxis1)+x];
+		}
+		lamp[x] = (double)DpRt_Combine_Median_Float(values,count);
+	}
+	/* smooth the lamp spectrum, so the pixel to pixel variations are kept in the flat.
+	** The boxcar shrinks symmetrically near the ends, so it is not biased by the slope of the lamp spectrum. */
+	for(x = 0; (x < naxis1)&&(!aborted); x++)
+	{
+		half_width = MASTER_FLAT_SMOOTH_WIDTH/2;
+		if(half_width > x)
+			half_width = x;
+		if(half_width > naxis1-1-x)
+			half_width = naxis1-1-x;
+		sum = 0.0;
+		count = 0;
+		for(i = x-half_width; i <= x+half_width; i++)
+		{
+			sum += lamp[i];
+			count++;
+		}
+		smooth_lamp[x] = sum/count;
+	}
+	/* normalise */
+	for(y = 0; (y < naxis2)&&(!aborted); y++)
+	{
+		aborted = !DpRt_Abort_Checkpoint(&checkpoint,naxis1,"Master_Flat_Normalise");
+		for(x = 0; x < naxis1; x++)
+		{
+			if(illuminated[y] && (smooth_lamp[x] > 0.0))
+				master[(((size_t)y)*naxis1)+x] /= (float)(smooth_lamp[x]);
+			else
+				master[(((size_t)y)*naxis1)+x] = 1.0f;
+		}
+	}
+	free(values);
+	free(row_level);
+	free(illuminated);
+	free(lamp);
+	free(smooth_lamp);
+	return !aborted;
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
@@ -0,0 +1,321 @@
+/* dprt_metrics.c
+** Stage timing and counters for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_metrics.c times the stages of each reduction (open, read, calibrate, extract, quick and write) against
+ * the monotonic clock, and counts frames, bytes read, calibration cache hits and misses, and aborts, so it can
+ * be seen where the time goes on a busy night. Each thread records into a slot of its own, created the first
+ * time it records anything, so reductions running in parallel do not contend for a lock. The slots are only
+ * summed when a snapshot is taken. When a thread exits, its slot is folded into a total kept for exited
+ * threads, so the short lived stage threads of a batch reduction are not lost.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt_metrics.h"
+#include "dprt_log.h"
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding one thread's slot.
+ * <dl>
+ * <dt>Mutex</dt> <dd>Protects Metrics. Only the owning thread records into the slot, so the mutex is only
+ *     contended while a snapshot is being taken.</dd>
+ * <dt>Metrics</dt> <dd>The timings and counters recorded by the thread.</dd>
+ * <dt>Next</dt> <dd>The next slot in Slot_List.</dd>
+ * </dl>
+ */
+struct Metrics_Slot_Struct
+{
+	pthread_mutex_t Mutex;
+	struct DpRt_Metrics_Snapshot_Struct Metrics;
+	struct Metrics_Slot_Struct *Next;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The names of the stages, indexed by DPRT_METRICS_STAGE, used when logging.
+ */
+static char *Stage_Name_List[DPRT_METRICS_STAGE_COUNT] =
+{
+	"Open","Read","Calibrate","Extract","Quick","Write","Cosmic"
+};
+/**
+ * The names of the counters, indexed by DPRT_METRICS_COUNTER, used when logging.
+ */
+static char *Counter_Name_List[DPRT_METRICS_COUNTER_COUNT] =
+{
+	"Frames","Frames Failed","Bytes Read","Cache Hits","Cache Misses","Aborts"
+};
+/**
+ * The list of slots of running threads.
+ */
+static struct Metrics_Slot_Struct *Slot_List = NULL;
+/**
+ * The timings and counters of threads that have exited, and of any thread whose slot could not be allocated.
+ */
+static struct DpRt_Metrics_Snapshot_Struct Exited_Metrics;
+/**
+ * Mutex protecting Slot_List and Exited_Metrics.
+ */
+static pthread_mutex_t Metrics_Mutex = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * The key of the thread-specific pointer to each thread's slot.
+ */
+static pthread_key_t Slot_Key;
+/**
+ * Used to create Slot_Key once.
+ */
+static pthread_once_t Slot_Key_Once = PTHREAD_ONCE_INIT;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static void Slot_Key_Create(void);
+static struct Metrics_Slot_Struct *Metrics_Slot_Get(void);
+static void Metrics_Slot_Free(void *user_arg);
+static void Metrics_Add(struct DpRt_Metrics_Snapshot_Struct *total,struct DpRt_Metrics_Snapshot_Struct *metrics);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Start timing a stage.
+ * @param start_time The address of a timespec, set to the current time of the monotonic clock.
+ * @see #DpRt_Metrics_Timer_Stop
+ */
+void DpRt_Metrics_Timer_Start(struct timespec *start_time)
+{
+	clock_gettime(CLOCK_MONOTONIC,start_time);
+}
+
+/**
+ * Stop timing a stage, and add the time since DpRt_Metrics_Timer_Start to the calling thread's slot.
+ * @param stage The stage timed.
+ * @param start_time The address of the timespec set by DpRt_Metrics_Timer_Start.
+ * @see #DpRt_Metrics_Timer_Start
+ * @see #Metrics_Slot_Get
+ */
+void DpRt_Metrics_Timer_Stop(enum DPRT_METRICS_STAGE stage,struct timespec *start_time)
+{
+	struct Metrics_Slot_Struct *slot = NULL;
+	struct DpRt_Metrics_Snapshot_Struct *metrics = NULL;
+	pthread_mutex_t *mutex = NULL;
+	struct timespec end_time;
+	double elapsed_time;
+
+	clock_gettime(CLOCK_MONOTONIC,&end_time);
+	elapsed_time = (end_time.tv_sec-start_time->tv_sec)+((end_time.tv_nsec-start_time->tv_nsec)/1.0e9);
+	slot = Metrics_Slot_Get();
+	if(slot != NULL)
+	{
+		mutex = &(slot->Mutex);
+		metrics = &(slot->Metrics);
+	}
+	else
+	{
+		mutex = &Metrics_Mutex;
+		metrics = &Exited_Metrics;
+	}
+	pthread_mutex_lock(mutex);
+	metrics->Stage_Count_List[stage]++;
+	metrics->Stage_Time_List[stage] += elapsed_time;
+	if(elapsed_time > metrics->Stage_Time_Maximum_List[stage])
+		metrics->Stage_Time_Maximum_List[stage] = elapsed_time;
+	pthread_mutex_unlock(mutex);
+}
+
+/**
+ * Add to a counter in the calling thread's slot.
+ * @param counter The counter.
+ * @param value The amount to add.
+ * @see #Metrics_Slot_Get
+ */
+void DpRt_Metrics_Count_Add(enum DPRT_METRICS_COUNTER counter,long value)
+{
+	struct Metrics_Slot_Struct *slot = NULL;
+
+	slot = Metrics_Slot_Get();
+	if(slot != NULL)
+	{
+		pthread_mutex_lock(&(slot->Mutex));
+		slot->Metrics.Counter_List[counter] += value;
+		pthread_mutex_unlock(&(slot->Mutex));
+	}
+	else
+	{
+		pthread_mutex_lock(&Metrics_Mutex);
+		Exited_Metrics.Counter_List[counter] += value;
+		pthread_mutex_unlock(&Metrics_Mutex);
+	}
+}
+
+/**
+ * Sum the timings and counters of every thread, including threads that have exited.
+ * @param snapshot The address of a structure to fill in.
+ * @param reset If TRUE, every slot is cleared once it has been added to the snapshot, so the next snapshot
+ *        covers only the time since this one.
+ * @see #Slot_List
+ * @see #Exited_Metrics
+ * @see #Metrics_Add
+ */
+void DpRt_Metrics_Snapshot_Get(struct DpRt_Metrics_Snapshot_Struct *snapshot,int reset)
+{
+	struct Metrics_Slot_Struct *slot = NULL;
+
+	if(snapshot == NULL)
+		return;
+	pthread_mutex_lock(&Metrics_Mutex);
+	(*snapshot) = Exited_Metrics;
+	snapshot->Thread_Count = 0;
+	if(reset)
+		memset(&Exited_Metrics,0,sizeof(struct DpRt_Metrics_Snapshot_Struct));
+	for(slot = Slot_List; slot != NULL; slot = slot->Next)
+	{
+		pthread_mutex_lock(&(slot->Mutex));
+		Metrics_Add(snapshot,&(slot->Metrics));
+		if(reset)
+			memset(&(slot->Metrics),0,sizeof(struct DpRt_Metrics_Snapshot_Struct));
+		pthread_mutex_unlock(&(slot->Mutex));
+		snapshot->Thread_Count++;
+	}
+	pthread_mutex_unlock(&Metrics_Mutex);
+}
+
+/**
+ * Log a snapshot of the timings and counters: for each stage the number of times it ran, and the mean and
+ * maximum time it took, then the value of each counter.
+ * @see #DpRt_Metrics_Snapshot_Get
+ */
+void DpRt_Metrics_Log(void)
+{
+	struct DpRt_Metrics_Snapshot_Struct snapshot;
+	double mean_time;
+	int i;
+
+	DpRt_Metrics_Snapshot_Get(&snapshot,FALSE);
+	for(i = 0; i < DPRT_METRICS_STAGE_COUNT; i++)
+	{
+		mean_time = 0.0;
+		if(snapshot.Stage_Count_List[i] > 0)
+			mean_time = snapshot.Stage_Time_List[i]/snapshot.Stage_Count_List[i];
+		DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Metrics_Log:%s:%ld:Mean %.3f ms:Maximum %.3f ms:Total %.3f s.",
+			Stage_Name_List[i],snapshot.Stage_Count_List[i],mean_time*1000.0,
+			snapshot.Stage_Time_Maximum_List[i]*1000.0,snapshot.Stage_Time_List[i]);
+	}
+	for(i = 0; i < DPRT_METRICS_COUNTER_COUNT; i++)
+		DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Metrics_Log:%s:%ld.",Counter_Name_List[i],snapshot.Counter_List[i]);
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Create the key of the thread-specific slot pointer. Metrics_Slot_Free is called on the slot of each thread
+ * when it exits.
+ * @see #Slot_Key
+ * @see #Metrics_Slot_Free
+ */
+static void Slot_Key_Create(void)
+{
+	pthread_key_create(&Slot_Key,Metrics_Slot_Free);
+}
+
+/**
+ * Get the calling thread's slot, creating it and adding it to Slot_List the first time the thread records
+ * anything.
+ * @return The thread's slot, or NULL if it could not be allocated, in which case the caller records into
+ *         Exited_Metrics instead.
+ * @see #Slot_Key
+ * @see #Slot_List
+ */
+static struct Metrics_Slot_Struct *Metrics_Slot_Get(void)
+{
+	struct Metrics_Slot_Struct *slot = NULL;
+
+	pthread_once(&Slot_Key_Once,Slot_Key_Create);
+	slot = (struct Metrics_Slot_Struct *)pthread_getspecific(Slot_Key);
+	if(slot != NULL)
+		return slot;
+	slot = (struct Metrics_Slot_Struct *)calloc(1,sizeof(struct Metrics_Slot_Struct));
+	if(slot == NULL)
+		return NULL;
+	pthread_mutex_init(&(slot->Mutex),NULL);
+	if(pthread_setspecific(Slot_Key,slot) != 0)
+	{
+		pthread_mutex_destroy(&(slot->Mutex));
+		free(slot);
+		return NULL;
+	}
+	pthread_mutex_lock(&Metrics_Mutex);
+	slot->Next = Slot_List;
+	Slot_List = slot;
+	pthread_mutex_unlock(&Metrics_Mutex);
+	return slot;
+}
+
+/**
+ * Called when a thread with a slot exits. The slot is removed from Slot_List, its timings and counters are
+ * added to Exited_Metrics, and it is freed.
+ * @param user_arg The thread's slot.
+ * @see #Slot_List
+ * @see #Exited_Metrics
+ */
+static void Metrics_Slot_Free(void *user_arg)
+{
+	struct Metrics_Slot_Struct *slot = (struct Metrics_Slot_Struct *)user_arg;
+	struct Metrics_Slot_Struct **slot_address = NULL;
+
+	if(slot == NULL)
+		return;
+	pthread_mutex_lock(&Metrics_Mutex);
+	for(slot_address = &Slot_List; (*slot_address) != NULL; slot_address = &((*slot_address)->Next))
+	{
+		if((*slot_address) == slot)
+		{
+			(*slot_address) = slot->Next;
+			break;
+		}
+	}
+	Metrics_Add(&Exited_Metrics,&(slot->Metrics));
+	pthread_mutex_unlock(&Metrics_Mutex);
+	pthread_mutex_destroy(&(slot->Mutex));
+	free(slot);
+}
+
+/**
+ * Add one set of timings and counters to a total. Maximum times are combined by taking the larger.
+ * @param total The total to add to.
+ * @param metrics The timings and counters to add.
+ */
+static void Metrics_Add(struct DpRt_Metrics_Snapshot_Struct *total,struct DpRt_Metrics_Snapshot_Struct *metrics)
+{
+	int i;
+
+	for(i = 0; i < DPRT_METRICS_STAGE_COUNT; i++)
+	{
+		total->Stage_Count_List[i] += metrics->Stage_Count_List[i];
+		total->Stage_Time_List[i] += metrics->Stage_Time_List[i];
+		if(metrics->Stage_Time_Maximum_List[i] > total->Stage_Time_Maximum_List[i])
+			total->Stage_Time_Maximum_List[i] = metrics->Stage_Time_Maximum_List[i];
+	}
+	for(i = 0; i < DPRT_METRICS_COUNTER_COUNT; i++)
+		total->Counter_List[i] += metrics->Counter_List[i];
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
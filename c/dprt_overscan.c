@@ -0,0 +1,283 @@
+/* dprt_overscan.c
+** Overscan bias correction and trimming for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_overscan.c fits a bias model to the overscan region of a frame, given by its BIASSEC keyword, so the bias
+ * level of each exposure can be subtracted without a master bias. A serial overscan region (narrower than it is
+ * tall) gives a bias level for each row, from the sigma clipped mean of the row's overscan pixels. A parallel
+ * overscan region gives a bias level for each column, from the sigma clipped mean of the column's overscan
+ * pixels, smoothed along the row with a boxcar. The clipped means are SIMD reductions in dprt_kernel.c.
+ * The model is applied a row at a time, as the frame is calibrated and trimmed to its TRIMSEC region, so neither
+ * the bias subtracted nor the trimmed frame is ever held as a separate copy.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_fits.h"
+#include "dprt_kernel.h"
+#include "dprt_overscan.h"
+#include "dprt_context.h"
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static void Overscan_Smooth(float *input,int count,int half_width,float *output);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Fit a bias model to the overscan region of a frame. If the region is no wider than it is tall it is a serial
+ * overscan, and each row's bias level is the clipped mean of that row's overscan pixels. Otherwise it is a
+ * parallel overscan, and each column's bias level is the clipped mean of that column's overscan pixels, smoothed
+ * with a boxcar of smooth columns either side.
+ * @param data The first pixel of the overscan region. This is either the region read on its own (stride is its
+ *        width), or the region's pixel within a whole frame (stride is the frame's width).
+ * @param stride The number of pixels between the start of one row of the region and the next.
+ * @param bias_section The overscan region, in frame pixels.
+ * @param smooth The half width of the boxcar the column bias levels are smoothed with, zero for no smoothing.
+ * @param overscan The address of a structure to fill in. Level is allocated here, and should be freed with
+ *        DpRt_Overscan_Free.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #DpRt_Overscan_Free
+ * @see #Overscan_Smooth
+ * @see dprt_overscan.h#DPRT_OVERSCAN_MODEL
+ * @see dprt_overscan.h#DPRT_OVERSCAN_CLIP_SIGMA
+ * @see dprt_kernel.html#DpRt_Kernel_Clipped_Mean
+ * @see dprt_kernel.html#DpRt_Kernel_Clipped_Mean_Columns
+ * @see dprt_context.html#DpRt_Error_Number
+ * @see dprt_context.html#DpRt_Error_String
+ */
+int DpRt_Overscan_Fit(float *data,int stride,struct DpRt_Fits_Section_Struct *bias_section,int smooth,
+		      struct DpRt_Overscan_Struct *overscan)
+{
+	float *work = NULL;
+	int width,height,y;
+
+	if((data == NULL)||(bias_section == NULL)||(overscan == NULL))
+	{
+		DpRt_Error_Number = 1600;
+		strcpy(DpRt_Error_String,"DpRt_Overscan_Fit:Parameter was NULL.");
+		return FALSE;
+	}
+	overscan->Level = NULL;
+	overscan->Length = 0;
+	width = bias_section->X_End-bias_section->X_Start+1;
+	height = bias_section->Y_End-bias_section->Y_Start+1;
+	if((width < 1)||(height < 1)||(stride < width)||(smooth < 0))
+	{
+		DpRt_Error_Number = 1601;
+		sprintf(DpRt_Error_String,"DpRt_Overscan_Fit:Illegal overscan region(%d,%d,%d,%d).",width,height,
+			stride,smooth);
+		return FALSE;
+	}
+	if(width <= height)
+	{
+		overscan->Model = DPRT_OVERSCAN_MODEL_ROW;
+		overscan->Start = bias_section->Y_Start;
+		overscan->Length = height;
+		overscan->Level = (float *)malloc(height*sizeof(float));
+	}
+	else
+	{
+		overscan->Model = DPRT_OVERSCAN_MODEL_COLUMN;
+		overscan->Start = bias_section->X_Start;
+		overscan->Length = width;
+		overscan->Level = (float *)malloc(width*sizeof(float));
+		work = (float *)malloc(5*width*sizeof(float));
+	}
+	if((overscan->Level == NULL)||((overscan->Model == DPRT_OVERSCAN_MODEL_COLUMN)&&(work == NULL)))
+	{
+		DpRt_Overscan_Free(overscan);
+		if(work != NULL)
+			free(work);
+		DpRt_Error_Number = 1602;
+		sprintf(DpRt_Error_String,"DpRt_Overscan_Fit:Failed to allocate bias levels(%d,%d).",width,height);
+		return FALSE;
+	}
+	if(overscan->Model == DPRT_OVERSCAN_MODEL_ROW)
+	{
+		for(y = 0; y < height; y++)
+		{
+			overscan->Level[y] = (float)DpRt_Kernel_Clipped_Mean(data+(((size_t)y)*stride),width,
+									     DPRT_OVERSCAN_CLIP_SIGMA);
+		}
+		return TRUE;
+	}
+	/* the unsmoothed column levels go after the kernel's work space */
+	DpRt_Kernel_Clipped_Mean_Columns(data,stride,width,height,DPRT_OVERSCAN_CLIP_SIGMA,work,work+(4*width));
+	Overscan_Smooth(work+(4*width),width,smooth,overscan->Level);
+	free(work);
+	return TRUE;
+}
+
+/**
+ * Subtract a reference bias model from another, e.g. the overscan model of the master bias from that of the frame,
+ * so that subtracting both the master bias and the difference of the models removes the frame's bias once. If
+ * the models were fitted to different overscan regions, the mean level of the reference is subtracted instead.
+ * Nothing is done if either model has not been fitted.
+ * @param overscan The address of the model to subtract from.
+ * @param reference The address of the model to subtract.
+ * @see #DpRt_Overscan_Level_Mean
+ */
+void DpRt_Overscan_Level_Subtract(struct DpRt_Overscan_Struct *overscan,struct DpRt_Overscan_Struct *reference)
+{
+	float mean;
+	int i;
+
+	if((overscan == NULL)||(reference == NULL)||(overscan->Level == NULL)||(reference->Level == NULL))
+		return;
+	if((overscan->Model == reference->Model)&&(overscan->Start == reference->Start)&&
+	   (overscan->Length == reference->Length))
+	{
+		for(i = 0; i < overscan->Length; i++)
+			overscan->Level[i] -= reference->Level[i];
+		return;
+	}
+	mean = (float)DpRt_Overscan_Level_Mean(reference);
+	for(i = 0; i < overscan->Length; i++)
+		overscan->Level[i] -= mean;
+}
+
+/**
+ * Get the mean of a model's bias levels, e.g. the bias level of a whole frame.
+ * @param overscan The address of the model.
+ * @return The mean bias level, or 0.0 if no model has been fitted.
+ */
+double DpRt_Overscan_Level_Mean(struct DpRt_Overscan_Struct *overscan)
+{
+	double sum;
+	int i;
+
+	if((overscan == NULL)||(overscan->Level == NULL)||(overscan->Length < 1))
+		return 0.0;
+	sum = 0.0;
+	for(i = 0; i < overscan->Length; i++)
+		sum += overscan->Level[i];
+	return sum/overscan->Length;
+}
+
+/**
+ * Get the bias level of each pixel of part of a frame row, for DpRt_Kernel_Calibrate_Block. Rows or columns
+ * beyond the overscan region use the level of the nearest row or column in it.
+ * @param overscan The address of the model. If no model has been fitted, the levels are zero.
+ * @param row The frame row.
+ * @param first_column The frame column of the first pixel.
+ * @param count The number of pixels.
+ * @param output The bias levels are written here, count floats.
+ * @see dprt_kernel.html#DpRt_Kernel_Calibrate_Block
+ */
+void DpRt_Overscan_Row_Get(struct DpRt_Overscan_Struct *overscan,int row,int first_column,int count,float *output)
+{
+	float level;
+	int index,i;
+
+	if((overscan == NULL)||(overscan->Level == NULL))
+	{
+		memset(output,0,count*sizeof(float));
+		return;
+	}
+	if(overscan->Model == DPRT_OVERSCAN_MODEL_ROW)
+	{
+		index = row-overscan->Start;
+		if(index < 0)
+			index = 0;
+		if(index >= overscan->Length)
+			index = overscan->Length-1;
+		level = overscan->Level[index];
+		for(i = 0; i < count; i++)
+			output[i] = level;
+		return;
+	}
+	for(i = 0; i < count; i++)
+	{
+		index = first_column+i-overscan->Start;
+		if(index < 0)
+			index = 0;
+		if(index >= overscan->Length)
+			index = overscan->Length-1;
+		output[i] = overscan->Level[index];
+	}
+}
+
+/**
+ * Trim a whole frame held in memory to its TRIMSEC region, in place. The rows of the region are moved to the
+ * start of the frame, each trim_section width pixels long. This is used for frames read whole, e.g. arcs; frames
+ * read a block of rows at a time are trimmed as they are calibrated.
+ * @param frame The frame, naxis1 pixels per row.
+ * @param naxis1 The number of columns in the frame.
+ * @param trim_section The region to keep.
+ */
+void DpRt_Overscan_Trim(float *frame,int naxis1,struct DpRt_Fits_Section_Struct *trim_section)
+{
+	int width,y;
+
+	width = trim_section->X_End-trim_section->X_Start+1;
+	/* each row moves towards the start of the frame, so moving in row order never overwrites a row to come */
+	for(y = trim_section->Y_Start; y <= trim_section->Y_End; y++)
+	{
+		memmove(frame+(((size_t)(y-trim_section->Y_Start))*width),
+			frame+(((size_t)y)*naxis1)+trim_section->X_Start,width*sizeof(float));
+	}
+}
+
+/**
+ * Free the bias levels of a model fitted by DpRt_Overscan_Fit. It is safe to call this on a model that was not
+ * fitted, as long as Level is NULL.
+ * @param overscan The address of the model.
+ */
+void DpRt_Overscan_Free(struct DpRt_Overscan_Struct *overscan)
+{
+	if(overscan == NULL)
+		return;
+	if(overscan->Level != NULL)
+		free(overscan->Level);
+	overscan->Level = NULL;
+	overscan->Length = 0;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Smooth a vector with a boxcar. The boxcar is shortened at the ends of the vector, so each output value is the
+ * mean of the input values within half_width either side that exist.
+ * @param input The vector to smooth, count values.
+ * @param count The number of values.
+ * @param half_width The number of values either side included in each mean.
+ * @param output The smoothed vector is written here, count values. This must not be input.
+ */
+static void Overscan_Smooth(float *input,int count,int half_width,float *output)
+{
+	double sum;
+	int low,high,i;
+
+	sum = 0.0;
+	low = 0;
+	high = -1;
+	for(i = 0; i < count; i++)
+	{
+		/* slide the window [i-half_width,i+half_width] along, clipped to the vector */
+		while((high < count-1)&&(high < i+half_width))
+			sum += input[++high];
+		while(low < i-half_width)
+			sum -= input[low++];
+		output[i] = (float)(sum/(high-low+1));
+	}
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
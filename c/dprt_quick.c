@@ -0,0 +1,804 @@
+/* dprt_quick.c
+** Quick, low latency reduction of FTSpec expose frames
+** $Header$
+*/
+/**
+ * dprt_quick.c implements the QUICK_REDUCTION mode of DpRt_Expose_Reduce. Rather than reading the whole frame,
+ * a decimated subset (every Quick_Decimation'th column of every Quick_Decimation'th row) is read. The spatial
+ * profile of the subset is used to find the spectrum, its centre and width, and a few full resolution rows
+ * across the spectrum are then read to measure the peak counts and saturation. Elapsed time is checked
+ * throughout; if the time budget is running out the sampling is made coarser, and the full resolution
+ * refinement is skipped, so the routine returns within the budget. The cfitsio lock is taken around each cfitsio
+ * call after the budget's clock has started, so time spent waiting for another thread's cfitsio calls counts
+ * against the budget, and the sampling is made coarser to make up for it.
+ * The frame is either read from a FITS file through cfitsio, or sampled directly from an image already in memory.
+ * The dispersion axis is along NAXIS1 (columns), the spatial axis along NAXIS2 (rows).
+ * If overscan correction is configured, only the TRIMSEC region of a FITS file is sampled, and the bias level
+ * fitted to its overscan region (BIASSEC) is subtracted from the peak counts, so the counts are bias corrected
+ * without a master bias being read.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fitsio.h"
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_fits.h"
+#include "dprt_combine.h"
+#include "dprt_config.h"
+#include "dprt_kernel.h"
+#include "dprt_overscan.h"
+#include "dprt_quick.h"
+#include "dprt_abort.h"
+#include "dprt_context.h"
+#include "dprt_metrics.h"
+#include "dprt_log.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The number of decimated pixels read by each call to fits_read_subset.
+ */
+#define QUICK_STRIP_PIXELS		(DPRT_FITS_BLOCK_PIXELS)
+/**
+ * The fraction of the time budget after which the decimated read makes its row sampling coarser.
+ */
+#define QUICK_READ_BUDGET_FRACTION	(0.5)
+/**
+ * The fraction of the time budget after which the full resolution refinement is skipped, or stopped early.
+ */
+#define QUICK_REFINE_BUDGET_FRACTION	(0.75)
+/**
+ * The number of pixels in each block of full resolution rows scanned by the refinement. The time budget is
+ * checked between blocks.
+ */
+#define QUICK_REFINE_BLOCK_PIXELS	(DPRT_FITS_BLOCK_PIXELS)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure describing where the frame's pixels come from.
+ * <dl>
+ * <dt>Fits_Fp</dt> <dd>The open cfitsio file pointer, or NULL if the frame is in memory.</dd>
+ * <dt>Pixels</dt> <dd>The frame's pixels, Naxis2 rows of Naxis1 pixels, or NULL if the frame is read through
+ *     cfitsio.</dd>
+ * <dt>Pixel_Format</dt> <dd>The format of Pixels, a DPRT_KERNEL_PIXEL_FORMAT value.</dd>
+ * <dt>Naxis1</dt> <dd>The number of columns in the frame.</dd>
+ * <dt>Naxis2</dt> <dd>The number of rows in the frame.</dd>
+ * <dt>Trim_Section</dt> <dd>The region of the frame sampled, the whole frame unless it has been trimmed.</dd>
+ * <dt>Bias_Level</dt> <dd>The overscan bias level subtracted from the peak counts, or 0.0.</dd>
+ * </dl>
+ * @see dprt_kernel.h#DPRT_KERNEL_PIXEL_FORMAT
+ */
+struct Quick_Source_Struct
+{
+	fitsfile *Fits_Fp;
+	unsigned short *Pixels;
+	int Pixel_Format;
+	int Naxis1;
+	int Naxis2;
+	struct DpRt_Fits_Section_Struct Trim_Section;
+	double Bias_Level;
+};
+
+/**
+ * Structure holding the decimated subset of a frame.
+ * <dl>
+ * <dt>Column_Step</dt> <dd>The spacing of the sampled columns.</dd>
+ * <dt>Column_Count</dt> <dd>The number of sampled columns in each sampled row.</dd>
+ * <dt>Row_Count</dt> <dd>The number of sampled rows.</dd>
+ * <dt>Row_List</dt> <dd>The frame row (0 based) of each sampled row. The rows are in increasing order, but
+ *     not necessarily evenly spaced.</dd>
+ * <dt>Data</dt> <dd>The sampled pixels, Row_Count rows of Column_Count pixels.</dd>
+ * </dl>
+ */
+struct Quick_Subset_Struct
+{
+	int Column_Step;
+	int Column_Count;
+	int Row_Count;
+	int *Row_List;
+	unsigned short *Data;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Quick_Reduce(struct Quick_Source_Struct *source,struct DpRt_Config_Struct *config,
+			struct timespec *start_time,struct DpRt_Quick_Result_Struct *result);
+static int Quick_Overscan_Get(struct Quick_Source_Struct *source,struct DpRt_Config_Struct *config);
+static int Quick_Subset_Read(struct Quick_Source_Struct *source,struct DpRt_Config_Struct *config,
+			     struct timespec *start_time,struct Quick_Subset_Struct *subset,int *degraded);
+static void Quick_Subset_Copy(struct Quick_Source_Struct *source,int first_row,int row_count,int row_step,
+			      int column_step,int column_count,unsigned short *data);
+static int Quick_Profile_Measure(struct Quick_Subset_Struct *subset,struct DpRt_Fits_Section_Struct *trim_section,
+				 double saturation_level,struct DpRt_Quick_Result_Struct *result,int *first_row,
+				 int *last_row,int *peak_row);
+static int Quick_Refine(struct Quick_Source_Struct *source,struct DpRt_Config_Struct *config,
+			struct timespec *start_time,int first_row,int last_row,int peak_row,
+			struct DpRt_Quick_Result_Struct *result);
+static int Quick_Refine_Block(struct Quick_Source_Struct *source,int first_row,int row_count,
+			      unsigned short *buffer,struct DpRt_Quick_Result_Struct *result);
+static double Quick_Elapsed_Time_Get(struct timespec *start_time);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Do a quick reduction of an expose frame within the configured time budget. The routine takes the cfitsio lock
+ * itself, around each cfitsio call, so the caller must not hold it.
+ * @param filename The FITS filename to reduce.
+ * @param config The configuration snapshot to use, giving the time budget, decimation factor,
+ *        saturation level and whether to correct the overscan.
+ * @param result The address of a structure to fill in with the results.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Quick_Source_Struct
+ * @see #Quick_Reduce
+ * @see #Quick_Overscan_Get
+ * @see dprt_fits.html#DpRt_Fits_Image_Open
+ * @see dprt_fits.html#DpRt_Fits_Image_Close
+ * @see dprt_fits.html#DpRt_Fits_Lock
+ * @see dprt_fits.html#DpRt_Fits_Unlock
+ * @see dprt_metrics.html#DpRt_Metrics_Timer_Stop
+ */
+int DpRt_Quick_Reduce(char *filename,struct DpRt_Config_Struct *config,struct DpRt_Quick_Result_Struct *result)
+{
+	struct Quick_Source_Struct source;
+	struct timespec start_time,stage_start_time;
+	int retval;
+
+	if((filename == NULL)||(config == NULL)||(result == NULL))
+	{
+		DpRt_Error_Number = 700;
+		strcpy(DpRt_Error_String,"DpRt_Quick_Reduce:Parameter was NULL.");
+		return FALSE;
+	}
+	clock_gettime(CLOCK_MONOTONIC,&start_time);
+	memset(result,0,sizeof(struct DpRt_Quick_Result_Struct));
+	source.Fits_Fp = NULL;
+	source.Pixels = NULL;
+	source.Pixel_Format = DPRT_KERNEL_PIXEL_FORMAT_NATIVE;
+	DpRt_Metrics_Timer_Start(&stage_start_time);
+	DpRt_Fits_Lock();
+	retval = DpRt_Fits_Image_Open(filename,&(source.Fits_Fp),&(source.Naxis1),&(source.Naxis2));
+	DpRt_Fits_Unlock();
+	if(!retval)
+		return FALSE;
+	DpRt_Metrics_Timer_Stop(DPRT_METRICS_STAGE_OPEN,&stage_start_time);
+	DpRt_Metrics_Timer_Start(&stage_start_time);
+	retval = Quick_Overscan_Get(&source,config);
+	if(retval)
+		retval = Quick_Reduce(&source,config,&start_time,result);
+	if(retval)
+		DpRt_Metrics_Timer_Stop(DPRT_METRICS_STAGE_QUICK,&stage_start_time);
+	DpRt_Fits_Lock();
+	if(retval)
+		retval = DpRt_Fits_Image_Close(source.Fits_Fp);
+	else
+		DpRt_Fits_Image_Close(source.Fits_Fp);
+	DpRt_Fits_Unlock();
+	if(!retval)
+		return FALSE;
+	result->Elapsed_Time = Quick_Elapsed_Time_Get(&start_time);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Quick_Reduce:%s:Counts:%.1f:Position:(%.2f,%.2f):FWHM:%.2f:Saturated:%d:"
+		"Degraded:%d:Took %.1f ms.",filename,result->Counts,result->X_Pix,result->Y_Pix,result->Fwhm,
+		result->Saturated,result->Degraded,result->Elapsed_Time);
+	return TRUE;
+}
+
+/**
+ * Do a quick reduction of an expose frame already in memory, within the configured time budget. The decimated
+ * subset and the full resolution rows are sampled directly from the caller's pixels, which are not copied or
+ * modified. No cfitsio routines are called, so the cfitsio lock need not be held.
+ * @param pixels The frame's pixels, naxis2 rows of naxis1 pixels.
+ * @param naxis1 The number of columns in the frame.
+ * @param naxis2 The number of rows in the frame.
+ * @param pixel_format The format of the pixels, a DPRT_KERNEL_PIXEL_FORMAT value.
+ * @param config The configuration snapshot to use, giving the time budget, decimation factor and
+ *        saturation level.
+ * @param result The address of a structure to fill in with the results.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Quick_Source_Struct
+ * @see #Quick_Reduce
+ * @see dprt_kernel.h#DPRT_KERNEL_PIXEL_FORMAT
+ * @see dprt_metrics.html#DpRt_Metrics_Timer_Stop
+ */
+int DpRt_Quick_Reduce_Buffer(unsigned short *pixels,int naxis1,int naxis2,int pixel_format,
+			     struct DpRt_Config_Struct *config,struct DpRt_Quick_Result_Struct *result)
+{
+	struct Quick_Source_Struct source;
+	struct timespec start_time,stage_start_time;
+
+	if((pixels == NULL)||(config == NULL)||(result == NULL))
+	{
+		DpRt_Error_Number = 704;
+		strcpy(DpRt_Error_String,"DpRt_Quick_Reduce_Buffer:Parameter was NULL.");
+		return FALSE;
+	}
+	if((naxis1 < 1)||(naxis2 < 1)||((pixel_format != DPRT_KERNEL_PIXEL_FORMAT_NATIVE)&&
+					  (pixel_format != DPRT_KERNEL_PIXEL_FORMAT_FITS)))
+	{
+		DpRt_Error_Number = 705;
+		sprintf(DpRt_Error_String,"DpRt_Quick_Reduce_Buffer:Illegal frame(%d,%d,%d).",naxis1,naxis2,
+			pixel_format);
+		return FALSE;
+	}
+	clock_gettime(CLOCK_MONOTONIC,&start_time);
+	memset(result,0,sizeof(struct DpRt_Quick_Result_Struct));
+	source.Fits_Fp = NULL;
+	source.Pixels = pixels;
+	source.Pixel_Format = pixel_format;
+	source.Naxis1 = naxis1;
+	source.Naxis2 = naxis2;
+	source.Trim_Section.X_Start = 0;
+	source.Trim_Section.X_End = naxis1-1;
+	source.Trim_Section.Y_Start = 0;
+	source.Trim_Section.Y_End = naxis2-1;
+	source.Bias_Level = 0.0;
+	DpRt_Metrics_Timer_Start(&stage_start_time);
+	if(!Quick_Reduce(&source,config,&start_time,result))
+		return FALSE;
+	DpRt_Metrics_Timer_Stop(DPRT_METRICS_STAGE_QUICK,&stage_start_time);
+	result->Elapsed_Time = Quick_Elapsed_Time_Get(&start_time);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Quick_Reduce_Buffer:(%d,%d):Counts:%.1f:Position:(%.2f,%.2f):"
+		"FWHM:%.2f:Saturated:%d:Degraded:%d:Took %.1f ms.",naxis1,naxis2,result->Counts,result->X_Pix,
+		result->Y_Pix,result->Fwhm,result->Saturated,result->Degraded,result->Elapsed_Time);
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Measure the spectrum from a decimated subset of the frame, and refine the peak counts from a few full resolution
+ * rows if the time budget allows. The source's bias level is subtracted from the peak counts, once the
+ * saturation flag has been set from the raw counts.
+ * @param source The source of the frame's pixels.
+ * @param config The configuration snapshot.
+ * @param start_time The time the quick reduction started.
+ * @param result The address of a structure to fill in with the results, cleared by the caller.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Quick_Subset_Read
+ * @see #Quick_Profile_Measure
+ * @see #Quick_Refine
+ */
+static int Quick_Reduce(struct Quick_Source_Struct *source,struct DpRt_Config_Struct *config,
+			struct timespec *start_time,struct DpRt_Quick_Result_Struct *result)
+{
+	struct Quick_Subset_Struct subset;
+	int first_row,last_row,peak_row,found,retval;
+
+	subset.Row_List = NULL;
+	subset.Data = NULL;
+	retval = Quick_Subset_Read(source,config,start_time,&subset,&(result->Degraded));
+	found = FALSE;
+	if(retval)
+		found = Quick_Profile_Measure(&subset,&(source->Trim_Section),config->Saturation_Level,result,
+					      &first_row,&last_row,&peak_row);
+	if(retval && found)
+	{
+		if(Quick_Elapsed_Time_Get(start_time) < (config->Quick_Time_Budget*QUICK_REFINE_BUDGET_FRACTION))
+			retval = Quick_Refine(source,config,start_time,first_row,last_row,peak_row,result);
+		else
+			result->Degraded = TRUE;
+	}
+	if(retval && found)
+		result->Counts -= source->Bias_Level;
+	if(subset.Row_List != NULL)
+		free(subset.Row_List);
+	if(subset.Data != NULL)
+		free(subset.Data);
+	return retval;
+}
+
+/**
+ * Get the trim section and overscan bias level of a frame being quick reduced from a FITS file. The whole frame
+ * is sampled, and no bias level subtracted, unless overscan correction is configured. The bias level is the mean
+ * of the bias model fitted to the overscan region, which is read at full resolution.
+ * @param source The source of the frame's pixels, with Fits_Fp, Naxis1 and Naxis2 set. Trim_Section and
+ *        Bias_Level are filled in.
+ * @param config The configuration snapshot.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see dprt_fits.html#DpRt_Fits_Sections_Read
+ * @see dprt_overscan.html#DpRt_Overscan_Fit
+ * @see dprt_overscan.html#DpRt_Overscan_Level_Mean
+ */
+static int Quick_Overscan_Get(struct Quick_Source_Struct *source,struct DpRt_Config_Struct *config)
+{
+	struct DpRt_Fits_Header_Struct header;
+	struct DpRt_Overscan_Struct overscan;
+	struct DpRt_Fits_Section_Struct *section = NULL;
+	char buff[FLEN_STATUS];
+	float *data = NULL;
+	long first_pixel[2];
+	long last_pixel[2];
+	long increment[2];
+	int width,height,retval,status = 0;
+
+	source->Trim_Section.X_Start = 0;
+	source->Trim_Section.X_End = source->Naxis1-1;
+	source->Trim_Section.Y_Start = 0;
+	source->Trim_Section.Y_End = source->Naxis2-1;
+	source->Bias_Level = 0.0;
+	if(!config->Overscan_Correct)
+		return TRUE;
+	header.Naxis1 = source->Naxis1;
+	header.Naxis2 = source->Naxis2;
+	DpRt_Fits_Lock();
+	retval = DpRt_Fits_Sections_Read(source->Fits_Fp,&header);
+	DpRt_Fits_Unlock();
+	if(!retval)
+		return FALSE;
+	if(header.Trim_Section_Found)
+		source->Trim_Section = header.Trim_Section;
+	if(!header.Bias_Section_Found)
+		return TRUE;
+	section = &(header.Bias_Section);
+	width = section->X_End-section->X_Start+1;
+	height = section->Y_End-section->Y_Start+1;
+	data = (float *)malloc(((size_t)width)*height*sizeof(float));
+	if(data == NULL)
+	{
+		DpRt_Error_Number = 706;
+		sprintf(DpRt_Error_String,"Quick_Overscan_Get:Failed to allocate overscan region(%d,%d).",width,height);
+		return FALSE;
+	}
+	/* cfitsio subset pixel coordinates are 1 based and inclusive */
+	first_pixel[0] = section->X_Start+1;
+	first_pixel[1] = section->Y_Start+1;
+	last_pixel[0] = section->X_End+1;
+	last_pixel[1] = section->Y_End+1;
+	increment[0] = 1;
+	increment[1] = 1;
+	DpRt_Fits_Lock();
+	fits_read_subset(source->Fits_Fp,TFLOAT,first_pixel,last_pixel,increment,NULL,data,NULL,&status);
+	DpRt_Fits_Unlock();
+	if(status)
+	{
+		free(data);
+		fits_get_errstatus(status,buff);
+		fits_report_error(stderr,status);
+		DpRt_Error_Number = 707;
+		sprintf(DpRt_Error_String,"Quick_Overscan_Get:Reading overscan region failed:%s.",buff);
+		return FALSE;
+	}
+	if(!DpRt_Overscan_Fit(data,width,section,config->Overscan_Smooth,&overscan))
+	{
+		free(data);
+		return FALSE;
+	}
+	free(data);
+	source->Bias_Level = DpRt_Overscan_Level_Mean(&overscan);
+	DpRt_Overscan_Free(&overscan);
+	return TRUE;
+}
+
+/**
+ * Read a decimated subset of the source's trim section of the frame, a strip of sampled rows at a time. If more
+ * than QUICK_READ_BUDGET_FRACTION of the time budget has been used before the whole section has been sampled,
+ * the row spacing is doubled for the remaining strips. The abort flag is polled before each strip is read.
+ * @param source The source of the frame's pixels.
+ * @param config The configuration snapshot.
+ * @param start_time The time the quick reduction started.
+ * @param subset The address of a subset structure to fill in. Row_List and Data are allocated here, and
+ *        should be freed by the caller (even on failure).
+ * @param degraded The address of an integer, set to TRUE if the row spacing was increased.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #QUICK_STRIP_PIXELS
+ * @see #QUICK_READ_BUDGET_FRACTION
+ * @see #Quick_Subset_Copy
+ * @see dprt_abort.html#DpRt_Abort_Check
+ */
+static int Quick_Subset_Read(struct Quick_Source_Struct *source,struct DpRt_Config_Struct *config,
+			     struct timespec *start_time,struct Quick_Subset_Struct *subset,int *degraded)
+{
+	char buff[FLEN_STATUS];
+	long first_pixel[2];
+	long last_pixel[2];
+	long increment[2];
+	int naxis1,naxis2,row,row_step,strip_rows,rows_left,i,status = 0;
+
+	/* the dimensions of the trim section */
+	naxis1 = source->Trim_Section.X_End-source->Trim_Section.X_Start+1;
+	naxis2 = source->Trim_Section.Y_End-source->Trim_Section.Y_Start+1;
+
+	subset->Column_Step = config->Quick_Decimation;
+	if(subset->Column_Step > naxis1)
+		subset->Column_Step = naxis1;
+	row_step = config->Quick_Decimation;
+	if(row_step > naxis2)
+		row_step = naxis2;
+	subset->Column_Count = ((naxis1-1)/subset->Column_Step)+1;
+	subset->Row_Count = 0;
+	subset->Row_List = (int *)malloc((((naxis2-1)/row_step)+1)*sizeof(int));
+	subset->Data = (unsigned short *)malloc(((size_t)(((naxis2-1)/row_step)+1))*subset->Column_Count*
+						sizeof(unsigned short));
+	if((subset->Row_List == NULL)||(subset->Data == NULL))
+	{
+		DpRt_Error_Number = 701;
+		sprintf(DpRt_Error_String,"Quick_Subset_Read:Failed to allocate subset(%d,%d).",
+			subset->Column_Count,((naxis2-1)/row_step)+1);
+		return FALSE;
+	}
+	strip_rows = QUICK_STRIP_PIXELS/subset->Column_Count;
+	if(strip_rows < 1)
+		strip_rows = 1;
+	row = source->Trim_Section.Y_Start;
+	while(row <= source->Trim_Section.Y_End)
+	{
+		if(!DpRt_Abort_Check("Quick_Subset_Read"))
+			return FALSE;
+		rows_left = ((source->Trim_Section.Y_End-row)/row_step)+1;
+		if(rows_left > strip_rows)
+			rows_left = strip_rows;
+		/* cfitsio subset pixel coordinates are 1 based and inclusive */
+		first_pixel[0] = source->Trim_Section.X_Start+1;
+		first_pixel[1] = row+1;
+		last_pixel[0] = source->Trim_Section.X_End+1;
+		last_pixel[1] = row+((rows_left-1)*row_step)+1;
+		increment[0] = subset->Column_Step;
+		increment[1] = row_step;
+		if(source->Pixels != NULL)
+		{
+			Quick_Subset_Copy(source,row,rows_left,row_step,subset->Column_Step,subset->Column_Count,
+					  subset->Data+(((size_t)subset->Row_Count)*subset->Column_Count));
+		}
+		else
+		{
+			DpRt_Fits_Lock();
+			fits_read_subset(source->Fits_Fp,TUSHORT,first_pixel,last_pixel,increment,NULL,
+					 subset->Data+(((size_t)subset->Row_Count)*subset->Column_Count),NULL,&status);
+			DpRt_Fits_Unlock();
+		}
+		if(status)
+		{
+			fits_get_errstatus(status,buff);
+			fits_report_error(stderr,status);
+			DpRt_Error_Number = 702;
+			sprintf(DpRt_Error_String,"Quick_Subset_Read:Reading rows %d to %ld failed:%s.",row,
+				last_pixel[1]-1,buff);
+			return FALSE;
+		}
+		for(i = 0; i < rows_left; i++)
+		{
+			subset->Row_List[subset->Row_Count] = row+(i*row_step);
+			subset->Row_Count++;
+		}
+		row += rows_left*row_step;
+		if((row <= source->Trim_Section.Y_End)&&
+		   (Quick_Elapsed_Time_Get(start_time) > (config->Quick_Time_Budget*QUICK_READ_BUDGET_FRACTION)))
+		{
+			row_step *= 2;
+			(*degraded) = TRUE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Copy a strip of decimated rows of the trim section from a frame in memory, in the same layout fits_read_subset
+ * uses. FITS format pixels are byte swapped and have BZERO applied as they are copied.
+ * @param source The source of the frame's pixels, with Pixels set.
+ * @param first_row The frame row (0 based) of the first sampled row.
+ * @param row_count The number of sampled rows to copy.
+ * @param row_step The spacing of the sampled rows.
+ * @param column_step The spacing of the sampled columns.
+ * @param column_count The number of sampled columns in each sampled row.
+ * @param data Where to copy the sampled pixels, row_count rows of column_count pixels.
+ * @see dprt_kernel.h#DPRT_KERNEL_FITS_PIXEL
+ */
+static void Quick_Subset_Copy(struct Quick_Source_Struct *source,int first_row,int row_count,int row_step,
+			      int column_step,int column_count,unsigned short *data)
+{
+	unsigned short *row_pixels = NULL;
+	int i,column;
+
+	for(i = 0; i < row_count; i++)
+	{
+		row_pixels = source->Pixels+(((size_t)(first_row+(i*row_step)))*source->Naxis1)+
+			source->Trim_Section.X_Start;
+		if(source->Pixel_Format == DPRT_KERNEL_PIXEL_FORMAT_FITS)
+		{
+			for(column = 0; column < column_count; column++)
+				data[column] = DPRT_KERNEL_FITS_PIXEL(row_pixels+(column*column_step));
+		}
+		else
+		{
+			for(column = 0; column < column_count; column++)
+				data[column] = row_pixels[column*column_step];
+		}
+		data += column_count;
+	}
+}
+
+/**
+ * Find the spectrum in the decimated subset and measure it. The spatial profile is the mean of each sampled row,
+ * and the background level is the median of the profile. The spectrum is the peak of the profile; its
+ * FWHM and centre are measured from the profile, its centre along the dispersion axis from the
+ * background subtracted peak row.
+ * @param subset The decimated subset.
+ * @param trim_section The region of the frame the subset was sampled from.
+ * @param saturation_level The number of counts at or above which a pixel is saturated.
+ * @param result The address of a result structure to fill in.
+ * @param first_row The address of an integer, set to the first frame row (0 based) that should be
+ *        searched at full resolution for the peak counts.
+ * @param last_row The address of an integer, set to the last frame row that should be searched.
+ * @param peak_row The address of an integer, set to the frame row of the peak of the profile.
+ * @return The routine returns TRUE if a spectrum was found, and FALSE if the profile is flat.
+ *         This routine does not fail.
+ * @see dprt_combine.html#DpRt_Combine_Median_Float
+ */
+static int Quick_Profile_Measure(struct Quick_Subset_Struct *subset,struct DpRt_Fits_Section_Struct *trim_section,
+				 double saturation_level,struct DpRt_Quick_Result_Struct *result,int *first_row,
+				 int *last_row,int *peak_row)
+{
+	unsigned short *row_data = NULL;
+	float *profile = NULL;
+	float *sorted_profile = NULL;
+	double sum,weight,weighted_sum,background,half_maximum,low_edge,high_edge;
+	int peak_index,low_index,high_index,i,j;
+
+	profile = (float *)malloc(subset->Row_Count*2*sizeof(float));
+	if(profile == NULL)
+		return FALSE;
+	sorted_profile = profile+subset->Row_Count;
+	for(i = 0; i < subset->Row_Count; i++)
+	{
+		row_data = subset->Data+(((size_t)i)*subset->Column_Count);
+		sum = 0.0;
+		for(j = 0; j < subset->Column_Count; j++)
+			sum += row_data[j];
+		profile[i] = (float)(sum/subset->Column_Count);
+		sorted_profile[i] = profile[i];
+	}
+	background = DpRt_Combine_Median_Float(sorted_profile,subset->Row_Count);
+	peak_index = 0;
+	for(i = 1; i < subset->Row_Count; i++)
+	{
+		if(profile[i] > profile[peak_index])
+			peak_index = i;
+	}
+	if(profile[peak_index] <= background)
+	{
+		free(profile);
+		return FALSE;
+	}
+	/* find the half maximum points either side of the peak, interpolating between sampled rows */
+	half_maximum = (profile[peak_index]-background)/2.0;
+	low_index = peak_index;
+	while((low_index > 0)&&((profile[low_index-1]-background) > half_maximum))
+		low_index--;
+	high_index = peak_index;
+	while((high_index < subset->Row_Count-1)&&((profile[high_index+1]-background) > half_maximum))
+		high_index++;
+	low_edge = subset->Row_List[low_index];
+	if(low_index > 0)
+	{
+		low_edge -= (subset->Row_List[low_index]-subset->Row_List[low_index-1])*
+			((profile[low_index]-background)-half_maximum)/(profile[low_index]-profile[low_index-1]);
+	}
+	high_edge = subset->Row_List[high_index];
+	if(high_index < subset->Row_Count-1)
+	{
+		high_edge += (subset->Row_List[high_index+1]-subset->Row_List[high_index])*
+			((profile[high_index]-background)-half_maximum)/(profile[high_index]-profile[high_index+1]);
+	}
+	result->Fwhm = high_edge-low_edge;
+	/* spatial centre, flux weighted over the rows above half maximum */
+	weight = 0.0;
+	weighted_sum = 0.0;
+	for(i = low_index; i <= high_index; i++)
+	{
+		weight += profile[i]-background;
+		weighted_sum += (profile[i]-background)*subset->Row_List[i];
+	}
+	result->Y_Pix = (weighted_sum/weight)+1.0;
+	/* dispersion centre and peak counts, from the peak row */
+	row_data = subset->Data+(((size_t)peak_index)*subset->Column_Count);
+	weight = 0.0;
+	weighted_sum = 0.0;
+	for(j = 0; j < subset->Column_Count; j++)
+	{
+		if(row_data[j] > background)
+		{
+			weight += row_data[j]-background;
+			weighted_sum += (row_data[j]-background)*((double)j*subset->Column_Step);
+		}
+	}
+	if(weight > 0.0)
+		result->X_Pix = (weighted_sum/weight)+trim_section->X_Start+1.0;
+	else
+		result->X_Pix = ((trim_section->X_Start+trim_section->X_End)/2.0)+1.0;
+	result->Counts = 0.0;
+	for(i = low_index; i <= high_index; i++)
+	{
+		row_data = subset->Data+(((size_t)i)*subset->Column_Count);
+		for(j = 0; j < subset->Column_Count; j++)
+		{
+			if(row_data[j] > result->Counts)
+				result->Counts = row_data[j];
+		}
+	}
+	result->Saturated = (result->Counts >= saturation_level);
+	/* search the rows between the sampled rows either side of the half maximum points */
+	if(low_index > 0)
+		(*first_row) = subset->Row_List[low_index-1]+1;
+	else
+		(*first_row) = trim_section->Y_Start;
+	if(high_index < subset->Row_Count-1)
+		(*last_row) = subset->Row_List[high_index+1]-1;
+	else
+		(*last_row) = subset->Row_List[high_index];
+	(*peak_row) = subset->Row_List[peak_index];
+	free(profile);
+	return TRUE;
+}
+
+/**
+ * Read the rows across the spectrum at full resolution, and update the peak counts and saturation
+ * flag from them. Decimation can miss the brightest (and saturated) pixels, reading these rows does not.
+ * The rows are scanned in blocks of QUICK_REFINE_BLOCK_PIXELS pixels, starting with the block around the peak
+ * row and working outwards. A broad profile (e.g. a sky dominated frame) can span most of the frame, so the time
+ * budget is checked between blocks; if it runs out the remaining rows are not scanned and the result is marked
+ * as degraded.
+ * @param source The source of the frame's pixels.
+ * @param config The configuration snapshot.
+ * @param start_time The time the quick reduction started.
+ * @param first_row The first frame row (0 based) to read.
+ * @param last_row The last frame row to read.
+ * @param peak_row The frame row of the peak of the profile, between first_row and last_row.
+ * @param result The address of a result structure to update.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #QUICK_REFINE_BLOCK_PIXELS
+ * @see #QUICK_REFINE_BUDGET_FRACTION
+ * @see #Quick_Refine_Block
+ * @see #Quick_Elapsed_Time_Get
+ */
+static int Quick_Refine(struct Quick_Source_Struct *source,struct DpRt_Config_Struct *config,
+			struct timespec *start_time,int first_row,int last_row,int peak_row,
+			struct DpRt_Quick_Result_Struct *result)
+{
+	unsigned short *buffer = NULL;
+	int block_rows,low_row,high_row,row_count,upward,retval;
+
+	block_rows = QUICK_REFINE_BLOCK_PIXELS/source->Naxis1;
+	if(block_rows < 1)
+		block_rows = 1;
+	if(block_rows > last_row-first_row+1)
+		block_rows = last_row-first_row+1;
+	if(source->Pixels == NULL)
+	{
+		buffer = (unsigned short *)malloc(((size_t)block_rows)*source->Naxis1*sizeof(unsigned short));
+		if(buffer == NULL)
+		{
+			DpRt_Error_Number = 703;
+			sprintf(DpRt_Error_String,"Quick_Refine:Failed to allocate buffer(%d,%d).",source->Naxis1,
+				block_rows);
+			return FALSE;
+		}
+	}
+	/* the block around the peak row first */
+	low_row = peak_row-(block_rows/2);
+	if(low_row > last_row-block_rows+1)
+		low_row = last_row-block_rows+1;
+	if(low_row < first_row)
+		low_row = first_row;
+	high_row = low_row+block_rows-1;
+	retval = Quick_Refine_Block(source,low_row,block_rows,buffer,result);
+	/* then the blocks either side in turn, while the time budget allows */
+	upward = TRUE;
+	while(retval && ((low_row > first_row)||(high_row < last_row)))
+	{
+		if(Quick_Elapsed_Time_Get(start_time) > (config->Quick_Time_Budget*QUICK_REFINE_BUDGET_FRACTION))
+		{
+			result->Degraded = TRUE;
+			break;
+		}
+		if((high_row < last_row)&&(upward||(low_row <= first_row)))
+		{
+			row_count = last_row-high_row;
+			if(row_count > block_rows)
+				row_count = block_rows;
+			retval = Quick_Refine_Block(source,high_row+1,row_count,buffer,result);
+			high_row += row_count;
+		}
+		else
+		{
+			row_count = low_row-first_row;
+			if(row_count > block_rows)
+				row_count = block_rows;
+			retval = Quick_Refine_Block(source,low_row-row_count,row_count,buffer,result);
+			low_row -= row_count;
+		}
+		upward = !upward;
+	}
+	result->Saturated = (result->Counts >= config->Saturation_Level);
+	if(buffer != NULL)
+		free(buffer);
+	return retval;
+}
+
+/**
+ * Scan a block of full resolution rows for the peak counts. Rows of a frame in memory are scanned in place,
+ * otherwise they are read through cfitsio into buffer. Only the columns of the source's trim section are scanned.
+ * @param source The source of the frame's pixels.
+ * @param first_row The first frame row (0 based) of the block.
+ * @param row_count The number of rows in the block.
+ * @param buffer A buffer of at least row_count rows, used if the frame is read through cfitsio.
+ * @param result The address of a result structure, whose Counts are updated.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see dprt_fits.html#DpRt_Fits_Image_Read_Rows
+ * @see dprt_kernel.h#DPRT_KERNEL_FITS_PIXEL
+ */
+static int Quick_Refine_Block(struct Quick_Source_Struct *source,int first_row,int row_count,
+			      unsigned short *buffer,struct DpRt_Quick_Result_Struct *result)
+{
+	unsigned short *row_pixels = NULL;
+	long i;
+	int naxis1,row,value,retval;
+
+	naxis1 = source->Naxis1;
+	if(source->Pixels != NULL)
+	{
+		buffer = source->Pixels+(((size_t)first_row)*naxis1);
+		for(row = 0; row < row_count; row++)
+		{
+			row_pixels = buffer+(((size_t)row)*naxis1);
+			for(i = source->Trim_Section.X_Start; i <= source->Trim_Section.X_End; i++)
+			{
+				if(source->Pixel_Format == DPRT_KERNEL_PIXEL_FORMAT_FITS)
+					value = DPRT_KERNEL_FITS_PIXEL(row_pixels+i);
+				else
+					value = row_pixels[i];
+				if(value > result->Counts)
+					result->Counts = value;
+			}
+		}
+		return TRUE;
+	}
+	DpRt_Fits_Lock();
+	retval = DpRt_Fits_Image_Read_Rows(source->Fits_Fp,naxis1,first_row,row_count,buffer);
+	DpRt_Fits_Unlock();
+	if(!retval)
+		return FALSE;
+	for(row = 0; row < row_count; row++)
+	{
+		row_pixels = buffer+(((size_t)row)*naxis1);
+		for(i = source->Trim_Section.X_Start; i <= source->Trim_Section.X_End; i++)
+		{
+			if(row_pixels[i] > result->Counts)
+				result->Counts = row_pixels[i];
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Get the time elapsed since start_time.
+ * @param start_time The start time, from the monotonic clock.
+ * @return The elapsed time in milliseconds.
+ */
+static double Quick_Elapsed_Time_Get(struct timespec *start_time)
+{
+	struct timespec current_time;
+
+	clock_gettime(CLOCK_MONOTONIC,&current_time);
+	return ((current_time.tv_sec-start_time->tv_sec)*1000.0)+
+		((current_time.tv_nsec-start_time->tv_nsec)/1000000.0);
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
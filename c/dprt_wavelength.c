@@ -0,0 +1,945 @@
+/* dprt_wavelength.c
+** Arc lamp wavelength calibration for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_wavelength.c fits a wavelength (dispersion) solution to an arc lamp frame, and keeps the latest solution
+ * for each binning in memory, so expose frames can be wavelength calibrated without refitting.
+ * <ul>
+ * <li>The arc frame is averaged along the spatial axis, over the illuminated part of the slit, to give an
+ *     arc spectrum.
+ * <li>Emission lines are detected in the arc spectrum, and their centres measured.
+ * <li>The lines are matched to the reference wavelengths in the line list file, starting from the configured
+ *     nominal dispersion. The zero point and scale of the nominal dispersion are first searched for the
+ *     combination that matches the most of the brightest lines.
+ * <li>A polynomial is fitted to the matched lines, the lines are re-matched using the fitted solution, and the
+ *     fit repeated with outlying lines clipped.
+ * </ul>
+ * When a solution is stored, the wavelength of every column is computed once into a lookup table.
+ * DpRt_Wavelength_Lut_Get copies this table for each expose frame, so applying the solution costs no more
+ * than a copy.
+ * The dispersion axis is along NAXIS1 (columns), the spatial axis along NAXIS2 (rows).
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_fits.h"
+#include "dprt_kernel.h"
+#include "dprt_combine.h"
+#include "dprt_config.h"
+#include "dprt_wavelength.h"
+#include "dprt_overscan.h"
+#include "dprt_abort.h"
+#include "dprt_context.h"
+#include "dprt_log.h"
+
+/* ------------------------------------------------------- */
+/* hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The number of standard deviations (of the arc spectrum about its median) a line's peak must be above the
+ * background to be detected.
+ */
+#define WAVELENGTH_DETECT_SIGMA			(5.0)
+/**
+ * A line's peak must be the brightest pixel within this many columns either side of it.
+ */
+#define WAVELENGTH_LINE_SEPARATION		(3)
+/**
+ * The maximum number of (the brightest) detected lines used to fit the solution.
+ */
+#define WAVELENGTH_LINE_COUNT_MAX		(256)
+/**
+ * The minimum number of matched lines needed to fit a solution.
+ */
+#define WAVELENGTH_LINE_MATCH_MIN		(4)
+/**
+ * Rows whose mean is above the background by at least this fraction of the brightest row's are considered
+ * to be illuminated by the arc lamp.
+ */
+#define WAVELENGTH_SLIT_FRACTION		(0.5)
+/**
+ * The zero point of the nominal dispersion is searched for this fraction of NAXIS1 columns either side of the
+ * nominal central wavelength.
+ */
+#define WAVELENGTH_SHIFT_SEARCH_FRACTION	(0.05)
+/**
+ * The minimum number of columns either side of the nominal central wavelength searched.
+ */
+#define WAVELENGTH_SHIFT_SEARCH_MIN		(10.0)
+/**
+ * The step size, in columns, of the zero point search.
+ */
+#define WAVELENGTH_SHIFT_STEP			(0.5)
+/**
+ * The nominal dispersion is searched over this fraction either side of its configured value.
+ */
+#define WAVELENGTH_SCALE_SEARCH_FRACTION	(0.1)
+/**
+ * The step size, as a fraction of the nominal dispersion, of the dispersion search.
+ */
+#define WAVELENGTH_SCALE_STEP			(0.01)
+/**
+ * The number of (the brightest) detected lines used when searching the zero point and scale of the nominal
+ * dispersion.
+ */
+#define WAVELENGTH_SEARCH_LINE_COUNT		(32)
+/**
+ * The number of match and fit iterations. The first iteration fits a linear solution.
+ */
+#define WAVELENGTH_MATCH_ITERATIONS		(3)
+/**
+ * Matched lines further than this many RMS residuals from the fit are clipped.
+ */
+#define WAVELENGTH_CLIP_SIGMA			(3.0)
+/**
+ * Matched lines are never clipped if they are within this fraction of the match tolerance of the fit, so a
+ * near perfect fit does not clip lines for tiny centring errors.
+ */
+#define WAVELENGTH_CLIP_FLOOR_FRACTION		(0.1)
+/**
+ * The number of wavelengths the line list is grown by when it is being read.
+ */
+#define WAVELENGTH_LINE_LIST_INCREMENT		(64)
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding a line detected in an arc spectrum.
+ * <dl>
+ * <dt>Pixel</dt> <dd>The centre of the line, as a 0 based column.</dd>
+ * <dt>Peak</dt> <dd>The peak counts of the line above the background.</dd>
+ * <dt>Reference_Index</dt> <dd>The index in the reference wavelength list of the matched line,
+ *     or -1 if the line is not matched.</dd>
+ * <dt>Residual</dt> <dd>The reference wavelength minus the wavelength predicted for the line.</dd>
+ * </dl>
+ */
+struct Wavelength_Line_Struct
+{
+	double Pixel;
+	double Peak;
+	int Reference_Index;
+	double Residual;
+};
+
+/**
+ * Structure holding a stored wavelength solution.
+ * <dl>
+ * <dt>Solution</dt> <dd>The wavelength solution.</dd>
+ * <dt>Lut</dt> <dd>The wavelength of each of the Solution.Naxis1 columns.</dd>
+ * <dt>Next</dt> <dd>The next stored solution in the list.</dd>
+ * </dl>
+ */
+struct Wavelength_Entry_Struct
+{
+	struct DpRt_Wavelength_Solution_Struct Solution;
+	float *Lut;
+	struct Wavelength_Entry_Struct *Next;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The list of stored wavelength solutions, one per binning.
+ */
+static struct Wavelength_Entry_Struct *Wavelength_Entry_List = NULL;
+/**
+ * Mutex protecting Wavelength_Entry_List.
+ */
+static pthread_mutex_t Wavelength_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static int Wavelength_Line_List_Load(char *filename,double **reference_list,int *reference_count);
+static int Wavelength_Spectrum_Collapse(float *frame,int naxis1,int naxis2,float *spectrum,int *row_count);
+static int Wavelength_Lines_Detect(float *spectrum,int naxis1,struct Wavelength_Line_Struct *line_list,
+				   int *line_count);
+static int Wavelength_Lines_Match(struct Wavelength_Line_Struct *line_list,int line_count,double *reference_list,
+				  int reference_count,struct DpRt_Wavelength_Solution_Struct *solution,double tolerance,
+				  double *x_list,double *y_list);
+static int Wavelength_Solution_Refine(struct Wavelength_Line_Struct *line_list,int line_count,
+				      double *reference_list,int reference_count,int order,double tolerance,
+				      struct DpRt_Wavelength_Solution_Struct *solution,double *x_list,double *y_list,
+				      double *rms);
+static int Wavelength_Solution_Store(struct DpRt_Wavelength_Solution_Struct *solution);
+static int Wavelength_Double_Compare(const void *p1,const void *p2);
+static int Wavelength_Line_Compare(const void *p1,const void *p2);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Fit a wavelength solution to an arc frame, and store it as the solution for the arc frame's binning.
+ * If the configuration has no line list, or no nominal dispersion, the arc frame is not fitted. If too few
+ * lines can be matched the arc frame is not fitted, and any previously stored solution is kept.
+ * If overscan correction is configured, the arc frame is trimmed to its TRIMSEC region before it is fitted, so
+ * the solution's columns match those of the trimmed expose frames it is applied to.
+ * @param filename The arc frame's FITS filename.
+ * @param config The configuration snapshot. Wavelength_Line_List, Wavelength_Centre, Wavelength_Dispersion,
+ *        Wavelength_Order, Wavelength_Match_Tolerance and Overscan_Correct are used.
+ * @param solution The address of a structure, filled in with the fitted solution if fitted is TRUE.
+ * @param fitted The address of an integer, set to TRUE if a solution was fitted and stored.
+ * @return The routine returns TRUE on success (whether or not a solution was fitted), and FALSE on failure or
+ *         if an abort was requested.
+ * @see #Wavelength_Line_List_Load
+ * @see #Wavelength_Spectrum_Collapse
+ * @see #Wavelength_Lines_Detect
+ * @see #Wavelength_Lines_Match
+ * @see #Wavelength_Solution_Refine
+ * @see #Wavelength_Solution_Store
+ * @see dprt_fits.html#DpRt_Fits_Lock
+ * @see dprt_fits.html#DpRt_Fits_Header_Read
+ * @see dprt_fits.html#DpRt_Fits_Read_Float_Image
+ * @see dprt_overscan.html#DpRt_Overscan_Trim
+ * @see dprt_kernel.html#DpRt_Kernel_Polynomial_Evaluate
+ * @see dprt_abort.html#DpRt_Abort_Check
+ */
+int DpRt_Wavelength_Arc_Reduce(char *filename,struct DpRt_Config_Struct *config,
+			       struct DpRt_Wavelength_Solution_Struct *solution,int *fitted)
+{
+	struct DpRt_Fits_Header_Struct header;
+	struct Wavelength_Line_Struct *line_list = NULL;
+	double *reference_list = NULL;
+	double *x_list = NULL;
+	double *y_list = NULL;
+	float *frame = NULL;
+	float *spectrum = NULL;
+	double dispersion,tolerance,scale,best_scale,shift,shift_limit,scale_shift,best_shift;
+	double residual_sum,scale_residual_sum,rms,best_rms;
+	int naxis1,naxis2,reference_count,line_count,search_line_count,row_count,match_count,scale_match_count;
+	int best_match_count,i,retval;
+
+	if((filename == NULL)||(config == NULL)||(solution == NULL)||(fitted == NULL))
+	{
+		DpRt_Error_Number = 900;
+		strcpy(DpRt_Error_String,"DpRt_Wavelength_Arc_Reduce:Parameter was NULL.");
+		return FALSE;
+	}
+	(*fitted) = FALSE;
+	if((strlen(config->Wavelength_Line_List) == 0)||(config->Wavelength_Dispersion == 0.0))
+	{
+		DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"DpRt_Wavelength_Arc_Reduce:No line list or nominal dispersion configured:"
+			"%s not fitted.",filename);
+		return TRUE;
+	}
+	if(!Wavelength_Line_List_Load(config->Wavelength_Line_List,&reference_list,&reference_count))
+		return FALSE;
+	/* other reductions may be using cfitsio */
+	DpRt_Fits_Lock();
+	retval = DpRt_Fits_Header_Read(filename,&header);
+	if(retval)
+		retval = DpRt_Fits_Read_Float_Image(filename,&naxis1,&naxis2,&frame);
+	DpRt_Fits_Unlock();
+	if(!retval)
+	{
+		free(reference_list);
+		return FALSE;
+	}
+	if(config->Overscan_Correct && header.Trim_Section_Found)
+	{
+		DpRt_Overscan_Trim(frame,naxis1,&(header.Trim_Section));
+		naxis1 = header.Trim_Section.X_End-header.Trim_Section.X_Start+1;
+		naxis2 = header.Trim_Section.Y_End-header.Trim_Section.Y_Start+1;
+	}
+	spectrum = (float *)malloc(naxis1*sizeof(float));
+	line_list = (struct Wavelength_Line_Struct *)malloc(naxis1*sizeof(struct Wavelength_Line_Struct));
+	x_list = (double *)malloc(2*naxis1*sizeof(double));
+	if((spectrum == NULL)||(line_list == NULL)||(x_list == NULL))
+	{
+		if(spectrum != NULL)
+			free(spectrum);
+		if(line_list != NULL)
+			free(line_list);
+		if(x_list != NULL)
+			free(x_list);
+		free(frame);
+		free(reference_list);
+		DpRt_Error_Number = 904;
+		sprintf(DpRt_Error_String,"DpRt_Wavelength_Arc_Reduce:Failed to allocate work space(%d).",naxis1);
+		return FALSE;
+	}
+	y_list = x_list+naxis1;
+	/* find the arc lines */
+	if((!Wavelength_Spectrum_Collapse(frame,naxis1,naxis2,spectrum,&row_count))||
+	   (!DpRt_Abort_Check("DpRt_Wavelength_Arc_Reduce")))
+	{
+		free(spectrum);
+		free(line_list);
+		free(x_list);
+		free(frame);
+		free(reference_list);
+		return FALSE;
+	}
+	free(frame);
+	if(!Wavelength_Lines_Detect(spectrum,naxis1,line_list,&line_count))
+	{
+		free(spectrum);
+		free(line_list);
+		free(x_list);
+		free(reference_list);
+		return FALSE;
+	}
+	free(spectrum);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Wavelength_Arc_Reduce:%s:%d rows collapsed:%d lines detected.",
+		filename,row_count,line_count);
+	/* search the zero point of the nominal (linear) dispersion at a range of scales, for the offset that
+	** matches the most of the brightest lines. Each scale's best offset is then refined, and the scale whose
+	** refined solution matches the most lines is used. */
+	dispersion = config->Wavelength_Dispersion*header.X_Bin;
+	tolerance = config->Wavelength_Match_Tolerance*fabs(dispersion);
+	solution->X_Bin = header.X_Bin;
+	solution->Y_Bin = header.Y_Bin;
+	solution->Naxis1 = naxis1;
+	solution->X_Centre = (naxis1-1)/2.0;
+	solution->X_Scale = (naxis1 > 1) ? (naxis1-1)/2.0 : 1.0;
+	search_line_count = line_count;
+	if(search_line_count > WAVELENGTH_SEARCH_LINE_COUNT)
+		search_line_count = WAVELENGTH_SEARCH_LINE_COUNT;
+	shift_limit = WAVELENGTH_SHIFT_SEARCH_FRACTION*naxis1;
+	if(shift_limit < WAVELENGTH_SHIFT_SEARCH_MIN)
+		shift_limit = WAVELENGTH_SHIFT_SEARCH_MIN;
+	best_scale = 0.0;
+	best_shift = 0.0;
+	best_match_count = 0;
+	best_rms = 0.0;
+	for(scale = -WAVELENGTH_SCALE_SEARCH_FRACTION; scale <= WAVELENGTH_SCALE_SEARCH_FRACTION+1.0e-6;
+	    scale += WAVELENGTH_SCALE_STEP)
+	{
+		solution->Order = 1;
+		solution->Coefficient_List[1] = dispersion*(1.0+scale)*solution->X_Scale;
+		scale_shift = 0.0;
+		scale_match_count = 0;
+		scale_residual_sum = 0.0;
+		for(shift = -shift_limit; shift <= shift_limit; shift += WAVELENGTH_SHIFT_STEP)
+		{
+			solution->Coefficient_List[0] = config->Wavelength_Centre-(dispersion*(1.0+scale)*shift);
+			match_count = Wavelength_Lines_Match(line_list,search_line_count,reference_list,reference_count,
+							     solution,tolerance,x_list,y_list);
+			residual_sum = 0.0;
+			for(i = 0; i < search_line_count; i++)
+			{
+				if(line_list[i].Reference_Index >= 0)
+					residual_sum += fabs(line_list[i].Residual);
+			}
+			if((match_count > scale_match_count)||
+			   ((match_count == scale_match_count)&&(residual_sum < scale_residual_sum)))
+			{
+				scale_shift = shift;
+				scale_match_count = match_count;
+				scale_residual_sum = residual_sum;
+			}
+		}
+		solution->Coefficient_List[0] = config->Wavelength_Centre-(dispersion*(1.0+scale)*scale_shift);
+		match_count = Wavelength_Solution_Refine(line_list,line_count,reference_list,reference_count,
+							 config->Wavelength_Order,tolerance,solution,x_list,y_list,&rms);
+		if((match_count > best_match_count)||((match_count == best_match_count)&&(rms < best_rms)))
+		{
+			best_scale = scale;
+			best_shift = scale_shift;
+			best_match_count = match_count;
+			best_rms = rms;
+		}
+	}
+	if(best_match_count < WAVELENGTH_LINE_MATCH_MIN)
+	{
+		free(reference_list);
+		free(line_list);
+		free(x_list);
+		DpRt_Log_Format(DPRT_LOG_LEVEL_WARNING,"DpRt_Wavelength_Arc_Reduce:Only %d lines matched:%s not fitted.",
+			best_match_count,filename);
+		return TRUE;
+	}
+	/* the last scale tried may not be the best, so refine the best again */
+	solution->Order = 1;
+	solution->Coefficient_List[0] = config->Wavelength_Centre-(dispersion*(1.0+best_scale)*best_shift);
+	solution->Coefficient_List[1] = dispersion*(1.0+best_scale)*solution->X_Scale;
+	solution->Line_Count = Wavelength_Solution_Refine(line_list,line_count,reference_list,reference_count,
+							  config->Wavelength_Order,tolerance,solution,x_list,y_list,
+							  &(solution->Rms));
+	free(reference_list);
+	free(line_list);
+	free(x_list);
+	if(!Wavelength_Solution_Store(solution))
+		return FALSE;
+	(*fitted) = TRUE;
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"DpRt_Wavelength_Arc_Reduce:Binning %dx%d:Order %d:%d lines:RMS %.3f:"
+		"Wavelength %.2f to %.2f.",solution->X_Bin,solution->Y_Bin,solution->Order,solution->Line_Count,
+		solution->Rms,
+		DpRt_Kernel_Polynomial_Evaluate(solution->Coefficient_List,solution->Order,solution->X_Centre,
+		solution->X_Scale,0.0),
+		DpRt_Kernel_Polynomial_Evaluate(solution->Coefficient_List,solution->Order,solution->X_Centre,
+		solution->X_Scale,naxis1-1));
+	return TRUE;
+}
+
+/**
+ * Copy the wavelength lookup table for a binning. The table holds the wavelength of each column, computed
+ * when the solution was stored.
+ * @param x_bin The binning along the dispersion axis.
+ * @param y_bin The binning along the spatial axis.
+ * @param naxis1 The number of columns in the frame being calibrated. A solution fitted to an arc frame of
+ *        a different width is not used.
+ * @param lut An array of naxis1 floats, filled with the wavelength of each column if found is TRUE.
+ * @param found The address of an integer, set to TRUE if there is a solution for this binning and width.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Wavelength_Entry_List
+ */
+int DpRt_Wavelength_Lut_Get(int x_bin,int y_bin,int naxis1,float *lut,int *found)
+{
+	struct Wavelength_Entry_Struct *entry = NULL;
+
+	if((lut == NULL)||(found == NULL))
+	{
+		DpRt_Error_Number = 908;
+		strcpy(DpRt_Error_String,"DpRt_Wavelength_Lut_Get:Parameter was NULL.");
+		return FALSE;
+	}
+	(*found) = FALSE;
+	pthread_mutex_lock(&Wavelength_Mutex);
+	for(entry = Wavelength_Entry_List; entry != NULL; entry = entry->Next)
+	{
+		if((entry->Solution.X_Bin == x_bin)&&(entry->Solution.Y_Bin == y_bin)&&
+		   (entry->Solution.Naxis1 == naxis1))
+		{
+			memcpy(lut,entry->Lut,naxis1*sizeof(float));
+			(*found) = TRUE;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&Wavelength_Mutex);
+	return TRUE;
+}
+
+/**
+ * Free all the stored wavelength solutions.
+ * @return The routine returns TRUE.
+ * @see #Wavelength_Entry_List
+ */
+int DpRt_Wavelength_Shutdown(void)
+{
+	struct Wavelength_Entry_Struct *entry = NULL;
+
+	pthread_mutex_lock(&Wavelength_Mutex);
+	while(Wavelength_Entry_List != NULL)
+	{
+		entry = Wavelength_Entry_List;
+		Wavelength_Entry_List = entry->Next;
+		free(entry->Lut);
+		free(entry);
+	}
+	pthread_mutex_unlock(&Wavelength_Mutex);
+	return TRUE;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Read a line list file. Each non-blank line not starting with '#' starts with a reference wavelength; the
+ * rest of the line (e.g. an element name) is ignored.
+ * @param filename The line list filename.
+ * @param reference_list The address of a double pointer, set to an allocated list of the wavelengths, sorted
+ *        into increasing order. This should be freed by the caller.
+ * @param reference_count The address of an integer, set to the number of wavelengths.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #WAVELENGTH_LINE_LIST_INCREMENT
+ * @see #Wavelength_Double_Compare
+ */
+static int Wavelength_Line_List_Load(char *filename,double **reference_list,int *reference_count)
+{
+	FILE *fp = NULL;
+	char buff[256];
+	double *new_list = NULL;
+	double wavelength;
+	int allocated_count;
+
+	(*reference_list) = NULL;
+	(*reference_count) = 0;
+	fp = fopen(filename,"r");
+	if(fp == NULL)
+	{
+		DpRt_Error_Number = 901;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"Wavelength_Line_List_Load:Failed to open %.200s.",
+			filename);
+		return FALSE;
+	}
+	allocated_count = 0;
+	while(fgets(buff,256,fp) != NULL)
+	{
+		if((buff[0] == '#')||(sscanf(buff,"%lf",&wavelength) != 1))
+			continue;
+		if((*reference_count) == allocated_count)
+		{
+			allocated_count += WAVELENGTH_LINE_LIST_INCREMENT;
+			new_list = (double *)realloc((*reference_list),allocated_count*sizeof(double));
+			if(new_list == NULL)
+			{
+				fclose(fp);
+				if((*reference_list) != NULL)
+					free(*reference_list);
+				(*reference_list) = NULL;
+				DpRt_Error_Number = 902;
+				sprintf(DpRt_Error_String,"Wavelength_Line_List_Load:Failed to allocate list(%d).",
+					allocated_count);
+				return FALSE;
+			}
+			(*reference_list) = new_list;
+		}
+		(*reference_list)[(*reference_count)++] = wavelength;
+	}
+	fclose(fp);
+	if((*reference_count) == 0)
+	{
+		DpRt_Error_Number = 903;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"Wavelength_Line_List_Load:%.200s contains no "
+			"wavelengths.",filename);
+		return FALSE;
+	}
+	qsort((*reference_list),(*reference_count),sizeof(double),Wavelength_Double_Compare);
+	return TRUE;
+}
+
+/**
+ * Collapse an arc frame along the spatial axis to an arc spectrum. The rows illuminated by the lamp are the
+ * contiguous rows around the brightest row whose mean is above the background by WAVELENGTH_SLIT_FRACTION of
+ * the brightest row's. If no row stands out all rows are used.
+ * @param frame The arc frame, naxis1*naxis2 pixels.
+ * @param naxis1 The number of columns in the frame.
+ * @param naxis2 The number of rows in the frame.
+ * @param spectrum An array of naxis1 floats, set to the mean of the illuminated rows in each column.
+ * @param row_count The address of an integer, set to the number of rows averaged.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #WAVELENGTH_SLIT_FRACTION
+ * @see dprt_combine.html#DpRt_Combine_Median_Float
+ */
+static int Wavelength_Spectrum_Collapse(float *frame,int naxis1,int naxis2,float *spectrum,int *row_count)
+{
+	float *profile = NULL;
+	float *work = NULL;
+	double *sum_list = NULL;
+	double sum,background,threshold;
+	int peak_row,low,high,x,y;
+
+	profile = (float *)malloc(2*naxis2*sizeof(float));
+	sum_list = (double *)calloc(naxis1,sizeof(double));
+	if((profile == NULL)||(sum_list == NULL))
+	{
+		if(profile != NULL)
+			free(profile);
+		if(sum_list != NULL)
+			free(sum_list);
+		DpRt_Error_Number = 905;
+		sprintf(DpRt_Error_String,"Wavelength_Spectrum_Collapse:Failed to allocate work space(%d,%d).",
+			naxis1,naxis2);
+		return FALSE;
+	}
+	work = profile+naxis2;
+	for(y = 0; y < naxis2; y++)
+	{
+		sum = 0.0;
+		for(x = 0; x < naxis1; x++)
+			sum += frame[(((size_t)y)*naxis1)+x];
+		profile[y] = (float)(sum/naxis1);
+		work[y] = profile[y];
+	}
+	background = DpRt_Combine_Median_Float(work,naxis2);
+	peak_row = 0;
+	for(y = 1; y < naxis2; y++)
+	{
+		if(profile[y] > profile[peak_row])
+			peak_row = y;
+	}
+	if(profile[peak_row] > background)
+	{
+		threshold = background+(WAVELENGTH_SLIT_FRACTION*(profile[peak_row]-background));
+		low = peak_row;
+		while((low > 0)&&(profile[low-1] >= threshold))
+			low--;
+		high = peak_row;
+		while((high < naxis2-1)&&(profile[high+1] >= threshold))
+			high++;
+	}
+	else
+	{
+		low = 0;
+		high = naxis2-1;
+	}
+	/* accumulate whole rows, so the frame is read in memory order */
+	for(y = low; y <= high; y++)
+	{
+		for(x = 0; x < naxis1; x++)
+			sum_list[x] += frame[(((size_t)y)*naxis1)+x];
+	}
+	for(x = 0; x < naxis1; x++)
+		spectrum[x] = (float)(sum_list[x]/(high-low+1));
+	(*row_count) = high-low+1;
+	free(profile);
+	free(sum_list);
+	return TRUE;
+}
+
+/**
+ * Detect emission lines in an arc spectrum. A line is a column at least WAVELENGTH_DETECT_SIGMA standard
+ * deviations above the background (the median of the spectrum), that is the brightest within
+ * WAVELENGTH_LINE_SEPARATION columns. The line centre is the peak of a gaussian through the brightest column and
+ * its neighbours. Only the WAVELENGTH_LINE_COUNT_MAX brightest lines are returned.
+ * @param spectrum The arc spectrum, naxis1 pixels.
+ * @param naxis1 The number of columns in the spectrum.
+ * @param line_list An array of at least naxis1 line structures, filled in with the detected lines, brightest
+ *        first.
+ * @param line_count The address of an integer, set to the number of lines detected.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #WAVELENGTH_DETECT_SIGMA
+ * @see #WAVELENGTH_LINE_SEPARATION
+ * @see #WAVELENGTH_LINE_COUNT_MAX
+ * @see #Wavelength_Line_Compare
+ * @see dprt_combine.html#DpRt_Combine_Median_Float
+ */
+static int Wavelength_Lines_Detect(float *spectrum,int naxis1,struct Wavelength_Line_Struct *line_list,
+				   int *line_count)
+{
+	float *work = NULL;
+	double background,noise,low_value,peak_value,high_value,offset;
+	int is_peak,x,i;
+
+	(*line_count) = 0;
+	work = (float *)malloc(naxis1*sizeof(float));
+	if(work == NULL)
+	{
+		DpRt_Error_Number = 906;
+		sprintf(DpRt_Error_String,"Wavelength_Lines_Detect:Failed to allocate work space(%d).",naxis1);
+		return FALSE;
+	}
+	memcpy(work,spectrum,naxis1*sizeof(float));
+	background = DpRt_Combine_Median_Float(work,naxis1);
+	for(x = 0; x < naxis1; x++)
+		work[x] = (float)fabs(spectrum[x]-background);
+	noise = 1.4826*DpRt_Combine_Median_Float(work,naxis1);
+	free(work);
+	/* a noiseless (e.g. synthetic or heavily binned) background would make every bump a line */
+	if(noise < 1.0)
+		noise = 1.0;
+	for(x = WAVELENGTH_LINE_SEPARATION; x < naxis1-WAVELENGTH_LINE_SEPARATION; x++)
+	{
+		if((spectrum[x]-background) < WAVELENGTH_DETECT_SIGMA*noise)
+			continue;
+		is_peak = TRUE;
+		for(i = 1; i <= WAVELENGTH_LINE_SEPARATION; i++)
+		{
+			if((spectrum[x-i] >= spectrum[x])||(spectrum[x+i] > spectrum[x]))
+			{
+				is_peak = FALSE;
+				break;
+			}
+		}
+		if(!is_peak)
+			continue;
+		low_value = spectrum[x-1]-background;
+		peak_value = spectrum[x]-background;
+		high_value = spectrum[x+1]-background;
+		offset = 0.0;
+		if((low_value > 0.0)&&(high_value > 0.0))
+		{
+			/* the log of a gaussian is a parabola */
+			low_value = log(low_value);
+			high_value = log(high_value);
+			peak_value = log(peak_value);
+		}
+		if((low_value-(2.0*peak_value)+high_value) < 0.0)
+			offset = 0.5*(low_value-high_value)/(low_value-(2.0*peak_value)+high_value);
+		line_list[(*line_count)].Pixel = x+offset;
+		line_list[(*line_count)].Peak = spectrum[x]-background;
+		line_list[(*line_count)].Reference_Index = -1;
+		line_list[(*line_count)].Residual = 0.0;
+		(*line_count)++;
+	}
+	qsort(line_list,(*line_count),sizeof(struct Wavelength_Line_Struct),Wavelength_Line_Compare);
+	if((*line_count) > WAVELENGTH_LINE_COUNT_MAX)
+		(*line_count) = WAVELENGTH_LINE_COUNT_MAX;
+	return TRUE;
+}
+
+/**
+ * Match detected lines to the nearest reference wavelength, using a wavelength solution. A line is matched if
+ * the nearest reference wavelength is within tolerance of the wavelength the solution predicts for it. If two
+ * lines match the same reference wavelength, only the closer is kept.
+ * @param line_list The detected lines. Each line's Reference_Index and Residual are set.
+ * @param line_count The number of detected lines.
+ * @param reference_list The reference wavelengths, in increasing order.
+ * @param reference_count The number of reference wavelengths.
+ * @param solution The wavelength solution used to predict each line's wavelength.
+ * @param tolerance The maximum difference between the predicted and reference wavelengths of a match.
+ * @param x_list An array of at least line_count doubles, set to the centres of the matched lines.
+ * @param y_list An array of at least line_count doubles, set to the reference wavelengths of the matched lines.
+ * @return The number of lines matched.
+ * @see dprt_kernel.html#DpRt_Kernel_Polynomial_Evaluate
+ */
+static int Wavelength_Lines_Match(struct Wavelength_Line_Struct *line_list,int line_count,double *reference_list,
+				  int reference_count,struct DpRt_Wavelength_Solution_Struct *solution,double tolerance,
+				  double *x_list,double *y_list)
+{
+	double wavelength;
+	int low,high,middle,match_count,i,j;
+
+	for(i = 0; i < line_count; i++)
+	{
+		wavelength = DpRt_Kernel_Polynomial_Evaluate(solution->Coefficient_List,solution->Order,
+							     solution->X_Centre,solution->X_Scale,line_list[i].Pixel);
+		/* binary search for the first reference wavelength >= wavelength */
+		low = 0;
+		high = reference_count;
+		while(low < high)
+		{
+			middle = (low+high)/2;
+			if(reference_list[middle] < wavelength)
+				low = middle+1;
+			else
+				high = middle;
+		}
+		if((low == reference_count)||
+		   ((low > 0)&&((wavelength-reference_list[low-1]) < (reference_list[low]-wavelength))))
+			low--;
+		line_list[i].Residual = reference_list[low]-wavelength;
+		if(fabs(line_list[i].Residual) <= tolerance)
+			line_list[i].Reference_Index = low;
+		else
+			line_list[i].Reference_Index = -1;
+	}
+	for(i = 0; i < line_count; i++)
+	{
+		if(line_list[i].Reference_Index < 0)
+			continue;
+		for(j = i+1; j < line_count; j++)
+		{
+			if(line_list[j].Reference_Index != line_list[i].Reference_Index)
+				continue;
+			if(fabs(line_list[j].Residual) < fabs(line_list[i].Residual))
+			{
+				line_list[i].Reference_Index = -1;
+				break;
+			}
+			line_list[j].Reference_Index = -1;
+		}
+	}
+	match_count = 0;
+	for(i = 0; i < line_count; i++)
+	{
+		if(line_list[i].Reference_Index < 0)
+			continue;
+		x_list[match_count] = line_list[i].Pixel;
+		y_list[match_count] = reference_list[line_list[i].Reference_Index];
+		match_count++;
+	}
+	return match_count;
+}
+
+/**
+ * Refine a wavelength solution. Starting from a linear solution, the lines are matched and a polynomial fitted
+ * to the matches, then outlying matches are clipped and the polynomial refitted. This is repeated
+ * WAVELENGTH_MATCH_ITERATIONS times, the first iteration fitting a linear solution and later ones a
+ * polynomial of the requested order (or lower, if there are too few matches).
+ * @param line_list The detected lines.
+ * @param line_count The number of detected lines.
+ * @param reference_list The reference wavelengths, in increasing order.
+ * @param reference_count The number of reference wavelengths.
+ * @param order The order of the polynomial to fit.
+ * @param tolerance The maximum difference between the predicted and reference wavelengths of a match.
+ * @param solution The solution to refine. On entry Order, Coefficient_List, X_Centre and X_Scale describe the
+ *        starting linear solution. On return Order and Coefficient_List describe the refined solution.
+ * @param x_list An array of at least line_count doubles, set to the centres of the lines fitted.
+ * @param y_list An array of at least line_count doubles, set to the reference wavelengths of the lines fitted.
+ * @param rms The address of a double, set to the root mean square residual of the refined solution.
+ * @return The number of lines in the refined solution, or 0 if fewer than WAVELENGTH_LINE_MATCH_MIN lines
+ *         could be matched.
+ * @see #WAVELENGTH_MATCH_ITERATIONS
+ * @see #WAVELENGTH_CLIP_SIGMA
+ * @see #WAVELENGTH_CLIP_FLOOR_FRACTION
+ * @see #Wavelength_Lines_Match
+ * @see dprt_kernel.html#DpRt_Kernel_Polynomial_Fit
+ * @see dprt_kernel.html#DpRt_Kernel_Polynomial_Evaluate
+ */
+static int Wavelength_Solution_Refine(struct Wavelength_Line_Struct *line_list,int line_count,
+				      double *reference_list,int reference_count,int order,double tolerance,
+				      struct DpRt_Wavelength_Solution_Struct *solution,double *x_list,double *y_list,
+				      double *rms)
+{
+	double residual,clip_limit;
+	int iteration,match_count,keep_count,i;
+
+	(*rms) = 0.0;
+	match_count = 0;
+	for(iteration = 0; iteration < WAVELENGTH_MATCH_ITERATIONS; iteration++)
+	{
+		match_count = Wavelength_Lines_Match(line_list,line_count,reference_list,reference_count,solution,
+						     tolerance,x_list,y_list);
+		if(match_count < WAVELENGTH_LINE_MATCH_MIN)
+			return 0;
+		if(iteration == 0)
+			solution->Order = 1;
+		else
+			solution->Order = order;
+		if(solution->Order > match_count-2)
+			solution->Order = match_count-2;
+		while(!DpRt_Kernel_Polynomial_Fit(x_list,y_list,match_count,solution->Order,solution->X_Centre,
+						  solution->X_Scale,solution->Coefficient_List))
+		{
+			solution->Order--;
+		}
+		(*rms) = 0.0;
+		for(i = 0; i < match_count; i++)
+		{
+			residual = y_list[i]-DpRt_Kernel_Polynomial_Evaluate(solution->Coefficient_List,solution->Order,
+									      solution->X_Centre,solution->X_Scale,
+									      x_list[i]);
+			(*rms) += residual*residual;
+		}
+		(*rms) = sqrt((*rms)/match_count);
+		clip_limit = WAVELENGTH_CLIP_SIGMA*(*rms);
+		if(clip_limit < WAVELENGTH_CLIP_FLOOR_FRACTION*tolerance)
+			clip_limit = WAVELENGTH_CLIP_FLOOR_FRACTION*tolerance;
+		keep_count = 0;
+		for(i = 0; i < match_count; i++)
+		{
+			residual = y_list[i]-DpRt_Kernel_Polynomial_Evaluate(solution->Coefficient_List,solution->Order,
+									      solution->X_Centre,solution->X_Scale,
+									      x_list[i]);
+			if(fabs(residual) <= clip_limit)
+			{
+				x_list[keep_count] = x_list[i];
+				y_list[keep_count] = y_list[i];
+				keep_count++;
+			}
+		}
+		if((keep_count < match_count)&&(keep_count >= WAVELENGTH_LINE_MATCH_MIN)&&
+		   (keep_count > solution->Order+1))
+		{
+			match_count = keep_count;
+			while(!DpRt_Kernel_Polynomial_Fit(x_list,y_list,match_count,solution->Order,solution->X_Centre,
+							  solution->X_Scale,solution->Coefficient_List))
+			{
+				solution->Order--;
+			}
+			(*rms) = 0.0;
+			for(i = 0; i < match_count; i++)
+			{
+				residual = y_list[i]-DpRt_Kernel_Polynomial_Evaluate(solution->Coefficient_List,
+										      solution->Order,solution->X_Centre,
+										      solution->X_Scale,x_list[i]);
+				(*rms) += residual*residual;
+			}
+			(*rms) = sqrt((*rms)/match_count);
+		}
+	}
+	return match_count;
+}
+
+/**
+ * Store a wavelength solution, replacing any stored solution for the same binning. The wavelength lookup
+ * table is computed here, once per solution.
+ * @param solution The wavelength solution to store.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Wavelength_Entry_List
+ * @see dprt_kernel.html#DpRt_Kernel_Polynomial_Evaluate
+ */
+static int Wavelength_Solution_Store(struct DpRt_Wavelength_Solution_Struct *solution)
+{
+	struct Wavelength_Entry_Struct *entry = NULL;
+	float *lut = NULL;
+	float *old_lut = NULL;
+	int x;
+
+	lut = (float *)malloc(solution->Naxis1*sizeof(float));
+	if(lut == NULL)
+	{
+		DpRt_Error_Number = 907;
+		sprintf(DpRt_Error_String,"Wavelength_Solution_Store:Failed to allocate lookup table(%d).",
+			solution->Naxis1);
+		return FALSE;
+	}
+	for(x = 0; x < solution->Naxis1; x++)
+	{
+		lut[x] = (float)DpRt_Kernel_Polynomial_Evaluate(solution->Coefficient_List,solution->Order,
+								solution->X_Centre,solution->X_Scale,x);
+	}
+	pthread_mutex_lock(&Wavelength_Mutex);
+	for(entry = Wavelength_Entry_List; entry != NULL; entry = entry->Next)
+	{
+		if((entry->Solution.X_Bin == solution->X_Bin)&&(entry->Solution.Y_Bin == solution->Y_Bin))
+			break;
+	}
+	if(entry == NULL)
+	{
+		entry = (struct Wavelength_Entry_Struct *)malloc(sizeof(struct Wavelength_Entry_Struct));
+		if(entry == NULL)
+		{
+			pthread_mutex_unlock(&Wavelength_Mutex);
+			free(lut);
+			DpRt_Error_Number = 909;
+			strcpy(DpRt_Error_String,"Wavelength_Solution_Store:Failed to allocate entry.");
+			return FALSE;
+		}
+		entry->Lut = NULL;
+		entry->Next = Wavelength_Entry_List;
+		Wavelength_Entry_List = entry;
+	}
+	old_lut = entry->Lut;
+	entry->Solution = (*solution);
+	entry->Lut = lut;
+	pthread_mutex_unlock(&Wavelength_Mutex);
+	if(old_lut != NULL)
+		free(old_lut);
+	return TRUE;
+}
+
+/**
+ * qsort comparison function, sorting doubles into increasing order.
+ * @param p1 The address of the first double.
+ * @param p2 The address of the second double.
+ * @return -1, 0 or 1.
+ */
+static int Wavelength_Double_Compare(const void *p1,const void *p2)
+{
+	double d1,d2;
+
+	d1 = *((const double *)p1);
+	d2 = *((const double *)p2);
+	if(d1 < d2)
+		return -1;
+	if(d1 > d2)
+		return 1;
+	return 0;
+}
+
+/**
+ * qsort comparison function, sorting lines into decreasing order of peak counts.
+ * @param p1 The address of the first line structure.
+ * @param p2 The address of the second line structure.
+ * @return -1, 0 or 1.
+ */
+static int Wavelength_Line_Compare(const void *p1,const void *p2)
+{
+	const struct Wavelength_Line_Struct *line1 = (const struct Wavelength_Line_Struct *)p1;
+	const struct Wavelength_Line_Struct *line2 = (const struct Wavelength_Line_Struct *)p2;
+
+	if(line1->Peak > line2->Peak)
+		return -1;
+	if(line1->Peak < line2->Peak)
+		return 1;
+	return 0;
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
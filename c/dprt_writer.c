@@ -0,0 +1,460 @@
+/* dprt_writer.c
+** Background output writer for the FTSpec Data Pipeline Reduction Routines
+** $Header$
+*/
+/**
+ * dprt_writer.c writes reduced frames and their extracted spectra in the background, so a reduction can return
+ * its results without waiting for the disk. DpRt_Writer_Submit copies a reduced frame into a bounded queue and
+ * returns; if the queue is full it waits for room, so a slow disk holds up the reductions rather than using
+ * unbounded memory. A pool of writer threads, started by the first submit, writes queued frames in the order they
+ * were submitted, optionally tile compressing them. Write failures are counted, and can be queried with
+ * DpRt_Writer_Status_Get; DpRt_Writer_Flush waits for the queue to empty and reports any failures since the last
+ * flush. Each write holds the cfitsio lock only around its individual cfitsio calls, and not at all if cfitsio was
+ * built reentrant, so several threads write different frames in parallel, interleaving their calls if cfitsio is
+ * not reentrant.
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "dprt_jni_general.h"
+#include "dprt.h"
+#include "dprt_config.h"
+#include "dprt_fits.h"
+#include "dprt_writer.h"
+#include "dprt_context.h"
+#include "dprt_metrics.h"
+#include "dprt_log.h"
+
+/* ------------------------------------------------------- */
+/* structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding one reduced frame queued for writing. All the data is owned by the structure.
+ * <dl>
+ * <dt>Input_Filename</dt> <dd>An allocated copy of the FITS filename of the frame that was reduced, whose
+ *     header keywords are copied to the output file.</dd>
+ * <dt>Output_Filename</dt> <dd>An allocated copy of the FITS filename to write.</dd>
+ * <dt>Naxis1</dt> <dd>The number of columns in the frame.</dd>
+ * <dt>Naxis2</dt> <dd>The number of rows in the frame.</dd>
+ * <dt>Frame</dt> <dd>An allocated copy of the reduced frame, Naxis1*Naxis2 floats.</dd>
+ * <dt>Flux</dt> <dd>An allocated copy of the extracted spectrum, or NULL if no spectrum was found.</dd>
+ * <dt>Variance</dt> <dd>An allocated copy of the spectrum's variance, or NULL.</dd>
+ * <dt>Wavelength</dt> <dd>An allocated copy of the wavelength of each spectrum pixel, or NULL if there is no
+ *     wavelength solution.</dd>
+ * <dt>Spectrum_Length</dt> <dd>The number of pixels in Flux, Variance and Wavelength.</dd>
+ * <dt>Compression</dt> <dd>The cfitsio tile compression algorithm to write the frame with, or 0.</dd>
+ * <dt>Log_Tag</dt> <dd>The log tag of the call that submitted the frame, which its write logs under.</dd>
+ * <dt>Abort_Generation</dt> <dd>The abort generation of the call that submitted the frame, which its write is
+ *     aborted with.</dd>
+ * <dt>Next</dt> <dd>The next frame in the queue.</dd>
+ * </dl>
+ */
+struct Writer_Frame_Struct
+{
+	char *Input_Filename;
+	char *Output_Filename;
+	int Naxis1;
+	int Naxis2;
+	float *Frame;
+	float *Flux;
+	float *Variance;
+	float *Wavelength;
+	int Spectrum_Length;
+	int Compression;
+	unsigned long Log_Tag;
+	unsigned long Abort_Generation;
+	struct Writer_Frame_Struct *Next;
+};
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The first frame in the queue, the next one a writer thread will write.
+ */
+static struct Writer_Frame_Struct *Writer_Queue_Head = NULL;
+/**
+ * The last frame in the queue, which newly submitted frames are appended after.
+ */
+static struct Writer_Frame_Struct *Writer_Queue_Tail = NULL;
+/**
+ * The status of the writer, returned by DpRt_Writer_Status_Get.
+ */
+static struct DpRt_Writer_Status_Struct Writer_Status;
+/**
+ * The number of writes that have failed since the last DpRt_Writer_Flush.
+ */
+static long Writer_Flush_Failed_Count = 0;
+/**
+ * The writer threads. Writer_Status.Thread_Count of them are running.
+ */
+static pthread_t Writer_Thread_List[DPRT_CONFIG_WRITER_THREAD_COUNT_MAX];
+/**
+ * Set by DpRt_Writer_Shutdown to tell the writer threads to exit once the queue is empty.
+ */
+static int Writer_Shutdown_Flag = FALSE;
+/**
+ * Mutex protecting all the writer's variables.
+ */
+static pthread_mutex_t Writer_Mutex = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * Condition signalled when a frame is queued, or shutdown is requested.
+ */
+static pthread_cond_t Writer_Queue_Condition = PTHREAD_COND_INITIALIZER;
+/**
+ * Condition signalled when a frame is taken off the queue, or finishes being written, so submitters waiting for
+ * room and flushes waiting for the queue to empty can check again.
+ */
+static pthread_cond_t Writer_Space_Condition = PTHREAD_COND_INITIALIZER;
+
+/* ------------------------------------------------------- */
+/* internal function declarations */
+/* ------------------------------------------------------- */
+static void *Writer_Thread(void *user_arg);
+static int Writer_Frame_Write(struct Writer_Frame_Struct *writer_frame);
+static int Writer_Float_Copy(float *data,long length,float **copy);
+static void Writer_Frame_Free(struct Writer_Frame_Struct *writer_frame);
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * Queue a reduced frame, and its extracted spectrum, to be written by the background writer. The frame and
+ * spectrum are copied, so the caller's buffers can be reused as soon as the routine returns. The writer threads
+ * are started if they are not already running. If config->Writer_Queue_Length frames are already waiting, the
+ * routine waits until a writer thread takes one.
+ * @param config The configuration snapshot, giving the queue length, the number of writer threads to start and
+ *        the compression to write the frame with.
+ * @param input_filename The FITS filename of the frame that was reduced, whose header keywords are copied to the
+ *        output file. It must still exist when the frame is written.
+ * @param output_filename The FITS filename to write.
+ * @param naxis1 The number of columns in the frame.
+ * @param naxis2 The number of rows in the frame.
+ * @param frame The reduced frame, naxis1*naxis2 floats.
+ * @param flux The extracted spectrum, or NULL if no spectrum was found.
+ * @param variance The spectrum's variance, or NULL.
+ * @param wavelength The wavelength of each spectrum pixel, or NULL.
+ * @param spectrum_length The number of pixels in flux, variance and wavelength.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Writer_Frame_Struct
+ * @see #Writer_Thread
+ * @see #Writer_Float_Copy
+ * @see #Writer_Space_Condition
+ */
+int DpRt_Writer_Submit(struct DpRt_Config_Struct *config,char *input_filename,char *output_filename,
+		       int naxis1,int naxis2,float *frame,float *flux,float *variance,float *wavelength,
+		       int spectrum_length)
+{
+	struct Writer_Frame_Struct *writer_frame = NULL;
+	int retval;
+
+	if((config == NULL)||(input_filename == NULL)||(output_filename == NULL)||(frame == NULL))
+	{
+		DpRt_Error_Number = 1300;
+		strcpy(DpRt_Error_String,"DpRt_Writer_Submit:Parameter was NULL.");
+		return FALSE;
+	}
+	writer_frame = (struct Writer_Frame_Struct *)calloc(1,sizeof(struct Writer_Frame_Struct));
+	if(writer_frame == NULL)
+	{
+		DpRt_Error_Number = 1301;
+		strcpy(DpRt_Error_String,"DpRt_Writer_Submit:Failed to allocate frame.");
+		return FALSE;
+	}
+	writer_frame->Input_Filename = (char *)malloc((strlen(input_filename)+1)*sizeof(char));
+	writer_frame->Output_Filename = (char *)malloc((strlen(output_filename)+1)*sizeof(char));
+	if((writer_frame->Input_Filename == NULL)||(writer_frame->Output_Filename == NULL))
+	{
+		Writer_Frame_Free(writer_frame);
+		DpRt_Error_Number = 1302;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Writer_Submit:Failed to allocate filenames(%.128s).",
+			output_filename);
+		return FALSE;
+	}
+	strcpy(writer_frame->Input_Filename,input_filename);
+	strcpy(writer_frame->Output_Filename,output_filename);
+	writer_frame->Naxis1 = naxis1;
+	writer_frame->Naxis2 = naxis2;
+	writer_frame->Spectrum_Length = spectrum_length;
+	writer_frame->Compression = config->Writer_Compression;
+	writer_frame->Log_Tag = DpRt_Error_Current_Get()->Log_Tag;
+	writer_frame->Abort_Generation = DpRt_Error_Current_Get()->Abort_Generation;
+	retval = Writer_Float_Copy(frame,((long)naxis1)*naxis2,&(writer_frame->Frame));
+	if(retval)
+		retval = Writer_Float_Copy(flux,spectrum_length,&(writer_frame->Flux));
+	if(retval)
+		retval = Writer_Float_Copy(variance,spectrum_length,&(writer_frame->Variance));
+	if(retval)
+		retval = Writer_Float_Copy(wavelength,spectrum_length,&(writer_frame->Wavelength));
+	if(!retval)
+	{
+		Writer_Frame_Free(writer_frame);
+		return FALSE;
+	}
+	pthread_mutex_lock(&Writer_Mutex);
+	while((Writer_Status.Thread_Count < config->Writer_Thread_Count)&&(!Writer_Shutdown_Flag))
+	{
+		if(pthread_create(&(Writer_Thread_List[Writer_Status.Thread_Count]),NULL,Writer_Thread,NULL) != 0)
+			break;
+		Writer_Status.Thread_Count++;
+	}
+	if(Writer_Shutdown_Flag||(Writer_Status.Thread_Count == 0))
+	{
+		pthread_mutex_unlock(&Writer_Mutex);
+		Writer_Frame_Free(writer_frame);
+		DpRt_Error_Number = 1303;
+		snprintf(DpRt_Error_String,DPRT_ERROR_STRING_LENGTH,"DpRt_Writer_Submit:Writer not running(%d threads):%.128s not "
+			"written.",Writer_Status.Thread_Count,output_filename);
+		return FALSE;
+	}
+	while((Writer_Status.Queued_Count >= config->Writer_Queue_Length)&&(!Writer_Shutdown_Flag))
+		pthread_cond_wait(&Writer_Space_Condition,&Writer_Mutex);
+	if(Writer_Queue_Tail != NULL)
+		Writer_Queue_Tail->Next = writer_frame;
+	else
+		Writer_Queue_Head = writer_frame;
+	Writer_Queue_Tail = writer_frame;
+	Writer_Status.Queued_Count++;
+	pthread_cond_signal(&Writer_Queue_Condition);
+	pthread_mutex_unlock(&Writer_Mutex);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_DEBUG,"DpRt_Writer_Submit:Queued %s.",output_filename);
+	return TRUE;
+}
+
+/**
+ * Wait until every queued frame has been written.
+ * @return The routine returns TRUE if every write since the last flush succeeded, and FALSE (describing the
+ *         last failure) if any failed.
+ * @see #Writer_Space_Condition
+ * @see #Writer_Flush_Failed_Count
+ */
+int DpRt_Writer_Flush(void)
+{
+	long failed_count;
+
+	pthread_mutex_lock(&Writer_Mutex);
+	while((Writer_Status.Queued_Count > 0)||(Writer_Status.Active_Count > 0))
+		pthread_cond_wait(&Writer_Space_Condition,&Writer_Mutex);
+	failed_count = Writer_Flush_Failed_Count;
+	Writer_Flush_Failed_Count = 0;
+	if(failed_count > 0)
+	{
+		DpRt_Error_Number = 1304;
+		sprintf(DpRt_Error_String,"DpRt_Writer_Flush:%ld writes failed:Last %.80s:%d:%.100s",failed_count,
+			Writer_Status.Last_Failed_Filename,Writer_Status.Last_Error_Number,
+			Writer_Status.Last_Error_String);
+	}
+	pthread_mutex_unlock(&Writer_Mutex);
+	return (failed_count == 0);
+}
+
+/**
+ * Get a copy of the background writer's status.
+ * @param status The address of a structure to copy the status into.
+ * @see #Writer_Status
+ */
+void DpRt_Writer_Status_Get(struct DpRt_Writer_Status_Struct *status)
+{
+	if(status == NULL)
+		return;
+	pthread_mutex_lock(&Writer_Mutex);
+	(*status) = Writer_Status;
+	pthread_mutex_unlock(&Writer_Mutex);
+}
+
+/**
+ * Shut down the background writer. Every queued frame is written first, so none are lost, then the writer
+ * threads are joined. Frames can be submitted again afterwards, which restarts the threads.
+ * @return The routine returns TRUE if every write since the last flush succeeded, and FALSE otherwise.
+ * @see #DpRt_Writer_Flush
+ * @see #Writer_Shutdown_Flag
+ */
+int DpRt_Writer_Shutdown(void)
+{
+	int thread_count,retval,i;
+
+	retval = DpRt_Writer_Flush();
+	pthread_mutex_lock(&Writer_Mutex);
+	thread_count = Writer_Status.Thread_Count;
+	Writer_Shutdown_Flag = TRUE;
+	pthread_cond_broadcast(&Writer_Queue_Condition);
+	pthread_cond_broadcast(&Writer_Space_Condition);
+	pthread_mutex_unlock(&Writer_Mutex);
+	for(i = 0; i < thread_count; i++)
+		pthread_join(Writer_Thread_List[i],NULL);
+	pthread_mutex_lock(&Writer_Mutex);
+	Writer_Status.Thread_Count = 0;
+	Writer_Shutdown_Flag = FALSE;
+	pthread_mutex_unlock(&Writer_Mutex);
+	return retval;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * A writer thread. Repeatedly takes the frame at the head of the queue and writes it. The thread binds its own
+ * error state, so a failed write's error is recorded in the writer's status rather than in a reduction
+ * context. Each write logs under the tag of the call that submitted the frame. When DpRt_Writer_Shutdown is
+ * called, the thread exits once the queue is empty.
+ * @param user_arg Not used.
+ * @return NULL.
+ * @see #Writer_Frame_Write
+ * @see #Writer_Status
+ * @see dprt_context.html#DpRt_Error_Bind
+ */
+static void *Writer_Thread(void *user_arg)
+{
+	struct DpRt_Error_Struct error;
+	struct Writer_Frame_Struct *writer_frame = NULL;
+	int retval;
+
+	error.Number = 0;
+	error.String[0] = '\0';
+	error.Log_Tag = 0;
+	error.Abort_Generation = 0;
+	DpRt_Error_Bind(&error);
+	while(TRUE)
+	{
+		pthread_mutex_lock(&Writer_Mutex);
+		while((Writer_Queue_Head == NULL)&&(!Writer_Shutdown_Flag))
+			pthread_cond_wait(&Writer_Queue_Condition,&Writer_Mutex);
+		writer_frame = Writer_Queue_Head;
+		if(writer_frame != NULL)
+		{
+			Writer_Queue_Head = writer_frame->Next;
+			if(Writer_Queue_Head == NULL)
+				Writer_Queue_Tail = NULL;
+			Writer_Status.Queued_Count--;
+			Writer_Status.Active_Count++;
+			pthread_cond_broadcast(&Writer_Space_Condition);
+		}
+		pthread_mutex_unlock(&Writer_Mutex);
+		if(writer_frame == NULL)
+			break;
+		error.Number = 0;
+		error.String[0] = '\0';
+		error.Log_Tag = writer_frame->Log_Tag;
+		error.Abort_Generation = writer_frame->Abort_Generation;
+		retval = Writer_Frame_Write(writer_frame);
+		if(!retval)
+		{
+			DpRt_Log_Format(DPRT_LOG_LEVEL_ERROR,"Writer_Thread:Writing %s failed:%d:%s",writer_frame->Output_Filename,
+				error.Number,error.String);
+		}
+		pthread_mutex_lock(&Writer_Mutex);
+		Writer_Status.Active_Count--;
+		if(retval)
+			Writer_Status.Written_Count++;
+		else
+		{
+			Writer_Status.Failed_Count++;
+			Writer_Flush_Failed_Count++;
+			Writer_Status.Last_Error_Number = error.Number;
+			strcpy(Writer_Status.Last_Error_String,error.String);
+			strncpy(Writer_Status.Last_Failed_Filename,writer_frame->Output_Filename,
+				DPRT_FITS_FILENAME_LENGTH-1);
+			Writer_Status.Last_Failed_Filename[DPRT_FITS_FILENAME_LENGTH-1] = '\0';
+		}
+		pthread_cond_broadcast(&Writer_Space_Condition);
+		pthread_mutex_unlock(&Writer_Mutex);
+		Writer_Frame_Free(writer_frame);
+	}
+	DpRt_Error_Bind(NULL);
+	return NULL;
+}
+
+/**
+ * Write a queued frame to its output file, with the spectrum, its variance and its wavelengths in extensions.
+ * The write routines take the cfitsio lock around each of their cfitsio calls (unless cfitsio was built
+ * reentrant), so other threads' cfitsio calls run between them.
+ * @param writer_frame The frame to write.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see dprt_fits.html#DpRt_Fits_Write_Reduced_Image
+ * @see dprt_fits.html#DpRt_Fits_Write_Spectrum
+ * @see dprt_metrics.html#DpRt_Metrics_Timer_Stop
+ */
+static int Writer_Frame_Write(struct Writer_Frame_Struct *writer_frame)
+{
+	struct timespec start_time;
+	int retval;
+
+	DpRt_Metrics_Timer_Start(&start_time);
+	retval = DpRt_Fits_Write_Reduced_Image(writer_frame->Input_Filename,writer_frame->Output_Filename,
+					       writer_frame->Naxis1,writer_frame->Naxis2,writer_frame->Frame,
+					       writer_frame->Compression);
+	if(retval && (writer_frame->Flux != NULL))
+	{
+		retval = DpRt_Fits_Write_Spectrum(writer_frame->Output_Filename,"SPECTRUM",writer_frame->Flux,
+						  writer_frame->Spectrum_Length);
+	}
+	if(retval && (writer_frame->Variance != NULL))
+	{
+		retval = DpRt_Fits_Write_Spectrum(writer_frame->Output_Filename,"VARIANCE",writer_frame->Variance,
+						  writer_frame->Spectrum_Length);
+	}
+	if(retval && (writer_frame->Wavelength != NULL))
+	{
+		retval = DpRt_Fits_Write_Spectrum(writer_frame->Output_Filename,"WAVELENGTH",writer_frame->Wavelength,
+						  writer_frame->Spectrum_Length);
+	}
+	if(!retval)
+		return FALSE;
+	DpRt_Metrics_Timer_Stop(DPRT_METRICS_STAGE_WRITE,&start_time);
+	DpRt_Log_Format(DPRT_LOG_LEVEL_INFO,"Writer_Frame_Write:Wrote %s.",writer_frame->Output_Filename);
+	return TRUE;
+}
+
+/**
+ * Allocate a copy of a float array.
+ * @param data The array to copy, or NULL.
+ * @param length The number of floats in the array.
+ * @param copy The address of a float pointer, set to the allocated copy, or NULL if data was NULL.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ */
+static int Writer_Float_Copy(float *data,long length,float **copy)
+{
+	(*copy) = NULL;
+	if((data == NULL)||(length < 1))
+		return TRUE;
+	(*copy) = (float *)malloc(length*sizeof(float));
+	if((*copy) == NULL)
+	{
+		DpRt_Error_Number = 1305;
+		sprintf(DpRt_Error_String,"Writer_Float_Copy:Failed to allocate copy(%ld).",length);
+		return FALSE;
+	}
+	memcpy((*copy),data,length*sizeof(float));
+	return TRUE;
+}
+
+/**
+ * Free a queued frame and the data it owns.
+ * @param writer_frame The frame to free.
+ */
+static void Writer_Frame_Free(struct Writer_Frame_Struct *writer_frame)
+{
+	if(writer_frame->Input_Filename != NULL)
+		free(writer_frame->Input_Filename);
+	if(writer_frame->Output_Filename != NULL)
+		free(writer_frame->Output_Filename);
+	if(writer_frame->Frame != NULL)
+		free(writer_frame->Frame);
+	if(writer_frame->Flux != NULL)
+		free(writer_frame->Flux);
+	if(writer_frame->Variance != NULL)
+		free(writer_frame->Variance);
+	if(writer_frame->Wavelength != NULL)
+		free(writer_frame->Wavelength);
+	free(writer_frame);
+}
+
+/*
+** $Log: not supported by cvs2svn $
+*/
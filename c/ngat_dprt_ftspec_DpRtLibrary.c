@@ -10,10 +10,170 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <jni.h>
 #include "ngat_dprt_ftspec_DpRtLibrary.h"
 #include "dprt.h"
 #include "dprt_jni_general.h"
+#include "dprt_kernel.h"
+#include "dprt_abort.h"
+#include "dprt_job.h"
+#include "dprt_writer.h"
+#include "dprt_metrics.h"
+#include "dprt_log.h"
+#include "dprt_context.h"
+
+/* -------------------------------------------------- */
+/* hash definitions */
+/* -------------------------------------------------- */
+/**
+ * The number of ngat.message.INST_DP DONE classes whose class reference and setter method IDs are cached.
+ * @see #DONE_CLASS_INDEX
+ */
+#define DONE_CLASS_COUNT		(4)
+/**
+ * The number of elements in the array returned by DpRt_Writer_Status_Get.
+ * @see #WRITER_STATUS_INDEX
+ */
+#define WRITER_STATUS_COUNT		(6)
+/**
+ * The number of elements in the array returned by DpRt_Metrics_Get: METRICS_STAGE_ELEMENT_COUNT elements for
+ * each stage, one for each counter, and the thread count.
+ * @see #METRICS_INDEX
+ * @see #METRICS_STAGE_ELEMENT_COUNT
+ */
+#define METRICS_COUNT			((DPRT_METRICS_STAGE_COUNT*METRICS_STAGE_ELEMENT_COUNT)+\
+					 DPRT_METRICS_COUNTER_COUNT+1)
+
+/* -------------------------------------------------- */
+/* enums */
+/* -------------------------------------------------- */
+/**
+ * Index of each cached DONE class in Done_Class_List.
+ * <ul>
+ * <li>DONE_CLASS_CALIBRATE_REDUCE CALIBRATE_REDUCE_DONE.
+ * <li>DONE_CLASS_EXPOSE_REDUCE EXPOSE_REDUCE_DONE.
+ * <li>DONE_CLASS_MAKE_MASTER_BIAS MAKE_MASTER_BIAS_DONE.
+ * <li>DONE_CLASS_MAKE_MASTER_FLAT MAKE_MASTER_FLAT_DONE.
+ * </ul>
+ * @see #Done_Class_List
+ */
+enum DONE_CLASS_INDEX
+{
+	DONE_CLASS_CALIBRATE_REDUCE=0,DONE_CLASS_EXPOSE_REDUCE=1,DONE_CLASS_MAKE_MASTER_BIAS=2,
+	DONE_CLASS_MAKE_MASTER_FLAT=3
+};
+
+/**
+ * Index of each element of the array returned by DpRt_Writer_Status_Get.
+ * <ul>
+ * <li>WRITER_STATUS_THREAD_COUNT The number of writer threads running.
+ * <li>WRITER_STATUS_QUEUED_COUNT The number of frames waiting to be written.
+ * <li>WRITER_STATUS_ACTIVE_COUNT The number of frames being written.
+ * <li>WRITER_STATUS_WRITTEN_COUNT The number of frames written.
+ * <li>WRITER_STATUS_FAILED_COUNT The number of frames that failed to be written.
+ * <li>WRITER_STATUS_LAST_ERROR_NUMBER The error number of the last failed write, or 0.
+ * </ul>
+ * @see #WRITER_STATUS_COUNT
+ */
+enum WRITER_STATUS_INDEX
+{
+	WRITER_STATUS_THREAD_COUNT=0,WRITER_STATUS_QUEUED_COUNT=1,WRITER_STATUS_ACTIVE_COUNT=2,
+	WRITER_STATUS_WRITTEN_COUNT=3,WRITER_STATUS_FAILED_COUNT=4,WRITER_STATUS_LAST_ERROR_NUMBER=5
+};
+
+/**
+ * Index of each element of a stage's group of elements, in the array returned by DpRt_Metrics_Get. The group
+ * of stage N (a DPRT_METRICS_STAGE value) starts at element N*METRICS_STAGE_ELEMENT_COUNT.
+ * <ul>
+ * <li>METRICS_STAGE_COUNT The number of times the stage was timed.
+ * <li>METRICS_STAGE_TIME The total time spent in the stage, in microseconds.
+ * <li>METRICS_STAGE_TIME_MAXIMUM The longest single time spent in the stage, in microseconds.
+ * <li>METRICS_STAGE_ELEMENT_COUNT The number of elements per stage.
+ * </ul>
+ * @see #METRICS_INDEX
+ * @see dprt_metrics.h#DPRT_METRICS_STAGE
+ */
+enum METRICS_STAGE_ELEMENT
+{
+	METRICS_STAGE_COUNT=0,METRICS_STAGE_TIME=1,METRICS_STAGE_TIME_MAXIMUM=2,METRICS_STAGE_ELEMENT_COUNT=3
+};
+
+/**
+ * Index of the groups of elements of the array returned by DpRt_Metrics_Get.
+ * <ul>
+ * <li>METRICS_STAGE_START The start of the stage groups, see METRICS_STAGE_ELEMENT.
+ * <li>METRICS_COUNTER_START The start of the counters, indexed by DPRT_METRICS_COUNTER.
+ * <li>METRICS_THREAD_COUNT The number of threads currently recording timings and counters.
+ * </ul>
+ * @see #METRICS_COUNT
+ * @see #METRICS_STAGE_ELEMENT
+ * @see dprt_metrics.h#DPRT_METRICS_COUNTER
+ */
+enum METRICS_INDEX
+{
+	METRICS_STAGE_START=0,METRICS_COUNTER_START=DPRT_METRICS_STAGE_COUNT*METRICS_STAGE_ELEMENT_COUNT,
+	METRICS_THREAD_COUNT=METRICS_COUNTER_START+DPRT_METRICS_COUNTER_COUNT
+};
+
+/* -------------------------------------------------- */
+/* structures */
+/* -------------------------------------------------- */
+/**
+ * Structure holding a global reference to a DONE class, and the method IDs of the setters used to fill in its
+ * instances. Setters a class does not have are NULL.
+ * <dl>
+ * <dt>Class</dt> <dd>A global reference to the class, or NULL if it is not cached.</dd>
+ * <dt>Set_Successful</dt> <dd>COMMAND_DONE's setSuccessful(boolean).</dd>
+ * <dt>Set_Error_Num</dt> <dd>COMMAND_DONE's setErrorNum(int).</dd>
+ * <dt>Set_Error_String</dt> <dd>COMMAND_DONE's setErrorString(String).</dd>
+ * <dt>Set_Filename</dt> <dd>REDUCE_DONE's setFilename(String).</dd>
+ * <dt>Set_Mean_Counts</dt> <dd>CALIBRATE_REDUCE_DONE's setMeanCounts(float).</dd>
+ * <dt>Set_Peak_Counts</dt> <dd>CALIBRATE_REDUCE_DONE's setPeakCounts(float).</dd>
+ * <dt>Set_Seeing</dt> <dd>EXPOSE_REDUCE_DONE's setSeeing(float).</dd>
+ * <dt>Set_Counts</dt> <dd>EXPOSE_REDUCE_DONE's setCounts(float).</dd>
+ * <dt>Set_X_Pix</dt> <dd>EXPOSE_REDUCE_DONE's setXpix(float).</dd>
+ * <dt>Set_Y_Pix</dt> <dd>EXPOSE_REDUCE_DONE's setYpix(float).</dd>
+ * <dt>Set_Photometricity</dt> <dd>EXPOSE_REDUCE_DONE's setPhotometricity(float).</dd>
+ * <dt>Set_Sky_Brightness</dt> <dd>EXPOSE_REDUCE_DONE's setSkyBrightness(float).</dd>
+ * <dt>Set_Saturation</dt> <dd>EXPOSE_REDUCE_DONE's setSaturation(boolean).</dd>
+ * </dl>
+ * @see #Done_Class_Cache
+ */
+struct Done_Class_Struct
+{
+	jclass Class;
+	jmethodID Set_Successful;
+	jmethodID Set_Error_Num;
+	jmethodID Set_Error_String;
+	jmethodID Set_Filename;
+	jmethodID Set_Mean_Counts;
+	jmethodID Set_Peak_Counts;
+	jmethodID Set_Seeing;
+	jmethodID Set_Counts;
+	jmethodID Set_X_Pix;
+	jmethodID Set_Y_Pix;
+	jmethodID Set_Photometricity;
+	jmethodID Set_Sky_Brightness;
+	jmethodID Set_Saturation;
+};
+
+/**
+ * Structure holding the Java objects an asynchronous reduction job calls back into when it finishes.
+ * <dl>
+ * <dt>Library</dt> <dd>A global reference to the ngat.dprt.ftspec.DpRtLibrary instance the job was submitted
+ *     from, whose exposeReduceDone method is called.</dd>
+ * <dt>Reduce_Done</dt> <dd>A global reference to the EXPOSE_REDUCE_DONE object filled in with the result.</dd>
+ * <dt>Next</dt> <dd>The next entry in Job_Reference_Free_List, if the job's callback could not free it.</dd>
+ * </dl>
+ * @see #Job_Reference_Free_List
+ */
+struct Job_Reference_Struct
+{
+	jobject Library;
+	jobject Reduce_Done;
+	struct Job_Reference_Struct *Next;
+};
 
 /* -------------------------------------------------- */
 /* internal variables */
@@ -22,10 +182,94 @@
  * Revision Control System identifier.
  */
 static char rcsid[] = "$Id: ngat_dprt_ftspec_DpRtLibrary.c,v 1.1 2005-03-11 11:56:51 cjm Exp $";
+/**
+ * A copy of the JavaVM pointer passed to JNI_OnLoad, used by the job worker thread to attach to the JVM.
+ */
+static JavaVM *Java_VM = NULL;
+/**
+ * The JNIEnv of the log drain thread, attached to the JVM once by Log_Thread_Start, or NULL. Only used on the
+ * drain thread.
+ * @see #Log_Thread_Start
+ * @see #Log_Thread_Stop
+ */
+static JNIEnv *Log_Env = NULL;
+/**
+ * A global reference to the logger set by initialiseLoggerReference, which Log_Handler delivers messages to,
+ * or NULL.
+ * @see #Logger_Log_Method_ID
+ */
+static jobject Logger = NULL;
+/**
+ * The method ID of the logger's log(int,String) method, cached when the logger is set.
+ * @see #Logger
+ */
+static jmethodID Logger_Log_Method_ID = NULL;
+/**
+ * Mutex protecting Logger and Logger_Log_Method_ID, which are set and removed on Java threads while the log
+ * drain thread uses them.
+ */
+static pthread_mutex_t Logger_Mutex = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * The JNI names of the cached DONE classes, in DONE_CLASS_INDEX order.
+ * @see #DONE_CLASS_INDEX
+ */
+static char *Done_Class_Name_List[DONE_CLASS_COUNT] =
+{
+	"ngat/message/INST_DP/CALIBRATE_REDUCE_DONE","ngat/message/INST_DP/EXPOSE_REDUCE_DONE",
+	"ngat/message/INST_DP/MAKE_MASTER_BIAS_DONE","ngat/message/INST_DP/MAKE_MASTER_FLAT_DONE"
+};
+/**
+ * The cached DONE classes and their setter method IDs, in DONE_CLASS_INDEX order. They are resolved in
+ * JNI_OnLoad, so results are marshalled without looking up the class and each setter by name on every call.
+ * @see #Done_Class_Cache
+ * @see #Done_Class_Get
+ */
+static struct Done_Class_Struct Done_Class_List[DONE_CLASS_COUNT];
+/**
+ * Mutex protecting Done_Class_List, which may be re-cached by any thread that marshals a result.
+ * @see #Done_Class_List
+ */
+static pthread_mutex_t Done_Class_Mutex = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * The method ID of DpRtLibrary's exposeReduceDone(int,EXPOSE_REDUCE_DONE) method, called when an asynchronous
+ * job finishes. It is resolved by the first DpRt_Expose_Reduce_Submit, so the job callback does not look it up.
+ * Protected by Job_Reference_Mutex.
+ * @see #Job_Expose_Reduce_Callback
+ */
+static jmethodID Expose_Reduce_Done_Method_ID = NULL;
+/**
+ * The job references whose callback could not attach to the JVM, and so could not delete their global
+ * references. They are deleted by the next JNI call that can, with Job_Reference_Free_List_Empty. Protected by
+ * Job_Reference_Mutex.
+ * @see #Job_Reference_Free_List_Empty
+ */
+static struct Job_Reference_Struct *Job_Reference_Free_List = NULL;
+/**
+ * Mutex protecting Expose_Reduce_Done_Method_ID and Job_Reference_Free_List.
+ */
+static pthread_mutex_t Job_Reference_Mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /* -------------------------------------------------- */
 /* internal functions */
 /* -------------------------------------------------- */
+static void Job_Expose_Reduce_Callback(int job_id,struct DpRt_Expose_Result_Struct *result,void *user_arg);
+static void Job_Reference_Free(JNIEnv *env,struct Job_Reference_Struct *job_reference);
+static void Job_Reference_Free_List_Empty(JNIEnv *env);
+static void Log_Handler(int level,char *string);
+static void Log_Thread_Start(void);
+static void Log_Thread_Stop(void);
+static int Done_Class_Cache(JNIEnv *env,int index);
+static void Done_Class_Uncache(JNIEnv *env,int index);
+static int Done_Class_Get(JNIEnv *env,int index,struct Done_Class_Struct *done_class);
+static int Done_Command_Set(JNIEnv *env,struct Done_Class_Struct *done_class,jobject done,int successful,
+			    int error_number,char *error_string);
+static int Done_Reduce_Set(JNIEnv *env,struct Done_Class_Struct *done_class,jobject done,char *filename);
+static int Calibrate_Reduce_Done_Set(JNIEnv *env,jobject done,int successful,int error_number,char *error_string,
+				     char *filename,double mean_counts,double peak_counts);
+static int Expose_Reduce_Done_Set(JNIEnv *env,jobject done,struct DpRt_Expose_Result_Struct *result);
+static int Make_Master_Done_Set(JNIEnv *env,int index,jobject done,int successful,int error_number,
+				char *error_string);
+static int Done_Float_Set(JNIEnv *env,jobject done,jmethodID method_id,double value);
 
 
 /* -------------------------------------------------- */
@@ -35,11 +279,33 @@ static char rcsid[] = "$Id: ngat_dprt_ftspec_DpRtLibrary.c,v 1.1 2005-03-11 11:5
  * This routine gets called when the native library is loaded. We use this routine
  * to get a copy of the JavaVM pointer of the JVM we are running in. This is used to
  * get the correct per-thread JNIEnv context pointer when C calls back into Java.
+ * A copy is also kept, for the asynchronous job worker thread to attach with.
+ * The DONE classes results are returned in, and their setter method IDs, are resolved and cached here. A class
+ * that cannot be resolved is filled in by name through jni_general instead.
+ * @see #Java_VM
+ * @see #Done_Class_Cache
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Java_VM
  */
 JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved)
 {
+	JNIEnv *env = NULL;
+	int i;
+
+	Java_VM = vm;
 	DpRt_JNI_Set_Java_VM(vm);
+	if((*vm)->GetEnv(vm,(void**)&env,JNI_VERSION_1_2) == JNI_OK)
+	{
+		pthread_mutex_lock(&Done_Class_Mutex);
+		for(i = 0; i < DONE_CLASS_COUNT; i++)
+		{
+			if(!Done_Class_Cache(env,i))
+			{
+				fprintf(stderr,"JNI_OnLoad:Failed to cache %s:Setting it by name.\n",
+					Done_Class_Name_List[i]);
+			}
+		}
+		pthread_mutex_unlock(&Done_Class_Mutex);
+	}
 	return JNI_VERSION_1_2;
 }
 
@@ -60,6 +326,11 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved)
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Double
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Property_Boolean
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Log_Handler
+ * @see #Log_Handler
+ * @see #Log_Thread_Start
+ * @see #Log_Thread_Stop
+ * @see dprt_log.html#DpRt_Log_Thread_Hooks_Set
+ * @see dprt_log.html#DpRt_Log_Handler_Set
  */
 JNIEXPORT void JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Initialise(JNIEnv *env,jobject object)
 {
@@ -72,6 +343,9 @@ JNIEXPORT void JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Initialise(JNIEnv
 	DpRt_JNI_Set_Property_Integer_Function_Pointer(DpRt_JNI_DpRtStatus_Get_Property_Integer);
 	DpRt_JNI_Set_Property_Double_Function_Pointer(DpRt_JNI_DpRtStatus_Get_Property_Double);
 	DpRt_JNI_Set_Property_Boolean_Function_Pointer(DpRt_JNI_DpRtStatus_Get_Property_Boolean);
+	/* log messages are delivered to the Java logger by the log drain thread, attached to the JVM once */
+	DpRt_Log_Thread_Hooks_Set(Log_Thread_Start,Log_Thread_Stop);
+	DpRt_Log_Handler_Set(Log_Handler);
 	/* call c initialisation */
 	retval = DpRt_Initialise();
 	if(retval != TRUE)
@@ -97,6 +371,27 @@ JNIEXPORT void JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Shutdown(JNIEnv *
 		DpRt_JNI_Throw_Exception(env,"DpRt_Shutdown");
 }
 
+/**
+ * Class:     ngat_dprt_ftspec_DpRtLibrary<br>
+ * Method:    DpRt_Reload_Config<br>
+ * Signature: ()V<br>
+ * Java Native Interface implementation ngat.dprt.ftspec.DpRtLibrary's reloadConfig. This re-reads the
+ * "dprt.*" properties into the C layer's configuration snapshot, and should be called after the properties
+ * have been changed.
+ * @param env The JNI environment pointer.
+ * @param object The instance of ngat.dprt.ftspec.DpRtLibrary this method was called with.
+ * @see dprt.html#DpRt_Reload_Config
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT void JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Reload_1Config(JNIEnv *env,jobject object)
+{
+	int retval;
+
+	retval = DpRt_Reload_Config();
+	if(retval != TRUE)
+		DpRt_JNI_Throw_Exception(env,"DpRt_Reload_Config");
+}
+
 /**
  * Class:     ngat_dprt_ftspec_DpRtLibrary<br>
  * Method:    DpRt_Set_Status<br>
@@ -115,13 +410,34 @@ JNIEXPORT void JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Set_1Status(JNIEn
  * Signature: (Lngat/util/logging/Logger;)V<br>
  * Java Native Interface implementation ngat.dprt.ftspec.DpRtLibrary's initialiseLoggerReference.
  * This takes the supplied logger object reference and stores it in the logger variable as a global reference.
- * The log method ID is also retrieved and stored.
+ * The log method ID is also retrieved and stored. A global reference and the log method ID are kept here too,
+ * for Log_Handler to deliver the library's log messages with.
  * @param l The DpRtLibrary's "ngat.dprt.ftspec.DpRtLibrary" logger.
+ * @see #Logger
+ * @see #Logger_Log_Method_ID
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Initialise_Logger_Reference
  */
 JNIEXPORT void JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_initialiseLoggerReference(JNIEnv *env,jobject obj,jobject l)
 {
+	jclass cls = NULL;
+
 	DpRt_JNI_Initialise_Logger_Reference(env,obj,l);
+	pthread_mutex_lock(&Logger_Mutex);
+	if(Logger != NULL)
+		(*env)->DeleteGlobalRef(env,Logger);
+	Logger = NULL;
+	Logger_Log_Method_ID = NULL;
+	if(l != NULL)
+	{
+		cls = (*env)->GetObjectClass(env,l);
+		Logger_Log_Method_ID = (*env)->GetMethodID(env,cls,"log","(ILjava/lang/String;)V");
+		(*env)->DeleteLocalRef(env,cls);
+		if(Logger_Log_Method_ID != NULL)
+			Logger = (*env)->NewGlobalRef(env,l);
+		else
+			(*env)->ExceptionClear(env);
+	}
+	pthread_mutex_unlock(&Logger_Mutex);
 }
 
 /**
@@ -130,10 +446,17 @@ JNIEXPORT void JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_initialiseLoggerReferen
  * Signature: ()V<br>
  * This native method is called from ngat.dprt.ftspec.DpRtLibrary's finaliser method. It removes the global reference to
  * logger.
+ * @see #Logger
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Finalise_Logger_Reference
  */
 JNIEXPORT void JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_finaliseLoggerReference(JNIEnv *env, jobject obj)
 {
+	pthread_mutex_lock(&Logger_Mutex);
+	if(Logger != NULL)
+		(*env)->DeleteGlobalRef(env,Logger);
+	Logger = NULL;
+	Logger_Log_Method_ID = NULL;
+	pthread_mutex_unlock(&Logger_Mutex);
 	DpRt_JNI_Finalise_Logger_Reference(env);
 }
 
@@ -147,12 +470,10 @@ JNIEXPORT void JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_finaliseLoggerReference
  * @param input_filename_string The Java String object representing the filename string to be processed.
  * @param reduce_done A Java object of class CALIBRATE_REDUCE_DONE. As a result of the data pipeline the fields of this
  * instance of the class should be filled in.
+ * @see #Calibrate_Reduce_Done_Set
  * @see dprt.html#DpRt_Calibrate_Reduce
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_Number
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_String
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Command_Done
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Reduce_Done
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Calibrate_Reduce_Done
  */
 JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Calibrate_1Reduce(JNIEnv *env, jobject object, 
 				 jstring input_filename_string, jobject reduce_done)
@@ -163,7 +484,7 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Calibrate_1Re
 	double meanCounts = 0.0,peakCounts= 0.0;
 	int successful = FALSE;
 	int error_number = 0;
-	jclass cls;
+	int retval;
 
 	/* Get the filename froma java string to a c null terminated string
 	** If the java String is null the input_filename should be null as well */
@@ -182,23 +503,14 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Calibrate_1Re
 		(*env)->ReleaseStringUTFChars(env,input_filename_string,input_filename);
 
 	/* set the relevant fields in reduce_done */
-	/* get the class of the object passed in */
-	cls = (*env)->GetObjectClass(env,reduce_done);
-
-	if(DpRt_JNI_Set_Command_Done(env,cls,reduce_done,successful,error_number,error_string) == FALSE)
-		return FALSE;
-
-	if(DpRt_JNI_Set_Reduce_Done(env,cls,reduce_done,output_filename) == FALSE)
-		return FALSE;
+	retval = Calibrate_Reduce_Done_Set(env,reduce_done,successful,error_number,error_string,output_filename,
+					   meanCounts,peakCounts);
 
 	/* free output_filename allocated in Reduction */
 	if(output_filename != NULL)
 		free(output_filename);
 
-	if(DpRt_JNI_Set_Calibrate_Reduce_Done(env,cls,reduce_done,meanCounts,peakCounts) == FALSE)
-		return FALSE;
-
-	return TRUE;
+	return (jboolean)retval;
 }
 
 /**
@@ -211,25 +523,17 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Calibrate_1Re
  * @param input_filename_string The Java String object representing the filename string to be processed.
  * @param reduce_done A Java object of class EXPOSE_REDUCE_DONE. As a result of the data pipeline the fields of this
  * 	instance of the class should be filled in.
+ * @see #Expose_Reduce_Done_Set
  * @see dprt.html#DpRt_Expose_Reduce
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_Number
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_String
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Command_Done
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Reduce_Done
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Expose_Reduce_Done
  */
 JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Expose_1Reduce(JNIEnv *env,jobject object,
 								 jstring input_filename_string,jobject reduce_done)
 {
-	char error_string[DPRT_ERROR_STRING_LENGTH];
+	struct DpRt_Expose_Result_Struct result;
 	const char *input_filename = NULL;
-	char *output_filename = NULL;
-	double seeing = 0.0,counts = 0.0,x_pix = 0.0,y_pix = 0.0;
-	double photometricity = 0.0, sky_brightness = 0.0;
-	int saturated = FALSE;
-	int successful = FALSE;
-	int error_number = 0;
-	jclass cls;
+	int retval;
 
 	/* Get the filename froma java string to a c null terminated string
 	** If the java String is null the input_filename should be null as well */
@@ -237,46 +541,423 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Expose_1Reduc
 		input_filename = (*env)->GetStringUTFChars(env,input_filename_string,0);
 
 	/* call the reduction process */
-	successful = DpRt_Expose_Reduce((char*)input_filename,&output_filename,&seeing,&counts,&x_pix,&y_pix,
-					&photometricity,&sky_brightness,&saturated);
+	result.Output_Filename = NULL;
+	result.Seeing = 0.0;
+	result.Counts = 0.0;
+	result.X_Pix = 0.0;
+	result.Y_Pix = 0.0;
+	result.Photometricity = 0.0;
+	result.Sky_Brightness = 0.0;
+	result.Saturated = FALSE;
+	result.Successful = DpRt_Expose_Reduce((char*)input_filename,&(result.Output_Filename),&(result.Seeing),
+					       &(result.Counts),&(result.X_Pix),&(result.Y_Pix),
+					       &(result.Photometricity),&(result.Sky_Brightness),&(result.Saturated));
 
 	/* get the error information associated with this call */
-	error_number = DpRt_JNI_Get_Error_Number();
-	DpRt_JNI_Get_Error_String(error_string);
+	result.Error_Number = DpRt_JNI_Get_Error_Number();
+	DpRt_JNI_Get_Error_String(result.Error_String);
 
 	/* free any c strings allocated */
 	if(input_filename_string != NULL)
 		(*env)->ReleaseStringUTFChars(env,input_filename_string,input_filename);
 
 	/* set the relevant fields in reduce_done */
-	/* get the class of the object passed in */
-	cls = (*env)->GetObjectClass(env,reduce_done);
+	retval = Expose_Reduce_Done_Set(env,reduce_done,&result);
+
+	/* free output_filename allocated in DpRt_Expose_Reduce */
+	if(result.Output_Filename != NULL)
+		free(result.Output_Filename);
 
-	if(DpRt_JNI_Set_Command_Done(env,cls,reduce_done,successful,error_number,error_string) == FALSE)
+	return (jboolean)retval;
+}
+
+/**
+ * Class:     ngat_dprt_ftspec_DpRtLibrary<br>
+ * Method:    DpRt_Expose_Reduce_Batch<br>
+ * Signature: ([Ljava/lang/String;[Lngat/message/INST_DP/EXPOSE_REDUCE_DONE;)Z<br>
+ * JNI interface routine called when ngat.dprt.ftspec.DpRtLibrary.DpRtExposeReduceBatch is called.
+ * @param env The JNI environment pointer.
+ * @param object The instance of ngat.dprt.ftspec.DpRtLibrary this method was called with.
+ * @param input_filename_array A Java array of String objects, the filenames to be processed.
+ * @param reduce_done_array A Java array of EXPOSE_REDUCE_DONE objects, at least as long as input_filename_array.
+ * 	As a result of the data pipeline the fields of the instance at the same index as each filename
+ * 	should be filled in.
+ * @return The routine returns TRUE if the batch was processed and every reduce_done filled in, and FALSE
+ * 	otherwise. Whether each frame was reduced is returned in its reduce_done.
+ * @see #Expose_Reduce_Done_Set
+ * @see dprt.html#DpRt_Expose_Reduce_Batch
+ */
+JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Expose_1Reduce_1Batch(JNIEnv *env,
+			jobject object,jobjectArray input_filename_array,jobjectArray reduce_done_array)
+{
+	struct DpRt_Expose_Result_Struct *result_list = NULL;
+	jstring input_filename_string = NULL;
+	const char *input_filename = NULL;
+	char **input_filename_list = NULL;
+	jobject reduce_done;
+	int frame_count,i,retval;
+
+	if((input_filename_array == NULL)||(reduce_done_array == NULL))
+		return FALSE;
+	frame_count = (*env)->GetArrayLength(env,input_filename_array);
+	if((*env)->GetArrayLength(env,reduce_done_array) < frame_count)
+		return FALSE;
+	/* allocate at least one of each, so a zero length batch does not look like an allocation failure */
+	input_filename_list = (char **)calloc(frame_count+1,sizeof(char *));
+	result_list = (struct DpRt_Expose_Result_Struct *)malloc((frame_count+1)*
+								sizeof(struct DpRt_Expose_Result_Struct));
+	if((input_filename_list == NULL)||(result_list == NULL))
 	{
-		/* free output_filename allocated in DpRt_Expose_Reduce */
-		if(output_filename != NULL)
-			free(output_filename);
+		if(input_filename_list != NULL)
+			free(input_filename_list);
+		if(result_list != NULL)
+			free(result_list);
 		return FALSE;
 	}
+	/* Copy the filenames from java strings to c null terminated strings, deleting each element's local
+	** reference as it is copied, so a large batch does not overflow the local reference table.
+	** If a java String is null the input_filename should be null as well */
+	retval = TRUE;
+	for(i = 0; (i < frame_count) && retval; i++)
+	{
+		input_filename_string = (jstring)((*env)->GetObjectArrayElement(env,input_filename_array,i));
+		if(input_filename_string == NULL)
+			continue;
+		input_filename = (*env)->GetStringUTFChars(env,input_filename_string,0);
+		if(input_filename != NULL)
+		{
+			input_filename_list[i] = strdup(input_filename);
+			(*env)->ReleaseStringUTFChars(env,input_filename_string,input_filename);
+		}
+		(*env)->DeleteLocalRef(env,input_filename_string);
+		retval = (input_filename_list[i] != NULL);
+	}
+
+	/* call the reduction process */
+	if(retval)
+		retval = DpRt_Expose_Reduce_Batch(input_filename_list,frame_count,result_list);
 
-	if(DpRt_JNI_Set_Reduce_Done(env,cls,reduce_done,output_filename) == FALSE)
+	/* free any c strings allocated */
+	for(i = 0; i < frame_count; i++)
+	{
+		if(input_filename_list[i] != NULL)
+			free(input_filename_list[i]);
+	}
+	free(input_filename_list);
+	if(retval == FALSE)
 	{
-		/* free output_filename allocated in DpRt_Expose_Reduce */
-		if(output_filename != NULL)
-			free(output_filename);
+		free(result_list);
 		return FALSE;
 	}
 
-	/* free output_filename allocated in Reduction */
-	if(output_filename != NULL)
-		free(output_filename);
+	/* set the relevant fields in each reduce_done */
+	for(i = 0; i < frame_count; i++)
+	{
+		reduce_done = (*env)->GetObjectArrayElement(env,reduce_done_array,i);
+		if(retval && (reduce_done != NULL))
+			retval = Expose_Reduce_Done_Set(env,reduce_done,&(result_list[i]));
+		if(reduce_done != NULL)
+			(*env)->DeleteLocalRef(env,reduce_done);
+		/* free output_filename allocated in DpRt_Expose_Reduce_Batch */
+		if(result_list[i].Output_Filename != NULL)
+			free(result_list[i].Output_Filename);
+	}
+	free(result_list);
+	return retval;
+}
 
-	if(DpRt_JNI_Set_Expose_Reduce_Done(env,cls,reduce_done,seeing,counts,x_pix,y_pix,
-					   photometricity,sky_brightness,saturated) == FALSE)
+/**
+ * Class:     ngat_dprt_ftspec_DpRtLibrary<br>
+ * Method:    DpRt_Expose_Reduce_Buffer<br>
+ * Signature: (Ljava/nio/ByteBuffer;IIIIZLngat/message/INST_DP/EXPOSE_REDUCE_DONE;)Z<br>
+ * JNI interface routine called when ngat.dprt.ftspec.DpRtLibrary.DpRtExposeReduceBuffer is called. The frame is
+ * reduced straight from the camera's readout buffer, before it has been written to disk. The buffer must be a
+ * direct ByteBuffer; its memory is used in place, through GetDirectBufferAddress, and is not copied.
+ * The Java side must not modify the buffer until this routine returns.
+ * @param env The JNI environment pointer.
+ * @param object The instance of ngat.dprt.ftspec.DpRtLibrary this method was called with.
+ * @param pixel_buffer A direct java.nio.ByteBuffer holding the frame's raw 16 bit pixels, naxis2 rows of naxis1
+ * 	pixels.
+ * @param naxis1 The value of the NAXIS1 keyword, the number of columns in the frame.
+ * @param naxis2 The value of the NAXIS2 keyword, the number of rows in the frame.
+ * @param x_bin The value of the CCDXBIN keyword.
+ * @param y_bin The value of the CCDYBIN keyword.
+ * @param fits_byte_order True if the pixels are in the FITS encoding (big endian signed shorts offset by
+ * 	BZERO = 32768), false if they are unsigned shorts in the host's byte order.
+ * @param reduce_done A Java object of class EXPOSE_REDUCE_DONE. As a result of the data pipeline the fields of this
+ * 	instance of the class should be filled in. The filename is set to null, as no reduced frame is written.
+ * @return The routine returns TRUE if reduce_done was filled in, and FALSE otherwise.
+ * 	If the buffer is not direct, or is too small for the frame, an exception is thrown.
+ * @see #Expose_Reduce_Done_Set
+ * @see dprt.html#DpRt_Expose_Reduce_Buffer
+ * @see dprt.html#DpRt_Context_Error_Publish
+ * @see dprt_kernel.h#DPRT_KERNEL_PIXEL_FORMAT
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Expose_1Reduce_1Buffer(JNIEnv *env,
+			jobject object,jobject pixel_buffer,jint naxis1,jint naxis2,jint x_bin,jint y_bin,
+			jboolean fits_byte_order,jobject reduce_done)
+{
+	struct DpRt_Expose_Result_Struct result;
+	unsigned short *pixels = NULL;
+	jlong capacity;
+	int pixel_format;
+
+	if(pixel_buffer != NULL)
+		pixels = (unsigned short *)((*env)->GetDirectBufferAddress(env,pixel_buffer));
+	if(pixels == NULL)
+	{
+		DpRt_Error_Number = 117;
+		strcpy(DpRt_Error_String,"DpRt_Expose_Reduce_Buffer:pixel buffer was not a direct buffer.");
+		DpRt_Context_Error_Publish(FALSE);
+		DpRt_JNI_Throw_Exception(env,"DpRt_Expose_Reduce_Buffer");
+		return FALSE;
+	}
+	capacity = (*env)->GetDirectBufferCapacity(env,pixel_buffer);
+	if((naxis1 < 1)||(naxis2 < 1)||(capacity < ((jlong)naxis1)*naxis2*2))
+	{
+		DpRt_Error_Number = 118;
+		sprintf(DpRt_Error_String,"DpRt_Expose_Reduce_Buffer:pixel buffer of %ld bytes too small for "
+			"frame (%d,%d).",(long)capacity,naxis1,naxis2);
+		DpRt_Context_Error_Publish(FALSE);
+		DpRt_JNI_Throw_Exception(env,"DpRt_Expose_Reduce_Buffer");
 		return FALSE;
+	}
+	if(fits_byte_order)
+		pixel_format = DPRT_KERNEL_PIXEL_FORMAT_FITS;
+	else
+		pixel_format = DPRT_KERNEL_PIXEL_FORMAT_NATIVE;
 
-	return TRUE;
+	/* call the reduction process */
+	DpRt_Expose_Reduce_Buffer(pixels,pixel_format,naxis1,naxis2,x_bin,y_bin,&result);
+
+	/* set the relevant fields in reduce_done */
+	return (jboolean)Expose_Reduce_Done_Set(env,reduce_done,&result);
+}
+
+/**
+ * Class:     ngat_dprt_ftspec_DpRtLibrary<br>
+ * Method:    DpRt_Expose_Reduce_Submit<br>
+ * Signature: (Ljava/lang/String;Lngat/message/INST_DP/EXPOSE_REDUCE_DONE;)I<br>
+ * JNI interface routine called when ngat.dprt.ftspec.DpRtLibrary.DpRtExposeReduceSubmit is called. The frame is
+ * queued for reduction by the native job worker thread, and the routine returns the job handle at once. When the
+ * job finishes, reduce_done is filled in and the DpRtLibrary instance's
+ * <code>void exposeReduceDone(int jobId,EXPOSE_REDUCE_DONE done)</code> method is called from the worker thread.
+ * @param env The JNI environment pointer.
+ * @param object The instance of ngat.dprt.ftspec.DpRtLibrary this method was called with.
+ * @param input_filename_string The Java String object representing the filename string to be processed.
+ * @param reduce_done A Java object of class EXPOSE_REDUCE_DONE. When the job finishes the fields of this
+ * 	instance of the class are filled in.
+ * @return The handle of the submitted job. If the job could not be submitted, an exception is thrown.
+ * @see #Job_Reference_Struct
+ * @see #Job_Reference_Free
+ * @see #Job_Reference_Free_List_Empty
+ * @see #Job_Expose_Reduce_Callback
+ * @see #Expose_Reduce_Done_Method_ID
+ * @see dprt_job.html#DpRt_Job_Expose_Submit
+ * @see dprt.html#DpRt_Context_Error_Publish
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT jint JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Expose_1Reduce_1Submit(JNIEnv *env,jobject object,
+								 jstring input_filename_string,jobject reduce_done)
+{
+	struct Job_Reference_Struct *job_reference = NULL;
+	const char *input_filename = NULL;
+	jclass cls;
+	int job_id = 0;
+	int successful = FALSE;
+
+	if((Java_VM == NULL)||(reduce_done == NULL))
+	{
+		DpRt_Error_Number = 1109;
+		strcpy(DpRt_Error_String,"DpRt_Expose_Reduce_Submit:JavaVM or reduce_done was NULL.");
+		DpRt_Context_Error_Publish(FALSE);
+		DpRt_JNI_Throw_Exception(env,"DpRt_Expose_Reduce_Submit");
+		return -1;
+	}
+	/* delete the references of jobs whose callback could not, and resolve the callback method once */
+	Job_Reference_Free_List_Empty(env);
+	pthread_mutex_lock(&Job_Reference_Mutex);
+	if(Expose_Reduce_Done_Method_ID == NULL)
+	{
+		cls = (*env)->GetObjectClass(env,object);
+		Expose_Reduce_Done_Method_ID = (*env)->GetMethodID(env,cls,"exposeReduceDone",
+								   "(ILngat/message/INST_DP/EXPOSE_REDUCE_DONE;)V");
+		(*env)->DeleteLocalRef(env,cls);
+	}
+	successful = (Expose_Reduce_Done_Method_ID != NULL);
+	pthread_mutex_unlock(&Job_Reference_Mutex);
+	if(!successful)
+	{
+		(*env)->ExceptionClear(env);
+		DpRt_Error_Number = 1111;
+		strcpy(DpRt_Error_String,"DpRt_Expose_Reduce_Submit:exposeReduceDone method not found.");
+		DpRt_Context_Error_Publish(FALSE);
+		DpRt_JNI_Throw_Exception(env,"DpRt_Expose_Reduce_Submit");
+		return -1;
+	}
+	job_reference = (struct Job_Reference_Struct *)malloc(sizeof(struct Job_Reference_Struct));
+	if(job_reference == NULL)
+	{
+		DpRt_Error_Number = 1110;
+		strcpy(DpRt_Error_String,"DpRt_Expose_Reduce_Submit:Failed to allocate job reference.");
+		DpRt_Context_Error_Publish(FALSE);
+		DpRt_JNI_Throw_Exception(env,"DpRt_Expose_Reduce_Submit");
+		return -1;
+	}
+	/* the worker thread uses these objects after this call returns */
+	job_reference->Library = (*env)->NewGlobalRef(env,object);
+	job_reference->Reduce_Done = (*env)->NewGlobalRef(env,reduce_done);
+	job_reference->Next = NULL;
+
+	/* Get the filename froma java string to a c null terminated string
+	** If the java String is null the input_filename should be null as well */
+	if(input_filename_string != NULL)
+		input_filename = (*env)->GetStringUTFChars(env,input_filename_string,0);
+
+	/* queue the reduction */
+	successful = DpRt_Job_Expose_Submit((char*)input_filename,Job_Expose_Reduce_Callback,job_reference,&job_id);
+
+	/* free any c strings allocated */
+	if(input_filename_string != NULL)
+		(*env)->ReleaseStringUTFChars(env,input_filename_string,input_filename);
+
+	if(successful == FALSE)
+	{
+		Job_Reference_Free(env,job_reference);
+		/* the job queue sets the default context's error state, the exception is built from the JNI one */
+		DpRt_Context_Error_Publish(FALSE);
+		DpRt_JNI_Throw_Exception(env,"DpRt_Expose_Reduce_Submit");
+		return -1;
+	}
+	return (jint)job_id;
+}
+
+/**
+ * Class:     ngat_dprt_ftspec_DpRtLibrary<br>
+ * Method:    DpRt_Job_State_Get<br>
+ * Signature: (I)I<br>
+ * JNI interface routine called when ngat.dprt.ftspec.DpRtLibrary.DpRtJobStateGet is called.
+ * @param env The JNI environment pointer.
+ * @param object The instance of ngat.dprt.ftspec.DpRtLibrary this method was called with.
+ * @param job_id The handle of a job returned by DpRt_Expose_Reduce_Submit.
+ * @return The state of the job: 0 (queued), 1 (running) or 2 (done). If the job is not known, an exception
+ * 	is thrown.
+ * @see dprt_job.html#DpRt_Job_State_Get
+ * @see dprt_job.html#DPRT_JOB_STATE
+ * @see dprt.html#DpRt_Context_Error_Publish
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT jint JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Job_1State_1Get(JNIEnv *env,jobject object,
+									       jint job_id)
+{
+	enum DPRT_JOB_STATE state;
+
+	if(!DpRt_Job_State_Get((int)job_id,&state))
+	{
+		DpRt_Context_Error_Publish(FALSE);
+		DpRt_JNI_Throw_Exception(env,"DpRt_Job_State_Get");
+		return -1;
+	}
+	return (jint)state;
+}
+
+/**
+ * Class:     ngat_dprt_ftspec_DpRtLibrary<br>
+ * Method:    DpRt_Writer_Flush<br>
+ * Signature: ()V<br>
+ * JNI interface routine called when ngat.dprt.ftspec.DpRtLibrary.DpRtWriterFlush is called. It waits until the
+ * background writer has written every queued frame. If any write failed since the last flush, an exception
+ * describing the last failure is thrown.
+ * @param env The JNI environment pointer.
+ * @param object The instance of ngat.dprt.ftspec.DpRtLibrary this method was called with.
+ * @see dprt_writer.html#DpRt_Writer_Flush
+ * @see dprt.html#DpRt_Context_Error_Publish
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Throw_Exception
+ */
+JNIEXPORT void JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Writer_1Flush(JNIEnv *env,jobject object)
+{
+	if(!DpRt_Writer_Flush())
+	{
+		DpRt_Context_Error_Publish(FALSE);
+		DpRt_JNI_Throw_Exception(env,"DpRt_Writer_Flush");
+	}
+}
+
+/**
+ * Class:     ngat_dprt_ftspec_DpRtLibrary<br>
+ * Method:    DpRt_Writer_Status_Get<br>
+ * Signature: ()[J<br>
+ * JNI interface routine called when ngat.dprt.ftspec.DpRtLibrary.DpRtWriterStatusGet is called.
+ * @param env The JNI environment pointer.
+ * @param object The instance of ngat.dprt.ftspec.DpRtLibrary this method was called with.
+ * @return An array of WRITER_STATUS_COUNT longs holding the background writer's status, indexed by
+ * 	WRITER_STATUS_INDEX, or NULL if the array could not be created.
+ * @see #WRITER_STATUS_COUNT
+ * @see #WRITER_STATUS_INDEX
+ * @see dprt_writer.html#DpRt_Writer_Status_Get
+ */
+JNIEXPORT jlongArray JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Writer_1Status_1Get(JNIEnv *env,
+											  jobject object)
+{
+	struct DpRt_Writer_Status_Struct status;
+	jlong status_list[WRITER_STATUS_COUNT];
+	jlongArray status_array;
+
+	DpRt_Writer_Status_Get(&status);
+	status_list[WRITER_STATUS_THREAD_COUNT] = (jlong)status.Thread_Count;
+	status_list[WRITER_STATUS_QUEUED_COUNT] = (jlong)status.Queued_Count;
+	status_list[WRITER_STATUS_ACTIVE_COUNT] = (jlong)status.Active_Count;
+	status_list[WRITER_STATUS_WRITTEN_COUNT] = (jlong)status.Written_Count;
+	status_list[WRITER_STATUS_FAILED_COUNT] = (jlong)status.Failed_Count;
+	status_list[WRITER_STATUS_LAST_ERROR_NUMBER] = (jlong)status.Last_Error_Number;
+	status_array = (*env)->NewLongArray(env,WRITER_STATUS_COUNT);
+	if(status_array == NULL)
+		return NULL;
+	(*env)->SetLongArrayRegion(env,status_array,0,WRITER_STATUS_COUNT,status_list);
+	return status_array;
+}
+
+/**
+ * Class:     ngat_dprt_ftspec_DpRtLibrary<br>
+ * Method:    DpRt_Metrics_Get<br>
+ * Signature: (Z)[J<br>
+ * JNI interface routine called when ngat.dprt.ftspec.DpRtLibrary.DpRtMetricsGet is called, to get a snapshot
+ * of the stage timings and counters summed over every reduction thread.
+ * @param env The JNI environment pointer.
+ * @param object The instance of ngat.dprt.ftspec.DpRtLibrary this method was called with.
+ * @param reset If true, the timings and counters are cleared once the snapshot is taken.
+ * @return An array of METRICS_COUNT longs laid out as described by METRICS_INDEX, or NULL if the array
+ * 	could not be created.
+ * @see #METRICS_COUNT
+ * @see #METRICS_INDEX
+ * @see #METRICS_STAGE_ELEMENT
+ * @see dprt_metrics.html#DpRt_Metrics_Snapshot_Get
+ */
+JNIEXPORT jlongArray JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Metrics_1Get(JNIEnv *env,jobject object,
+										  jboolean reset)
+{
+	struct DpRt_Metrics_Snapshot_Struct snapshot;
+	jlong metrics_list[METRICS_COUNT];
+	jlongArray metrics_array;
+	int i,index;
+
+	DpRt_Metrics_Snapshot_Get(&snapshot,(reset == JNI_TRUE));
+	for(i = 0; i < DPRT_METRICS_STAGE_COUNT; i++)
+	{
+		index = METRICS_STAGE_START+(i*METRICS_STAGE_ELEMENT_COUNT);
+		metrics_list[index+METRICS_STAGE_COUNT] = (jlong)snapshot.Stage_Count_List[i];
+		metrics_list[index+METRICS_STAGE_TIME] = (jlong)(snapshot.Stage_Time_List[i]*1.0e6);
+		metrics_list[index+METRICS_STAGE_TIME_MAXIMUM] = (jlong)(snapshot.Stage_Time_Maximum_List[i]*1.0e6);
+	}
+	for(i = 0; i < DPRT_METRICS_COUNTER_COUNT; i++)
+		metrics_list[METRICS_COUNTER_START+i] = (jlong)snapshot.Counter_List[i];
+	metrics_list[METRICS_THREAD_COUNT] = (jlong)snapshot.Thread_Count;
+	metrics_array = (*env)->NewLongArray(env,METRICS_COUNT);
+	if(metrics_array == NULL)
+		return NULL;
+	(*env)->SetLongArrayRegion(env,metrics_array,0,METRICS_COUNT,metrics_list);
+	return metrics_array;
 }
 
 /**
@@ -289,11 +970,10 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Expose_1Reduc
  * @param dirname_jstring The Java String object representing the directory to be processed.
  * @param make_master_bias_done A Java object of class MAKE_MASTER_BIAS_DONE. 
  * 	As a result of the data pipeline the fields of this instance of the class should be filled in.
+ * @see #Make_Master_Done_Set
  * @see dprt.html#DpRt_Make_Master_Bias
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_Number
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_String
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Command_Done
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Reduce_Done
  */
 JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Make_1Master_1Bias(JNIEnv *env, jobject object, 
 			   jstring dirname_jstring, jobject make_master_bias_done)
@@ -302,7 +982,6 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Make_1Master_
 	const char *dirname_cstring = NULL;
 	int successful = FALSE;
 	int error_number = 0;
-	jclass cls;
 
 	/* Get the filename froma java string to a c null terminated string
 	** If the java String is null the dirname_cstring should be null as well */
@@ -321,14 +1000,8 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Make_1Master_
 		(*env)->ReleaseStringUTFChars(env,dirname_jstring,dirname_cstring);
 
 	/* set the relevant fields in make_master_bias_done */
-	/* get the class of the object passed in */
-	cls = (*env)->GetObjectClass(env,make_master_bias_done);
-
-	if(DpRt_JNI_Set_Command_Done(env,cls,make_master_bias_done,successful,error_number,error_string) == FALSE)
-	{
-		return FALSE;
-	}
-	return TRUE;
+	return (jboolean)Make_Master_Done_Set(env,DONE_CLASS_MAKE_MASTER_BIAS,make_master_bias_done,successful,error_number,
+					      error_string);
 }
 /*
  * Class:     ngat_dprt_ftspec_DpRtLibrary<br>
@@ -340,11 +1013,10 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Make_1Master_
  * @param dirname_jstring The Java String object representing the directory to be processed.
  * @param make_master_flat_done A Java object of class MAKE_MASTER_FLAT_DONE. 
  * 	As a result of the data pipeline the fields of this instance of the class should be filled in.
+ * @see #Make_Master_Done_Set
  * @see dprt.html#DpRt_Make_Master_Flat
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_Number
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Get_Error_String
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Command_Done
- * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Reduce_Done
  */
 JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Make_1Master_1Flat(JNIEnv *env, jobject object, 
 			     jstring dirname_jstring, jobject make_master_flat_done)
@@ -353,7 +1025,6 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Make_1Master_
 	const char *dirname_cstring = NULL;
 	int successful = FALSE;
 	int error_number = 0;
-	jclass cls;
 
 	/* Get the filename froma java string to a c null terminated string
 	** If the java String is null the dirname_cstring should be null as well */
@@ -372,46 +1043,558 @@ JNIEXPORT jboolean JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Make_1Master_
 		(*env)->ReleaseStringUTFChars(env,dirname_jstring,dirname_cstring);
 
 	/* set the relevant fields in make_master_flat_done */
-	/* get the class of the object passed in */
-	cls = (*env)->GetObjectClass(env,make_master_flat_done);
-
-	if(DpRt_JNI_Set_Command_Done(env,cls,make_master_flat_done,successful,error_number,error_string) == FALSE)
-	{
-		return FALSE;
-	}
-	return TRUE;
+	return (jboolean)Make_Master_Done_Set(env,DONE_CLASS_MAKE_MASTER_FLAT,make_master_flat_done,successful,error_number,
+					      error_string);
 }
 
 /**
  * Class:     ngat_dprt_ftspec_DpRtLibrary<br>
  * Method:    DpRt_Abort<br>
  * Signature: ()V<br>
- * JNI interface routine called when ngat.dprt.ftspec.DpRtLibrary.DpRtAbort is called.
+ * JNI interface routine called when ngat.dprt.ftspec.DpRtLibrary.DpRtAbort is called. As well as the
+ * jni_general abort flag being set, the library's abort generation is moved on, so every reduction in progress
+ * (and every reduction job still queued) stops at its next abort checkpoint.
  * @param env The JNI environment pointer.
  * @param object The instance of ngat.dprt.ftspec.DpRtLibrary this method was called with.
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Abort
+ * @see dprt_abort.html#DpRt_Abort_Request
  */
 JNIEXPORT void JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Abort(JNIEnv *env, jobject object)
 {
 	DpRt_JNI_Set_Abort(TRUE);
+	DpRt_Abort_Request();
 }
 
 /**
  * Class:     ngat_dprt_ftspec_DpRtLibrary<br>
  * Method:    DpRt_Finalise_References<br>
  * Signature: ()V<br>
+ * The global references to the cached DONE classes are deleted, and their method IDs invalidated. They are
+ * resolved again if another result is marshalled. The references of any jobs whose callback could not delete
+ * them are deleted too.
  * @param env The JNI environment pointer.
  * @param object The instance of ngat.dprt.ftspec.DpRtLibrary this method was called with.
+ * @see #Done_Class_Uncache
+ * @see #Job_Reference_Free_List_Empty
  * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Finalise_Status_Reference
  */
 JNIEXPORT void JNICALL Java_ngat_dprt_ftspec_DpRtLibrary_DpRt_1Finalise_1References(JNIEnv *env,jobject object)
 {
+	int i;
+
 	DpRt_JNI_Finalise_Status_Reference(env);
+	pthread_mutex_lock(&Done_Class_Mutex);
+	for(i = 0; i < DONE_CLASS_COUNT; i++)
+		Done_Class_Uncache(env,i);
+	pthread_mutex_unlock(&Done_Class_Mutex);
+	Job_Reference_Free_List_Empty(env);
 }
 
 /* -------------------------------------------------- */
 /* internal routines */
 /* -------------------------------------------------- */
+/**
+ * Callback called from the job worker thread when an asynchronous expose reduction finishes. The thread is
+ * attached to the JVM, the job's EXPOSE_REDUCE_DONE object is filled in from the result, and the submitting
+ * DpRtLibrary's <code>exposeReduceDone(int jobId,EXPOSE_REDUCE_DONE done)</code> method is called with it,
+ * through the method ID cached by DpRt_Expose_Reduce_Submit. The job's global references are then deleted, and
+ * the thread detached. If the thread cannot be attached, the job's references are put on Job_Reference_Free_List,
+ * for the next JNI call to delete.
+ * @param job_id The handle of the finished job.
+ * @param result The result of the job.
+ * @param user_arg The job's Job_Reference_Struct, allocated by DpRt_Expose_Reduce_Submit. It is freed.
+ * @see #Java_VM
+ * @see #Job_Reference_Struct
+ * @see #Job_Reference_Free
+ * @see #Job_Reference_Free_List
+ * @see #Expose_Reduce_Done_Method_ID
+ * @see #Expose_Reduce_Done_Set
+ */
+static void Job_Expose_Reduce_Callback(int job_id,struct DpRt_Expose_Result_Struct *result,void *user_arg)
+{
+	struct Job_Reference_Struct *job_reference = NULL;
+	JNIEnv *env = NULL;
+	jmethodID method_id;
+	int retval;
+
+	job_reference = (struct Job_Reference_Struct *)user_arg;
+	if((*Java_VM)->AttachCurrentThread(Java_VM,(void**)&env,NULL) != JNI_OK)
+	{
+		fprintf(stderr,"Job_Expose_Reduce_Callback:Job %d:Failed to attach to the JVM.\n",job_id);
+		pthread_mutex_lock(&Job_Reference_Mutex);
+		job_reference->Next = Job_Reference_Free_List;
+		Job_Reference_Free_List = job_reference;
+		pthread_mutex_unlock(&Job_Reference_Mutex);
+		return;
+	}
+	/* set the relevant fields in reduce_done */
+	retval = Expose_Reduce_Done_Set(env,job_reference->Reduce_Done,result);
+	if(retval == FALSE)
+		fprintf(stderr,"Job_Expose_Reduce_Callback:Job %d:Failed to set EXPOSE_REDUCE_DONE.\n",job_id);
+	if((*env)->ExceptionCheck(env))
+	{
+		(*env)->ExceptionDescribe(env);
+		(*env)->ExceptionClear(env);
+	}
+	/* tell the library the job has finished */
+	pthread_mutex_lock(&Job_Reference_Mutex);
+	method_id = Expose_Reduce_Done_Method_ID;
+	pthread_mutex_unlock(&Job_Reference_Mutex);
+	(*env)->CallVoidMethod(env,job_reference->Library,method_id,(jint)job_id,job_reference->Reduce_Done);
+	if((*env)->ExceptionCheck(env))
+	{
+		(*env)->ExceptionDescribe(env);
+		(*env)->ExceptionClear(env);
+	}
+	Job_Reference_Free(env,job_reference);
+	(*Java_VM)->DetachCurrentThread(Java_VM);
+}
+
+/**
+ * Delete a job's global references, and free its Job_Reference_Struct.
+ * @param env The JNI environment pointer.
+ * @param job_reference The job's references.
+ * @see #Job_Reference_Struct
+ */
+static void Job_Reference_Free(JNIEnv *env,struct Job_Reference_Struct *job_reference)
+{
+	(*env)->DeleteGlobalRef(env,job_reference->Library);
+	(*env)->DeleteGlobalRef(env,job_reference->Reduce_Done);
+	free(job_reference);
+}
+
+/**
+ * Free the job references whose callback could not attach to the JVM to free them.
+ * @param env The JNI environment pointer.
+ * @see #Job_Reference_Free_List
+ * @see #Job_Reference_Free
+ */
+static void Job_Reference_Free_List_Empty(JNIEnv *env)
+{
+	struct Job_Reference_Struct *job_reference_list = NULL;
+	struct Job_Reference_Struct *job_reference = NULL;
+
+	pthread_mutex_lock(&Job_Reference_Mutex);
+	job_reference_list = Job_Reference_Free_List;
+	Job_Reference_Free_List = NULL;
+	pthread_mutex_unlock(&Job_Reference_Mutex);
+	while(job_reference_list != NULL)
+	{
+		job_reference = job_reference_list;
+		job_reference_list = job_reference->Next;
+		Job_Reference_Free(env,job_reference);
+	}
+}
+
+/**
+ * Log handler set with DpRt_Log_Handler_Set, called from the log drain thread to deliver each message. The
+ * drain thread was attached to the JVM when it started, by Log_Thread_Start, so the message is passed straight
+ * to the logger's log method, through the method ID cached by initialiseLoggerReference. If the message is
+ * delivered by another thread, because the drain thread is not running, that thread's JNIEnv is used if it is
+ * attached, otherwise the message is written to stderr. If no logger is set, the message is passed to
+ * DpRt_JNI_Log_Handler.
+ * @param level The level of the message, a DPRT_LOG_LEVEL value.
+ * @param string The message.
+ * @see #Log_Env
+ * @see #Logger
+ * @see #Logger_Log_Method_ID
+ * @see dprt_log.h#DPRT_LOG_LEVEL
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Log_Handler
+ */
+static void Log_Handler(int level,char *string)
+{
+	JNIEnv *env = NULL;
+	jstring java_string = NULL;
+
+	env = Log_Env;
+	if((env == NULL)&&(Java_VM != NULL))
+	{
+		if((*Java_VM)->GetEnv(Java_VM,(void**)&env,JNI_VERSION_1_2) != JNI_OK)
+			env = NULL;
+	}
+	if(env == NULL)
+	{
+		fprintf(stderr,"%s\n",string);
+		return;
+	}
+	pthread_mutex_lock(&Logger_Mutex);
+	if(Logger == NULL)
+	{
+		pthread_mutex_unlock(&Logger_Mutex);
+		DpRt_JNI_Log_Handler(level,string);
+		return;
+	}
+	java_string = (*env)->NewStringUTF(env,string);
+	if(java_string != NULL)
+	{
+		(*env)->CallVoidMethod(env,Logger,Logger_Log_Method_ID,(jint)level,java_string);
+		(*env)->DeleteLocalRef(env,java_string);
+	}
+	/* the drain thread has no Java caller to pass an exception to */
+	if((*env)->ExceptionCheck(env))
+		(*env)->ExceptionClear(env);
+	pthread_mutex_unlock(&Logger_Mutex);
+}
+
+/**
+ * Log drain thread start hook set with DpRt_Log_Thread_Hooks_Set. The drain thread is attached to the JVM, as a
+ * daemon so it does not hold the JVM up when it exits, and stays attached until Log_Thread_Stop.
+ * @see #Log_Env
+ * @see #Java_VM
+ * @see dprt_log.html#DpRt_Log_Thread_Hooks_Set
+ */
+static void Log_Thread_Start(void)
+{
+	JNIEnv *env = NULL;
+
+	if(Java_VM == NULL)
+		return;
+	if((*Java_VM)->AttachCurrentThreadAsDaemon(Java_VM,(void**)&env,NULL) != JNI_OK)
+	{
+		fprintf(stderr,"Log_Thread_Start:Failed to attach the log drain thread.\n");
+		return;
+	}
+	Log_Env = env;
+}
+
+/**
+ * Log drain thread stop hook set with DpRt_Log_Thread_Hooks_Set. The drain thread is detached from the JVM, if
+ * Log_Thread_Start attached it.
+ * @see #Log_Env
+ * @see #Java_VM
+ * @see dprt_log.html#DpRt_Log_Thread_Hooks_Set
+ */
+static void Log_Thread_Stop(void)
+{
+	if(Log_Env == NULL)
+		return;
+	Log_Env = NULL;
+	(*Java_VM)->DetachCurrentThread(Java_VM);
+}
+
+/**
+ * Resolve one DONE class and its setter method IDs, and cache them in Done_Class_List. Done_Class_Mutex should
+ * be held. If the class or any of its setters cannot be resolved, the pending exception is cleared and nothing
+ * is cached.
+ * @param env The JNI environment pointer.
+ * @param index Which DONE class to cache, a DONE_CLASS_INDEX.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Done_Class_List
+ * @see #Done_Class_Name_List
+ * @see #Done_Class_Uncache
+ */
+static int Done_Class_Cache(JNIEnv *env,int index)
+{
+	struct Done_Class_Struct done_class;
+	jclass cls;
+	int retval;
+
+	memset(&done_class,0,sizeof(struct Done_Class_Struct));
+	cls = (*env)->FindClass(env,Done_Class_Name_List[index]);
+	if(cls == NULL)
+	{
+		(*env)->ExceptionClear(env);
+		return FALSE;
+	}
+	done_class.Set_Successful = (*env)->GetMethodID(env,cls,"setSuccessful","(Z)V");
+	done_class.Set_Error_Num = (*env)->GetMethodID(env,cls,"setErrorNum","(I)V");
+	done_class.Set_Error_String = (*env)->GetMethodID(env,cls,"setErrorString","(Ljava/lang/String;)V");
+	retval = (done_class.Set_Successful != NULL)&&(done_class.Set_Error_Num != NULL)&&
+		(done_class.Set_Error_String != NULL);
+	if(retval && ((index == DONE_CLASS_CALIBRATE_REDUCE)||(index == DONE_CLASS_EXPOSE_REDUCE)))
+	{
+		done_class.Set_Filename = (*env)->GetMethodID(env,cls,"setFilename","(Ljava/lang/String;)V");
+		retval = (done_class.Set_Filename != NULL);
+	}
+	if(retval && (index == DONE_CLASS_CALIBRATE_REDUCE))
+	{
+		done_class.Set_Mean_Counts = (*env)->GetMethodID(env,cls,"setMeanCounts","(F)V");
+		done_class.Set_Peak_Counts = (*env)->GetMethodID(env,cls,"setPeakCounts","(F)V");
+		retval = (done_class.Set_Mean_Counts != NULL)&&(done_class.Set_Peak_Counts != NULL);
+	}
+	if(retval && (index == DONE_CLASS_EXPOSE_REDUCE))
+	{
+		done_class.Set_Seeing = (*env)->GetMethodID(env,cls,"setSeeing","(F)V");
+		done_class.Set_Counts = (*env)->GetMethodID(env,cls,"setCounts","(F)V");
+		done_class.Set_X_Pix = (*env)->GetMethodID(env,cls,"setXpix","(F)V");
+		done_class.Set_Y_Pix = (*env)->GetMethodID(env,cls,"setYpix","(F)V");
+		done_class.Set_Photometricity = (*env)->GetMethodID(env,cls,"setPhotometricity","(F)V");
+		done_class.Set_Sky_Brightness = (*env)->GetMethodID(env,cls,"setSkyBrightness","(F)V");
+		done_class.Set_Saturation = (*env)->GetMethodID(env,cls,"setSaturation","(Z)V");
+		retval = (done_class.Set_Seeing != NULL)&&(done_class.Set_Counts != NULL)&&
+			(done_class.Set_X_Pix != NULL)&&(done_class.Set_Y_Pix != NULL)&&
+			(done_class.Set_Photometricity != NULL)&&(done_class.Set_Sky_Brightness != NULL)&&
+			(done_class.Set_Saturation != NULL);
+	}
+	if(retval)
+		done_class.Class = (jclass)((*env)->NewGlobalRef(env,cls));
+	(*env)->DeleteLocalRef(env,cls);
+	if((!retval)||(done_class.Class == NULL))
+	{
+		(*env)->ExceptionClear(env);
+		return FALSE;
+	}
+	Done_Class_List[index] = done_class;
+	return TRUE;
+}
+
+/**
+ * Delete the global reference to a cached DONE class, and invalidate its method IDs. Done_Class_Mutex should be
+ * held.
+ * @param env The JNI environment pointer.
+ * @param index Which DONE class to uncache, a DONE_CLASS_INDEX.
+ * @see #Done_Class_List
+ * @see #Done_Class_Cache
+ */
+static void Done_Class_Uncache(JNIEnv *env,int index)
+{
+	if(Done_Class_List[index].Class != NULL)
+		(*env)->DeleteGlobalRef(env,Done_Class_List[index].Class);
+	memset(&(Done_Class_List[index]),0,sizeof(struct Done_Class_Struct));
+}
+
+/**
+ * Get a copy of a cached DONE class, resolving it again if it has been uncached since JNI_OnLoad. A thread
+ * attached from native code may not be able to find the class, in which case FALSE is returned. The entry is
+ * copied under Done_Class_Mutex, as DpRt_Finalise_References may uncache it once the mutex is released. The
+ * copied method IDs stay valid while the DONE object they are called on keeps its class loaded; the copied
+ * class reference must not be used.
+ * @param env The JNI environment pointer.
+ * @param index Which DONE class to get, a DONE_CLASS_INDEX.
+ * @param done_class The address of a structure to copy the cached class's method IDs into.
+ * @return The routine returns TRUE if the class is cached, and FALSE if it is not.
+ * @see #Done_Class_List
+ * @see #Done_Class_Mutex
+ * @see #Done_Class_Cache
+ */
+static int Done_Class_Get(JNIEnv *env,int index,struct Done_Class_Struct *done_class)
+{
+	int retval;
+
+	pthread_mutex_lock(&Done_Class_Mutex);
+	retval = (Done_Class_List[index].Class != NULL)||Done_Class_Cache(env,index);
+	if(retval)
+		(*done_class) = Done_Class_List[index];
+	pthread_mutex_unlock(&Done_Class_Mutex);
+	return retval;
+}
+
+/**
+ * Set the COMMAND_DONE fields of a DONE object, using cached method IDs.
+ * @param env The JNI environment pointer.
+ * @param done_class The cached class of done.
+ * @param done The DONE object to fill in.
+ * @param successful Whether the command succeeded.
+ * @param error_number The error number.
+ * @param error_string The error string.
+ * @return The routine returns TRUE on success and FALSE if a setter threw an exception.
+ * @see #Done_Class_Struct
+ */
+static int Done_Command_Set(JNIEnv *env,struct Done_Class_Struct *done_class,jobject done,int successful,
+			    int error_number,char *error_string)
+{
+	jstring string;
+
+	(*env)->CallVoidMethod(env,done,done_class->Set_Successful,(jboolean)(successful ? JNI_TRUE : JNI_FALSE));
+	if((*env)->ExceptionCheck(env))
+		return FALSE;
+	(*env)->CallVoidMethod(env,done,done_class->Set_Error_Num,(jint)error_number);
+	if((*env)->ExceptionCheck(env))
+		return FALSE;
+	string = (*env)->NewStringUTF(env,error_string);
+	if(string == NULL)
+		return FALSE;
+	(*env)->CallVoidMethod(env,done,done_class->Set_Error_String,string);
+	(*env)->DeleteLocalRef(env,string);
+	if((*env)->ExceptionCheck(env))
+		return FALSE;
+	return TRUE;
+}
+
+/**
+ * Set the REDUCE_DONE fields of a DONE object, using cached method IDs.
+ * @param env The JNI environment pointer.
+ * @param done_class The cached class of done.
+ * @param done The DONE object to fill in.
+ * @param filename The reduced filename, or NULL.
+ * @return The routine returns TRUE on success and FALSE if the setter threw an exception.
+ * @see #Done_Class_Struct
+ */
+static int Done_Reduce_Set(JNIEnv *env,struct Done_Class_Struct *done_class,jobject done,char *filename)
+{
+	jstring string = NULL;
+
+	if(filename != NULL)
+	{
+		string = (*env)->NewStringUTF(env,filename);
+		if(string == NULL)
+			return FALSE;
+	}
+	(*env)->CallVoidMethod(env,done,done_class->Set_Filename,string);
+	if(string != NULL)
+		(*env)->DeleteLocalRef(env,string);
+	if((*env)->ExceptionCheck(env))
+		return FALSE;
+	return TRUE;
+}
+
+/**
+ * Fill in a CALIBRATE_REDUCE_DONE object with a calibration reduction's result. The cached class is used if
+ * there is one, otherwise the fields are set by name through jni_general.
+ * @param env The JNI environment pointer.
+ * @param done The CALIBRATE_REDUCE_DONE object to fill in.
+ * @param successful Whether the reduction succeeded.
+ * @param error_number The error number.
+ * @param error_string The error string.
+ * @param filename The reduced filename, or NULL.
+ * @param mean_counts The mean counts.
+ * @param peak_counts The peak counts.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Done_Class_Get
+ * @see #Done_Command_Set
+ * @see #Done_Reduce_Set
+ * @see #Done_Float_Set
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Command_Done
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Reduce_Done
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Calibrate_Reduce_Done
+ */
+static int Calibrate_Reduce_Done_Set(JNIEnv *env,jobject done,int successful,int error_number,char *error_string,
+				     char *filename,double mean_counts,double peak_counts)
+{
+	struct Done_Class_Struct done_class;
+	jclass cls;
+	int retval;
+
+	if(!Done_Class_Get(env,DONE_CLASS_CALIBRATE_REDUCE,&done_class))
+	{
+		cls = (*env)->GetObjectClass(env,done);
+		retval = DpRt_JNI_Set_Command_Done(env,cls,done,successful,error_number,error_string);
+		if(retval)
+			retval = DpRt_JNI_Set_Reduce_Done(env,cls,done,filename);
+		if(retval)
+			retval = DpRt_JNI_Set_Calibrate_Reduce_Done(env,cls,done,mean_counts,peak_counts);
+		(*env)->DeleteLocalRef(env,cls);
+		return retval;
+	}
+	retval = Done_Command_Set(env,&done_class,done,successful,error_number,error_string);
+	if(retval)
+		retval = Done_Reduce_Set(env,&done_class,done,filename);
+	if(retval)
+		retval = Done_Float_Set(env,done,done_class.Set_Mean_Counts,mean_counts);
+	if(retval)
+		retval = Done_Float_Set(env,done,done_class.Set_Peak_Counts,peak_counts);
+	return retval;
+}
+
+/**
+ * Fill in an EXPOSE_REDUCE_DONE object with an expose reduction's result. The cached class is used if there is
+ * one, otherwise the fields are set by name through jni_general.
+ * @param env The JNI environment pointer.
+ * @param done The EXPOSE_REDUCE_DONE object to fill in.
+ * @param result The result of the reduction.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Done_Class_Get
+ * @see #Done_Command_Set
+ * @see #Done_Reduce_Set
+ * @see #Done_Float_Set
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Command_Done
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Reduce_Done
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Expose_Reduce_Done
+ */
+static int Expose_Reduce_Done_Set(JNIEnv *env,jobject done,struct DpRt_Expose_Result_Struct *result)
+{
+	struct Done_Class_Struct done_class;
+	jclass cls;
+	int retval;
+
+	if(!Done_Class_Get(env,DONE_CLASS_EXPOSE_REDUCE,&done_class))
+	{
+		cls = (*env)->GetObjectClass(env,done);
+		retval = DpRt_JNI_Set_Command_Done(env,cls,done,result->Successful,result->Error_Number,
+						   result->Error_String);
+		if(retval)
+			retval = DpRt_JNI_Set_Reduce_Done(env,cls,done,result->Output_Filename);
+		if(retval)
+		{
+			retval = DpRt_JNI_Set_Expose_Reduce_Done(env,cls,done,result->Seeing,result->Counts,
+								 result->X_Pix,result->Y_Pix,result->Photometricity,
+								 result->Sky_Brightness,result->Saturated);
+		}
+		(*env)->DeleteLocalRef(env,cls);
+		return retval;
+	}
+	retval = Done_Command_Set(env,&done_class,done,result->Successful,result->Error_Number,result->Error_String);
+	if(retval)
+		retval = Done_Reduce_Set(env,&done_class,done,result->Output_Filename);
+	if(retval)
+		retval = Done_Float_Set(env,done,done_class.Set_Seeing,result->Seeing);
+	if(retval)
+		retval = Done_Float_Set(env,done,done_class.Set_Counts,result->Counts);
+	if(retval)
+		retval = Done_Float_Set(env,done,done_class.Set_X_Pix,result->X_Pix);
+	if(retval)
+		retval = Done_Float_Set(env,done,done_class.Set_Y_Pix,result->Y_Pix);
+	if(retval)
+		retval = Done_Float_Set(env,done,done_class.Set_Photometricity,result->Photometricity);
+	if(retval)
+		retval = Done_Float_Set(env,done,done_class.Set_Sky_Brightness,result->Sky_Brightness);
+	if(retval)
+	{
+		(*env)->CallVoidMethod(env,done,done_class.Set_Saturation,
+				       (jboolean)(result->Saturated ? JNI_TRUE : JNI_FALSE));
+		retval = !((*env)->ExceptionCheck(env));
+	}
+	return retval;
+}
+
+/**
+ * Fill in a MAKE_MASTER_BIAS_DONE or MAKE_MASTER_FLAT_DONE object. The cached class is used if there is one,
+ * otherwise the fields are set by name through jni_general.
+ * @param env The JNI environment pointer.
+ * @param index DONE_CLASS_MAKE_MASTER_BIAS or DONE_CLASS_MAKE_MASTER_FLAT.
+ * @param done The DONE object to fill in.
+ * @param successful Whether the command succeeded.
+ * @param error_number The error number.
+ * @param error_string The error string.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Done_Class_Get
+ * @see #Done_Command_Set
+ * @see ../../jni_general/cdocs/dprt_jni_general.html#DpRt_JNI_Set_Command_Done
+ */
+static int Make_Master_Done_Set(JNIEnv *env,int index,jobject done,int successful,int error_number,
+				char *error_string)
+{
+	struct Done_Class_Struct done_class;
+	jclass cls;
+	int retval;
+
+	if(!Done_Class_Get(env,index,&done_class))
+	{
+		cls = (*env)->GetObjectClass(env,done);
+		retval = DpRt_JNI_Set_Command_Done(env,cls,done,successful,error_number,error_string);
+		(*env)->DeleteLocalRef(env,cls);
+		return retval;
+	}
+	return Done_Command_Set(env,&done_class,done,successful,error_number,error_string);
+}
+
+/**
+ * Call a cached float setter of a DONE object.
+ * @param env The JNI environment pointer.
+ * @param done The DONE object.
+ * @param method_id The method ID of the setter, which takes a single float.
+ * @param value The value to set.
+ * @return The routine returns TRUE on success and FALSE if the setter threw an exception.
+ */
+static int Done_Float_Set(JNIEnv *env,jobject done,jmethodID method_id,double value)
+{
+	/* a float passed through the variable argument list is promoted to double, as the JVM expects */
+	(*env)->CallVoidMethod(env,done,method_id,value);
+	if((*env)->ExceptionCheck(env))
+		return FALSE;
+	return TRUE;
+}
+
 /*
 ** $Log: not supported by cvs2svn $
 */
@@ -3,6 +3,7 @@
 */
 #ifndef DPRT_H
 #define DPRT_H
+#include "dprt_jni_general.h"
 
 /**
  * TRUE is the value usually returned from routines to indicate success.
@@ -17,12 +18,75 @@
 #define FALSE 0
 #endif
 
+/* structures */
+/**
+ * Structure holding the result of reducing one expose frame in a batch.
+ * <dl>
+ * <dt>Successful</dt> <dd>TRUE if the frame was reduced, FALSE if it failed.</dd>
+ * <dt>Error_Number</dt> <dd>If the frame failed, the error number of the failure.</dd>
+ * <dt>Error_String</dt> <dd>If the frame failed, a description of the failure.</dd>
+ * <dt>Output_Filename</dt> <dd>An allocated string containing the reduced filename, or NULL if the frame
+ *     failed. This should be freed by the caller.</dd>
+ * <dt>Seeing</dt> <dd>The seeing, the full width half maximum of the spectrum's spatial profile in pixels measured
+ *     from the trace by a full reduction or by a quick reduction, or 0.</dd>
+ * <dt>Counts</dt> <dd>The counts of the brightest pixel in the spectrum.</dd>
+ * <dt>X_Pix</dt> <dd>The x pixel position of the spectrum.</dd>
+ * <dt>Y_Pix</dt> <dd>The y pixel position of the spectrum.</dd>
+ * <dt>Photometricity</dt> <dd>In units of magnitudes of extinction.</dd>
+ * <dt>Sky_Brightness</dt> <dd>In units of magnitudes per arcsec&#178;. Always 0.0, as no photometric zero point
+ *     or plate scale is configured to convert the sky level measured by a full reduction.</dd>
+ * <dt>Saturated</dt> <dd>TRUE if the spectrum is saturated.</dd>
+ * </dl>
+ * @see #DpRt_Expose_Reduce_Batch
+ * @see #DpRt_Expose_Reduce_Buffer
+ */
+struct DpRt_Expose_Result_Struct
+{
+	int Successful;
+	int Error_Number;
+	char Error_String[DPRT_ERROR_STRING_LENGTH];
+	char *Output_Filename;
+	double Seeing;
+	double Counts;
+	double X_Pix;
+	double Y_Pix;
+	double Photometricity;
+	double Sky_Brightness;
+	int Saturated;
+};
+
+/**
+ * A reduction context, declared in dprt_context.h.
+ */
+struct DpRt_Context_Struct;
+
 /* function declarations */
 extern int DpRt_Initialise(void);
 extern int DpRt_Shutdown(void);
+extern int DpRt_Reload_Config(void);
 extern int DpRt_Calibrate_Reduce(char *input_filename,char **output_filename,double *mean_counts,double *peak_counts);
 extern int DpRt_Expose_Reduce(char *input_filename,char **output_filename,double *seeing,double *counts,double *x_pix,
 		       double *y_pix,double *photometricity,double *sky_brightness,int *saturated);
+extern int DpRt_Expose_Reduce_Batch(char **input_filename_list,int frame_count,
+				    struct DpRt_Expose_Result_Struct *result_list);
+extern int DpRt_Expose_Reduce_Buffer(unsigned short *pixels,int pixel_format,int naxis1,int naxis2,int x_bin,
+				     int y_bin,struct DpRt_Expose_Result_Struct *result);
 extern int DpRt_Make_Master_Bias(char *directory_name);
 extern int DpRt_Make_Master_Flat(char *directory_name);
+extern int DpRt_Initialise_Context(struct DpRt_Context_Struct *context);
+extern int DpRt_Shutdown_Context(struct DpRt_Context_Struct *context);
+extern int DpRt_Reload_Config_Context(struct DpRt_Context_Struct *context);
+extern int DpRt_Calibrate_Reduce_Context(struct DpRt_Context_Struct *context,char *input_filename,
+					 char **output_filename,double *mean_counts,double *peak_counts);
+extern int DpRt_Expose_Reduce_Context(struct DpRt_Context_Struct *context,char *input_filename,
+				      char **output_filename,double *seeing,double *counts,double *x_pix,
+				      double *y_pix,double *photometricity,double *sky_brightness,int *saturated);
+extern int DpRt_Expose_Reduce_Batch_Context(struct DpRt_Context_Struct *context,char **input_filename_list,
+					    int frame_count,struct DpRt_Expose_Result_Struct *result_list);
+extern int DpRt_Expose_Reduce_Buffer_Context(struct DpRt_Context_Struct *context,unsigned short *pixels,
+					     int pixel_format,int naxis1,int naxis2,int x_bin,int y_bin,
+					     struct DpRt_Expose_Result_Struct *result);
+extern int DpRt_Make_Master_Bias_Context(struct DpRt_Context_Struct *context,char *directory_name);
+extern int DpRt_Make_Master_Flat_Context(struct DpRt_Context_Struct *context,char *directory_name);
+extern int DpRt_Context_Error_Publish(int retval);
 #endif
@@ -0,0 +1,34 @@
+/* dprt_abort.h
+** $Header$
+*/
+#ifndef DPRT_ABORT_H
+#define DPRT_ABORT_H
+
+/* hash definitions */
+/**
+ * The error number set by a reduction stage that stops because an abort was requested.
+ */
+#define DPRT_ABORT_ERROR_NUMBER		(1000)
+
+/* structures */
+/**
+ * Structure used by a reduction loop to poll the abort generation every Granularity pixels processed.
+ * <dl>
+ * <dt>Granularity</dt> <dd>The number of pixels processed between polls of the abort generation.</dd>
+ * <dt>Pixel_Count</dt> <dd>The number of pixels processed since the abort generation was last polled.</dd>
+ * </dl>
+ */
+struct DpRt_Abort_Checkpoint_Struct
+{
+	long Granularity;
+	long Pixel_Count;
+};
+
+/* function declarations */
+extern void DpRt_Abort_Request(void);
+extern unsigned long DpRt_Abort_Generation_Get(void);
+extern void DpRt_Abort_Checkpoint_Initialise(struct DpRt_Abort_Checkpoint_Struct *checkpoint);
+extern int DpRt_Abort_Checkpoint(struct DpRt_Abort_Checkpoint_Struct *checkpoint,long pixel_count,
+				 char *function_name);
+extern int DpRt_Abort_Check(char *function_name);
+#endif
@@ -0,0 +1,52 @@
+/* dprt_accumulator.h
+** $Header$
+*/
+#ifndef DPRT_ACCUMULATOR_H
+#define DPRT_ACCUMULATOR_H
+#include "dprt_fits.h"
+#include "dprt_master.h"
+
+/* hash definitions */
+/**
+ * The number of standard deviations from a pixel's running mean beyond which a bias pixel (e.g. a cosmic ray)
+ * is left out of the running master bias.
+ */
+#define DPRT_ACCUMULATOR_CLIP_SIGMA	(3.0)
+
+/* structures */
+/**
+ * Structure describing one bias frame being added to the running master bias of its binning, between
+ * DpRt_Accumulator_Frame_Start and DpRt_Accumulator_Frame_End. The frame's pixels are staged here as they are
+ * read, and only added to the running master by DpRt_Accumulator_Frame_End.
+ * <dl>
+ * <dt>X_Bin</dt> <dd>The X binning of the frame.</dd>
+ * <dt>Y_Bin</dt> <dd>The Y binning of the frame.</dd>
+ * <dt>Naxis1</dt> <dd>The number of columns in the frame.</dd>
+ * <dt>Naxis2</dt> <dd>The number of rows in the frame.</dd>
+ * <dt>Read_Noise</dt> <dd>The read noise in counts, the least standard deviation the clip limit is based on.</dd>
+ * <dt>Pixels</dt> <dd>The staged pixels of the frame, Naxis1*Naxis2 values in the host's byte order.</dd>
+ * <dt>Pixel_Count</dt> <dd>The number of pixels staged so far.</dd>
+ * </dl>
+ */
+struct DpRt_Accumulator_Frame_Struct
+{
+	int X_Bin;
+	int Y_Bin;
+	int Naxis1;
+	int Naxis2;
+	double Read_Noise;
+	unsigned short *Pixels;
+	long Pixel_Count;
+};
+
+/* function declarations */
+extern int DpRt_Accumulator_Frame_Start(struct DpRt_Fits_Header_Struct *header,double read_noise,
+					struct DpRt_Accumulator_Frame_Struct *frame);
+extern void DpRt_Accumulator_Block_Add(struct DpRt_Accumulator_Frame_Struct *frame,unsigned short *block,
+				       int start_row,int row_count,int pixel_format);
+extern int DpRt_Accumulator_Frame_End(struct DpRt_Accumulator_Frame_Struct *frame);
+extern void DpRt_Accumulator_Frame_Abort(struct DpRt_Accumulator_Frame_Struct *frame);
+extern int DpRt_Accumulator_Master_Write(char *directory_name,struct DpRt_Master_Binning_Struct **written_list,
+					 int *written_count);
+extern int DpRt_Accumulator_Shutdown(void);
+#endif
@@ -0,0 +1,48 @@
+/* dprt_cache.h
+** $Header$
+*/
+#ifndef DPRT_CACHE_H
+#define DPRT_CACHE_H
+#include <stddef.h>
+
+/* enums */
+/**
+ * The types of master calibration frame held in the cache.
+ * <ul>
+ * <li>DPRT_CACHE_TYPE_BIAS A master bias.
+ * <li>DPRT_CACHE_TYPE_FLAT A normalised master flat.
+ * </ul>
+ */
+enum DPRT_CACHE_TYPE
+{
+	DPRT_CACHE_TYPE_BIAS,DPRT_CACHE_TYPE_FLAT
+};
+
+/* structures */
+/**
+ * Structure returned by DpRt_Cache_Statistics_Get, describing the cache's use.
+ * <dl>
+ * <dt>Entry_Count</dt> <dd>The number of master frames currently held in memory.</dd>
+ * <dt>Memory_Size</dt> <dd>The number of bytes of master frame data held in memory.</dd>
+ * <dt>Hit_Count</dt> <dd>The number of lookups satisfied from memory.</dd>
+ * <dt>Miss_Count</dt> <dd>The number of lookups that had to read a master frame from disk.</dd>
+ * <dt>Reload_Count</dt> <dd>The number of misses caused by a newer master frame replacing a cached one.</dd>
+ * </dl>
+ */
+struct DpRt_Cache_Statistics_Struct
+{
+	int Entry_Count;
+	size_t Memory_Size;
+	long Hit_Count;
+	long Miss_Count;
+	long Reload_Count;
+};
+
+/* function declarations */
+extern int DpRt_Cache_Initialise(void);
+extern int DpRt_Cache_Shutdown(void);
+extern int DpRt_Cache_Master_Directory_Set(char *directory_name);
+extern int DpRt_Cache_Master_Get(enum DPRT_CACHE_TYPE type,int x_bin,int y_bin,int naxis1,int naxis2,float **data);
+extern void DpRt_Cache_Master_Release(float *data);
+extern void DpRt_Cache_Statistics_Get(struct DpRt_Cache_Statistics_Struct *statistics);
+#endif
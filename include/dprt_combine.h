@@ -0,0 +1,19 @@
+/* dprt_combine.h
+** $Header$
+*/
+#ifndef DPRT_COMBINE_H
+#define DPRT_COMBINE_H
+
+/* hash definitions */
+/**
+ * The maximum number of combine worker threads.
+ */
+#define DPRT_COMBINE_THREAD_COUNT_MAX	(16)
+
+/* function declarations */
+extern int DpRt_Combine_Median(char **filename_list,int frame_count,int naxis1,int naxis2,float *output);
+extern int DpRt_Combine_Sigma_Clip(char **filename_list,int frame_count,int naxis1,int naxis2,float *bias,
+				   double *scale_list,double sigma,float *output);
+extern float DpRt_Combine_Median_Float(float *values,int count);
+extern int DpRt_Combine_Thread_Count_Get(void);
+#endif
@@ -0,0 +1,203 @@
+/* dprt_config.h
+** $Header$
+*/
+#ifndef DPRT_CONFIG_H
+#define DPRT_CONFIG_H
+#include "dprt_fits.h"
+
+/* hash definitions */
+/**
+ * The default quick reduction time budget, in milliseconds.
+ */
+#define DPRT_CONFIG_QUICK_TIME_BUDGET_DEFAULT	(200)
+/**
+ * The default quick reduction decimation factor, in pixels.
+ */
+#define DPRT_CONFIG_QUICK_DECIMATION_DEFAULT	(4)
+/**
+ * The default number of counts at or above which a pixel is considered saturated.
+ */
+#define DPRT_CONFIG_SATURATION_LEVEL_DEFAULT	(65000.0)
+/**
+ * The default CCD gain, in electrons per count.
+ */
+#define DPRT_CONFIG_GAIN_DEFAULT		(1.0)
+/**
+ * The default CCD read noise, in electrons.
+ */
+#define DPRT_CONFIG_READ_NOISE_DEFAULT		(5.0)
+/**
+ * The default order of the polynomial fitted to the spectral trace centre.
+ */
+#define DPRT_CONFIG_TRACE_ORDER_DEFAULT		(2)
+/**
+ * The default nominal wavelength of the central column.
+ */
+#define DPRT_CONFIG_WAVELENGTH_CENTRE_DEFAULT	(0.0)
+/**
+ * The default nominal dispersion, in line list units per unbinned pixel. 0.0 means no nominal dispersion is
+ * configured, and arc frames are not fitted.
+ */
+#define DPRT_CONFIG_WAVELENGTH_DISPERSION_DEFAULT	(0.0)
+/**
+ * The default order of the polynomial fitted as the wavelength solution.
+ */
+#define DPRT_CONFIG_WAVELENGTH_ORDER_DEFAULT	(3)
+/**
+ * The default maximum distance, in (binned) pixels, between a line's predicted and reference wavelengths
+ * for the line to be matched.
+ */
+#define DPRT_CONFIG_WAVELENGTH_MATCH_TOLERANCE_DEFAULT	(3.0)
+/**
+ * The default number of pixels a reduction loop processes between polls of the abort flag. At the slowest
+ * per-pixel rate of any stage this is a few milliseconds of work, well inside the required abort latency.
+ */
+#define DPRT_CONFIG_ABORT_CHECK_PIXELS_DEFAULT	(262144)
+/**
+ * The default maximum number of reduced frames waiting for the background writer. A reduction submitting a frame
+ * to a full queue waits for room.
+ */
+#define DPRT_CONFIG_WRITER_QUEUE_LENGTH_DEFAULT	(4)
+/**
+ * The default number of background writer threads.
+ */
+#define DPRT_CONFIG_WRITER_THREAD_COUNT_DEFAULT	(1)
+/**
+ * The maximum number of background writer threads.
+ */
+#define DPRT_CONFIG_WRITER_THREAD_COUNT_MAX	(8)
+/**
+ * The default Laplacian significance, in standard deviations, above which a pixel is a cosmic ray candidate.
+ */
+#define DPRT_CONFIG_COSMIC_SIGMA_CLIP_DEFAULT	(4.5)
+/**
+ * The default fraction of the cosmic ray clip above which a neighbour of a cosmic ray is also rejected.
+ */
+#define DPRT_CONFIG_COSMIC_SIGMA_FRACTION_DEFAULT	(0.3)
+/**
+ * The default minimum contrast between a cosmic ray candidate's Laplacian and the fine structure around it.
+ */
+#define DPRT_CONFIG_COSMIC_OBJECT_LIMIT_DEFAULT	(5.0)
+/**
+ * The default maximum number of cosmic ray detection iterations.
+ */
+#define DPRT_CONFIG_COSMIC_ITERATIONS_DEFAULT	(4)
+/**
+ * The default half width, in columns, of the boxcar a parallel overscan bias model is smoothed with.
+ */
+#define DPRT_CONFIG_OVERSCAN_SMOOTH_DEFAULT	(8)
+/**
+ * The default number of megabytes of frame data the master frame combine may hold in memory at once.
+ */
+#define DPRT_CONFIG_COMBINE_MEMORY_MB_DEFAULT	(64)
+
+/* structures */
+/**
+ * Structure holding a snapshot of the library's "dprt.*" configuration properties. The snapshot is
+ * read once by DpRt_Config_Load, so reduction routines read plain fields rather than calling back
+ * into the property functions (and hence Java) for every frame.
+ * <dl>
+ * <dt>Full_Reduction</dt> <dd>The "dprt.full_reduction" boolean. If TRUE frames are fully reduced,
+ *     otherwise a quick reduction is done.</dd>
+ * <dt>Make_Master_Bias</dt> <dd>The "dprt.make_master_bias" boolean, whether DpRt_Make_Master_Bias makes
+ *     master biases.</dd>
+ * <dt>Make_Master_Flat</dt> <dd>The "dprt.make_master_flat" boolean, whether DpRt_Make_Master_Flat makes
+ *     master flats.</dd>
+ * <dt>Master_Directory</dt> <dd>The "dprt.master.directory" string, the directory containing master frames
+ *     to use before any are made. An empty string if the property is not set.</dd>
+ * <dt>Quick_Time_Budget</dt> <dd>The "dprt.quick.time_budget" integer, the time in milliseconds a quick
+ *     reduction should complete within.</dd>
+ * <dt>Quick_Decimation</dt> <dd>The "dprt.quick.decimation" integer. A quick reduction reads every
+ *     Quick_Decimation'th column of every Quick_Decimation'th row.</dd>
+ * <dt>Saturation_Level</dt> <dd>The "dprt.saturation_level" double, the number of counts at or above which
+ *     a pixel is considered saturated.</dd>
+ * <dt>Gain</dt> <dd>The "dprt.ccd.gain" double, the CCD gain in electrons per count.</dd>
+ * <dt>Read_Noise</dt> <dd>The "dprt.ccd.read_noise" double, the CCD read noise in electrons.</dd>
+ * <dt>Trace_Order</dt> <dd>The "dprt.extract.trace_order" integer, the order of the polynomial fitted to the
+ *     spectral trace centre.</dd>
+ * <dt>Wavelength_Line_List</dt> <dd>The "dprt.wavelength.line_list" string, the filename of the arc line list
+ *     of reference wavelengths. An empty string if the property is not set, in which case arc frames are
+ *     not fitted.</dd>
+ * <dt>Wavelength_Centre</dt> <dd>The "dprt.wavelength.centre" double, the nominal wavelength of the central
+ *     column.</dd>
+ * <dt>Wavelength_Dispersion</dt> <dd>The "dprt.wavelength.dispersion" double, the nominal dispersion in
+ *     wavelength per unbinned pixel. Negative if wavelength decreases with column.</dd>
+ * <dt>Wavelength_Order</dt> <dd>The "dprt.wavelength.order" integer, the order of the polynomial fitted as the
+ *     wavelength solution.</dd>
+ * <dt>Wavelength_Match_Tolerance</dt> <dd>The "dprt.wavelength.match_tolerance" double, the maximum distance
+ *     in pixels between a line's predicted and reference wavelengths for the line to be matched.</dd>
+ * <dt>Abort_Check_Pixels</dt> <dd>The "dprt.abort.check_pixels" integer, the number of pixels a reduction loop
+ *     processes between polls of the abort flag.</dd>
+ * <dt>Writer_Async</dt> <dd>The "dprt.writer.async" boolean. If TRUE reduced frames are queued for the background
+ *     writer, and the reduction returns as soon as the output filename is decided. Otherwise they are written
+ *     before the reduction returns.</dd>
+ * <dt>Writer_Queue_Length</dt> <dd>The "dprt.writer.queue_length" integer, the maximum number of frames waiting
+ *     for the background writer.</dd>
+ * <dt>Writer_Thread_Count</dt> <dd>The "dprt.writer.thread_count" integer, the number of background writer
+ *     threads, fixed when the writer first starts.</dd>
+ * <dt>Writer_Compression</dt> <dd>The "dprt.writer.compression" string ("none", "rice" or "gzip"), as the
+ *     cfitsio tile compression algorithm the reduced frames are written with: RICE_1, GZIP_1 or 0 for none.</dd>
+ * <dt>Log_Level</dt> <dd>The "dprt.log.level" string ("error", "warning", "info" or "debug"), as the
+ *     DPRT_LOG_LEVEL above which log messages are discarded.</dd>
+ * <dt>Log_Filename</dt> <dd>The "dprt.log.filename" string. If set, and no log handler is installed, log messages
+ *     are appended to this file rather than written to stdout.</dd>
+ * <dt>Cosmic_Reject</dt> <dd>The "dprt.cosmic.reject" boolean. If TRUE a full reduction finds the cosmic rays in
+ *     the calibrated frame, and the extraction ignores them.</dd>
+ * <dt>Cosmic_Sigma_Clip</dt> <dd>The "dprt.cosmic.sigma_clip" double, the Laplacian significance in standard
+ *     deviations above which a pixel is a cosmic ray candidate.</dd>
+ * <dt>Cosmic_Sigma_Fraction</dt> <dd>The "dprt.cosmic.sigma_fraction" double, the fraction of
+ *     Cosmic_Sigma_Clip above which a neighbour of a cosmic ray is also rejected.</dd>
+ * <dt>Cosmic_Object_Limit</dt> <dd>The "dprt.cosmic.object_limit" double, the minimum contrast between a
+ *     candidate's Laplacian and the fine structure around it. Raise it if sharp lines are being rejected.</dd>
+ * <dt>Cosmic_Iterations</dt> <dd>The "dprt.cosmic.iterations" integer, the most detection iterations done.
+ *     Each tile of the frame stops as soon as an iteration finds nothing new.</dd>
+ * <dt>Overscan_Correct</dt> <dd>The "dprt.overscan.correct" boolean. If TRUE the bias level fitted to each frame's
+ *     overscan region (BIASSEC) is subtracted, and the frame is trimmed to its TRIMSEC region.</dd>
+ * <dt>Overscan_Smooth</dt> <dd>The "dprt.overscan.smooth" integer, the half width in columns of the boxcar a
+ *     parallel overscan bias model is smoothed with.</dd>
+ * <dt>Bias_Accumulate</dt> <dd>The "dprt.bias.accumulate" boolean. If TRUE each bias passed to
+ *     DpRt_Calibrate_Reduce is added to a running master bias, which DpRt_Make_Master_Bias then writes.</dd>
+ * <dt>Combine_Memory_MB</dt> <dd>The "dprt.combine.memory_mb" integer, the most megabytes of frame data the
+ *     master bias and flat combine holds in memory at once, however many frames are combined.</dd>
+ * </dl>
+ * @see dprt_log.h#DPRT_LOG_LEVEL
+ */
+struct DpRt_Config_Struct
+{
+	int Full_Reduction;
+	int Make_Master_Bias;
+	int Make_Master_Flat;
+	char Master_Directory[DPRT_FITS_FILENAME_LENGTH];
+	int Quick_Time_Budget;
+	int Quick_Decimation;
+	double Saturation_Level;
+	double Gain;
+	double Read_Noise;
+	int Trace_Order;
+	char Wavelength_Line_List[DPRT_FITS_FILENAME_LENGTH];
+	double Wavelength_Centre;
+	double Wavelength_Dispersion;
+	int Wavelength_Order;
+	double Wavelength_Match_Tolerance;
+	int Abort_Check_Pixels;
+	int Writer_Async;
+	int Writer_Queue_Length;
+	int Writer_Thread_Count;
+	int Writer_Compression;
+	int Log_Level;
+	char Log_Filename[DPRT_FITS_FILENAME_LENGTH];
+	int Cosmic_Reject;
+	double Cosmic_Sigma_Clip;
+	double Cosmic_Sigma_Fraction;
+	double Cosmic_Object_Limit;
+	int Cosmic_Iterations;
+	int Overscan_Correct;
+	int Overscan_Smooth;
+	int Bias_Accumulate;
+	int Combine_Memory_MB;
+};
+
+/* function declarations */
+extern int DpRt_Config_Load(void);
+extern void DpRt_Config_Get(struct DpRt_Config_Struct *config);
+#endif
@@ -0,0 +1,94 @@
+/* dprt_context.h
+** $Header$
+*/
+#ifndef DPRT_CONTEXT_H
+#define DPRT_CONTEXT_H
+#include <stddef.h>
+#include "dprt_jni_general.h"
+#include "dprt_config.h"
+
+/* hash definitions */
+/**
+ * The number of frame scratch buffers held by a context. DpRt_Expose_Reduce_Batch has this many frames in
+ * flight at once.
+ */
+#define DPRT_CONTEXT_SCRATCH_COUNT	(3)
+/**
+ * The error number of the calling thread's current error state. The library routines set this, rather than
+ * DpRt_JNI_Error_Number, so reductions running in different contexts do not overwrite each other's errors.
+ * @see #DpRt_Error_Current_Get
+ */
+#define DpRt_Error_Number		(DpRt_Error_Current_Get()->Number)
+/**
+ * The error string of the calling thread's current error state, DPRT_ERROR_STRING_LENGTH characters long.
+ * @see #DpRt_Error_Current_Get
+ */
+#define DpRt_Error_String		(DpRt_Error_Current_Get()->String)
+
+/* structures */
+/**
+ * Structure holding an error state. As it is bound to the thread doing a reduction, it also carries the call
+ * number messages logged by the reduction are tagged with, and the abort generation the reduction started in.
+ * <dl>
+ * <dt>Number</dt> <dd>The error number, or 0 if no error has occured.</dd>
+ * <dt>String</dt> <dd>A description of the error.</dd>
+ * <dt>Log_Tag</dt> <dd>The call number of the reduction, or 0.</dd>
+ * <dt>Abort_Generation</dt> <dd>The abort generation the reduction started in, or 0 if no reduction is
+ *     running. The reduction is aborted once the abort generation moves on.</dd>
+ * </dl>
+ * @see dprt_log.html#DpRt_Log_Tag_Create
+ * @see dprt_abort.html#DpRt_Abort_Check
+ */
+struct DpRt_Error_Struct
+{
+	int Number;
+	char String[DPRT_ERROR_STRING_LENGTH];
+	unsigned long Log_Tag;
+	unsigned long Abort_Generation;
+};
+
+/**
+ * Structure holding the state of one caller's reductions. Reductions in different contexts can run at the
+ * same time on different threads.
+ * <dl>
+ * <dt>Error</dt> <dd>The error state of the last reduction called with this context.</dd>
+ * <dt>Config</dt> <dd>The configuration snapshot reductions in this context use.</dd>
+ * <dt>Frame_Scratch_List</dt> <dd>Frame buffers reused by successive reductions in this context.</dd>
+ * <dt>Frame_Scratch_Length_List</dt> <dd>The number of pixels each frame buffer can hold.</dd>
+ * <dt>Mask_Scratch_List</dt> <dd>Bit-packed saturation mask buffers, one per frame buffer.</dd>
+ * <dt>Mask_Scratch_Length_List</dt> <dd>The number of bytes in each mask buffer.</dd>
+ * <dt>Cosmic_Mask_Scratch_List</dt> <dd>Bit-packed cosmic ray mask buffers, one per frame buffer.</dd>
+ * <dt>Cosmic_Mask_Scratch_Length_List</dt> <dd>The number of bytes in each cosmic ray mask buffer.</dd>
+ * <dt>Abort_Generation</dt> <dd>If non zero, the abort generation the next reduction in this context is taken
+ *     to have started in, so work queued before an abort is aborted when it runs. If 0, each reduction starts
+ *     in the current abort generation.</dd>
+ * </dl>
+ * @see #DPRT_CONTEXT_SCRATCH_COUNT
+ * @see dprt_abort.html#DpRt_Abort_Generation_Get
+ */
+struct DpRt_Context_Struct
+{
+	struct DpRt_Error_Struct Error;
+	struct DpRt_Config_Struct Config;
+	float *Frame_Scratch_List[DPRT_CONTEXT_SCRATCH_COUNT];
+	size_t Frame_Scratch_Length_List[DPRT_CONTEXT_SCRATCH_COUNT];
+	unsigned char *Mask_Scratch_List[DPRT_CONTEXT_SCRATCH_COUNT];
+	size_t Mask_Scratch_Length_List[DPRT_CONTEXT_SCRATCH_COUNT];
+	unsigned char *Cosmic_Mask_Scratch_List[DPRT_CONTEXT_SCRATCH_COUNT];
+	size_t Cosmic_Mask_Scratch_Length_List[DPRT_CONTEXT_SCRATCH_COUNT];
+	unsigned long Abort_Generation;
+};
+
+/* function declarations */
+extern struct DpRt_Error_Struct *DpRt_Error_Current_Get(void);
+extern struct DpRt_Error_Struct *DpRt_Error_Bind(struct DpRt_Error_Struct *error);
+extern int DpRt_Context_Create(struct DpRt_Context_Struct **context);
+extern int DpRt_Context_Destroy(struct DpRt_Context_Struct *context);
+extern struct DpRt_Context_Struct *DpRt_Context_Default_Get(void);
+extern void DpRt_Context_Config_Refresh(struct DpRt_Context_Struct *context);
+extern int DpRt_Context_Scratch_Get(struct DpRt_Context_Struct *context,int slot,long pixel_count,float **frame,
+				    unsigned char **mask);
+extern int DpRt_Context_Cosmic_Mask_Get(struct DpRt_Context_Struct *context,int slot,long pixel_count,
+					unsigned char **mask);
+extern void DpRt_Context_Scratch_Free(struct DpRt_Context_Struct *context);
+#endif
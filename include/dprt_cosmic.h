@@ -0,0 +1,43 @@
+/* dprt_cosmic.h
+** $Header$
+*/
+#ifndef DPRT_COSMIC_H
+#define DPRT_COSMIC_H
+
+/* hash definitions */
+/**
+ * The maximum number of detection iterations DpRt_Cosmic_Reject can be asked to do.
+ */
+#define DPRT_COSMIC_ITERATIONS_MAX	(10)
+
+/* structures */
+/**
+ * Structure holding the parameters of a cosmic ray rejection.
+ * <dl>
+ * <dt>Gain</dt> <dd>The CCD gain, in electrons per count.</dd>
+ * <dt>Read_Noise</dt> <dd>The CCD read noise, in electrons.</dd>
+ * <dt>Sigma_Clip</dt> <dd>The Laplacian significance, in standard deviations, above which a pixel is a
+ *     cosmic ray candidate.</dd>
+ * <dt>Sigma_Fraction</dt> <dd>The fraction of Sigma_Clip above which a pixel next to a cosmic ray is also
+ *     rejected.</dd>
+ * <dt>Object_Limit</dt> <dd>The minimum contrast between the Laplacian and the fine structure of a candidate.
+ *     Sharp features of the spectrum (e.g. unresolved lines) have a lower contrast, and are kept.</dd>
+ * <dt>Iteration_Count</dt> <dd>The most detection iterations to do. A tile stops iterating as soon as an
+ *     iteration finds no new cosmic rays.</dd>
+ * </dl>
+ */
+struct DpRt_Cosmic_Parameter_Struct
+{
+	double Gain;
+	double Read_Noise;
+	double Sigma_Clip;
+	double Sigma_Fraction;
+	double Object_Limit;
+	int Iteration_Count;
+};
+
+/* function declarations */
+extern int DpRt_Cosmic_Reject(float *frame,unsigned char *saturation_mask,int naxis1,int naxis2,
+			      struct DpRt_Cosmic_Parameter_Struct *parameters,unsigned char *cosmic_mask,
+			      long *cosmic_count);
+#endif
@@ -0,0 +1,77 @@
+/* dprt_extract.h
+** $Header$
+*/
+#ifndef DPRT_EXTRACT_H
+#define DPRT_EXTRACT_H
+
+/* hash definitions */
+/**
+ * The maximum order of the polynomial fitted to the trace centre.
+ */
+#define DPRT_EXTRACT_TRACE_ORDER_MAX	(5)
+
+/* structures */
+/**
+ * Structure describing a spectral trace found by DpRt_Extract_Trace_Find. The trace centre (a 0 based row)
+ * at column x is the polynomial sum of Coefficient_List[i]*u^i, where u = (x-X_Centre)/X_Scale.
+ * <dl>
+ * <dt>Order</dt> <dd>The order of the polynomial fitted.</dd>
+ * <dt>Coefficient_List</dt> <dd>The polynomial coefficients, Order+1 of them.</dd>
+ * <dt>X_Centre</dt> <dd>The column the polynomial's independent variable is centred on.</dd>
+ * <dt>X_Scale</dt> <dd>The number of columns the polynomial's independent variable is scaled by.</dd>
+ * <dt>Fwhm</dt> <dd>The full width half maximum of the spatial profile, in pixels.</dd>
+ * <dt>Sigma</dt> <dd>The gaussian sigma of the spatial profile, in pixels.</dd>
+ * <dt>Aperture_Half_Width</dt> <dd>The extraction aperture extends this many rows either side of the
+ *     trace centre.</dd>
+ * <dt>Point_Count</dt> <dd>The number of column bins the trace centre was measured in and fitted to.</dd>
+ * </dl>
+ */
+struct DpRt_Extract_Trace_Struct
+{
+	int Order;
+	double Coefficient_List[DPRT_EXTRACT_TRACE_ORDER_MAX+1];
+	double X_Centre;
+	double X_Scale;
+	double Fwhm;
+	double Sigma;
+	double Aperture_Half_Width;
+	int Point_Count;
+};
+
+/**
+ * Structure holding an optimally extracted spectrum.
+ * <dl>
+ * <dt>Length</dt> <dd>The number of columns in the spectrum (NAXIS1 of the frame).</dd>
+ * <dt>Flux</dt> <dd>The extracted flux in each column, in counts.</dd>
+ * <dt>Variance</dt> <dd>The variance of the extracted flux in each column.</dd>
+ * <dt>Peak_Counts</dt> <dd>The counts of the brightest unmasked pixel within the extraction aperture.</dd>
+ * <dt>Peak_Column</dt> <dd>The column (0 based) of the brightest pixel within the extraction aperture.</dd>
+ * <dt>Saturated</dt> <dd>TRUE if any pixel within the aperture was flagged as saturated.</dd>
+ * <dt>Rejected_Count</dt> <dd>The number of aperture pixels rejected as outliers (e.g. cosmic rays).</dd>
+ * <dt>Cosmic_Count</dt> <dd>The number of aperture pixels left out because they were in the cosmic ray mask.</dd>
+ * <dt>Sky_Level</dt> <dd>The mean over the columns of the sky level subtracted from each column, in counts per
+ *     pixel.</dd>
+ * </dl>
+ */
+struct DpRt_Extract_Spectrum_Struct
+{
+	int Length;
+	float *Flux;
+	float *Variance;
+	double Peak_Counts;
+	int Peak_Column;
+	int Saturated;
+	long Rejected_Count;
+	long Cosmic_Count;
+	double Sky_Level;
+};
+
+/* function declarations */
+extern int DpRt_Extract_Trace_Find(float *frame,int naxis1,int naxis2,int order,
+				   struct DpRt_Extract_Trace_Struct *trace,int *found);
+extern double DpRt_Extract_Trace_Centre_Get(struct DpRt_Extract_Trace_Struct *trace,double x);
+extern int DpRt_Extract_Optimal(float *frame,unsigned char *saturation_mask,unsigned char *cosmic_mask,int naxis1,
+				int naxis2,struct DpRt_Extract_Trace_Struct *trace,double gain,double read_noise,
+				struct DpRt_Extract_Spectrum_Struct *spectrum);
+extern void DpRt_Extract_Spectrum_Free(struct DpRt_Extract_Spectrum_Struct *spectrum);
+#endif
@@ -0,0 +1,133 @@
+/* dprt_fits.h
+** $Header$
+*/
+#ifndef DPRT_FITS_H
+#define DPRT_FITS_H
+#include <stddef.h>
+#include "fitsio.h"
+
+/* hash definitions */
+/**
+ * The number of pixels the row block reader tries to read in one go. The number of rows in a block is
+ * this divided by NAXIS1, so a block fits comfortably in the processor's L2 cache.
+ */
+#define DPRT_FITS_BLOCK_PIXELS		(131072)
+/**
+ * The maximum length of a FITS filename (including directory) handled by the library.
+ */
+#define DPRT_FITS_FILENAME_LENGTH	(256)
+/**
+ * The error number DpRt_Fits_Header_Parse sets when the frame's BITPIX is not that of a raw frame. The frame was
+ * parsed, so reading its header through cfitsio instead would not help.
+ */
+#define DPRT_FITS_BITPIX_ERROR_NUMBER	(246)
+
+/* structures */
+/**
+ * Structure holding the state of a FITS image being read a block of rows at a time.
+ * <dl>
+ * <dt>Fits_Fp</dt> <dd>The cfitsio file pointer.</dd>
+ * <dt>Naxis1</dt> <dd>The number of columns in the image.</dd>
+ * <dt>Naxis2</dt> <dd>The number of rows in the image.</dd>
+ * <dt>Block_Rows</dt> <dd>The maximum number of rows read per block.</dd>
+ * <dt>Current_Row</dt> <dd>The next row to be read (0 based).</dd>
+ * <dt>Buffer</dt> <dd>A buffer of Block_Rows*Naxis1 unsigned shorts the rows are read into, when the image is
+ *     read through cfitsio.</dd>
+ * <dt>Map</dt> <dd>The start of the memory mapped file, or NULL if the image is read through cfitsio.</dd>
+ * <dt>Map_Length</dt> <dd>The length of the memory mapping, in bytes.</dd>
+ * <dt>Data</dt> <dd>The start of the image's data unit within the memory mapped file, or the caller's pixels
+ *     for an image opened with DpRt_Fits_Reader_Open_Buffer. NULL if the image is read through cfitsio.</dd>
+ * <dt>Pixel_Format</dt> <dd>The format of the pixels in the blocks returned, a DPRT_KERNEL_PIXEL_FORMAT value.
+ *     DPRT_KERNEL_PIXEL_FORMAT_FITS for a memory mapped file, DPRT_KERNEL_PIXEL_FORMAT_NATIVE when read through
+ *     cfitsio, and the caller's format for an image in memory.</dd>
+ * </dl>
+ */
+struct DpRt_Fits_Reader_Struct
+{
+	fitsfile *Fits_Fp;
+	int Naxis1;
+	int Naxis2;
+	int Block_Rows;
+	int Current_Row;
+	unsigned short *Buffer;
+	unsigned char *Map;
+	size_t Map_Length;
+	unsigned char *Data;
+	int Pixel_Format;
+};
+
+/**
+ * Structure holding a rectangular section of an image, as given by a keyword such as BIASSEC or TRIMSEC.
+ * The coordinates are 0 based and inclusive, so the FITS section [1:10,1:20] is X_Start 0, X_End 9,
+ * Y_Start 0, Y_End 19.
+ * <dl>
+ * <dt>X_Start</dt> <dd>The first column in the section.</dd>
+ * <dt>X_End</dt> <dd>The last column in the section.</dd>
+ * <dt>Y_Start</dt> <dd>The first row in the section.</dd>
+ * <dt>Y_End</dt> <dd>The last row in the section.</dd>
+ * </dl>
+ */
+struct DpRt_Fits_Section_Struct
+{
+	int X_Start;
+	int X_End;
+	int Y_Start;
+	int Y_End;
+};
+
+/**
+ * Structure holding the FITS header keywords used to classify a frame.
+ * <dl>
+ * <dt>Obstype</dt> <dd>The value of the OBSTYPE keyword, e.g. BIAS.</dd>
+ * <dt>Naxis1</dt> <dd>The number of columns in the image.</dd>
+ * <dt>Naxis2</dt> <dd>The number of rows in the image.</dd>
+ * <dt>X_Bin</dt> <dd>The value of the CCDXBIN keyword, or 1 if it is not present.</dd>
+ * <dt>Y_Bin</dt> <dd>The value of the CCDYBIN keyword, or 1 if it is not present.</dd>
+ * <dt>Exposure_Length</dt> <dd>The value of the EXPTIME keyword in seconds, or 0.0 if it is not present.</dd>
+ * <dt>Bias_Section_Found</dt> <dd>Whether the header has a valid BIASSEC keyword.</dd>
+ * <dt>Bias_Section</dt> <dd>The detector overscan region given by BIASSEC, if Bias_Section_Found is TRUE.</dd>
+ * <dt>Trim_Section_Found</dt> <dd>Whether the header has a valid TRIMSEC keyword.</dd>
+ * <dt>Trim_Section</dt> <dd>The region of the image holding illuminated pixels given by TRIMSEC, if
+ *     Trim_Section_Found is TRUE.</dd>
+ * </dl>
+ */
+struct DpRt_Fits_Header_Struct
+{
+	char Obstype[FLEN_VALUE];
+	int Naxis1;
+	int Naxis2;
+	int X_Bin;
+	int Y_Bin;
+	double Exposure_Length;
+	int Bias_Section_Found;
+	struct DpRt_Fits_Section_Struct Bias_Section;
+	int Trim_Section_Found;
+	struct DpRt_Fits_Section_Struct Trim_Section;
+};
+
+/* function declarations */
+extern int DpRt_Fits_Image_Open(char *filename,fitsfile **fits_fp,int *naxis1,int *naxis2);
+extern int DpRt_Fits_Image_Read_Rows(fitsfile *fits_fp,int naxis1,int start_row,int row_count,unsigned short *buffer);
+extern int DpRt_Fits_Image_Raw_Data_Get(fitsfile *fits_fp,int naxis1,int naxis2,LONGLONG *data_start,
+					LONGLONG *data_end);
+extern int DpRt_Fits_Image_Close(fitsfile *fits_fp);
+extern int DpRt_Fits_Reader_Open(char *filename,struct DpRt_Fits_Reader_Struct *reader);
+extern int DpRt_Fits_Reader_Open_Buffer(unsigned short *pixels,int naxis1,int naxis2,int pixel_format,
+					struct DpRt_Fits_Reader_Struct *reader);
+extern int DpRt_Fits_Reader_Read_Block(struct DpRt_Fits_Reader_Struct *reader,unsigned short **block,
+				       int *start_row,int *row_count);
+extern int DpRt_Fits_Reader_Read_Section(struct DpRt_Fits_Reader_Struct *reader,
+					  struct DpRt_Fits_Section_Struct *section,float *data);
+extern int DpRt_Fits_Reader_Close(struct DpRt_Fits_Reader_Struct *reader);
+extern int DpRt_Fits_Header_Read(char *filename,struct DpRt_Fits_Header_Struct *header);
+extern int DpRt_Fits_Sections_Read(fitsfile *fits_fp,struct DpRt_Fits_Header_Struct *header);
+extern int DpRt_Fits_Header_Parse(char *filename,struct DpRt_Fits_Header_Struct *header);
+extern int DpRt_Fits_Read_Float_Image(char *filename,int *naxis1,int *naxis2,float **data);
+extern int DpRt_Fits_Write_Float_Image(char *filename,struct DpRt_Fits_Header_Struct *header,float *data,
+				       int combine_count);
+extern int DpRt_Fits_Write_Reduced_Image(char *input_filename,char *output_filename,int naxis1,int naxis2,
+					 float *data,int compression_type);
+extern int DpRt_Fits_Write_Spectrum(char *filename,char *extension_name,float *data,int length);
+extern void DpRt_Fits_Lock(void);
+extern void DpRt_Fits_Unlock(void);
+#endif
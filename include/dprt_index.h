@@ -0,0 +1,43 @@
+/* dprt_index.h
+** $Header$
+*/
+#ifndef DPRT_INDEX_H
+#define DPRT_INDEX_H
+#include <sys/types.h>
+#include <time.h>
+#include "dprt_fits.h"
+
+/* hash definitions */
+/**
+ * The name of the header index file kept in each directory indexed. The leading '.' keeps it out of directory
+ * listings, and it never matches the extension of the frames indexed.
+ */
+#define DPRT_INDEX_FILENAME		(".dprt_index")
+
+/* structures */
+/**
+ * Structure describing one file in a directory's header index.
+ * <dl>
+ * <dt>Filename</dt> <dd>The full pathname of the file.</dd>
+ * <dt>Modification_Time</dt> <dd>The modification time of the file when its header was read.</dd>
+ * <dt>Modification_Time_Nsec</dt> <dd>The nanoseconds part of the modification time.</dd>
+ * <dt>File_Size</dt> <dd>The size of the file when its header was read.</dd>
+ * <dt>Valid</dt> <dd>TRUE if the header was read, FALSE if it could not be. Unreadable files are indexed too,
+ *     so they are not tried again until they change.</dd>
+ * <dt>Header</dt> <dd>The classification keywords read from the file's header, if Valid is TRUE.</dd>
+ * </dl>
+ */
+struct DpRt_Index_Entry_Struct
+{
+	char Filename[DPRT_FITS_FILENAME_LENGTH];
+	time_t Modification_Time;
+	long Modification_Time_Nsec;
+	off_t File_Size;
+	int Valid;
+	struct DpRt_Fits_Header_Struct Header;
+};
+
+/* function declarations */
+extern int DpRt_Index_Get(char *directory_name,char *extension,struct DpRt_Index_Entry_Struct **entry_list,
+			  int *entry_count);
+#endif
@@ -0,0 +1,28 @@
+/* dprt_job.h
+** $Header$
+*/
+#ifndef DPRT_JOB_H
+#define DPRT_JOB_H
+#include "dprt.h"
+
+/* enums */
+/**
+ * The states a submitted reduction job passes through.
+ * <ul>
+ * <li>DPRT_JOB_STATE_QUEUED The job is waiting for the worker thread.
+ * <li>DPRT_JOB_STATE_RUNNING The worker thread is reducing the job's frame.
+ * <li>DPRT_JOB_STATE_DONE The job has finished and its callback has returned.
+ * </ul>
+ */
+enum DPRT_JOB_STATE
+{
+	DPRT_JOB_STATE_QUEUED,DPRT_JOB_STATE_RUNNING,DPRT_JOB_STATE_DONE
+};
+
+/* function declarations */
+extern int DpRt_Job_Expose_Submit(char *input_filename,
+				  void (*callback)(int job_id,struct DpRt_Expose_Result_Struct *result,void *user_arg),
+				  void *user_arg,int *job_id);
+extern int DpRt_Job_State_Get(int job_id,enum DPRT_JOB_STATE *state);
+extern int DpRt_Job_Shutdown(void);
+#endif
@@ -0,0 +1,104 @@
+/* dprt_kernel.h
+** $Header$
+*/
+#ifndef DPRT_KERNEL_H
+#define DPRT_KERNEL_H
+
+/* hash definitions */
+/**
+ * The number of bytes in a bit-packed pixel mask of pixel_count pixels (one bit per pixel).
+ */
+#define DPRT_KERNEL_MASK_LENGTH(pixel_count)	(((pixel_count)+7)/8)
+/**
+ * Set the bit for pixel (an index into the frame) in a bit-packed pixel mask.
+ */
+#define DPRT_KERNEL_MASK_SET(mask,pixel)	((mask)[(pixel)>>3] |= (unsigned char)(1<<((pixel)&7)))
+/**
+ * Test the bit for pixel (an index into the frame) in a bit-packed pixel mask. Evaluates to 1 if it is set.
+ */
+#define DPRT_KERNEL_MASK_TEST(mask,pixel)	(((mask)[(pixel)>>3]>>((pixel)&7))&1)
+/**
+ * Get the value of the pixel at address (an unsigned short pointer) in DPRT_KERNEL_PIXEL_FORMAT_FITS format:
+ * the big endian bytes are assembled, and BZERO applied by flipping the sign bit. This works on hosts of either
+ * byte order.
+ */
+#define DPRT_KERNEL_FITS_PIXEL(address)	((unsigned short)(((((unsigned char *)(address))[0]<<8)| \
+					  ((unsigned char *)(address))[1])^0x8000))
+
+/**
+ * The maximum order of polynomial fitted by DpRt_Kernel_Polynomial_Fit.
+ */
+#define DPRT_KERNEL_POLYNOMIAL_ORDER_MAX	(7)
+
+/* enums */
+/**
+ * The formats of 16 bit pixel data the kernels accept.
+ * <ul>
+ * <li>DPRT_KERNEL_PIXEL_FORMAT_NATIVE Unsigned shorts in the host's byte order, e.g. as read by cfitsio.
+ * <li>DPRT_KERNEL_PIXEL_FORMAT_FITS The raw FITS encoding of unsigned 16 bit data: big endian signed shorts,
+ *     offset by BZERO = 32768, e.g. a view of a memory mapped FITS data unit.
+ * </ul>
+ */
+enum DPRT_KERNEL_PIXEL_FORMAT
+{
+	DPRT_KERNEL_PIXEL_FORMAT_NATIVE,DPRT_KERNEL_PIXEL_FORMAT_FITS
+};
+
+/* structures */
+/**
+ * Structure holding running image statistics, accumulated a block of pixels at a time.
+ * <dl>
+ * <dt>Sum</dt> <dd>The sum of all pixel values accumulated so far.</dd>
+ * <dt>Peak</dt> <dd>The largest pixel value accumulated so far.</dd>
+ * <dt>Count</dt> <dd>The number of pixels accumulated so far.</dd>
+ * </dl>
+ */
+struct DpRt_Kernel_Stats_Struct
+{
+	double Sum;
+	unsigned short Peak;
+	long Count;
+};
+
+/**
+ * Structure holding running statistics of calibrated (bias subtracted and flat fielded) pixels, accumulated a
+ * block of pixels at a time by DpRt_Kernel_Calibrate_Block.
+ * <dl>
+ * <dt>Sum</dt> <dd>The sum of the calibrated pixel values.</dd>
+ * <dt>Sum_Squares</dt> <dd>The sum of the squares of the calibrated pixel values.</dd>
+ * <dt>Minimum</dt> <dd>The smallest calibrated pixel value.</dd>
+ * <dt>Maximum</dt> <dd>The largest calibrated pixel value.</dd>
+ * <dt>Count</dt> <dd>The number of pixels accumulated so far.</dd>
+ * <dt>Saturated_Count</dt> <dd>The number of raw pixels at or above the saturation level.</dd>
+ * </dl>
+ */
+struct DpRt_Kernel_Calibrate_Stats_Struct
+{
+	double Sum;
+	double Sum_Squares;
+	float Minimum;
+	float Maximum;
+	long Count;
+	long Saturated_Count;
+};
+
+/* function declarations */
+extern void DpRt_Kernel_Stats_Initialise(struct DpRt_Kernel_Stats_Struct *stats);
+extern void DpRt_Kernel_Stats_Accumulate(struct DpRt_Kernel_Stats_Struct *stats,unsigned short *data,long count,
+					 int pixel_format);
+extern double DpRt_Kernel_Stats_Mean(struct DpRt_Kernel_Stats_Struct *stats);
+extern void DpRt_Kernel_Calibrate_Stats_Initialise(struct DpRt_Kernel_Calibrate_Stats_Struct *stats);
+extern void DpRt_Kernel_Calibrate_Block(unsigned short *data,int pixel_format,float *bias,float *flat,
+					float *overscan,long count,float saturation_level,unsigned char *saturation_mask,
+					long first_pixel,float *output,struct DpRt_Kernel_Calibrate_Stats_Struct *stats);
+extern double DpRt_Kernel_Calibrate_Stats_Mean(struct DpRt_Kernel_Calibrate_Stats_Struct *stats);
+extern double DpRt_Kernel_Calibrate_Stats_Sigma(struct DpRt_Kernel_Calibrate_Stats_Struct *stats);
+extern void DpRt_Kernel_Laplacian_Row(float *above,float *row,float *below,long count,float *output);
+extern double DpRt_Kernel_Clipped_Mean(float *data,long count,double clip_sigma);
+extern void DpRt_Kernel_Clipped_Mean_Columns(float *data,long stride,int column_count,int row_count,
+					     double clip_sigma,float *work,float *mean);
+extern int DpRt_Kernel_Polynomial_Fit(double *x_list,double *y_list,int count,int order,double x_centre,
+				      double x_scale,double *coefficient_list);
+extern double DpRt_Kernel_Polynomial_Evaluate(double *coefficient_list,int order,double x_centre,double x_scale,
+					      double x);
+#endif
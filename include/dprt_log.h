@@ -0,0 +1,44 @@
+/* dprt_log.h
+** $Header$
+*/
+#ifndef DPRT_LOG_H
+#define DPRT_LOG_H
+
+/* hash definitions */
+/**
+ * The number of entries the log ring buffer holds. This must be a power of two. If the drain thread falls this
+ * far behind, further entries are dropped rather than making the caller wait.
+ */
+#define DPRT_LOG_RING_LENGTH		(512)
+/**
+ * The maximum length of a log message, including the terminating NUL. Longer messages are truncated.
+ */
+#define DPRT_LOG_STRING_LENGTH		(512)
+
+/* enums */
+/**
+ * The level of a log message. Messages above the configured level are discarded when they are logged. The values
+ * are passed to the log handler as the level.
+ * <ul>
+ * <li>DPRT_LOG_LEVEL_ERROR A failure.
+ * <li>DPRT_LOG_LEVEL_WARNING Something missing or unexpected, that the reduction carried on without.
+ * <li>DPRT_LOG_LEVEL_INFO The progress and results of each reduction.
+ * <li>DPRT_LOG_LEVEL_DEBUG Detail of the reduction stages, and the configuration defaults used.
+ * </ul>
+ */
+enum DPRT_LOG_LEVEL
+{
+	DPRT_LOG_LEVEL_ERROR=1,DPRT_LOG_LEVEL_WARNING=2,DPRT_LOG_LEVEL_INFO=3,DPRT_LOG_LEVEL_DEBUG=4
+};
+
+/* function declarations */
+extern void DpRt_Log_Format(int level,char *format,...);
+extern unsigned long DpRt_Log_Tag_Create(void);
+extern void DpRt_Log_Level_Set(int level);
+extern void DpRt_Log_Handler_Set(void (*handler)(int level,char *string));
+extern void DpRt_Log_Thread_Hooks_Set(void (*start_hook)(void),void (*stop_hook)(void));
+extern int DpRt_Log_Filename_Set(char *filename);
+extern int DpRt_Log_Initialise(void);
+extern void DpRt_Log_Flush(void);
+extern void DpRt_Log_Shutdown(void);
+#endif
@@ -0,0 +1,63 @@
+/* dprt_master.h
+** $Header$
+*/
+#ifndef DPRT_MASTER_H
+#define DPRT_MASTER_H
+#include "dprt_fits.h"
+
+/* hash definitions */
+/**
+ * The minimum number of frames of one binning needed to make a master frame.
+ */
+#define DPRT_MASTER_FRAME_COUNT_MIN	(3)
+/**
+ * Format of a master bias filename. The parameters are the directory, X binning and Y binning.
+ */
+#define DPRT_MASTER_BIAS_FILENAME_FORMAT	("%s/master_bias_%dx%d.fits")
+/**
+ * Format of a master flat filename. The parameters are the directory, X binning and Y binning.
+ */
+#define DPRT_MASTER_FLAT_FILENAME_FORMAT	("%s/master_flat_%dx%d.fits")
+/**
+ * The clipping threshold, in standard deviations, used when combining flats.
+ */
+#define DPRT_MASTER_FLAT_CLIP_SIGMA	(3.0)
+/**
+ * The filename prefix used for all master frames. Files starting with this prefix are never used as input
+ * frames.
+ */
+#define DPRT_MASTER_FILENAME_PREFIX	("master_")
+
+/* structures */
+/**
+ * Structure describing one calibration frame found in a directory.
+ * <dl>
+ * <dt>Filename</dt> <dd>The full pathname of the frame.</dd>
+ * <dt>Header</dt> <dd>The classification keywords read from the frame's header.</dd>
+ * </dl>
+ */
+struct DpRt_Master_Frame_Struct
+{
+	char Filename[DPRT_FITS_FILENAME_LENGTH];
+	struct DpRt_Fits_Header_Struct Header;
+};
+
+/**
+ * Structure describing the binning of a master frame.
+ * <dl>
+ * <dt>X_Bin</dt> <dd>The X binning.</dd>
+ * <dt>Y_Bin</dt> <dd>The Y binning.</dd>
+ * </dl>
+ */
+struct DpRt_Master_Binning_Struct
+{
+	int X_Bin;
+	int Y_Bin;
+};
+
+/* function declarations */
+extern int DpRt_Master_Bias_Make(char *directory_name,struct DpRt_Master_Binning_Struct *skip_list,int skip_count);
+extern int DpRt_Master_Flat_Make(char *directory_name);
+extern int DpRt_Master_Frame_List_Get(char *directory_name,char **obstype_list,
+				      struct DpRt_Master_Frame_Struct **frame_list,int *frame_count);
+#endif
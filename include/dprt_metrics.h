@@ -0,0 +1,75 @@
+/* dprt_metrics.h
+** $Header$
+*/
+#ifndef DPRT_METRICS_H
+#define DPRT_METRICS_H
+#include <time.h>
+
+/* enums */
+/**
+ * The reduction stages timed.
+ * <ul>
+ * <li>DPRT_METRICS_STAGE_OPEN Opening a raw frame, and parsing its header, for reading.
+ * <li>DPRT_METRICS_STAGE_READ Reading a block of rows of a raw frame.
+ * <li>DPRT_METRICS_STAGE_CALIBRATE Bias subtracting and flat fielding a block of rows.
+ * <li>DPRT_METRICS_STAGE_EXTRACT Finding the trace and extracting the spectrum of a calibrated frame.
+ * <li>DPRT_METRICS_STAGE_QUICK Measuring the spectrum of a frame in a quick reduction.
+ * <li>DPRT_METRICS_STAGE_WRITE Writing a reduced frame and its spectrum.
+ * <li>DPRT_METRICS_STAGE_COSMIC Rejecting cosmic rays from a calibrated frame.
+ * <li>DPRT_METRICS_STAGE_COUNT The number of stages.
+ * </ul>
+ */
+enum DPRT_METRICS_STAGE
+{
+	DPRT_METRICS_STAGE_OPEN,DPRT_METRICS_STAGE_READ,DPRT_METRICS_STAGE_CALIBRATE,DPRT_METRICS_STAGE_EXTRACT,
+	DPRT_METRICS_STAGE_QUICK,DPRT_METRICS_STAGE_WRITE,DPRT_METRICS_STAGE_COSMIC,DPRT_METRICS_STAGE_COUNT
+};
+
+/**
+ * The events counted.
+ * <ul>
+ * <li>DPRT_METRICS_COUNTER_FRAMES The number of frames reduced successfully.
+ * <li>DPRT_METRICS_COUNTER_FRAMES_FAILED The number of frames whose reduction failed.
+ * <li>DPRT_METRICS_COUNTER_BYTES_READ The number of bytes of raw pixel data read from disk.
+ * <li>DPRT_METRICS_COUNTER_CACHE_HITS The number of master frame lookups satisfied from memory.
+ * <li>DPRT_METRICS_COUNTER_CACHE_MISSES The number of master frame lookups that read the master from disk.
+ * <li>DPRT_METRICS_COUNTER_ABORTS The number of reduction stages stopped by an abort.
+ * <li>DPRT_METRICS_COUNTER_COUNT The number of counters.
+ * </ul>
+ */
+enum DPRT_METRICS_COUNTER
+{
+	DPRT_METRICS_COUNTER_FRAMES,DPRT_METRICS_COUNTER_FRAMES_FAILED,DPRT_METRICS_COUNTER_BYTES_READ,
+	DPRT_METRICS_COUNTER_CACHE_HITS,DPRT_METRICS_COUNTER_CACHE_MISSES,DPRT_METRICS_COUNTER_ABORTS,
+	DPRT_METRICS_COUNTER_COUNT
+};
+
+/* structures */
+/**
+ * Structure holding the stage timings and counters, returned by DpRt_Metrics_Snapshot_Get.
+ * <dl>
+ * <dt>Stage_Count_List</dt> <dd>The number of times each stage was timed, indexed by DPRT_METRICS_STAGE.</dd>
+ * <dt>Stage_Time_List</dt> <dd>The total time spent in each stage, in seconds.</dd>
+ * <dt>Stage_Time_Maximum_List</dt> <dd>The longest single time spent in each stage, in seconds.</dd>
+ * <dt>Counter_List</dt> <dd>The value of each counter, indexed by DPRT_METRICS_COUNTER.</dd>
+ * <dt>Thread_Count</dt> <dd>The number of threads currently holding a slot.</dd>
+ * </dl>
+ * @see #DPRT_METRICS_STAGE
+ * @see #DPRT_METRICS_COUNTER
+ */
+struct DpRt_Metrics_Snapshot_Struct
+{
+	long Stage_Count_List[DPRT_METRICS_STAGE_COUNT];
+	double Stage_Time_List[DPRT_METRICS_STAGE_COUNT];
+	double Stage_Time_Maximum_List[DPRT_METRICS_STAGE_COUNT];
+	long Counter_List[DPRT_METRICS_COUNTER_COUNT];
+	int Thread_Count;
+};
+
+/* function declarations */
+extern void DpRt_Metrics_Timer_Start(struct timespec *start_time);
+extern void DpRt_Metrics_Timer_Stop(enum DPRT_METRICS_STAGE stage,struct timespec *start_time);
+extern void DpRt_Metrics_Count_Add(enum DPRT_METRICS_COUNTER counter,long value);
+extern void DpRt_Metrics_Snapshot_Get(struct DpRt_Metrics_Snapshot_Struct *snapshot,int reset);
+extern void DpRt_Metrics_Log(void);
+#endif
@@ -0,0 +1,61 @@
+/* dprt_overscan.h
+** $Header$
+*/
+#ifndef DPRT_OVERSCAN_H
+#define DPRT_OVERSCAN_H
+#include "dprt_fits.h"
+
+/* hash definitions */
+/**
+ * The number of standard deviations from the mean beyond which an overscan pixel (e.g. a cosmic ray or hot
+ * pixel) is left out of the bias level.
+ */
+#define DPRT_OVERSCAN_CLIP_SIGMA	(3.0)
+
+/* enums */
+/**
+ * The bias models that can be fitted to an overscan region. Which is used depends on the shape of the region.
+ * <ul>
+ * <li>DPRT_OVERSCAN_MODEL_ROW A bias level for each row, from a serial overscan region (columns read out past
+ *     the end of each row), which tracks row to row changes in the bias.
+ * <li>DPRT_OVERSCAN_MODEL_COLUMN A smoothed bias level for each column, from a parallel overscan region (rows
+ *     read out past the end of the frame).
+ * </ul>
+ */
+enum DPRT_OVERSCAN_MODEL
+{
+	DPRT_OVERSCAN_MODEL_ROW,DPRT_OVERSCAN_MODEL_COLUMN
+};
+
+/* structures */
+/**
+ * Structure holding a bias model fitted to an overscan region.
+ * <dl>
+ * <dt>Model</dt> <dd>The kind of model, a DPRT_OVERSCAN_MODEL value.</dd>
+ * <dt>Start</dt> <dd>The frame row (DPRT_OVERSCAN_MODEL_ROW) or column (DPRT_OVERSCAN_MODEL_COLUMN) of the
+ *     first bias level.</dd>
+ * <dt>Length</dt> <dd>The number of bias levels.</dd>
+ * <dt>Level</dt> <dd>The bias levels, one for each row or column of the overscan region, or NULL if no model
+ *     has been fitted.</dd>
+ * </dl>
+ * @see #DPRT_OVERSCAN_MODEL
+ */
+struct DpRt_Overscan_Struct
+{
+	int Model;
+	int Start;
+	int Length;
+	float *Level;
+};
+
+/* function declarations */
+extern int DpRt_Overscan_Fit(float *data,int stride,struct DpRt_Fits_Section_Struct *bias_section,int smooth,
+			     struct DpRt_Overscan_Struct *overscan);
+extern void DpRt_Overscan_Level_Subtract(struct DpRt_Overscan_Struct *overscan,
+					 struct DpRt_Overscan_Struct *reference);
+extern double DpRt_Overscan_Level_Mean(struct DpRt_Overscan_Struct *overscan);
+extern void DpRt_Overscan_Row_Get(struct DpRt_Overscan_Struct *overscan,int row,int first_column,int count,
+				  float *output);
+extern void DpRt_Overscan_Trim(float *frame,int naxis1,struct DpRt_Fits_Section_Struct *trim_section);
+extern void DpRt_Overscan_Free(struct DpRt_Overscan_Struct *overscan);
+#endif
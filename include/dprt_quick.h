@@ -0,0 +1,40 @@
+/* dprt_quick.h
+** $Header$
+*/
+#ifndef DPRT_QUICK_H
+#define DPRT_QUICK_H
+#include "dprt_config.h"
+
+/* structures */
+/**
+ * Structure holding the results of a quick reduction.
+ * <dl>
+ * <dt>Counts</dt> <dd>The counts of the brightest pixel found in the spectrum.</dd>
+ * <dt>X_Pix</dt> <dd>The flux weighted centre of the spectrum along the dispersion axis (NAXIS1), in FITS
+ *     pixels (the first pixel is 1).</dd>
+ * <dt>Y_Pix</dt> <dd>The flux weighted centre of the spectrum across the dispersion axis (NAXIS2), in FITS
+ *     pixels.</dd>
+ * <dt>Fwhm</dt> <dd>The full width half maximum of the spectrum's spatial profile, in pixels.</dd>
+ * <dt>Saturated</dt> <dd>TRUE if the brightest pixel found is at or above the saturation level.</dd>
+ * <dt>Degraded</dt> <dd>TRUE if the time budget forced a coarser sampling, or the skipping or early end of the
+ *     full resolution refinement.</dd>
+ * <dt>Elapsed_Time</dt> <dd>The time the quick reduction took, in milliseconds.</dd>
+ * </dl>
+ */
+struct DpRt_Quick_Result_Struct
+{
+	double Counts;
+	double X_Pix;
+	double Y_Pix;
+	double Fwhm;
+	int Saturated;
+	int Degraded;
+	double Elapsed_Time;
+};
+
+/* function declarations */
+extern int DpRt_Quick_Reduce(char *filename,struct DpRt_Config_Struct *config,
+			     struct DpRt_Quick_Result_Struct *result);
+extern int DpRt_Quick_Reduce_Buffer(unsigned short *pixels,int naxis1,int naxis2,int pixel_format,
+				    struct DpRt_Config_Struct *config,struct DpRt_Quick_Result_Struct *result);
+#endif
@@ -0,0 +1,49 @@
+/* dprt_wavelength.h
+** $Header$
+*/
+#ifndef DPRT_WAVELENGTH_H
+#define DPRT_WAVELENGTH_H
+#include "dprt_config.h"
+
+/* hash definitions */
+/**
+ * The maximum order of the dispersion solution polynomial.
+ */
+#define DPRT_WAVELENGTH_ORDER_MAX	(5)
+
+/* structures */
+/**
+ * Structure describing a wavelength (dispersion) solution fitted to an arc frame. The wavelength (in the
+ * units of the line list) at column x (0 based) is the polynomial sum of Coefficient_List[i]*u^i,
+ * where u = (x-X_Centre)/X_Scale.
+ * <dl>
+ * <dt>X_Bin</dt> <dd>The binning along the dispersion axis of the arc frame.</dd>
+ * <dt>Y_Bin</dt> <dd>The binning along the spatial axis of the arc frame.</dd>
+ * <dt>Naxis1</dt> <dd>The number of columns in the arc frame.</dd>
+ * <dt>Order</dt> <dd>The order of the polynomial fitted.</dd>
+ * <dt>Coefficient_List</dt> <dd>The polynomial coefficients, Order+1 of them.</dd>
+ * <dt>X_Centre</dt> <dd>The column the polynomial's independent variable is centred on.</dd>
+ * <dt>X_Scale</dt> <dd>The number of columns the polynomial's independent variable is scaled by.</dd>
+ * <dt>Line_Count</dt> <dd>The number of arc lines identified and used in the fit.</dd>
+ * <dt>Rms</dt> <dd>The root mean square residual of the fit, in the units of the line list.</dd>
+ * </dl>
+ */
+struct DpRt_Wavelength_Solution_Struct
+{
+	int X_Bin;
+	int Y_Bin;
+	int Naxis1;
+	int Order;
+	double Coefficient_List[DPRT_WAVELENGTH_ORDER_MAX+1];
+	double X_Centre;
+	double X_Scale;
+	int Line_Count;
+	double Rms;
+};
+
+/* function declarations */
+extern int DpRt_Wavelength_Arc_Reduce(char *filename,struct DpRt_Config_Struct *config,
+				      struct DpRt_Wavelength_Solution_Struct *solution,int *fitted);
+extern int DpRt_Wavelength_Lut_Get(int x_bin,int y_bin,int naxis1,float *lut,int *found);
+extern int DpRt_Wavelength_Shutdown(void);
+#endif
@@ -0,0 +1,45 @@
+/* dprt_writer.h
+** $Header$
+*/
+#ifndef DPRT_WRITER_H
+#define DPRT_WRITER_H
+#include "dprt.h"
+#include "dprt_config.h"
+#include "dprt_fits.h"
+
+/* structures */
+/**
+ * Structure holding the status of the background writer.
+ * <dl>
+ * <dt>Thread_Count</dt> <dd>The number of writer threads running.</dd>
+ * <dt>Queued_Count</dt> <dd>The number of frames waiting to be written.</dd>
+ * <dt>Active_Count</dt> <dd>The number of frames being written.</dd>
+ * <dt>Written_Count</dt> <dd>The number of frames written since the library was initialised.</dd>
+ * <dt>Failed_Count</dt> <dd>The number of frames that failed to be written since the library was
+ *     initialised.</dd>
+ * <dt>Last_Error_Number</dt> <dd>The error number of the last failed write, or 0.</dd>
+ * <dt>Last_Error_String</dt> <dd>A description of the last failed write, or an empty string.</dd>
+ * <dt>Last_Failed_Filename</dt> <dd>The output filename of the last failed write, or an empty string.</dd>
+ * </dl>
+ * @see #DpRt_Writer_Status_Get
+ */
+struct DpRt_Writer_Status_Struct
+{
+	int Thread_Count;
+	int Queued_Count;
+	int Active_Count;
+	long Written_Count;
+	long Failed_Count;
+	int Last_Error_Number;
+	char Last_Error_String[DPRT_ERROR_STRING_LENGTH];
+	char Last_Failed_Filename[DPRT_FITS_FILENAME_LENGTH];
+};
+
+/* function declarations */
+extern int DpRt_Writer_Submit(struct DpRt_Config_Struct *config,char *input_filename,char *output_filename,
+			      int naxis1,int naxis2,float *frame,float *flux,float *variance,float *wavelength,
+			      int spectrum_length);
+extern int DpRt_Writer_Flush(void);
+extern void DpRt_Writer_Status_Get(struct DpRt_Writer_Status_Struct *status);
+extern int DpRt_Writer_Shutdown(void);
+#endif
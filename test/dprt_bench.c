@@ -0,0 +1,1171 @@
+/* dprt_bench.c
+** $Header$
+*/
+/**
+ * dprt_bench.c benchmarks libdprt_ftspec, the Data Pipeline Real Time reduction library, on synthetic FTSpec
+ * frames, so the speed of a new library build can be checked before it is deployed to the telescope.
+ * For each binning, a set of frames is generated in a directory of its own: biases, lamp flats, an arc and
+ * some expose frames. The frames have a bias level with a gradient, read and photon noise, a pixel response,
+ * a slit illumination profile, and the expose frames have sky lines, a curved spectral trace, cosmic ray hits
+ * and (in every other frame) a saturated trace. Each DpRt routine is then called a number of times on them,
+ * and the latency percentiles, throughput and peak resident set size of each are printed.
+ * <pre>
+ * dprt_bench [-d <directory>][-n <iterations>][-x <columns>][-y <rows>][-b <binning>]...[-s <seed>][-help]
+ * </pre>
+ * @version $Revision$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "fitsio.h"
+#include "dprt.h"
+#include "dprt_jni_general.h"
+#include "dprt_config.h"
+#include "dprt_context.h"
+#include "dprt_kernel.h"
+
+/* ------------------------------------------------------- */
+/* internal hash definitions */
+/* ------------------------------------------------------- */
+/**
+ * The default directory the synthetic frames are written to.
+ */
+#define BENCH_DIRECTORY_DEFAULT		("/tmp/dprt_bench")
+/**
+ * The maximum length of the directory name, leaving room in DPRT_FITS_FILENAME_LENGTH for the frames' filenames.
+ */
+#define BENCH_DIRECTORY_LENGTH		(128)
+/**
+ * The default number of times each routine is called, for each binning.
+ */
+#define BENCH_ITERATION_COUNT_DEFAULT	(20)
+/**
+ * The default number of unbinned columns (along the dispersion axis) in the synthetic frames.
+ */
+#define BENCH_NAXIS1_DEFAULT		(2048)
+/**
+ * The default number of unbinned rows (along the slit) in the synthetic frames.
+ */
+#define BENCH_NAXIS2_DEFAULT		(512)
+/**
+ * The maximum number of binnings that can be benchmarked in one run.
+ */
+#define BENCH_BINNING_MAX		(8)
+/**
+ * The number of biases, and the number of lamp flats, generated for each binning.
+ */
+#define BENCH_CALIBRATION_FRAME_COUNT	(5)
+/**
+ * The number of expose frames generated for each binning.
+ */
+#define BENCH_EXPOSE_FRAME_COUNT	(4)
+/**
+ * The bias level of the synthetic frames, in counts, at the first column.
+ */
+#define BENCH_BIAS_LEVEL		(1000.0)
+/**
+ * The increase in the bias level across the frame, in counts.
+ */
+#define BENCH_BIAS_GRADIENT		(20.0)
+/**
+ * The read noise of the synthetic frames, in counts. The gain is taken to be 1 electron per count.
+ */
+#define BENCH_READ_NOISE		(5.0)
+/**
+ * The RMS pixel to pixel variation of the detector response.
+ */
+#define BENCH_RESPONSE_SIGMA		(0.01)
+/**
+ * The fraction of the rows, at each end of the slit, that are not illuminated.
+ */
+#define BENCH_SLIT_MARGIN		(0.08)
+/**
+ * The level of the lamp flats, in counts, at the peak of the lamp spectrum.
+ */
+#define BENCH_FLAT_LEVEL		(25000.0)
+/**
+ * The wavelength (Angstroms) of the centre column of the synthetic frames.
+ */
+#define BENCH_WAVELENGTH_CENTRE		(5800.0)
+/**
+ * The dispersion of the synthetic frames, in Angstroms per unbinned pixel.
+ */
+#define BENCH_WAVELENGTH_DISPERSION	(1.6)
+/**
+ * The quadratic term of the wavelength solution, in Angstroms per unbinned pixel squared.
+ */
+#define BENCH_WAVELENGTH_CURVATURE	(1.0e-5)
+/**
+ * The number of emission lines in the arc frames, all of which are in the line list.
+ */
+#define BENCH_ARC_LINE_COUNT		(32)
+/**
+ * The number of sky emission lines in the expose frames.
+ */
+#define BENCH_SKY_LINE_COUNT		(12)
+/**
+ * The Gaussian sigma of arc and sky lines, in unbinned pixels.
+ */
+#define BENCH_LINE_SIGMA		(2.0)
+/**
+ * The sky continuum, in counts per unbinned pixel.
+ */
+#define BENCH_SKY_LEVEL			(20.0)
+/**
+ * The flux of the object in each unbinned column, in counts summed along the slit.
+ */
+#define BENCH_OBJECT_FLUX		(6000.0)
+/**
+ * The factor the object flux is multiplied by in frames with a saturated trace.
+ */
+#define BENCH_SATURATED_FLUX_FACTOR	(60.0)
+/**
+ * The Gaussian sigma of the trace profile along the slit, in unbinned pixels.
+ */
+#define BENCH_TRACE_SIGMA		(3.0)
+/**
+ * The difference between the trace position at the ends and the centre of the frame, in unbinned pixels.
+ */
+#define BENCH_TRACE_CURVATURE		(12.0)
+/**
+ * The number of cosmic ray hits per million unbinned pixels in each expose frame.
+ */
+#define BENCH_COSMIC_DENSITY		(150.0)
+/**
+ * The exposure length of the expose frames, in seconds.
+ */
+#define BENCH_EXPOSE_LENGTH		(600.0)
+/**
+ * The number of stages (DpRt routines) benchmarked for each binning.
+ * @see #Stage_List
+ */
+#define BENCH_STAGE_COUNT		(7)
+/**
+ * The maximum value of an unsigned 16 bit pixel.
+ */
+#define BENCH_PIXEL_MAX			(65535.0)
+
+/* ------------------------------------------------------- */
+/* internal structures */
+/* ------------------------------------------------------- */
+/**
+ * Structure holding the synthetic frames of one binning.
+ * <dl>
+ * <dt>Bin</dt> <dd>The binning factor, the same along both axes.</dd>
+ * <dt>Naxis1</dt> <dd>The number of binned columns.</dd>
+ * <dt>Naxis2</dt> <dd>The number of binned rows.</dd>
+ * <dt>Calibration_Directory</dt> <dd>The directory holding the biases, flats and master frames.</dd>
+ * <dt>Arc_Filename</dt> <dd>The arc frame's filename.</dd>
+ * <dt>Expose_Filename_List</dt> <dd>The expose frames' filenames.</dd>
+ * <dt>Expose_Pointer_List</dt> <dd>Pointers to each element of Expose_Filename_List, passed to
+ *     DpRt_Expose_Reduce_Batch_Context.</dd>
+ * <dt>Response</dt> <dd>The pixel response of each binned pixel, Naxis1*Naxis2 floats.</dd>
+ * <dt>Expose_Pixels</dt> <dd>The pixels of the first expose frame, in native byte order, reduced by
+ *     DpRt_Expose_Reduce_Buffer_Context.</dd>
+ * </dl>
+ */
+struct Bench_Binning_Struct
+{
+	int Bin;
+	int Naxis1;
+	int Naxis2;
+	char Calibration_Directory[DPRT_FITS_FILENAME_LENGTH];
+	char Arc_Filename[DPRT_FITS_FILENAME_LENGTH];
+	char Expose_Filename_List[BENCH_EXPOSE_FRAME_COUNT][DPRT_FITS_FILENAME_LENGTH];
+	char *Expose_Pointer_List[BENCH_EXPOSE_FRAME_COUNT];
+	float *Response;
+	unsigned short *Expose_Pixels;
+};
+
+/**
+ * Structure describing one benchmarked stage.
+ * <dl>
+ * <dt>Name</dt> <dd>The name printed in the results.</dd>
+ * <dt>Run</dt> <dd>The function that calls the DpRt routine once, given the binning's frames and the iteration
+ *     number. It returns TRUE on success and FALSE on failure.</dd>
+ * <dt>Frame_Count</dt> <dd>The number of frames each call processes, used to compute the throughput.</dd>
+ * </dl>
+ */
+struct Bench_Stage_Struct
+{
+	char *Name;
+	int (*Run)(struct Bench_Binning_Struct *binning,int iteration);
+	int Frame_Count;
+};
+
+/**
+ * Structure holding the timings of one stage on one binning.
+ * <dl>
+ * <dt>Time_List</dt> <dd>The elapsed time of each successful call, in seconds.</dd>
+ * <dt>Time_Count</dt> <dd>The number of successful calls.</dd>
+ * <dt>Failed_Count</dt> <dd>The number of failed calls.</dd>
+ * <dt>Peak_Rss</dt> <dd>The process's peak resident set size after the stage, in kilobytes.</dd>
+ * </dl>
+ */
+struct Bench_Result_Struct
+{
+	double *Time_List;
+	int Time_Count;
+	int Failed_Count;
+	long Peak_Rss;
+};
+
+/* ------------------------------------------------------- */
+/* internal functions declarations */
+/* ------------------------------------------------------- */
+static void Help(void);
+static int Parse_Args(int argc,char *argv[]);
+static int Bench_Binning_Generate(struct Bench_Binning_Struct *binning,int bin);
+static int Bench_Frame_Generate(struct Bench_Binning_Struct *binning,char *filename,char *obstype,
+				double exposure_length,int frame_index,unsigned short *pixels);
+static int Bench_Line_List_Write(char *filename);
+static int Bench_Fits_Write(char *filename,char *obstype,int bin,double exposure_length,int naxis1,int naxis2,
+			    unsigned short *pixels);
+static double Bench_Lamp_Level(double ux,double columns);
+static double Bench_Slit_Illumination(double uy,double rows);
+static double Bench_Line_Column(double wavelength,double columns);
+static double Bench_Random_Uniform(void);
+static double Bench_Random_Gaussian(void);
+static int Bench_Directory_Make(char *directory_name);
+static int Bench_Stage_Run(struct Bench_Binning_Struct *binning,struct Bench_Stage_Struct *stage,
+			   struct Bench_Result_Struct *result);
+static int Bench_Make_Master_Bias(struct Bench_Binning_Struct *binning,int iteration);
+static int Bench_Make_Master_Flat(struct Bench_Binning_Struct *binning,int iteration);
+static int Bench_Calibrate_Reduce(struct Bench_Binning_Struct *binning,int iteration);
+static int Bench_Expose_Reduce_Full(struct Bench_Binning_Struct *binning,int iteration);
+static int Bench_Expose_Reduce_Quick(struct Bench_Binning_Struct *binning,int iteration);
+static int Bench_Expose_Reduce_Buffer(struct Bench_Binning_Struct *binning,int iteration);
+static int Bench_Expose_Reduce_Batch(struct Bench_Binning_Struct *binning,int iteration);
+static int Bench_Expose_Reduce(struct Bench_Binning_Struct *binning,int iteration);
+static void Bench_Error_Print(char *name);
+static void Bench_Results_Print(struct Bench_Binning_Struct *binning_list,
+				struct Bench_Result_Struct result_list[][BENCH_STAGE_COUNT]);
+static int Bench_Time_Compare(const void *p1,const void *p2);
+static double Bench_Percentile(double *sorted_list,int count,double percent);
+static long Bench_Peak_Rss_Get(void);
+
+/* ------------------------------------------------------- */
+/* internal variables */
+/* ------------------------------------------------------- */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The directory the synthetic frames are written to.
+ */
+static char Directory[BENCH_DIRECTORY_LENGTH] = BENCH_DIRECTORY_DEFAULT;
+/**
+ * The number of times each routine is called, for each binning.
+ */
+static int Iteration_Count = BENCH_ITERATION_COUNT_DEFAULT;
+/**
+ * The number of unbinned columns in the synthetic frames.
+ */
+static int Naxis1 = BENCH_NAXIS1_DEFAULT;
+/**
+ * The number of unbinned rows in the synthetic frames.
+ */
+static int Naxis2 = BENCH_NAXIS2_DEFAULT;
+/**
+ * The binnings to benchmark.
+ */
+static int Bin_List[BENCH_BINNING_MAX];
+/**
+ * The number of binnings in Bin_List. If none are specified on the command line, 1x1, 2x2 and 4x4 are used.
+ */
+static int Bin_Count = 0;
+/**
+ * The seed of the random number generator, so the same frames are generated on every run.
+ */
+static unsigned long Seed = 1;
+/**
+ * The state of the random number generator.
+ * @see #Bench_Random_Uniform
+ */
+static unsigned long Random_State = 1;
+/**
+ * The filename of the arc line list, written into Directory.
+ */
+static char Line_List_Filename[DPRT_FITS_FILENAME_LENGTH];
+/**
+ * The wavelengths of the arc lines, which are also written to the line list.
+ */
+static double Arc_Wavelength_List[BENCH_ARC_LINE_COUNT];
+/**
+ * The wavelengths of the sky lines.
+ */
+static double Sky_Wavelength_List[BENCH_SKY_LINE_COUNT];
+/**
+ * The reduction context the routines are called in. Its configuration snapshot is modified to point at the
+ * synthetic frames.
+ */
+static struct DpRt_Context_Struct *Context = NULL;
+/**
+ * The stages benchmarked, in the order they are run: the master frames must exist, and the arc must have been
+ * fitted, before the expose frames are reduced.
+ * @see #BENCH_STAGE_COUNT
+ */
+static struct Bench_Stage_Struct Stage_List[BENCH_STAGE_COUNT] =
+{
+	{"Make_Master_Bias",Bench_Make_Master_Bias,BENCH_CALIBRATION_FRAME_COUNT},
+	{"Make_Master_Flat",Bench_Make_Master_Flat,BENCH_CALIBRATION_FRAME_COUNT},
+	{"Calibrate_Reduce(arc)",Bench_Calibrate_Reduce,1},
+	{"Expose_Reduce(full)",Bench_Expose_Reduce_Full,1},
+	{"Expose_Reduce(quick)",Bench_Expose_Reduce_Quick,1},
+	{"Expose_Reduce_Buffer",Bench_Expose_Reduce_Buffer,1},
+	{"Expose_Reduce_Batch",Bench_Expose_Reduce_Batch,BENCH_EXPOSE_FRAME_COUNT}
+};
+
+/* ------------------------------------------------------- */
+/* external functions */
+/* ------------------------------------------------------- */
+/**
+ * The main program. The synthetic frames of every binning are generated, then each stage in Stage_List is run
+ * Iteration_Count times on each binning, and the results printed.
+ * @see #Bench_Binning_Generate
+ * @see #Bench_Stage_Run
+ * @see #Bench_Results_Print
+ */
+int main(int argc, char *argv[])
+{
+	struct Bench_Binning_Struct binning_list[BENCH_BINNING_MAX];
+	struct Bench_Result_Struct result_list[BENCH_BINNING_MAX][BENCH_STAGE_COUNT];
+	char error_string[DPRT_ERROR_STRING_LENGTH];
+	int i,j,retval;
+
+	if(!Parse_Args(argc,argv))
+		return 0;
+	if(Bin_Count == 0)
+	{
+		Bin_List[0] = 1;
+		Bin_List[1] = 2;
+		Bin_List[2] = 4;
+		Bin_Count = 3;
+	}
+	if(!Bench_Directory_Make(Directory))
+		return 1;
+	sprintf(Line_List_Filename,"%s/bench_lines.dat",Directory);
+	Random_State = Seed;
+	if(!Bench_Line_List_Write(Line_List_Filename))
+		return 1;
+	memset(binning_list,0,sizeof(binning_list));
+	for(i = 0; i < Bin_Count; i++)
+	{
+		fprintf(stdout,"dprt_bench:Generating %dx%d frames.\n",Bin_List[i],Bin_List[i]);
+		if(!Bench_Binning_Generate(&(binning_list[i]),Bin_List[i]))
+			return 1;
+	}
+/* initialise the DpRt */
+	retval = DpRt_Initialise();
+	if(retval == FALSE)
+	{
+		DpRt_JNI_Get_Error_String(error_string);
+		fprintf(stderr,"DpRt_Initialise failed:(%d) %s.\n",DpRt_JNI_Get_Error_Number(),error_string);
+		return 1;
+	}
+	if(!DpRt_Context_Create(&Context))
+	{
+		Bench_Error_Print("DpRt_Context_Create");
+		return 1;
+	}
+	Context->Config.Make_Master_Bias = TRUE;
+	Context->Config.Make_Master_Flat = TRUE;
+	strcpy(Context->Config.Wavelength_Line_List,Line_List_Filename);
+	Context->Config.Wavelength_Centre = BENCH_WAVELENGTH_CENTRE;
+	Context->Config.Wavelength_Dispersion = BENCH_WAVELENGTH_DISPERSION;
+	for(i = 0; i < Bin_Count; i++)
+	{
+		strcpy(Context->Config.Master_Directory,binning_list[i].Calibration_Directory);
+		for(j = 0; j < BENCH_STAGE_COUNT; j++)
+		{
+			fprintf(stdout,"dprt_bench:Running %s %d times on %dx%d frames.\n",Stage_List[j].Name,
+				Iteration_Count,binning_list[i].Bin,binning_list[i].Bin);
+			if(!Bench_Stage_Run(&(binning_list[i]),&(Stage_List[j]),&(result_list[i][j])))
+				return 1;
+		}
+	}
+	Bench_Results_Print(binning_list,result_list);
+	for(i = 0; i < Bin_Count; i++)
+	{
+		free(binning_list[i].Response);
+		free(binning_list[i].Expose_Pixels);
+		for(j = 0; j < BENCH_STAGE_COUNT; j++)
+			free(result_list[i][j].Time_List);
+	}
+	DpRt_Context_Destroy(Context);
+/* shutdown the DpRt */
+	retval = DpRt_Shutdown();
+	if(retval == FALSE)
+	{
+		DpRt_JNI_Get_Error_String(error_string);
+		fprintf(stderr,"DpRt_Shutdown failed:(%d) %s.\n",DpRt_JNI_Get_Error_Number(),error_string);
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------- */
+/* internal functions */
+/* ------------------------------------------------------- */
+/**
+ * Routine to parse arguments.
+ * @param argc The argument count.
+ * @param argv The argument list.
+ * @return Returns TRUE if the program can proceed, FALSE if it should stop (the user requested help, or an
+ *         argument was wrong).
+ */
+static int Parse_Args(int argc,char *argv[])
+{
+	int i;
+	int call_help = FALSE;
+
+	for(i=1;i<argc;i++)
+	{
+		if(strcmp(argv[i],"-help")==0)
+			call_help = TRUE;
+		else if((strcmp(argv[i],"-b")==0)&&((i+1)<argc))
+		{
+			if(Bin_Count >= BENCH_BINNING_MAX)
+			{
+				fprintf(stderr,"dprt_bench: Too many binnings (maximum %d).\n",BENCH_BINNING_MAX);
+				return FALSE;
+			}
+			Bin_List[Bin_Count] = atoi(argv[i+1]);
+			if(Bin_List[Bin_Count] < 1)
+			{
+				fprintf(stderr,"dprt_bench: Illegal binning %s.\n",argv[i+1]);
+				return FALSE;
+			}
+			Bin_Count++;
+			i++;
+		}
+		else if((strcmp(argv[i],"-d")==0)&&((i+1)<argc))
+		{
+			if(strlen(argv[i+1]) >= BENCH_DIRECTORY_LENGTH)
+			{
+				fprintf(stderr,"dprt_bench: Directory name too long (maximum %d).\n",
+					BENCH_DIRECTORY_LENGTH-1);
+				return FALSE;
+			}
+			strcpy(Directory,argv[i+1]);
+			i++;
+		}
+		else if((strcmp(argv[i],"-n")==0)&&((i+1)<argc))
+		{
+			Iteration_Count = atoi(argv[i+1]);
+			i++;
+		}
+		else if((strcmp(argv[i],"-s")==0)&&((i+1)<argc))
+		{
+			Seed = (unsigned long)atol(argv[i+1]);
+			i++;
+		}
+		else if((strcmp(argv[i],"-x")==0)&&((i+1)<argc))
+		{
+			Naxis1 = atoi(argv[i+1]);
+			i++;
+		}
+		else if((strcmp(argv[i],"-y")==0)&&((i+1)<argc))
+		{
+			Naxis2 = atoi(argv[i+1]);
+			i++;
+		}
+		else
+		{
+			fprintf(stderr,"dprt_bench: Unknown argument %s.\n",argv[i]);
+			call_help = TRUE;
+		}
+	}
+	if(call_help)
+	{
+		Help();
+		return FALSE;
+	}
+	if((Iteration_Count < 1)||(Naxis1 < 64)||(Naxis2 < 64))
+	{
+		fprintf(stderr,"dprt_bench: Illegal iteration count %d or frame size %dx%d.\n",Iteration_Count,
+			Naxis1,Naxis2);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Routine to produce some help.
+ */
+static void Help(void)
+{
+	fprintf(stdout,"dprt_bench Benchmarks the reduction routines in libdprt_ftspec on synthetic frames.\n");
+	fprintf(stdout,"dprt_bench [-d <directory>][-n <iterations>][-x <columns>][-y <rows>][-b <binning>]..."
+		"[-s <seed>][-help]\n");
+	fprintf(stdout,"-d is the directory the synthetic frames are written to (default %s).\n",
+		BENCH_DIRECTORY_DEFAULT);
+	fprintf(stdout,"-n is the number of times each routine is called for each binning (default %d).\n",
+		BENCH_ITERATION_COUNT_DEFAULT);
+	fprintf(stdout,"-x and -y are the unbinned frame size (default %dx%d).\n",BENCH_NAXIS1_DEFAULT,
+		BENCH_NAXIS2_DEFAULT);
+	fprintf(stdout,"-b adds a binning to benchmark, and can be repeated (default 1, 2 and 4).\n");
+	fprintf(stdout,"-s is the random number seed used to generate the frames (default 1).\n");
+	fprintf(stdout,"-help prints this help message and exits.\n");
+	fprintf(stdout,"The dprt.* properties are read as usual, but the make master, master directory and "
+		"wavelength properties are set to match the synthetic frames.\n");
+}
+
+/**
+ * Generate the synthetic frames of one binning. They are written to a sub-directory of Directory named after
+ * the binning: the biases and flats in a calibration directory, where the master frames are made, and the arc
+ * and expose frames in an expose directory. The expose frames' filenames end in "_0.fits", so the reduced
+ * frames are written alongside them.
+ * @param binning The binning structure to fill in.
+ * @param bin The binning factor.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Bench_Frame_Generate
+ * @see #Bench_Directory_Make
+ */
+static int Bench_Binning_Generate(struct Bench_Binning_Struct *binning,int bin)
+{
+	char directory_name[BENCH_DIRECTORY_LENGTH+16];
+	char filename[DPRT_FITS_FILENAME_LENGTH];
+	unsigned short *pixels = NULL;
+	long pixel_count,i;
+
+	binning->Bin = bin;
+	binning->Naxis1 = Naxis1/bin;
+	binning->Naxis2 = Naxis2/bin;
+	pixel_count = ((long)binning->Naxis1)*binning->Naxis2;
+	sprintf(directory_name,"%s/%dx%d",Directory,bin,bin);
+	sprintf(binning->Calibration_Directory,"%s/calibration",directory_name);
+	sprintf(filename,"%s/expose",directory_name);
+	if((!Bench_Directory_Make(directory_name))||(!Bench_Directory_Make(binning->Calibration_Directory))||
+	   (!Bench_Directory_Make(filename)))
+		return FALSE;
+	binning->Response = (float *)malloc(pixel_count*sizeof(float));
+	binning->Expose_Pixels = (unsigned short *)malloc(pixel_count*sizeof(unsigned short));
+	pixels = (unsigned short *)malloc(pixel_count*sizeof(unsigned short));
+	if((binning->Response == NULL)||(binning->Expose_Pixels == NULL)||(pixels == NULL))
+	{
+		fprintf(stderr,"Bench_Binning_Generate:Failed to allocate %dx%d frames.\n",binning->Naxis1,
+			binning->Naxis2);
+		return FALSE;
+	}
+	for(i = 0; i < pixel_count; i++)
+		binning->Response[i] = (float)(1.0+(BENCH_RESPONSE_SIGMA*Bench_Random_Gaussian()));
+	for(i = 0; i < BENCH_CALIBRATION_FRAME_COUNT; i++)
+	{
+		sprintf(filename,"%s/bias_%ld.fits",binning->Calibration_Directory,i+1);
+		if(!Bench_Frame_Generate(binning,filename,"BIAS",0.0,(int)i,pixels))
+			return FALSE;
+		sprintf(filename,"%s/flat_%ld.fits",binning->Calibration_Directory,i+1);
+		if(!Bench_Frame_Generate(binning,filename,"LAMPFLAT",10.0,(int)i,pixels))
+			return FALSE;
+	}
+	sprintf(binning->Arc_Filename,"%s/expose/arc_0.fits",directory_name);
+	if(!Bench_Frame_Generate(binning,binning->Arc_Filename,"ARC",30.0,0,pixels))
+		return FALSE;
+	for(i = 0; i < BENCH_EXPOSE_FRAME_COUNT; i++)
+	{
+		sprintf(binning->Expose_Filename_List[i],"%s/expose/expose_%ld_0.fits",directory_name,i+1);
+		binning->Expose_Pointer_List[i] = binning->Expose_Filename_List[i];
+		if(!Bench_Frame_Generate(binning,binning->Expose_Filename_List[i],"EXPOSE",BENCH_EXPOSE_LENGTH,(int)i,
+					 pixels))
+			return FALSE;
+		if(i == 0)
+			memcpy(binning->Expose_Pixels,pixels,pixel_count*sizeof(unsigned short));
+	}
+	free(pixels);
+	return TRUE;
+}
+
+/**
+ * Generate one synthetic frame and write it to a FITS file. Every frame has the bias level, with a gradient
+ * along the dispersion axis, and read noise. Light falling on the detector is multiplied by the pixel
+ * response and has photon noise added; binned pixels collect the light of bin*bin unbinned pixels, except in
+ * flats whose exposure is taken to be scaled to keep the same level.
+ * <ul>
+ * <li>LAMPFLAT frames have a smooth lamp spectrum along the dispersion axis, across the illuminated slit.
+ * <li>ARC frames have the lines in Arc_Wavelength_List across the illuminated slit.
+ * <li>EXPOSE frames have a sky continuum with the lines in Sky_Wavelength_List across the illuminated slit, an
+ *     object whose trace is curved and shifted a little in each frame, and cosmic ray hits. In frames with an
+ *     odd frame_index the object is bright enough to saturate the centre of the trace.
+ * </ul>
+ * @param binning The binning structure, giving the frame size and pixel response.
+ * @param filename The FITS filename to write.
+ * @param obstype The frame's OBSTYPE: "BIAS", "LAMPFLAT", "ARC" or "EXPOSE".
+ * @param exposure_length The exposure length written to the header, in seconds.
+ * @param frame_index The number of this frame amongst the frames of the same OBSTYPE.
+ * @param pixels An array of Naxis1*Naxis2 unsigned shorts, filled in with the frame.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Bench_Fits_Write
+ */
+static int Bench_Frame_Generate(struct Bench_Binning_Struct *binning,char *filename,char *obstype,
+				double exposure_length,int frame_index,unsigned short *pixels)
+{
+	double line_column_list[BENCH_ARC_LINE_COUNT+BENCH_SKY_LINE_COUNT];
+	double line_amplitude_list[BENCH_ARC_LINE_COUNT+BENCH_SKY_LINE_COUNT];
+	double columns,rows,bin_area,ux,uy,dx,trace_centre,object_flux,light,value,amplitude;
+	int line_count,cosmic_count,x,y,i,j,cx,cy,dxi,dyi,length;
+	long index;
+
+	columns = (double)(binning->Naxis1*binning->Bin);
+	rows = (double)(binning->Naxis2*binning->Bin);
+	bin_area = (double)(binning->Bin*binning->Bin);
+	line_count = 0;
+	if(strcmp(obstype,"ARC") == 0)
+	{
+		for(i = 0; i < BENCH_ARC_LINE_COUNT; i++)
+		{
+			line_column_list[line_count] = Bench_Line_Column(Arc_Wavelength_List[i],columns);
+			line_amplitude_list[line_count] = 3000.0+(1500.0*(i%5));
+			line_count++;
+		}
+	}
+	else if(strcmp(obstype,"EXPOSE") == 0)
+	{
+		for(i = 0; i < BENCH_SKY_LINE_COUNT; i++)
+		{
+			line_column_list[line_count] = Bench_Line_Column(Sky_Wavelength_List[i],columns);
+			line_amplitude_list[line_count] = 150.0+(100.0*(i%4));
+			line_count++;
+		}
+	}
+	object_flux = BENCH_OBJECT_FLUX;
+	if((frame_index%2) == 1)
+		object_flux *= BENCH_SATURATED_FLUX_FACTOR;
+	for(x = 0; x < binning->Naxis1; x++)
+	{
+		/* the centre of the binned pixel, in unbinned pixels */
+		ux = (x*binning->Bin)+((binning->Bin-1)/2.0);
+		dx = (ux-((columns-1.0)/2.0))/((columns-1.0)/2.0);
+		trace_centre = (rows/2.0)+(BENCH_TRACE_CURVATURE*dx*dx)+(3.0*dx)+(2.0*frame_index);
+		for(y = 0; y < binning->Naxis2; y++)
+		{
+			uy = (y*binning->Bin)+((binning->Bin-1)/2.0);
+			light = 0.0;
+			if(strcmp(obstype,"LAMPFLAT") == 0)
+				light = BENCH_FLAT_LEVEL*Bench_Lamp_Level(ux,columns)*Bench_Slit_Illumination(uy,rows);
+			else if(line_count > 0)
+			{
+				if(strcmp(obstype,"EXPOSE") == 0)
+					light = BENCH_SKY_LEVEL;
+				for(i = 0; i < line_count; i++)
+				{
+					value = (ux-line_column_list[i])/BENCH_LINE_SIGMA;
+					if(fabs(value) < 6.0)
+						light += line_amplitude_list[i]*exp(-0.5*value*value);
+				}
+				light *= Bench_Slit_Illumination(uy,rows);
+				if(strcmp(obstype,"EXPOSE") == 0)
+				{
+					value = (uy-trace_centre)/BENCH_TRACE_SIGMA;
+					light += (object_flux/(sqrt(2.0*M_PI)*BENCH_TRACE_SIGMA))*exp(-0.5*value*value);
+				}
+				light *= bin_area;
+			}
+			index = (((long)y)*binning->Naxis1)+x;
+			light *= binning->Response[index];
+			value = BENCH_BIAS_LEVEL+(BENCH_BIAS_GRADIENT*ux/columns)+light+
+				(sqrt((BENCH_READ_NOISE*BENCH_READ_NOISE)+light)*Bench_Random_Gaussian());
+			if(value < 0.0)
+				value = 0.0;
+			if(value > BENCH_PIXEL_MAX)
+				value = BENCH_PIXEL_MAX;
+			pixels[index] = (unsigned short)(value+0.5);
+		}
+	}
+	if(strcmp(obstype,"EXPOSE") == 0)
+	{
+		/* cosmic ray hits are the same size whatever the binning, so the same number hit each frame */
+		cosmic_count = (int)(BENCH_COSMIC_DENSITY*columns*rows/1.0e6);
+		for(i = 0; i < cosmic_count; i++)
+		{
+			cx = (int)(Bench_Random_Uniform()*binning->Naxis1);
+			cy = (int)(Bench_Random_Uniform()*binning->Naxis2);
+			amplitude = 500.0+(Bench_Random_Uniform()*20000.0);
+			length = 1+(int)(Bench_Random_Uniform()*4.0);
+			dxi = (int)(Bench_Random_Uniform()*3.0)-1;
+			dyi = (int)(Bench_Random_Uniform()*3.0)-1;
+			for(j = 0; j < length; j++)
+			{
+				x = cx+(j*dxi);
+				y = cy+(j*dyi);
+				if((x < 0)||(x >= binning->Naxis1)||(y < 0)||(y >= binning->Naxis2))
+					break;
+				index = (((long)y)*binning->Naxis1)+x;
+				value = pixels[index]+amplitude;
+				if(value > BENCH_PIXEL_MAX)
+					value = BENCH_PIXEL_MAX;
+				pixels[index] = (unsigned short)value;
+			}
+		}
+	}
+	return Bench_Fits_Write(filename,obstype,binning->Bin,exposure_length,binning->Naxis1,binning->Naxis2,
+				pixels);
+}
+
+/**
+ * Choose the arc and sky line wavelengths, and write the arc lines to a line list file in the format read by
+ * the library: one wavelength per line, '#' starting a comment. The arc lines are spread irregularly across
+ * the wavelength range of the frames, so the lines can be identified by their spacing.
+ * @param filename The line list filename.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Arc_Wavelength_List
+ * @see #Sky_Wavelength_List
+ */
+static int Bench_Line_List_Write(char *filename)
+{
+	FILE *fp = NULL;
+	double range,start;
+	int i;
+
+	range = BENCH_WAVELENGTH_DISPERSION*(Naxis1-1)*0.9;
+	start = BENCH_WAVELENGTH_CENTRE-(range/2.0);
+	for(i = 0; i < BENCH_ARC_LINE_COUNT; i++)
+	{
+		Arc_Wavelength_List[i] = start+(range*(i+(0.35*Bench_Random_Uniform()))/BENCH_ARC_LINE_COUNT);
+	}
+	for(i = 0; i < BENCH_SKY_LINE_COUNT; i++)
+	{
+		Sky_Wavelength_List[i] = start+(range*(i+(0.8*Bench_Random_Uniform()))/BENCH_SKY_LINE_COUNT);
+	}
+	fp = fopen(filename,"w");
+	if(fp == NULL)
+	{
+		fprintf(stderr,"Bench_Line_List_Write:Failed to open %s.\n",filename);
+		return FALSE;
+	}
+	fprintf(fp,"# dprt_bench synthetic arc lines\n");
+	for(i = 0; i < BENCH_ARC_LINE_COUNT; i++)
+		fprintf(fp,"%.3f BENCH\n",Arc_Wavelength_List[i]);
+	fclose(fp);
+	return TRUE;
+}
+
+/**
+ * Write a frame of unsigned 16 bit pixels to a new FITS file, with the keywords the library reads.
+ * @param filename The FITS filename. Any existing file is overwritten.
+ * @param obstype The value of the OBSTYPE keyword.
+ * @param bin The value of the CCDXBIN and CCDYBIN keywords.
+ * @param exposure_length The value of the EXPTIME keyword.
+ * @param naxis1 The number of columns.
+ * @param naxis2 The number of rows.
+ * @param pixels The pixels, naxis1*naxis2 unsigned shorts.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ */
+static int Bench_Fits_Write(char *filename,char *obstype,int bin,double exposure_length,int naxis1,int naxis2,
+			    unsigned short *pixels)
+{
+	fitsfile *fits_fp = NULL;
+	char clobber_filename[DPRT_FITS_FILENAME_LENGTH+1];
+	char buff[32];
+	long naxes[2],first_pixel[2];
+	int status = 0;
+
+	sprintf(clobber_filename,"!%s",filename);
+	naxes[0] = naxis1;
+	naxes[1] = naxis2;
+	first_pixel[0] = 1;
+	first_pixel[1] = 1;
+	fits_create_file(&fits_fp,clobber_filename,&status);
+	fits_create_img(fits_fp,USHORT_IMG,2,naxes,&status);
+	fits_write_key(fits_fp,TSTRING,"OBSTYPE",obstype,"Observation type",&status);
+	fits_write_key(fits_fp,TINT,"CCDXBIN",&bin,"X binning factor",&status);
+	fits_write_key(fits_fp,TINT,"CCDYBIN",&bin,"Y binning factor",&status);
+	fits_write_key(fits_fp,TDOUBLE,"EXPTIME",&exposure_length,"Exposure length (s)",&status);
+	fits_write_pix(fits_fp,TUSHORT,first_pixel,((LONGLONG)naxis1)*naxis2,pixels,&status);
+	fits_close_file(fits_fp,&status);
+	if(status)
+	{
+		fits_get_errstatus(status,buff);
+		fprintf(stderr,"Bench_Fits_Write:Writing %s failed:%s.\n",filename,buff);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * The relative level of the flat field lamp's spectrum, a smooth curve peaking near the centre of the frame.
+ * @param ux The column, in unbinned pixels.
+ * @param columns The number of unbinned columns.
+ * @return The lamp level, between 0.3 and 1.
+ */
+static double Bench_Lamp_Level(double ux,double columns)
+{
+	return 0.3+(0.7*sin(M_PI*(ux+0.5)/columns));
+}
+
+/**
+ * The relative illumination of the slit. Rows within BENCH_SLIT_MARGIN of the ends of the slit are dark, and
+ * the illumination falls off slightly towards the ends of the illuminated part.
+ * @param uy The row, in unbinned pixels.
+ * @param rows The number of unbinned rows.
+ * @return The illumination, between 0 and 1.
+ * @see #BENCH_SLIT_MARGIN
+ */
+static double Bench_Slit_Illumination(double uy,double rows)
+{
+	double position;
+
+	position = uy/rows;
+	if((position < BENCH_SLIT_MARGIN)||(position > (1.0-BENCH_SLIT_MARGIN)))
+		return 0.0;
+	position = (position-0.5)/(0.5-BENCH_SLIT_MARGIN);
+	return 1.0-(0.1*position*position);
+}
+
+/**
+ * Get the column (in unbinned pixels) a wavelength falls on, by inverting the synthetic wavelength solution:
+ * wavelength = centre + dispersion*dx + curvature*dx*dx, where dx is the offset from the centre column.
+ * @param wavelength The wavelength, in Angstroms.
+ * @param columns The number of unbinned columns.
+ * @return The column.
+ * @see #BENCH_WAVELENGTH_CENTRE
+ * @see #BENCH_WAVELENGTH_DISPERSION
+ * @see #BENCH_WAVELENGTH_CURVATURE
+ */
+static double Bench_Line_Column(double wavelength,double columns)
+{
+	double dx;
+	int i;
+
+	dx = (wavelength-BENCH_WAVELENGTH_CENTRE)/BENCH_WAVELENGTH_DISPERSION;
+	for(i = 0; i < 4; i++)
+	{
+		dx -= (BENCH_WAVELENGTH_CENTRE+(BENCH_WAVELENGTH_DISPERSION*dx)+(BENCH_WAVELENGTH_CURVATURE*dx*dx)-
+		       wavelength)/(BENCH_WAVELENGTH_DISPERSION+(2.0*BENCH_WAVELENGTH_CURVATURE*dx));
+	}
+	return ((columns-1.0)/2.0)+dx;
+}
+
+/**
+ * Get a uniformly distributed random number, from a linear congruential generator seeded with Seed, so the
+ * same frames are generated on every platform.
+ * @return A random number greater than 0 and less than 1.
+ * @see #Random_State
+ */
+static double Bench_Random_Uniform(void)
+{
+	Random_State = ((Random_State*1664525UL)+1013904223UL)&0xffffffffUL;
+	return (Random_State+0.5)/4294967296.0;
+}
+
+/**
+ * Get a normally distributed random number, using the Box-Muller transform.
+ * @return A random number with a mean of 0 and a standard deviation of 1.
+ * @see #Bench_Random_Uniform
+ */
+static double Bench_Random_Gaussian(void)
+{
+	double u1,u2;
+
+	u1 = Bench_Random_Uniform();
+	u2 = Bench_Random_Uniform();
+	return sqrt(-2.0*log(u1))*cos(2.0*M_PI*u2);
+}
+
+/**
+ * Create a directory, if it does not already exist.
+ * @param directory_name The directory.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ */
+static int Bench_Directory_Make(char *directory_name)
+{
+	if((mkdir(directory_name,0755) != 0)&&(errno != EEXIST))
+	{
+		fprintf(stderr,"Bench_Directory_Make:Failed to create %s:%s.\n",directory_name,strerror(errno));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Call a stage's routine Iteration_Count times on a binning's frames, timing each call.
+ * @param binning The binning's frames.
+ * @param stage The stage to run.
+ * @param result The result structure to fill in. Its Time_List is allocated, and should be freed by the caller.
+ * @return The routine returns TRUE on success and FALSE if the result could not be allocated. Calls that fail
+ *         are counted in the result, and their errors printed.
+ * @see #Bench_Peak_Rss_Get
+ */
+static int Bench_Stage_Run(struct Bench_Binning_Struct *binning,struct Bench_Stage_Struct *stage,
+			   struct Bench_Result_Struct *result)
+{
+	struct timespec start_time,end_time;
+	int i;
+
+	result->Time_List = (double *)malloc(Iteration_Count*sizeof(double));
+	if(result->Time_List == NULL)
+	{
+		fprintf(stderr,"Bench_Stage_Run:Failed to allocate time list(%d).\n",Iteration_Count);
+		return FALSE;
+	}
+	result->Time_Count = 0;
+	result->Failed_Count = 0;
+	for(i = 0; i < Iteration_Count; i++)
+	{
+		clock_gettime(CLOCK_MONOTONIC,&start_time);
+		if(stage->Run(binning,i))
+		{
+			clock_gettime(CLOCK_MONOTONIC,&end_time);
+			result->Time_List[result->Time_Count] = (end_time.tv_sec-start_time.tv_sec)+
+				((end_time.tv_nsec-start_time.tv_nsec)/1.0e9);
+			result->Time_Count++;
+		}
+		else
+		{
+			Bench_Error_Print(stage->Name);
+			result->Failed_Count++;
+		}
+	}
+	result->Peak_Rss = Bench_Peak_Rss_Get();
+	return TRUE;
+}
+
+/**
+ * Make the master biases of a binning.
+ * @param binning The binning's frames.
+ * @param iteration The iteration number, not used.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ */
+static int Bench_Make_Master_Bias(struct Bench_Binning_Struct *binning,int iteration)
+{
+	return DpRt_Make_Master_Bias_Context(Context,binning->Calibration_Directory);
+}
+
+/**
+ * Make the master flats of a binning.
+ * @param binning The binning's frames.
+ * @param iteration The iteration number, not used.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ */
+static int Bench_Make_Master_Flat(struct Bench_Binning_Struct *binning,int iteration)
+{
+	return DpRt_Make_Master_Flat_Context(Context,binning->Calibration_Directory);
+}
+
+/**
+ * Reduce a binning's arc frame, which fits its wavelength solution.
+ * @param binning The binning's frames.
+ * @param iteration The iteration number, not used.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ */
+static int Bench_Calibrate_Reduce(struct Bench_Binning_Struct *binning,int iteration)
+{
+	char *output_filename = NULL;
+	double mean_counts,peak_counts;
+
+	Context->Config.Full_Reduction = TRUE;
+	if(!DpRt_Calibrate_Reduce_Context(Context,binning->Arc_Filename,&output_filename,&mean_counts,&peak_counts))
+		return FALSE;
+	free(output_filename);
+	return TRUE;
+}
+
+/**
+ * Fully reduce one of a binning's expose frames, chosen by the iteration number.
+ * @param binning The binning's frames.
+ * @param iteration The iteration number.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Bench_Expose_Reduce
+ */
+static int Bench_Expose_Reduce_Full(struct Bench_Binning_Struct *binning,int iteration)
+{
+	Context->Config.Full_Reduction = TRUE;
+	return Bench_Expose_Reduce(binning,iteration);
+}
+
+/**
+ * Quick reduce one of a binning's expose frames, chosen by the iteration number.
+ * @param binning The binning's frames.
+ * @param iteration The iteration number.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Bench_Expose_Reduce
+ */
+static int Bench_Expose_Reduce_Quick(struct Bench_Binning_Struct *binning,int iteration)
+{
+	Context->Config.Full_Reduction = FALSE;
+	return Bench_Expose_Reduce(binning,iteration);
+}
+
+/**
+ * Fully reduce a binning's first expose frame from memory.
+ * @param binning The binning's frames.
+ * @param iteration The iteration number, not used.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ */
+static int Bench_Expose_Reduce_Buffer(struct Bench_Binning_Struct *binning,int iteration)
+{
+	struct DpRt_Expose_Result_Struct result;
+
+	Context->Config.Full_Reduction = TRUE;
+	return DpRt_Expose_Reduce_Buffer_Context(Context,binning->Expose_Pixels,DPRT_KERNEL_PIXEL_FORMAT_NATIVE,
+						 binning->Naxis1,binning->Naxis2,binning->Bin,binning->Bin,&result);
+}
+
+/**
+ * Fully reduce all of a binning's expose frames as a batch.
+ * @param binning The binning's frames.
+ * @param iteration The iteration number, not used.
+ * @return The routine returns TRUE if every frame was reduced, and FALSE otherwise.
+ */
+static int Bench_Expose_Reduce_Batch(struct Bench_Binning_Struct *binning,int iteration)
+{
+	struct DpRt_Expose_Result_Struct result_list[BENCH_EXPOSE_FRAME_COUNT];
+	int i,retval;
+
+	Context->Config.Full_Reduction = TRUE;
+	retval = DpRt_Expose_Reduce_Batch_Context(Context,binning->Expose_Pointer_List,BENCH_EXPOSE_FRAME_COUNT,
+						  result_list);
+	if(!retval)
+		return FALSE;
+	for(i = 0; i < BENCH_EXPOSE_FRAME_COUNT; i++)
+	{
+		if(result_list[i].Successful)
+			free(result_list[i].Output_Filename);
+		else if(retval)
+		{
+			fprintf(stderr,"Bench_Expose_Reduce_Batch:%s failed:(%d) %s.\n",
+				binning->Expose_Filename_List[i],result_list[i].Error_Number,
+				result_list[i].Error_String);
+			retval = FALSE;
+		}
+	}
+	return retval;
+}
+
+/**
+ * Reduce one of a binning's expose frames, chosen by the iteration number, using the context's full reduction
+ * flag.
+ * @param binning The binning's frames.
+ * @param iteration The iteration number.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ */
+static int Bench_Expose_Reduce(struct Bench_Binning_Struct *binning,int iteration)
+{
+	char *output_filename = NULL;
+	double seeing,counts,x_pix,y_pix,photometricity,sky_brightness;
+	int saturated;
+
+	if(!DpRt_Expose_Reduce_Context(Context,binning->Expose_Filename_List[iteration%BENCH_EXPOSE_FRAME_COUNT],
+				       &output_filename,&seeing,&counts,&x_pix,&y_pix,&photometricity,
+				       &sky_brightness,&saturated))
+		return FALSE;
+	free(output_filename);
+	return TRUE;
+}
+
+/**
+ * Print the context's error.
+ * @param name The name of the routine that failed.
+ */
+static void Bench_Error_Print(char *name)
+{
+	fprintf(stderr,"%s failed:(%d) %s.\n",name,Context->Error.Number,Context->Error.String);
+}
+
+/**
+ * Print the results of every stage on every binning: the number of successful and failed calls, the 50th, 95th
+ * and 99th percentiles of the latency of a call, the throughput in frames and megapixels per second, and the
+ * peak resident set size of the process after the stage.
+ * @param binning_list The binnings.
+ * @param result_list The results of each stage on each binning.
+ * @see #Bench_Percentile
+ */
+static void Bench_Results_Print(struct Bench_Binning_Struct *binning_list,
+				struct Bench_Result_Struct result_list[][BENCH_STAGE_COUNT])
+{
+	struct Bench_Result_Struct *result = NULL;
+	double total_time,frame_rate,pixel_rate;
+	int i,j,k;
+
+	fprintf(stdout,"\ndprt_bench:%d iterations:%dx%d unbinned frames.\n",Iteration_Count,Naxis1,Naxis2);
+	fprintf(stdout,"%-22s %7s %5s %6s %9s %9s %9s %9s %9s %9s\n","Stage","Binning","Calls","Failed",
+		"p50(ms)","p95(ms)","p99(ms)","Frames/s","Mpixel/s","RSS(MB)");
+	for(i = 0; i < Bin_Count; i++)
+	{
+		for(j = 0; j < BENCH_STAGE_COUNT; j++)
+		{
+			result = &(result_list[i][j]);
+			qsort(result->Time_List,result->Time_Count,sizeof(double),Bench_Time_Compare);
+			total_time = 0.0;
+			for(k = 0; k < result->Time_Count; k++)
+				total_time += result->Time_List[k];
+			frame_rate = 0.0;
+			pixel_rate = 0.0;
+			if(total_time > 0.0)
+			{
+				frame_rate = ((double)result->Time_Count*Stage_List[j].Frame_Count)/total_time;
+				pixel_rate = frame_rate*binning_list[i].Naxis1*binning_list[i].Naxis2/1.0e6;
+			}
+			fprintf(stdout,"%-22s %5dx%d %5d %6d %9.2f %9.2f %9.2f %9.2f %9.2f %9.1f\n",Stage_List[j].Name,
+				binning_list[i].Bin,binning_list[i].Bin,result->Time_Count,result->Failed_Count,
+				Bench_Percentile(result->Time_List,result->Time_Count,50.0)*1000.0,
+				Bench_Percentile(result->Time_List,result->Time_Count,95.0)*1000.0,
+				Bench_Percentile(result->Time_List,result->Time_Count,99.0)*1000.0,
+				frame_rate,pixel_rate,result->Peak_Rss/1024.0);
+		}
+	}
+	fprintf(stdout,"dprt_bench:Peak RSS:%.1f MB.\n",Bench_Peak_Rss_Get()/1024.0);
+}
+
+/**
+ * qsort comparison routine, sorting times into ascending order.
+ * @param p1 A pointer to the first time (a double).
+ * @param p2 A pointer to the second time (a double).
+ * @return -1, 0 or 1 if the first time is less than, equal to or greater than the second.
+ */
+static int Bench_Time_Compare(const void *p1,const void *p2)
+{
+	double t1,t2;
+
+	t1 = *((const double *)p1);
+	t2 = *((const double *)p2);
+	if(t1 < t2)
+		return -1;
+	if(t1 > t2)
+		return 1;
+	return 0;
+}
+
+/**
+ * Get a percentile of a sorted list, using the nearest rank method.
+ * @param sorted_list The list, in ascending order.
+ * @param count The number of elements in the list.
+ * @param percent The percentile to get, between 0 and 100.
+ * @return The percentile, or 0 if the list is empty.
+ */
+static double Bench_Percentile(double *sorted_list,int count,double percent)
+{
+	int rank;
+
+	if(count < 1)
+		return 0.0;
+	rank = (int)ceil((percent/100.0)*count);
+	if(rank < 1)
+		rank = 1;
+	if(rank > count)
+		rank = count;
+	return sorted_list[rank-1];
+}
+
+/**
+ * Get the peak resident set size of the process so far.
+ * @return The peak resident set size, in kilobytes.
+ */
+static long Bench_Peak_Rss_Get(void)
+{
+	struct rusage usage;
+
+	if(getrusage(RUSAGE_SELF,&usage) != 0)
+		return 0;
+	return usage.ru_maxrss;
+}
+/*
+** $Log: not supported by cvs2svn $
+*/
@@ -5,7 +5,7 @@
  * dprt_test.c Tests libdprt_ftspec, the Data Pipeline Real Time
  * reduction library. Note you cannot check Aborting reductions with this software at the moment.
  * <pre>
- * dprt_test [-b][-c][-e][-f][-help] <filename>
+ * dprt_test [-b][-c][-e][-f][-l <log filename>][-help] <filename>
  * </pre>
  */
 #include <stdio.h>
@@ -13,6 +13,7 @@
 #include <strings.h>
 #include "dprt.h"
 #include "dprt_jni_general.h"
+#include "dprt_log.h"
 
 /* ------------------------------------------------------- */
 /* internal hash definitions */
@@ -55,6 +56,10 @@ static char Filename[256] = "";
  * The type of reduction to perform on the file.
  */
 static int Reduce_Type = REDUCE_TYPE_EXPOSE;
+/**
+ * Filename the library's log is written to, or an empty string for standard output.
+ */
+static char Log_Filename[256] = "";
 
 /* ------------------------------------------------------- */
 /* external functions */
@@ -89,6 +94,15 @@ int main(int argc, char *argv[])
 		fprintf(stderr,"dprt_test: No filename specified.\n");
 		return 1;
 	}
+/* set where the library logs to */
+	if(strcmp(Log_Filename,"")!=0)
+	{
+		if(!DpRt_Log_Filename_Set(Log_Filename))
+		{
+			fprintf(stderr,"dprt_test: Failed to open log file '%s'.\n",Log_Filename);
+			return 1;
+		}
+	}
 /* initialise the DpRt */
 	retval = DpRt_Initialise();
 	if(retval == FALSE)
@@ -205,6 +219,19 @@ static int Parse_Args(int argc,char *argv[])
 			Reduce_Type = REDUCE_TYPE_EXPOSE;
 		else if(strcmp(argv[i],"-f")==0)
 			Reduce_Type = REDUCE_TYPE_MAKE_MASTER_FLAT;
+		else if(strcmp(argv[i],"-l")==0)
+		{
+			if((i+1)<argc)
+			{
+				strcpy(Log_Filename,argv[i+1]);
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"dprt_test: -l requires a log filename.\n");
+				return FALSE;
+			}
+		}
 		else
 			strcpy(Filename,argv[i]);
 	}
@@ -223,11 +250,12 @@ static void Help(void)
 {
 	fprintf(stdout,"dprt_test Tests the reduction routines in libdprt_ftspec.\n");
 	fprintf(stdout,"dprt_test does NOT test the Java JNI interface or aborting reductions.\n");
-	fprintf(stdout,"dprt_test [-b] [-c] [-e] [-f] [-help] <filename>\n");
+	fprintf(stdout,"dprt_test [-b] [-c] [-e] [-f] [-l <log filename>] [-help] <filename>\n");
 	fprintf(stdout,"-b creates a master bias frame from biases in the directory specified in filename.\n");
 	fprintf(stdout,"-c reduces the filename as a calibration image.\n");
 	fprintf(stdout,"-e reduces the filename as a expose image.\n");
 	fprintf(stdout,"-f creates a master flat frame from fields in the directory specified in filename.\n");
+	fprintf(stdout,"-l appends the library's log to the specified file, rather than standard output.\n");
 	fprintf(stdout,"-help prints this help message and exits.\n");
 	fprintf(stdout,"You must always specify a filename to reduce.\n");
 }